@@ -224,6 +224,7 @@ static inline void clear_bits(int offset, int len, unsigned long *p)
 /*****************************************************************************/
 
 struct edma *edma_cc[EDMA_MAX_CC];
+EXPORT_SYMBOL(edma_cc);
 static int arch_num_cc;
 
 /* dummy param set used to (re)initialize parameter RAM slots */
@@ -1234,23 +1235,17 @@ int edma_start(unsigned channel)
 
 		/* EDMA channels without event association */
 		if (test_bit(channel, edma_cc[ctlr]->edma_unused)) {
-			pr_debug("EDMA: ESR%d %08x\n", j,
-				edma_shadow0_read_array(ctlr, SH_ESR, j));
 			edma_shadow0_write_array(ctlr, SH_ESR, j, mask);
 			return 0;
 		}
 
 		/* EDMA channel with event association */
-		pr_debug("EDMA: ER%d %08x\n", j,
-			edma_shadow0_read_array(ctlr, SH_ER, j));
 		/* Clear any pending event or error */
 		edma_write_array(ctlr, EDMA_ECR, j, mask);
 		edma_write_array(ctlr, EDMA_EMCR, j, mask);
 		/* Clear any SER */
 		edma_shadow0_write_array(ctlr, SH_SECR, j, mask);
 		edma_shadow0_write_array(ctlr, SH_EESR, j, mask);
-		pr_debug("EDMA: EER%d %08x\n", j,
-			edma_shadow0_read_array(ctlr, SH_EER, j));
 		return 0;
 	}
 
@@ -1258,6 +1253,32 @@ int edma_start(unsigned channel)
 }
 EXPORT_SYMBOL(edma_start);
 
+/**
+ * edma_trigger_channel - manually trigger a transfer on a channel
+ * @channel: channel returned from edma_alloc_channel()
+ *
+ * Sets the event bit through the shadow ESR without enabling the
+ * hardware event, so one (A or AB synchronized) transfer request is
+ * issued no matter whether a peripheral event is tied to the channel.
+ * Used for memory to memory copies.
+ */
+void edma_trigger_channel(unsigned channel)
+{
+	unsigned ctlr;
+	unsigned int mask;
+
+	ctlr = EDMA_CTLR(channel);
+	channel = EDMA_CHAN_SLOT(channel);
+
+	if (channel >= edma_cc[ctlr]->num_channels)
+		return;
+
+	mask = BIT(channel & 0x1f);
+	edma_write_array(ctlr, EDMA_EMCR, channel >> 5, mask);
+	edma_shadow0_write_array(ctlr, SH_ESR, channel >> 5, mask);
+}
+EXPORT_SYMBOL(edma_trigger_channel);
+
 /**
  * edma_stop - stops dma on the channel passed
  * @channel: channel being deactivated
@@ -1283,9 +1304,6 @@ void edma_stop(unsigned channel)
 		edma_shadow0_write_array(ctlr, SH_SECR, j, mask);
 		edma_write_array(ctlr, EDMA_EMCR, j, mask);
 
-		pr_debug("EDMA: EER%d %08x\n", j,
-				edma_shadow0_read_array(ctlr, SH_EER, j));
-
 		/* REVISIT:  consider guarding against inappropriate event
 		 * chaining by overwriting with dummy_paramset.
 		 */
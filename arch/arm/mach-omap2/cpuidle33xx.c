@@ -20,6 +20,11 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/io.h>
+#include <linux/clk.h>
+#include <linux/err.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/dma-mapping.h>
 #include <linux/platform_device.h>
 #include <linux/cpuidle.h>
 #include <linux/sched.h>
@@ -29,7 +34,11 @@
 
 #include "cpuidle33xx.h"
 
-#define AM33XX_CPUIDLE_MAX_STATES	2
+#define AM33XX_CPUIDLE_MAX_STATES	3
+
+/* boot time calibration of the DDR wake up cost */
+#define AM33XX_CALIB_LOOPS		16
+#define AM33XX_CALIB_SETTLE_US		20
 
 struct am33xx_ops {
 	void (*enter) (u32 flags);
@@ -37,8 +46,11 @@ struct am33xx_ops {
 	u32 flags;
 };
 
-/* fields in am33xx_ops.flags */
-#define AM33XX_CPUIDLE_FLAGS_DDR2_PWDN	BIT(0)
+/* fields in am33xx_ops.flags: the EMIF low power mode to use */
+#define AM33XX_CPUIDLE_FLAGS_DDR_PWDN	\
+		POWER_DOWN_ENABLE(EMIF_PM_TIM_64_CLKS)
+#define AM33XX_CPUIDLE_FLAGS_DDR_SR	\
+		SELF_REFRESH_ENABLE(EMIF_PM_TIM_64_CLKS)
 
 static struct cpuidle_driver am33xx_idle_driver = {
 	.name	= "cpuidle-am33xx",
@@ -47,36 +59,41 @@ static struct cpuidle_driver am33xx_idle_driver = {
 
 static DEFINE_PER_CPU(struct cpuidle_device, am33xx_cpuidle_device);
 static void __iomem *emif_base;
+static u32 emif_pmcr;
 
-static void am33xx_save_ddr_power(int enter, bool pdown)
+/*
+ * Enabling a low power mode only arms the EMIF: it enters power-down or
+ * self refresh once DDR has been idle for the programmed number of
+ * clocks and leaves it again on the next access, so DMA keeps working
+ * while the MPU sits in WFI.
+ */
+static void am33xx_save_ddr_power(u32 mode)
 {
-	u32 val;
-
-	val = __raw_readl(emif_base + EMIF4_0_SDRAM_MGMT_CTRL);
+	u32 val = emif_pmcr & ~(LP_MODE_MASK | SR_TIM_MASK | PD_TIM_MASK);
 
-	/* TODO: Choose the mode based on memory type */
-	if (enter)
-		val = SELF_REFRESH_ENABLE(64);
-	else
-		val = SELF_REFRESH_DISABLE;
-
-	__raw_writel(val, emif_base + EMIF4_0_SDRAM_MGMT_CTRL);
+	__raw_writel(val | mode, emif_base + EMIF4_0_SDRAM_MGMT_CTRL);
 }
 
-static void am33xx_c2state_enter(u32 flags)
+static void am33xx_ddr_state_enter(u32 flags)
 {
-	am33xx_save_ddr_power(1, !!(flags & AM33XX_CPUIDLE_FLAGS_DDR2_PWDN));
+	am33xx_save_ddr_power(flags);
 }
 
-static void am33xx_c2state_exit(u32 flags)
+static void am33xx_ddr_state_exit(u32 flags)
 {
-	am33xx_save_ddr_power(0, !!(flags & AM33XX_CPUIDLE_FLAGS_DDR2_PWDN));
+	am33xx_save_ddr_power(SELF_REFRESH_DISABLE);
 }
 
 static struct am33xx_ops am33xx_states[AM33XX_CPUIDLE_MAX_STATES] = {
 	[1] = {
-		.enter	= am33xx_c2state_enter,
-		.exit	= am33xx_c2state_exit,
+		.enter	= am33xx_ddr_state_enter,
+		.exit	= am33xx_ddr_state_exit,
+		.flags	= AM33XX_CPUIDLE_FLAGS_DDR_PWDN,
+	},
+	[2] = {
+		.enter	= am33xx_ddr_state_enter,
+		.exit	= am33xx_ddr_state_exit,
+		.flags	= AM33XX_CPUIDLE_FLAGS_DDR_SR,
 	},
 };
 
@@ -86,11 +103,10 @@ static int am33xx_enter_idle(struct cpuidle_device *dev,
 {
 	struct cpuidle_state_usage *state_usage = &dev->states_usage[index];
 	struct am33xx_ops *ops = cpuidle_get_statedata(state_usage);
-	struct timeval before, after;
-	int idle_time;
+	ktime_t before;
 
 	local_irq_disable();
-	do_gettimeofday(&before);
+	before = ktime_get();
 
 	if (ops && ops->enter)
 		ops->enter(ops->flags);
@@ -100,22 +116,82 @@ static int am33xx_enter_idle(struct cpuidle_device *dev,
 	if (ops && ops->exit)
 		ops->exit(ops->flags);
 
-	do_gettimeofday(&after);
+	dev->last_residency = ktime_to_us(ktime_sub(ktime_get(), before));
 	local_irq_enable();
-	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
-			(after.tv_usec - before.tv_usec);
-
-	dev->last_residency = idle_time;
 
 	return index;
 }
 
+/*
+ * Worst observed time for an uncached read that finds the EMIF in @mode,
+ * including arming and disarming the mode.  The settle delay runs from
+ * the I-cache, so DDR is idle long enough for the EMIF to get there.
+ */
+static s64 __init am33xx_ddr_wake_ns(u32 mode, volatile u32 *probe)
+{
+	unsigned long flags;
+	ktime_t start;
+	s64 ns, worst = 0;
+	int i;
+
+	for (i = 0; i < AM33XX_CALIB_LOOPS; i++) {
+		local_irq_save(flags);
+		am33xx_save_ddr_power(mode);
+		udelay(AM33XX_CALIB_SETTLE_US);
+		start = ktime_get();
+		(void)*probe;
+		am33xx_save_ddr_power(SELF_REFRESH_DISABLE);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		local_irq_restore(flags);
+
+		worst = max(worst, ns);
+	}
+
+	return worst;
+}
+
+/*
+ * Exit latency is the measured wake up penalty on top of plain WFI.  No
+ * power figures are available at run time, so a state is only worth
+ * entering for a few times its wake up cost plus the EMIF idle timer
+ * that has to expire before DDR actually changes mode.
+ */
+static void __init am33xx_calibrate_state(struct cpuidle_state *states,
+		int index, u32 mode, s64 base_ns, unsigned int timer_us,
+		volatile u32 *probe)
+{
+	struct cpuidle_state *state = &states[index];
+	struct cpuidle_state *prev = &states[index - 1];
+	s64 ns = am33xx_ddr_wake_ns(mode, probe) - base_ns;
+	unsigned int lat;
+
+	lat = states[0].exit_latency + DIV_ROUND_UP((u32)max_t(s64, ns, 0),
+			NSEC_PER_USEC);
+
+	/* deeper states must never look cheaper to the governor */
+	state->exit_latency = max(lat, prev->exit_latency + 1);
+	state->target_residency = max(3 * state->exit_latency + timer_us,
+			prev->target_residency + 1);
+
+	pr_info("cpuidle-am33xx: %s: exit latency %u us, residency %u us\n",
+			state->name, state->exit_latency,
+			state->target_residency);
+}
+
 static int __init am33xx_cpuidle_probe(struct platform_device *pdev)
 {
-	int ret;
+	int ret, i, count;
 	struct cpuidle_device *device;
 	struct cpuidle_driver *driver = &am33xx_idle_driver;
 	struct am33xx_cpuidle_config *pdata = pdev->dev.platform_data;
+	struct cpuidle_state *state;
+	unsigned int timer_us = 1;
+	volatile u32 *probe;
+	dma_addr_t probe_dma;
+	struct clk *ddr_clk;
+	bool pdown;
+	u32 type;
+	s64 base_ns;
 
 	device = &per_cpu(am33xx_cpuidle_device, smp_processor_id());
 
@@ -125,28 +201,81 @@ static int __init am33xx_cpuidle_probe(struct platform_device *pdev)
 	}
 
 	emif_base = pdata->emif_base;
+	emif_pmcr = __raw_readl(emif_base + EMIF4_0_SDRAM_MGMT_CTRL);
+
+	/* DDR2 power-down is a board option, the other types support it */
+	type = (__raw_readl(emif_base + EMIF4_0_SDRAM_CONFIG) &
+			SDRAM_TYPE_MASK) >> SDRAM_TYPE_SHIFT;
+	pdown = type != SDRAM_TYPE_DDR2 || pdata->ddr2_pdown;
+
+	/* the EMIF idle timer counts 64 DDR clocks before changing mode */
+	ddr_clk = clk_get(NULL, "dpll_ddr_m2_ck");
+	if (!IS_ERR(ddr_clk)) {
+		unsigned long mhz = clk_get_rate(ddr_clk) / 1000000;
+
+		if (mhz)
+			timer_us = DIV_ROUND_UP(64, mhz);
+		clk_put(ddr_clk);
+	}
 
 	/* Wait for interrupt state */
-	driver->states[0].enter = am33xx_enter_idle;
-	driver->states[0].exit_latency = 1;
-	driver->states[0].target_residency = 10000;
-	driver->states[0].flags = CPUIDLE_FLAG_TIME_VALID;
-	strcpy(driver->states[0].name, "WFI");
-	strcpy(driver->states[0].desc, "Wait for interrupt");
+	state = &driver->states[0];
+	state->enter = am33xx_enter_idle;
+	state->exit_latency = 1;
+	state->target_residency = 1;
+	state->flags = CPUIDLE_FLAG_TIME_VALID;
+	strcpy(state->name, "WFI");
+	strcpy(state->desc, "Wait for interrupt");
+	count = 1;
+
+	if (pdown) {
+		/* Wait for interrupt and DDR power-down state */
+		state = &driver->states[count];
+		state->enter = am33xx_enter_idle;
+		state->flags = CPUIDLE_FLAG_TIME_VALID;
+		strcpy(state->name, "DDR PD");
+		strcpy(state->desc, "WFI and DDR Power Down");
+		cpuidle_set_statedata(&device->states_usage[count],
+				&am33xx_states[1]);
+		count++;
+	}
 
 	/* Wait for interrupt and DDR self refresh state */
-	driver->states[1].enter = am33xx_enter_idle;
-	driver->states[1].exit_latency = 100;
-	driver->states[1].target_residency = 10000;
-	driver->states[1].flags = CPUIDLE_FLAG_TIME_VALID;
-	strcpy(driver->states[1].name, "DDR SR");
-	strcpy(driver->states[1].desc, "WFI and DDR Self Refresh");
-	if (pdata->ddr2_pdown)
-		am33xx_states[1].flags |= AM33XX_CPUIDLE_FLAGS_DDR2_PWDN;
-	cpuidle_set_statedata(&device->states_usage[1], &am33xx_states[1]);
-
-	device->state_count = AM33XX_CPUIDLE_MAX_STATES;
-	driver->state_count = AM33XX_CPUIDLE_MAX_STATES;
+	state = &driver->states[count];
+	state->enter = am33xx_enter_idle;
+	state->flags = CPUIDLE_FLAG_TIME_VALID;
+	strcpy(state->name, "DDR SR");
+	strcpy(state->desc, "WFI and DDR Self Refresh");
+	cpuidle_set_statedata(&device->states_usage[count], &am33xx_states[2]);
+	count++;
+
+	/*
+	 * Replace guessed latencies with measured ones, so the governor
+	 * can weigh them against PM QoS requests from drivers.
+	 */
+	probe = dma_alloc_coherent(&pdev->dev, sizeof(*probe), &probe_dma,
+			GFP_KERNEL);
+	if (probe) {
+		base_ns = am33xx_ddr_wake_ns(SELF_REFRESH_DISABLE, probe);
+		for (i = 1; i < count; i++) {
+			struct am33xx_ops *ops = cpuidle_get_statedata(
+					&device->states_usage[i]);
+
+			am33xx_calibrate_state(driver->states, i, ops->flags,
+					base_ns, timer_us, probe);
+		}
+		dma_free_coherent(&pdev->dev, sizeof(*probe), (void *)probe,
+				probe_dma);
+	} else {
+		dev_warn(&pdev->dev, "no calibration buffer, using defaults\n");
+		for (i = 1; i < count; i++) {
+			driver->states[i].exit_latency = 100 * i;
+			driver->states[i].target_residency = 10000;
+		}
+	}
+
+	device->state_count = count;
+	driver->state_count = count;
 
 	ret = cpuidle_register_driver(&am33xx_idle_driver);
 	if (ret) {
@@ -25,7 +25,7 @@
 #include <linux/can/platform/d_can.h>
 #include <linux/platform_data/uio_pruss.h>
 #include <linux/pwm/pwm.h>
-#include <linux/input/ti_tscadc.h>
+#include <linux/mfd/ti_tscadc.h>
 
 #include <mach/hardware.h>
 #include <mach/irqs.h>
@@ -174,13 +174,13 @@ int __init am33xx_register_lcdc(struct da8xx_lcdc_platform_data *pdata)
 	return 0;
 }
 
-int __init am33xx_register_tsc(struct tsc_data *pdata)
+int __init am33xx_register_mfd_tscadc(struct mfd_tscadc_board *pdata)
 {
         int id = -1;
         struct platform_device *pdev;
         struct omap_hwmod *oh;
         char *oh_name = "adc_tsc";
-        char *dev_name = "tsc";
+        char *dev_name = "ti_tscadc";
 
         oh = omap_hwmod_lookup(oh_name);
         if (!oh) {
@@ -189,7 +189,7 @@ int __init am33xx_register_tsc(struct tsc_data *pdata)
         }
 
         pdev = omap_device_build(dev_name, id, oh, pdata,
-                        sizeof(struct tsc_data), NULL, 0, 0);
+                        sizeof(struct mfd_tscadc_board), NULL, 0, 0);
 
         WARN(IS_ERR(pdev), "Can't build omap_device for %s:%s.\n",
                         dev_name, oh->name);
@@ -1221,6 +1221,7 @@ static struct cpsw_platform_data am33xx_cpsw_pdata = {
 	.ale_entries		= 1024,
 	.host_port_reg_ofs      = 0x108,
 	.hw_stats_reg_ofs       = 0x900,
+	.cpts_reg_ofs		= 0xc00,
 	.bd_ram_ofs		= 0x2000,
 	.bd_ram_size		= SZ_8K,
 	.rx_descs               = 64,
@@ -977,6 +977,42 @@ int gpmc_enable_hwecc(int ecc_type, int cs, int mode,
 }
 EXPORT_SYMBOL(gpmc_enable_hwecc);
 
+/*
+ * gpmc_read_bch_result - read the BCH result of one sector
+ *
+ * Result set of sector i sits at 0x240 + 0x10 * i, 0x240-0x24C holds the
+ * first sector, 0x250-0x25C the second one and so on.
+ */
+static void gpmc_read_bch_result(int ecc_type, int sector,
+		u_char *ecc_code)
+{
+	unsigned int reg;
+	unsigned int val1 = 0x0, val2 = 0x0;
+	unsigned int val3 = 0x0, val4 = 0x0;
+
+	reg =  GPMC_ECC_BCH_RESULT_0 + (0x10 * sector);
+	val1 = gpmc_read_reg(reg);
+	val2 = gpmc_read_reg(reg + 4);
+	if (ecc_type == OMAP_ECC_BCH8_CODE_HW) {
+		val3 = gpmc_read_reg(reg + 8);
+		val4 = gpmc_read_reg(reg + 12);
+
+		*ecc_code++ = (val4 & 0xFF);
+		*ecc_code++ = ((val3 >> 24) & 0xFF);
+		*ecc_code++ = ((val3 >> 16) & 0xFF);
+		*ecc_code++ = ((val3 >> 8) & 0xFF);
+		*ecc_code++ = (val3 & 0xFF);
+		*ecc_code++ = ((val2 >> 24) & 0xFF);
+	}
+	*ecc_code++ = ((val2 >> 16) & 0xFF);
+	*ecc_code++ = ((val2 >> 8) & 0xFF);
+	*ecc_code++ = (val2 & 0xFF);
+	*ecc_code++ = ((val1 >> 24) & 0xFF);
+	*ecc_code++ = ((val1 >> 16) & 0xFF);
+	*ecc_code++ = ((val1 >> 8) & 0xFF);
+	*ecc_code++ = (val1 & 0xFF);
+}
+
 /**
  * gpmc_calculate_ecc - generate non-inverted ecc bytes
  * @ecc_type: ecc type e.g. Hamming, BCH
@@ -993,40 +1029,11 @@ EXPORT_SYMBOL(gpmc_enable_hwecc);
 int gpmc_calculate_ecc(int ecc_type, int cs,
 		const u_char *dat, u_char *ecc_code)
 {
-	unsigned int reg;
-	unsigned int val1 = 0x0, val2 = 0x0;
-	unsigned int val3 = 0x0, val4 = 0x0;
-	int i;
+	unsigned int val1 = 0x0;
 
 	if ((ecc_type == OMAP_ECC_BCH4_CODE_HW) ||
 		(ecc_type == OMAP_ECC_BCH8_CODE_HW)) {
-		for (i = 0; i < 1; i++) {
-			/*
-			 * Reading HW ECC_BCH_Results
-			 * 0x240-0x24C, 0x250-0x25C, 0x260-0x26C, 0x270-0x27C
-			 */
-			reg =  GPMC_ECC_BCH_RESULT_0 + (0x10 * i);
-			val1 = gpmc_read_reg(reg);
-			val2 = gpmc_read_reg(reg + 4);
-			if (ecc_type == OMAP_ECC_BCH8_CODE_HW) {
-				val3 = gpmc_read_reg(reg + 8);
-				val4 = gpmc_read_reg(reg + 12);
-
-				*ecc_code++ = (val4 & 0xFF);
-				*ecc_code++ = ((val3 >> 24) & 0xFF);
-				*ecc_code++ = ((val3 >> 16) & 0xFF);
-				*ecc_code++ = ((val3 >> 8) & 0xFF);
-				*ecc_code++ = (val3 & 0xFF);
-				*ecc_code++ = ((val2 >> 24) & 0xFF);
-			}
-			*ecc_code++ = ((val2 >> 16) & 0xFF);
-			*ecc_code++ = ((val2 >> 8) & 0xFF);
-			*ecc_code++ = (val2 & 0xFF);
-			*ecc_code++ = ((val1 >> 24) & 0xFF);
-			*ecc_code++ = ((val1 >> 16) & 0xFF);
-			*ecc_code++ = ((val1 >> 8) & 0xFF);
-			*ecc_code++ = (val1 & 0xFF);
-		}
+		gpmc_read_bch_result(ecc_type, 0, ecc_code);
 	} else {
 		/* read ecc result */
 		val1 = gpmc_read_reg(GPMC_ECC1_RESULT);
@@ -1038,3 +1045,68 @@ int gpmc_calculate_ecc(int ecc_type, int cs,
 	return 0;
 }
 EXPORT_SYMBOL(gpmc_calculate_ecc);
+
+/**
+ * gpmc_enable_hwecc_bch_page - enable BCH ecc over several sectors
+ * @ecc_type: ecc type, BCH4 or BCH8
+ * @cs: chip select number
+ * @dev_width: device bus width(1 for x16, 0 for x8)
+ * @nsectors: number of 512 byte sectors, 1 to 8
+ *
+ * The engine is set up as for a write, so it generates the ECC of the
+ * data of every sector while the whole page is streamed in one go; the
+ * spare area following the data is not processed. The result of each
+ * sector is fetched with gpmc_calculate_ecc_bch_page().
+ */
+int gpmc_enable_hwecc_bch_page(int ecc_type, int cs, int dev_width,
+		int nsectors)
+{
+	unsigned int bch_mod, bch_wrapmode, eccsize1, eccsize0;
+
+	if (nsectors < 1 || nsectors > 8)
+		return -EINVAL;
+
+	if (ecc_type == OMAP_ECC_BCH4_CODE_HW) {
+		eccsize1 = 0x10; eccsize0 = 0x00;
+		bch_mod = 0;
+		bch_wrapmode = 0x06;
+	} else if (ecc_type == OMAP_ECC_BCH8_CODE_HW) {
+		eccsize1 = 0x1c; eccsize0 = 0x00;
+		bch_mod = 1;
+		bch_wrapmode = 0x01;
+	} else
+		return -EINVAL;
+
+	gpmc_write_reg(GPMC_ECC_CONTROL, 0x00000001);
+	gpmc_write_reg(GPMC_ECC_SIZE_CONFIG,
+			(eccsize1 << 22) | (eccsize0 << 12));
+	gpmc_write_reg(GPMC_ECC_CONFIG, (0x01 << 16) | (bch_mod << 12)
+			| (bch_wrapmode << 8) | (dev_width << 7)
+			| ((nsectors - 1) << 4) | (cs << 1) | (0x1));
+	gpmc_write_reg(GPMC_ECC_CONTROL, 0x00000101);
+	return 0;
+}
+EXPORT_SYMBOL(gpmc_enable_hwecc_bch_page);
+
+/**
+ * gpmc_calculate_ecc_bch_page - read BCH ecc bytes of several sectors
+ * @ecc_type: ecc type, BCH4 or BCH8
+ * @nsectors: number of sectors set up in gpmc_enable_hwecc_bch_page()
+ * @ecc_code: ecc code buffer
+ * @stride: distance in bytes between the ecc codes of two sectors
+ */
+int gpmc_calculate_ecc_bch_page(int ecc_type, int nsectors,
+		u_char *ecc_code, int stride)
+{
+	int i;
+
+	if ((ecc_type != OMAP_ECC_BCH4_CODE_HW) &&
+		(ecc_type != OMAP_ECC_BCH8_CODE_HW))
+		return -EINVAL;
+
+	for (i = 0; i < nsectors; i++)
+		gpmc_read_bch_result(ecc_type, i, ecc_code + i * stride);
+
+	return 0;
+}
+EXPORT_SYMBOL(gpmc_calculate_ecc_bch_page);
@@ -219,6 +219,7 @@ void edma_read_slot(unsigned slot, struct edmacc_param *params);
 
 /* channel control operations */
 int edma_start(unsigned channel);
+void edma_trigger_channel(unsigned channel);
 void edma_stop(unsigned channel);
 void edma_clean_channel(unsigned channel);
 void edma_clear_event(unsigned channel);
@@ -1422,8 +1422,8 @@ static struct omap_hwmod_irq_info i2c1_mpu_irqs[] = {
 };
 
 static struct omap_hwmod_dma_info i2c1_edma_reqs[] = {
-	{ .name = "tx", .dma_req = 0, },
-	{ .name = "rx", .dma_req = 0, },
+	{ .name = "tx", .dma_req = AM33XX_DMA_MSHSI2COCP0_TX, },
+	{ .name = "rx", .dma_req = AM33XX_DMA_MSHSI2COCP0_RX, },
 	{ .dma_req = -1 }
 };
 
@@ -1473,8 +1473,8 @@ static struct omap_hwmod_irq_info i2c2_mpu_irqs[] = {
 };
 
 static struct omap_hwmod_dma_info i2c2_edma_reqs[] = {
-	{ .name = "tx", .dma_req = 0, },
-	{ .name = "rx", .dma_req = 0, },
+	{ .name = "tx", .dma_req = AM33XX_DMA_MSHSI2COCP1_TX, },
+	{ .name = "rx", .dma_req = AM33XX_DMA_MSHSI2COCP1_RX, },
 	{ .dma_req = -1 }
 };
 
@@ -1522,6 +1522,7 @@ static struct omap_hwmod_ocp_if *am33xx_i2c3_slaves[] = {
 	&am335_l4_per_i2c3,
 };
 
+/* I2C2 events only reach the EDMA through the crossbar, PIO only */
 static struct omap_hwmod_dma_info i2c3_edma_reqs[] = {
 	{ .name = "tx", .dma_req = 0, },
 	{ .name = "rx", .dma_req = 0, },
@@ -25,6 +25,9 @@
 #include <linux/suspend.h>
 #include <linux/completion.h>
 #include <linux/pm_runtime.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <mach/board-am335xevm.h>
 #include <plat/prcm.h>
@@ -70,8 +73,52 @@ static int m3_state = M3_STATE_UNKNOWN;
 static int am33xx_ipc_cmd(struct a8_wkup_m3_ipc_data *);
 static int am33xx_verify_lp_state(int);
 static void am33xx_m3_state_machine_reset(void);
+static void am33xx_m3_stage_lp_cmd(void);
 
 static DECLARE_COMPLETION(a8_m3_sync);
+static bool m3_reset_pending;
+
+/*
+ * Timestamps of one suspend/resume cycle.  Timekeeping is stopped
+ * between syscore suspend and resume, so the resume side starts at
+ * the ->wake callback, the first point at which ktime_get() is valid.
+ */
+enum am33xx_pm_phase {
+	PM_PHASE_M3_SYNC,	/* ->begin: LP handshake with the WKUP_M3 */
+	PM_PHASE_DEV_SUSPEND,	/* ->begin to ->prepare */
+	PM_PHASE_PAD_SAVE,	/* ->prepare */
+	PM_PHASE_NOIRQ_RESUME,	/* ->wake to ->finish */
+	PM_PHASE_PAD_RESTORE,	/* ->finish */
+	PM_PHASE_DEV_RESUME,	/* ->finish to ->end */
+	PM_PHASE_M3_RESET,	/* ->end: M3 state machine reset */
+	PM_PHASE_MAX,
+};
+
+static struct am33xx_pm_latency {
+	u32 cycles;
+	u32 last_us[PM_PHASE_MAX];
+	u32 max_us[PM_PHASE_MAX];
+	u32 last_resume_us;
+	u32 max_resume_us;
+} am33xx_pm_lat;
+
+static ktime_t pm_phase_start;
+
+static void am33xx_pm_phase_begin(void)
+{
+	pm_phase_start = ktime_get();
+}
+
+/* Close @phase and start timing the next one */
+static void am33xx_pm_phase_end(enum am33xx_pm_phase phase)
+{
+	ktime_t now = ktime_get();
+	u32 us = ktime_to_us(ktime_sub(now, pm_phase_start));
+
+	am33xx_pm_lat.last_us[phase] = us;
+	am33xx_pm_lat.max_us[phase] = max(am33xx_pm_lat.max_us[phase], us);
+	pm_phase_start = now;
+}
 
 static void save_padconf(void)
 {
@@ -95,14 +142,23 @@ static int am33xx_pm_prepare_late(void)
 {
 	int ret = 0;
 
+	am33xx_pm_phase_end(PM_PHASE_DEV_SUSPEND);
 	save_padconf();
+	am33xx_pm_phase_end(PM_PHASE_PAD_SAVE);
 
 	return ret;
 }
 
+static void am33xx_pm_wake(void)
+{
+	am33xx_pm_phase_begin();
+}
+
 static void am33xx_pm_finish(void)
 {
+	am33xx_pm_phase_end(PM_PHASE_NOIRQ_RESUME);
 	restore_padconf();
+	am33xx_pm_phase_end(PM_PHASE_PAD_RESTORE);
 }
 
 static int am33xx_do_sram_idle(long unsigned int state)
@@ -149,7 +205,7 @@ static int am33xx_pm_suspend(void)
 		if (state != PWRDM_POWER_OFF)
 			pr_err("GFX domain did not transition to low power state\n");
 		else
-			pr_info("GFX domain entered low power state\n");
+			pr_debug("GFX domain entered low power state\n");
 	}
 
 	/* XXX: Why do we need to wakeup the clockdomains? */
@@ -185,20 +241,24 @@ static int am33xx_pm_begin(suspend_state_t state)
 
 	disable_hlt();
 
+	am33xx_pm_phase_begin();
+
 	/*
-	 * Populate the resume address as part of IPC data
-	 * The offset to be added comes from sleep33xx.S
-	 * Add 4 bytes to ensure that resume happens from
-	 * the word *after* the word which holds the resume offset
+	 * The reset of the previous cycle is normally acked long before
+	 * the next suspend, in which case this does not sleep.
 	 */
-	am33xx_lp_ipc.resume_addr = (DS_RESUME_BASE + am33xx_resume_offset + 4);
-	am33xx_lp_ipc.sleep_mode  = DS_MODE;
-	am33xx_lp_ipc.ipc_data1	  = DS_IPC_DEFAULT;
-	am33xx_lp_ipc.ipc_data2   = DS_IPC_DEFAULT;
+	if (m3_reset_pending) {
+		m3_reset_pending = false;
+		if (!wait_for_completion_timeout(&a8_m3_sync,
+						msecs_to_jiffies(5000)))
+			pr_err("A8<->CM3 sync failure\n");
+	}
 
-	am33xx_ipc_cmd(&am33xx_lp_ipc);
+	/* Normally pre-staged by the reset ack, but cheap to redo */
+	am33xx_m3_stage_lp_cmd();
 
 	m3_state = M3_STATE_MSG_FOR_LP;
+	INIT_COMPLETION(a8_m3_sync);
 
 	omap_mbox_enable_irq(m3_mbox, IRQ_RX);
 
@@ -219,13 +279,34 @@ static int am33xx_pm_begin(suspend_state_t state)
 		omap_mbox_disable_irq(m3_mbox, IRQ_RX);
 	}
 
+	am33xx_pm_phase_end(PM_PHASE_M3_SYNC);
+
 	suspend_state = state;
 	return ret;
 }
 
-static void am33xx_m3_state_machine_reset(void)
+/*
+ * Write the IPC data for the next deep sleep entry, so that ->begin
+ * only has to ring the mailbox.
+ *
+ * The resume address comes from sleep33xx.S; add 4 bytes to ensure
+ * that resume happens from the word *after* the word which holds the
+ * resume offset.
+ */
+static void am33xx_m3_stage_lp_cmd(void)
 {
-	int ret = 0;
+	am33xx_lp_ipc.resume_addr = (DS_RESUME_BASE + am33xx_resume_offset + 4);
+	am33xx_lp_ipc.sleep_mode  = DS_MODE;
+	am33xx_lp_ipc.ipc_data1	  = DS_IPC_DEFAULT;
+	am33xx_lp_ipc.ipc_data2   = DS_IPC_DEFAULT;
+
+	am33xx_ipc_cmd(&am33xx_lp_ipc);
+}
+
+/* Returns 0 once the reset message is posted; the ack is asynchronous */
+static int am33xx_m3_reset_send(void)
+{
+	int ret;
 
 	am33xx_lp_ipc.resume_addr = 0x0;
 	am33xx_lp_ipc.sleep_mode  = 0xe;
@@ -235,25 +316,52 @@ static void am33xx_m3_state_machine_reset(void)
 	am33xx_ipc_cmd(&am33xx_lp_ipc);
 
 	m3_state = M3_STATE_MSG_FOR_RESET;
+	INIT_COMPLETION(a8_m3_sync);
 
 	ret = omap_mbox_msg_send(m3_mbox, 0xABCDABCD);
 	if (!ret) {
 		pr_debug("Message sent for resetting M3 state machine\n");
-		if (!wait_for_completion_timeout(&a8_m3_sync, msecs_to_jiffies(5000)))
-			pr_err("A8<->CM3 sync failure\n");
 	} else {
 		pr_err("Could not reset M3 state machine!!!\n");
 		m3_state = M3_STATE_UNKNOWN;
 	}
+
+	return ret;
+}
+
+static void am33xx_m3_state_machine_reset(void)
+{
+	if (!am33xx_m3_reset_send() &&
+	    !wait_for_completion_timeout(&a8_m3_sync, msecs_to_jiffies(5000)))
+		pr_err("A8<->CM3 sync failure\n");
 }
 
 static void am33xx_pm_end(void)
 {
+	u32 us = 0;
+	int i;
+
+	am33xx_pm_phase_end(PM_PHASE_DEV_RESUME);
+
 	suspend_state = PM_SUSPEND_ON;
 
 	omap_mbox_enable_irq(m3_mbox, IRQ_RX);
 
-	am33xx_m3_state_machine_reset();
+	/*
+	 * Nothing on the way back to user space depends on the M3, so
+	 * only post the reset here; the ack is collected by the next
+	 * ->begin, by which time it has long arrived.
+	 */
+	if (!am33xx_m3_reset_send())
+		m3_reset_pending = true;
+
+	am33xx_pm_phase_end(PM_PHASE_M3_RESET);
+
+	for (i = PM_PHASE_NOIRQ_RESUME; i < PM_PHASE_MAX; i++)
+		us += am33xx_pm_lat.last_us[i];
+	am33xx_pm_lat.last_resume_us = us;
+	am33xx_pm_lat.max_resume_us = max(am33xx_pm_lat.max_resume_us, us);
+	am33xx_pm_lat.cycles++;
 
 	enable_hlt();
 
@@ -266,6 +374,7 @@ static const struct platform_suspend_ops am33xx_pm_ops = {
 	.enter		= am33xx_pm_enter,
 	.valid		= suspend_valid_only_mem,
 	.prepare	= am33xx_pm_prepare_late,
+	.wake		= am33xx_pm_wake,
 	.finish		= am33xx_pm_finish,
 };
 
@@ -294,7 +403,7 @@ static int am33xx_verify_lp_state(int core_suspend_stat)
 	status &= 0xffff0000;
 
 	if (status == 0x0) {
-		pr_info("Successfully transitioned all domains to low power state\n");
+		pr_debug("Successfully transitioned all domains to low power state\n");
 		if (am33xx_lp_ipc.sleep_mode == DS0_ID)
 			per_pwrdm->ret_logic_off_counter++;
 		goto clear_old_status;
@@ -343,6 +452,8 @@ static irqreturn_t wkup_m3_txev_handler(int irq, void *unused)
 		omap_mbox_msg_rx_flush(m3_mbox);
 		if (m3_mbox->ops->ack_irq)
 			m3_mbox->ops->ack_irq(m3_mbox, IRQ_RX);
+		/* M3 is idle again: stage the next LP command right away */
+		am33xx_m3_stage_lp_cmd();
 		complete(&a8_m3_sync);
 	} else if (m3_state == M3_STATE_MSG_FOR_LP) {
 		omap_mbox_msg_rx_flush(m3_mbox);
@@ -465,6 +576,78 @@ exit:
 	return ret;
 }
 
+/*
+ * IP blocks whose drivers only touch their own registers on resume and
+ * can therefore resume in parallel with everything else.  Blocks whose
+ * drivers reach other devices outside the device tree ordering (MMC via
+ * PMIC regulators, CPSW via MDIO, LCDC via the PWM backlight) stay
+ * synchronous.
+ */
+static const char *am33xx_async_classes[] __initdata = {
+	"uart", "mcspi", "d_can", "usbotg", "mcasp", "adc_tsc", "elm",
+	"aes", "sha0",
+};
+
+static int __init am33xx_pm_set_async(struct device *dev, void *unused)
+{
+	struct omap_device *od = to_omap_device(to_platform_device(dev));
+	const char *name;
+	int i;
+
+	if (!od || !od->hwmods_cnt)
+		return 0;
+
+	name = od->hwmods[0]->class->name;
+	for (i = 0; i < ARRAY_SIZE(am33xx_async_classes); i++) {
+		if (!strcmp(name, am33xx_async_classes[i])) {
+			device_enable_async_suspend(dev);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static const char *am33xx_pm_phase_names[PM_PHASE_MAX] = {
+	[PM_PHASE_M3_SYNC]	= "m3_sync",
+	[PM_PHASE_DEV_SUSPEND]	= "dev_suspend",
+	[PM_PHASE_PAD_SAVE]	= "pad_save",
+	[PM_PHASE_NOIRQ_RESUME]	= "noirq_resume",
+	[PM_PHASE_PAD_RESTORE]	= "pad_restore",
+	[PM_PHASE_DEV_RESUME]	= "dev_resume",
+	[PM_PHASE_M3_RESET]	= "m3_reset",
+};
+
+static int am33xx_pm_latency_show(struct seq_file *s, void *unused)
+{
+	struct am33xx_pm_latency *lat = &am33xx_pm_lat;
+	int i;
+
+	seq_printf(s, "cycles: %u\n", lat->cycles);
+	seq_printf(s, "%-14s %10s %10s\n", "phase", "last(us)", "max(us)");
+	for (i = 0; i < PM_PHASE_MAX; i++)
+		seq_printf(s, "%-14s %10u %10u\n", am33xx_pm_phase_names[i],
+				lat->last_us[i], lat->max_us[i]);
+	seq_printf(s, "%-14s %10u %10u\n", "resume",
+			lat->last_resume_us, lat->max_resume_us);
+
+	return 0;
+}
+
+static int am33xx_pm_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, am33xx_pm_latency_show, NULL);
+}
+
+static const struct file_operations am33xx_pm_latency_fops = {
+	.open		= am33xx_pm_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif /* CONFIG_DEBUG_FS */
+
 /*
  * Initiate sleep transition for other clockdomains, if
  * they are not used
@@ -565,8 +748,15 @@ static int __init am33xx_pm_init(void)
 		enable_deep_sleep = false;
 	}
 
-	if (enable_deep_sleep)
+	if (enable_deep_sleep) {
 		suspend_set_ops(&am33xx_pm_ops);
+		bus_for_each_dev(&platform_bus_type, NULL, NULL,
+				am33xx_pm_set_async);
+#ifdef CONFIG_DEBUG_FS
+		(void) debugfs_create_file("am33xx_pm_latency", S_IRUGO, NULL,
+				NULL, &am33xx_pm_latency_fops);
+#endif
+	}
 #endif /* CONFIG_SUSPEND */
 
 	return ret;
@@ -27,7 +27,20 @@ enum omap_bch_ecc {
 #define BCH_MAX_ECC_BYTES_PER_SECTOR	(28)
 #define BCH8_ECC_MAX	((BCH8_ECC_BYTES + BCH8_ECC_OOB_BYTES) * 8)
 
+/* ELM has one syndrome polynomial per sector of a 4K page */
+#define ELM_MAX_SECTORS			8
+#define ELM_MAX_ERRORS			16
+
+struct elm_errorvec {
+	bool error_reported;		/* in: sector has a non-zero syndrome */
+	bool error_uncorrectable;
+	int error_count;
+	unsigned int error_loc[ELM_MAX_ERRORS];
+};
+
 int omap_elm_decode_bch_error(int bch_type, char *ecc_calc,
 		unsigned int *err_loc);
+int omap_elm_decode_bch_page(int bch_type, u8 *ecc_calc,
+		struct elm_errorvec *err_vec, int nsectors);
 void omap_configure_elm(struct mtd_info *mtdi, int bch_type);
 #endif /* OMAP_ELM_H */
@@ -35,9 +35,21 @@
 #define EMIF4_0_DDR_PHY_CTRL_1		(0xE4)
 #define EMIF4_0_DDR_PHY_CTRL_1_SHADOW	(0xE8)
 
+/*
+ * SDRAM_MGMT_CTRL: m is the SR_TIM/PD_TIM code, the EMIF enters the low
+ * power mode after 16 << (m - 1) idle DDR clocks (m = 0: immediately).
+ */
 #define SELF_REFRESH_ENABLE(m)		(0x2 << 8 | (m << 4))
 #define SELF_REFRESH_DISABLE		(0x0 << 8)
+#define POWER_DOWN_ENABLE(m)		(0x4 << 8 | (m << 12))
+#define LP_MODE_MASK			(0x7 << 8)
+#define SR_TIM_MASK			(0xf << 4)
+#define PD_TIM_MASK			(0xf << 12)
+#define EMIF_PM_TIM_64_CLKS		0x3
 
 #define SDRAM_TYPE_MASK			0xe0000000
 #define SDRAM_TYPE_SHIFT		29
+#define SDRAM_TYPE_MDDR			1
+#define SDRAM_TYPE_DDR2			2
+#define SDRAM_TYPE_DDR3			3
 #endif /* __EMIF_H */
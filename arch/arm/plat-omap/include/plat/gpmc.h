@@ -174,6 +174,9 @@ extern int gpmc_nand_write(int cs, int cmd, int wval);
 
 int gpmc_enable_hwecc(int ecc, int cs, int mode, int dev_width, int ecc_size);
 int gpmc_calculate_ecc(int ecc, int cs, const u_char *dat, u_char *ecc_code);
+int gpmc_enable_hwecc_bch_page(int ecc, int cs, int dev_width, int nsectors);
+int gpmc_calculate_ecc_bch_page(int ecc, int nsectors, u_char *ecc_code,
+				int stride);
 int gpmc_suspend(void);
 int gpmc_resume(void);
 #endif
@@ -54,6 +54,20 @@
 
 #define OMAP_UART_DMA_CH_FREE	-1
 
+/* RX FIFO level register (AM33xx/OMAP4) and the IIR RX timeout code */
+#define UART_OMAP_RXFIFO_LVL		0x19
+#define OMAP_UART_IIR_ID_MASK		0x3e
+#define OMAP_UART_IIR_RX_TIMEOUT	0x0c
+
+/*
+ * EDMA RX ring: the buffer is split in this many periods, each one
+ * interrupting when full.  The UART requests DMA every
+ * OMAP_UART_RXDMA_TRIG bytes; a short tail stays in the FIFO until the
+ * RX timeout interrupt, or the rx_timer poll while the DMA owns the FIFO.
+ */
+#define OMAP_UART_RXDMA_PERIODS		4
+#define OMAP_UART_RXDMA_TRIG		32
+
 #define OMAP_MAX_HSUART_PORTS	6
 
 #define MSR_SAVE_FLAGS		UART_MSR_ANY_DELTA
@@ -77,6 +91,15 @@ struct omap_uart_port_info {
 	void (*enable_wakeup)(struct platform_device *, bool);
 };
 
+struct uart_omap_rxdma_stats {
+	unsigned long		periods;	/* ring periods completed */
+	unsigned long		timeouts;	/* RX timeout flushes */
+	unsigned long		dma_bytes;	/* bytes pushed from the ring */
+	unsigned long		pio_bytes;	/* FIFO tails read by the CPU */
+	unsigned int		ring_hwm;	/* highest ring occupancy */
+	unsigned long		ring_overruns;	/* unread ring data lost */
+};
+
 struct uart_omap_dma {
 	u8			uart_dma_tx;
 	u8			uart_dma_rx;
@@ -101,6 +124,14 @@ struct uart_omap_dma {
 	unsigned int		rx_buf_size;
 	unsigned int		rx_poll_rate;
 	unsigned int		rx_timeout;
+	/* EDMA RX ring, see serial_omap_start_rxdma() */
+	int			rx_ring_slot[OMAP_UART_RXDMA_PERIODS];
+	unsigned int		rx_period_len;
+	u32			rx_periods_done;
+	/* free running counts of bytes DMAed into and pushed from the ring */
+	u32			rx_head;
+	u32			rx_tail;
+	struct uart_omap_rxdma_stats rx_stats;
 };
 
 struct uart_omap_port {
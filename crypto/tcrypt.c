@@ -719,6 +719,166 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+/*
+ * Used by test_ahash_inflight_speed()
+ */
+#define TCRYPT_INFLIGHT	8
+
+struct tcrypt_inflight {
+	atomic_t		pending;
+	int			err;
+	struct completion	completion;
+};
+
+static void tcrypt_inflight_complete(struct crypto_async_request *req,
+				     int err)
+{
+	struct tcrypt_inflight *tf = req->data;
+
+	if (err == -EINPROGRESS)
+		return;
+
+	if (err)
+		tf->err = err;
+	if (atomic_dec_and_test(&tf->pending))
+		complete(&tf->completion);
+}
+
+/* Issue one digest on every request and wait until all of them are done */
+static int test_ahash_inflight_batch(struct ahash_request **req,
+				     struct tcrypt_inflight *tf)
+{
+	int i, ret;
+
+	tf->err = 0;
+	atomic_set(&tf->pending, 1);
+	INIT_COMPLETION(tf->completion);
+
+	for (i = 0; i < TCRYPT_INFLIGHT; i++) {
+		atomic_inc(&tf->pending);
+		ret = crypto_ahash_digest(req[i]);
+		if (ret == -EINPROGRESS || ret == -EBUSY)
+			continue;
+		/* completed synchronously, no callback */
+		if (ret)
+			tf->err = ret;
+		atomic_dec(&tf->pending);
+	}
+
+	if (!atomic_dec_and_test(&tf->pending))
+		wait_for_completion(&tf->completion);
+
+	return tf->err;
+}
+
+/*
+ * Like test_ahash_speed(), but keeps TCRYPT_INFLIGHT digests queued at
+ * once, so drivers that overlap requests are measured as such.
+ */
+static void test_ahash_inflight_speed(const char *algo, unsigned int sec,
+				      struct hash_speed *speed)
+{
+	struct scatterlist sg[TVMEMSIZE];
+	struct ahash_request *req[TCRYPT_INFLIGHT] = { NULL };
+	struct tcrypt_inflight tf;
+	struct crypto_ahash *tfm;
+	static char output[TCRYPT_INFLIGHT][64];
+	unsigned long start, end, bcount;
+	cycles_t cstart, cend;
+	int i, j, ret = 0;
+
+	printk(KERN_INFO "\ntesting speed of async %s, %d requests in flight\n",
+	       algo, TCRYPT_INFLIGHT);
+
+	tfm = crypto_alloc_ahash(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		pr_err("failed to load transform for %s: %ld\n",
+		       algo, PTR_ERR(tfm));
+		return;
+	}
+
+	if (crypto_ahash_digestsize(tfm) > sizeof(output[0])) {
+		pr_err("digestsize(%u) > outputbuffer(%zu)\n",
+		       crypto_ahash_digestsize(tfm), sizeof(output[0]));
+		goto out;
+	}
+
+	test_hash_sg_init(sg);
+	init_completion(&tf.completion);
+
+	for (i = 0; i < TCRYPT_INFLIGHT; i++) {
+		req[i] = ahash_request_alloc(tfm, GFP_KERNEL);
+		if (!req[i]) {
+			pr_err("ahash request allocation failure\n");
+			goto out_free;
+		}
+		ahash_request_set_callback(req[i], CRYPTO_TFM_REQ_MAY_BACKLOG,
+					   tcrypt_inflight_complete, &tf);
+	}
+
+	for (j = 0; speed[j].blen != 0; j++) {
+		if (speed[j].blen > TVMEMSIZE * PAGE_SIZE) {
+			pr_err("template (%u) too big for tvmem (%lu)\n",
+			       speed[j].blen, TVMEMSIZE * PAGE_SIZE);
+			break;
+		}
+
+		if (speed[j].klen) {
+			ret = crypto_ahash_setkey(tfm, tvmem[0], speed[j].klen);
+			if (ret) {
+				pr_err("setkey() failed ret=%d\n", ret);
+				break;
+			}
+		}
+
+		pr_info("test%3u (%5u byte blocks): ", j, speed[j].blen);
+
+		for (i = 0; i < TCRYPT_INFLIGHT; i++)
+			ahash_request_set_crypt(req[i], sg, output[i],
+						speed[j].blen);
+
+		if (sec) {
+			for (start = jiffies, end = start + sec * HZ,
+			     bcount = 0; time_before(jiffies, end);
+			     bcount += TCRYPT_INFLIGHT) {
+				ret = test_ahash_inflight_batch(req, &tf);
+				if (ret)
+					break;
+			}
+			if (!ret)
+				pr_cont("%6lu opers/sec, %9lu bytes/sec\n",
+					bcount / sec,
+					(bcount * speed[j].blen) / sec);
+		} else {
+			/* Warm-up run. */
+			ret = test_ahash_inflight_batch(req, &tf);
+
+			cstart = get_cycles();
+			for (i = 0; i < 8 && !ret; i++)
+				ret = test_ahash_inflight_batch(req, &tf);
+			cend = get_cycles();
+
+			bcount = 8 * TCRYPT_INFLIGHT;
+			if (!ret)
+				pr_cont("%6lu cycles/operation, %4lu cycles/byte\n",
+					(unsigned long)(cend - cstart) / bcount,
+					(unsigned long)(cend - cstart) /
+					(bcount * speed[j].blen));
+		}
+
+		if (ret) {
+			pr_err("hashing failed ret=%d\n", ret);
+			break;
+		}
+	}
+
+out_free:
+	for (i = 0; i < TCRYPT_INFLIGHT; i++)
+		ahash_request_free(req[i]);
+out:
+	crypto_free_ahash(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -1089,6 +1249,21 @@ static int do_test(int m)
 				  speed_template_16_32);
 		break;
 
+	case 207:
+		test_cipher_speed("ecb(aes-asm)", ENCRYPT, sec, NULL, 0,
+				speed_template_16_24_32);
+		test_cipher_speed("ecb(aes-asm)", DECRYPT, sec, NULL, 0,
+				speed_template_16_24_32);
+		test_cipher_speed("cbc(aes-asm)", ENCRYPT, sec, NULL, 0,
+				speed_template_16_24_32);
+		test_cipher_speed("cbc(aes-asm)", DECRYPT, sec, NULL, 0,
+				speed_template_16_24_32);
+		test_cipher_speed("ctr(aes-asm)", ENCRYPT, sec, NULL, 0,
+				speed_template_16_24_32);
+		test_cipher_speed("ctr(aes-asm)", DECRYPT, sec, NULL, 0,
+				speed_template_16_24_32);
+		break;
+
 	case 300:
 		/* fall through */
 
@@ -1164,6 +1339,18 @@ static int do_test(int m)
 		test_hash_speed("ghash-generic", sec, hash_speed_template_16);
 		if (mode > 300 && mode < 400) break;
 
+	case 319:
+		test_hash_speed("sha1-asm", sec, generic_hash_speed_template);
+		if (mode > 300 && mode < 400) break;
+
+	case 320:
+		test_hash_speed("sha256-asm", sec, generic_hash_speed_template);
+		if (mode > 300 && mode < 400) break;
+
+	case 321:
+		test_hash_speed("sha224-asm", sec, generic_hash_speed_template);
+		if (mode > 300 && mode < 400) break;
+
 	case 399:
 		break;
 
@@ -1238,6 +1425,26 @@ static int do_test(int m)
 		test_ahash_speed("rmd320", sec, generic_hash_speed_template);
 		if (mode > 400 && mode < 500) break;
 
+	case 418:
+		test_ahash_inflight_speed("sha1", sec,
+					  inflight_hash_speed_template);
+		if (mode > 400 && mode < 500) break;
+
+	case 419:
+		test_ahash_inflight_speed("md5", sec,
+					  inflight_hash_speed_template);
+		if (mode > 400 && mode < 500) break;
+
+	case 420:
+		test_ahash_inflight_speed("hmac(sha1)", sec,
+					  inflight_hmac_speed_template);
+		if (mode > 400 && mode < 500) break;
+
+	case 421:
+		test_ahash_inflight_speed("hmac(md5)", sec,
+					  inflight_hmac_speed_template);
+		if (mode > 400 && mode < 500) break;
+
 	case 499:
 		break;
 
@@ -112,4 +112,32 @@ static struct hash_speed hash_speed_template_16[] = {
 	{  .blen = 0,	.plen = 0,	.klen = 0, }
 };
 
+/*
+ * Digest-only sizes for the in-flight test; packet sized buffers are
+ * where per-request driver overhead shows.
+ */
+static struct hash_speed inflight_hash_speed_template[] = {
+	{ .blen = 64,	.plen = 64, },
+	{ .blen = 256,	.plen = 256, },
+	{ .blen = 1024,	.plen = 1024, },
+	{ .blen = 1472,	.plen = 1472, },
+	{ .blen = 4096,	.plen = 4096, },
+	{ .blen = 8192,	.plen = 8192, },
+
+	/* End marker */
+	{  .blen = 0,	.plen = 0, }
+};
+
+static struct hash_speed inflight_hmac_speed_template[] = {
+	{ .blen = 64,	.plen = 64,	.klen = 20, },
+	{ .blen = 256,	.plen = 256,	.klen = 20, },
+	{ .blen = 1024,	.plen = 1024,	.klen = 20, },
+	{ .blen = 1472,	.plen = 1472,	.klen = 20, },
+	{ .blen = 4096,	.plen = 4096,	.klen = 20, },
+	{ .blen = 8192,	.plen = 8192,	.klen = 20, },
+
+	/* End marker */
+	{  .blen = 0,	.plen = 0,	.klen = 0, }
+};
+
 #endif	/* _CRYPTO_TCRYPT_H */
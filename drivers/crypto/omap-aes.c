@@ -73,6 +73,7 @@
 #define FLAGS_ENCRYPT		BIT(0)
 #define FLAGS_CBC		BIT(1)
 #define FLAGS_GIV		BIT(2)
+#define FLAGS_CTR		BIT(3)
 
 #define FLAGS_INIT		BIT(4)
 #define FLAGS_FAST		BIT(5)
@@ -84,13 +85,22 @@ struct omap_aes_ctx {
 	int		keylen;
 	u32		key[AES_KEYSIZE_256 / sizeof(u32)];
 	unsigned long	flags;
+
+	/* ctr(aes) requests the 32 bit hw counter can't handle */
+	struct crypto_ablkcipher	*fallback;
 };
 
 struct omap_aes_reqctx {
 	unsigned long mode;
+	int in_nents;
+	int out_nents;
+	bool fast;		/* scatterlists mapped, no bounce copy */
+
+	/* must be the last member */
+	struct ablkcipher_request fallback_req;
 };
 
-#define OMAP_AES_QUEUE_LENGTH	1
+#define OMAP_AES_QUEUE_LENGTH	32
 #define OMAP_AES_CACHE_SIZE	0
 
 struct omap_aes_dev {
@@ -110,6 +120,8 @@ struct omap_aes_dev {
 	struct tasklet_struct	queue_task;
 
 	struct ablkcipher_request	*req;
+	/* dequeued and mapped while req is in the engine */
+	struct ablkcipher_request	*next_req;
 	size_t				total;
 	struct scatterlist		*in_sg;
 	size_t				in_offset;
@@ -233,17 +245,20 @@ static int omap_aes_write_ctrl(struct omap_aes_dev *dd)
 			__le32_to_cpu(dd->ctx->key[i]));
 	}
 
-	if ((dd->flags & FLAGS_CBC) && dd->req->info)
+	if ((dd->flags & (FLAGS_CBC | FLAGS_CTR)) && dd->req->info)
 		omap_aes_write_n(dd, AES_REG_IV(0), dd->req->info, 4);
 
 	val = FLD_VAL(((dd->ctx->keylen >> 3) - 1), 4, 3);
 	if (dd->flags & FLAGS_CBC)
 		val |= AES_REG_CTRL_CBC;
+	/* 32 bit counter, CTR_WIDTH left clear */
+	if (dd->flags & FLAGS_CTR)
+		val |= AES_REG_CTRL_CTR;
 	if (dd->flags & FLAGS_ENCRYPT)
 		val |= AES_REG_CTRL_DIRECTION;
 
-	mask = AES_REG_CTRL_CBC | AES_REG_CTRL_DIRECTION |
-			AES_REG_CTRL_KEY_SIZE;
+	mask = AES_REG_CTRL_CBC | AES_REG_CTRL_CTR | AES_REG_CTRL_CTR_WIDTH |
+			AES_REG_CTRL_DIRECTION | AES_REG_CTRL_KEY_SIZE;
 
 	omap_aes_write_mask(dd, AES_REG_CTRL, val, mask);
 
@@ -470,50 +485,156 @@ static int omap_aes_crypt_dma(struct crypto_tfm *tfm, dma_addr_t dma_addr_in,
 	return 0;
 }
 
+/*
+ * Every entry has to start word aligned and hold whole AES blocks, so a
+ * DMA transfer never ends in the middle of a block.
+ */
+static bool omap_aes_sg_aligned(struct scatterlist *sg, size_t total,
+				int *nents)
+{
+	size_t len;
+
+	for (*nents = 0; sg && total; sg = sg_next(sg), (*nents)++) {
+		len = min_t(size_t, sg->length, total);
+		if (!IS_ALIGNED(sg->offset, sizeof(u32)) ||
+		    !IS_ALIGNED(len, AES_BLOCK_SIZE))
+			return false;
+		total -= len;
+	}
+
+	return total == 0;
+}
+
+/* Map the request scatterlists for direct DMA if their layout allows it */
+static int omap_aes_map_req(struct omap_aes_dev *dd,
+			    struct ablkcipher_request *req)
+{
+	struct omap_aes_reqctx *rctx = ablkcipher_request_ctx(req);
+
+	rctx->fast = false;
+
+	if (!omap_aes_sg_aligned(req->src, req->nbytes, &rctx->in_nents) ||
+	    !omap_aes_sg_aligned(req->dst, req->nbytes, &rctx->out_nents))
+		return 0;
+
+	if (req->src == req->dst) {
+		if (!dma_map_sg(dd->dev, req->src, rctx->in_nents,
+				DMA_BIDIRECTIONAL))
+			goto err;
+	} else {
+		if (!dma_map_sg(dd->dev, req->src, rctx->in_nents,
+				DMA_TO_DEVICE))
+			goto err;
+		if (!dma_map_sg(dd->dev, req->dst, rctx->out_nents,
+				DMA_FROM_DEVICE)) {
+			dma_unmap_sg(dd->dev, req->src, rctx->in_nents,
+				     DMA_TO_DEVICE);
+			goto err;
+		}
+	}
+
+	rctx->fast = true;
+	return 0;
+
+err:
+	dev_err(dd->dev, "dma_map_sg() error\n");
+	return -EINVAL;
+}
+
+static void omap_aes_unmap_req(struct omap_aes_dev *dd,
+			       struct ablkcipher_request *req)
+{
+	struct omap_aes_reqctx *rctx = ablkcipher_request_ctx(req);
+
+	if (!rctx->fast)
+		return;
+
+	if (req->src == req->dst) {
+		dma_unmap_sg(dd->dev, req->src, rctx->in_nents,
+			     DMA_BIDIRECTIONAL);
+	} else {
+		dma_unmap_sg(dd->dev, req->dst, rctx->out_nents,
+			     DMA_FROM_DEVICE);
+		dma_unmap_sg(dd->dev, req->src, rctx->in_nents,
+			     DMA_TO_DEVICE);
+	}
+	rctx->fast = false;
+}
+
+/*
+ * Dequeue and map the next request while the engine works on the
+ * current one, so it can be started right from the done tasklet.
+ */
+static void omap_aes_prepare_next(struct omap_aes_dev *dd)
+{
+	struct crypto_async_request *async_req, *backlog;
+	struct ablkcipher_request *req;
+	unsigned long flags;
+	int err;
+
+	spin_lock_irqsave(&dd->lock, flags);
+	if (dd->next_req) {
+		spin_unlock_irqrestore(&dd->lock, flags);
+		return;
+	}
+	backlog = crypto_get_backlog(&dd->queue);
+	async_req = crypto_dequeue_request(&dd->queue);
+	spin_unlock_irqrestore(&dd->lock, flags);
+
+	if (!async_req)
+		return;
+
+	if (backlog)
+		backlog->complete(backlog, -EINPROGRESS);
+
+	req = ablkcipher_request_cast(async_req);
+
+	err = omap_aes_map_req(dd, req);
+	if (err) {
+		req->base.complete(&req->base, err);
+		return;
+	}
+
+	spin_lock_irqsave(&dd->lock, flags);
+	dd->next_req = req;
+	/* the engine went idle meanwhile, nobody else will pick it up */
+	if (!(dd->flags & FLAGS_BUSY))
+		tasklet_schedule(&dd->queue_task);
+	spin_unlock_irqrestore(&dd->lock, flags);
+}
+
 static int omap_aes_crypt_dma_start(struct omap_aes_dev *dd)
 {
 	struct crypto_tfm *tfm = crypto_ablkcipher_tfm(
 					crypto_ablkcipher_reqtfm(dd->req));
-	int err, fast = 0, in, out;
+	struct omap_aes_reqctx *rctx = ablkcipher_request_ctx(dd->req);
+	int err;
 	size_t count;
 	dma_addr_t addr_in, addr_out;
 
 	pr_debug("total: %d\n", dd->total);
 
-	if (sg_is_last(dd->in_sg) && sg_is_last(dd->out_sg)) {
-		/* check for alignment */
-		in = IS_ALIGNED((u32)dd->in_sg->offset, sizeof(u32));
-		out = IS_ALIGNED((u32)dd->out_sg->offset, sizeof(u32));
-
-		fast = in && out;
-	}
-
-	if (fast)  {
-		count = min(dd->total, sg_dma_len(dd->in_sg));
-		count = min(count, sg_dma_len(dd->out_sg));
-
-		if (count != dd->total) {
-			pr_err("request length != buffer length\n");
-			return -EINVAL;
-		}
+	if (rctx->fast)  {
+		/* largest piece contiguous in both lists */
+		count = min(sg_dma_len(dd->in_sg) - dd->in_offset,
+			    sg_dma_len(dd->out_sg) - dd->out_offset);
+		count = min(count, dd->total);
 
 		pr_debug("fast\n");
 
-		err = dma_map_sg(dd->dev, dd->in_sg, 1, DMA_TO_DEVICE);
-		if (!err) {
-			dev_err(dd->dev, "dma_map_sg() error\n");
-			return -EINVAL;
-		}
+		addr_in = sg_dma_address(dd->in_sg) + dd->in_offset;
+		addr_out = sg_dma_address(dd->out_sg) + dd->out_offset;
 
-		err = dma_map_sg(dd->dev, dd->out_sg, 1, DMA_FROM_DEVICE);
-		if (!err) {
-			dev_err(dd->dev, "dma_map_sg() error\n");
-			dma_unmap_sg(dd->dev, dd->in_sg, 1, DMA_TO_DEVICE);
-			return -EINVAL;
+		dd->in_offset += count;
+		if (dd->in_offset == sg_dma_len(dd->in_sg)) {
+			dd->in_sg = sg_next(dd->in_sg);
+			dd->in_offset = 0;
+		}
+		dd->out_offset += count;
+		if (dd->out_offset == sg_dma_len(dd->out_sg)) {
+			dd->out_sg = sg_next(dd->out_sg);
+			dd->out_offset = 0;
 		}
-
-		addr_in = sg_dma_address(dd->in_sg);
-		addr_out = sg_dma_address(dd->out_sg);
 
 		dd->flags |= FLAGS_FAST;
 
@@ -532,10 +653,8 @@ static int omap_aes_crypt_dma_start(struct omap_aes_dev *dd)
 	dd->total -= count;
 
 	err = omap_aes_crypt_dma(tfm, addr_in, addr_out, count);
-	if (err) {
-		dma_unmap_sg(dd->dev, dd->in_sg, 1, DMA_TO_DEVICE);
-		dma_unmap_sg(dd->dev, dd->out_sg, 1, DMA_TO_DEVICE);
-	}
+	if (!err)
+		omap_aes_prepare_next(dd);
 
 	return err;
 }
@@ -546,6 +665,8 @@ static void omap_aes_finish_req(struct omap_aes_dev *dd, int err)
 
 	pr_debug("err: %d\n", err);
 
+	omap_aes_unmap_req(dd, req);
+
 	clk_disable(dd->iclk);
 	dd->flags &= ~FLAGS_BUSY;
 
@@ -564,10 +685,7 @@ static int omap_aes_crypt_dma_stop(struct omap_aes_dev *dd)
 	omap_stop_dma(dd->dma_lch_in);
 	omap_stop_dma(dd->dma_lch_out);
 
-	if (dd->flags & FLAGS_FAST) {
-		dma_unmap_sg(dd->dev, dd->out_sg, 1, DMA_FROM_DEVICE);
-		dma_unmap_sg(dd->dev, dd->in_sg, 1, DMA_TO_DEVICE);
-	} else {
+	if (!(dd->flags & FLAGS_FAST)) {
 		dma_sync_single_for_device(dd->dev, dd->dma_addr_out,
 					   dd->dma_size, DMA_FROM_DEVICE);
 
@@ -586,11 +704,12 @@ static int omap_aes_crypt_dma_stop(struct omap_aes_dev *dd)
 static int omap_aes_handle_queue(struct omap_aes_dev *dd,
 			       struct ablkcipher_request *req)
 {
-	struct crypto_async_request *async_req, *backlog;
+	struct crypto_async_request *async_req = NULL, *backlog = NULL;
 	struct omap_aes_ctx *ctx;
 	struct omap_aes_reqctx *rctx;
 	unsigned long flags;
 	int err, ret = 0;
+	bool mapped = false;
 
 	spin_lock_irqsave(&dd->lock, flags);
 	if (req)
@@ -599,8 +718,15 @@ static int omap_aes_handle_queue(struct omap_aes_dev *dd,
 		spin_unlock_irqrestore(&dd->lock, flags);
 		return ret;
 	}
-	backlog = crypto_get_backlog(&dd->queue);
-	async_req = crypto_dequeue_request(&dd->queue);
+	if (dd->next_req) {
+		/* already dequeued and mapped behind the previous one */
+		async_req = &dd->next_req->base;
+		dd->next_req = NULL;
+		mapped = true;
+	} else {
+		backlog = crypto_get_backlog(&dd->queue);
+		async_req = crypto_dequeue_request(&dd->queue);
+	}
 	if (async_req)
 		dd->flags |= FLAGS_BUSY;
 	spin_unlock_irqrestore(&dd->lock, flags);
@@ -630,6 +756,8 @@ static int omap_aes_handle_queue(struct omap_aes_dev *dd,
 	ctx->dd = dd;
 
 	err = omap_aes_write_ctrl(dd);
+	if (!err && !mapped)
+		err = omap_aes_map_req(dd, req);
 	if (!err)
 		err = omap_aes_crypt_dma_start(dd);
 	if (err) {
@@ -659,6 +787,7 @@ static void omap_aes_done_task(unsigned long data)
 	}
 
 	omap_aes_finish_req(dd, err);
+	/* starts the prepared next request right away */
 	omap_aes_handle_queue(dd, NULL);
 
 	pr_debug("exit\n");
@@ -671,6 +800,39 @@ static void omap_aes_queue_task(unsigned long data)
 	omap_aes_handle_queue(dd, NULL);
 }
 
+/*
+ * The engine counts in the low 32 bits of the IV only and works on
+ * whole blocks, anything else goes to the software ctr(aes).
+ */
+static bool omap_aes_ctr_need_fallback(struct ablkcipher_request *req)
+{
+	u32 ctr;
+
+	if (!IS_ALIGNED(req->nbytes, AES_BLOCK_SIZE))
+		return true;
+
+	ctr = be32_to_cpu(((__be32 *)req->info)[3]);
+
+	return (u64)ctr + req->nbytes / AES_BLOCK_SIZE > 0x100000000ULL;
+}
+
+static int omap_aes_ctr_fallback(struct ablkcipher_request *req)
+{
+	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(
+			crypto_ablkcipher_reqtfm(req));
+	struct omap_aes_reqctx *rctx = ablkcipher_request_ctx(req);
+	struct ablkcipher_request *subreq = &rctx->fallback_req;
+
+	ablkcipher_request_set_tfm(subreq, ctx->fallback);
+	ablkcipher_request_set_callback(subreq, req->base.flags,
+					req->base.complete, req->base.data);
+	ablkcipher_request_set_crypt(subreq, req->src, req->dst,
+				     req->nbytes, req->info);
+
+	/* counter mode decryption is encryption */
+	return crypto_ablkcipher_encrypt(subreq);
+}
+
 static int omap_aes_crypt(struct ablkcipher_request *req, unsigned long mode)
 {
 	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(
@@ -678,9 +840,13 @@ static int omap_aes_crypt(struct ablkcipher_request *req, unsigned long mode)
 	struct omap_aes_reqctx *rctx = ablkcipher_request_ctx(req);
 	struct omap_aes_dev *dd;
 
-	pr_debug("nbytes: %d, enc: %d, cbc: %d\n", req->nbytes,
+	pr_debug("nbytes: %d, enc: %d, cbc: %d, ctr: %d\n", req->nbytes,
 		  !!(mode & FLAGS_ENCRYPT),
-		  !!(mode & FLAGS_CBC));
+		  !!(mode & FLAGS_CBC),
+		  !!(mode & FLAGS_CTR));
+
+	if ((mode & FLAGS_CTR) && omap_aes_ctr_need_fallback(req))
+		return omap_aes_ctr_fallback(req);
 
 	if (!IS_ALIGNED(req->nbytes, AES_BLOCK_SIZE)) {
 		pr_err("request size is not exact amount of AES blocks\n");
@@ -712,6 +878,9 @@ static int omap_aes_setkey(struct crypto_ablkcipher *tfm, const u8 *key,
 	memcpy(ctx->key, key, keylen);
 	ctx->keylen = keylen;
 
+	if (ctx->fallback)
+		return crypto_ablkcipher_setkey(ctx->fallback, key, keylen);
+
 	return 0;
 }
 
@@ -735,6 +904,12 @@ static int omap_aes_cbc_decrypt(struct ablkcipher_request *req)
 	return omap_aes_crypt(req, FLAGS_CBC);
 }
 
+/* In counter mode the engine always encrypts the counter blocks */
+static int omap_aes_ctr_crypt(struct ablkcipher_request *req)
+{
+	return omap_aes_crypt(req, FLAGS_ENCRYPT | FLAGS_CTR);
+}
+
 static int omap_aes_cra_init(struct crypto_tfm *tfm)
 {
 	pr_debug("enter\n");
@@ -744,9 +919,34 @@ static int omap_aes_cra_init(struct crypto_tfm *tfm)
 	return 0;
 }
 
+static int omap_aes_ctr_cra_init(struct crypto_tfm *tfm)
+{
+	struct omap_aes_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	pr_debug("enter\n");
+
+	ctx->fallback = crypto_alloc_ablkcipher(crypto_tfm_alg_name(tfm), 0,
+			CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(ctx->fallback)) {
+		pr_err("fallback cipher not available\n");
+		return PTR_ERR(ctx->fallback);
+	}
+
+	tfm->crt_ablkcipher.reqsize = sizeof(struct omap_aes_reqctx) +
+		crypto_ablkcipher_reqsize(ctx->fallback);
+
+	return 0;
+}
+
 static void omap_aes_cra_exit(struct crypto_tfm *tfm)
 {
+	struct omap_aes_ctx *ctx = crypto_tfm_ctx(tfm);
+
 	pr_debug("enter\n");
+
+	if (ctx->fallback)
+		crypto_free_ablkcipher(ctx->fallback);
+	ctx->fallback = NULL;
 }
 
 /* ********************** ALGS ************************************ */
@@ -792,6 +992,28 @@ static struct crypto_alg algs[] = {
 		.encrypt	= omap_aes_cbc_encrypt,
 		.decrypt	= omap_aes_cbc_decrypt,
 	}
+},
+{
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-omap",
+	.cra_priority		= 100,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER | CRYPTO_ALG_ASYNC |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct omap_aes_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_ablkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= omap_aes_ctr_cra_init,
+	.cra_exit		= omap_aes_cra_exit,
+	.cra_u.ablkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= omap_aes_setkey,
+		.encrypt	= omap_aes_ctr_crypt,
+		.decrypt	= omap_aes_ctr_crypt,
+	}
 }
 };
 
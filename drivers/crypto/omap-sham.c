@@ -113,6 +113,10 @@ struct omap_sham_reqctx {
 	unsigned int		offset;	/* offset in current sg */
 	unsigned int		total;	/* total request */
 
+	/* whole source list, mapped once per request */
+	struct scatterlist	*sgl;
+	int			sgl_nents;
+
 	u8			buffer[0] OMAP_ALIGNED;
 };
 
@@ -133,7 +137,7 @@ struct omap_sham_ctx {
 	struct omap_sham_hmac_ctx base[0];
 };
 
-#define OMAP_SHAM_QUEUE_LENGTH	1
+#define OMAP_SHAM_QUEUE_LENGTH	16
 
 struct omap_sham_dev {
 	struct list_head	list;
@@ -151,6 +155,8 @@ struct omap_sham_dev {
 	unsigned long		flags;
 	struct crypto_queue	queue;
 	struct ahash_request	*req;
+	/* dequeued and mapped while req is in the engine */
+	struct ahash_request	*next_req;
 };
 
 struct omap_sham_drv {
@@ -449,13 +455,20 @@ static int omap_sham_update_dma_start(struct omap_sham_dev *dd)
 	if (!SG_AA(sg))
 		return omap_sham_update_dma_slow(dd);
 
-	if (!sg_is_last(sg) && !SG_SA(sg))
-		/* size is not SHA1_BLOCK_SIZE aligned */
+	if (!ctx->sgl)
 		return omap_sham_update_dma_slow(dd);
 
 	length = min(ctx->total, sg->length);
 
-	if (sg_is_last(sg)) {
+	if (!sg_is_last(sg) && !SG_SA(sg)) {
+		/*
+		 * size is not SHA1_BLOCK_SIZE aligned, send the aligned
+		 * head directly and let the slow path collect the rest
+		 */
+		length = round_down(length, SHA1_MD5_BLOCK_SIZE);
+		if (!length)
+			return omap_sham_update_dma_slow(dd);
+	} else if (sg_is_last(sg)) {
 		if (!(ctx->flags & BIT(FLAGS_FINUP))) {
 			/* not last sg must be SHA1_MD5_BLOCK_SIZE aligned */
 			tail = length & (SHA1_MD5_BLOCK_SIZE - 1);
@@ -466,11 +479,6 @@ static int omap_sham_update_dma_start(struct omap_sham_dev *dd)
 		}
 	}
 
-	if (!dma_map_sg(dd->dev, ctx->sg, 1, DMA_TO_DEVICE)) {
-		dev_err(dd->dev, "dma_map_sg  error\n");
-		return -EINVAL;
-	}
-
 	ctx->flags |= BIT(FLAGS_SG);
 
 	ctx->total -= length;
@@ -500,7 +508,7 @@ static int omap_sham_update_dma_stop(struct omap_sham_dev *dd)
 
 	omap_stop_dma(dd->dma_lch);
 	if (ctx->flags & BIT(FLAGS_SG)) {
-		dma_unmap_sg(dd->dev, ctx->sg, 1, DMA_TO_DEVICE);
+		/* the list stays mapped until the request is finished */
 		if (ctx->sg->length == ctx->offset) {
 			ctx->sg = sg_next(ctx->sg);
 			if (ctx->sg)
@@ -546,6 +554,7 @@ static int omap_sham_init(struct ahash_request *req)
 	ctx->bufcnt = 0;
 	ctx->digcnt = 0;
 	ctx->buflen = BUFLEN;
+	ctx->sgl = NULL;
 
 	if (tctx->flags & BIT(FLAGS_HMAC)) {
 		struct omap_sham_hmac_ctx *bctx = tctx->base;
@@ -637,6 +646,97 @@ static int omap_sham_finish(struct ahash_request *req)
 	return err;
 }
 
+/*
+ * Map the whole source list of an update up front, so the DMA path only
+ * has to walk it. Short and CPU driven updates never touch the list.
+ */
+static int omap_sham_map_req(struct omap_sham_dev *dd,
+			     struct ahash_request *req)
+{
+	struct omap_sham_reqctx *ctx = ahash_request_ctx(req);
+	struct scatterlist *sg;
+	unsigned int total;
+	int nents;
+
+	ctx->sgl = NULL;
+
+	if (ctx->op != OP_UPDATE || !ctx->total ||
+	    (ctx->flags & BIT(FLAGS_CPU)))
+		return 0;
+
+	for (sg = ctx->sg, total = ctx->total, nents = 0; sg && total;
+	     sg = sg_next(sg), nents++)
+		total -= min(total, sg->length);
+
+	if (!dma_map_sg(dd->dev, ctx->sg, nents, DMA_TO_DEVICE)) {
+		dev_err(dd->dev, "dma_map_sg  error\n");
+		return -EINVAL;
+	}
+
+	ctx->sgl = ctx->sg;
+	ctx->sgl_nents = nents;
+
+	return 0;
+}
+
+static void omap_sham_unmap_req(struct omap_sham_dev *dd,
+				struct ahash_request *req)
+{
+	struct omap_sham_reqctx *ctx = ahash_request_ctx(req);
+
+	if (!ctx->sgl)
+		return;
+
+	dma_unmap_sg(dd->dev, ctx->sgl, ctx->sgl_nents, DMA_TO_DEVICE);
+	ctx->sgl = NULL;
+}
+
+/*
+ * Dequeue and map the next request while the engine hashes the current
+ * one, so the done tasklet can start it without another round trip.
+ */
+static void omap_sham_prepare_next(struct omap_sham_dev *dd)
+{
+	struct crypto_async_request *async_req, *backlog;
+	struct omap_sham_reqctx *ctx;
+	struct ahash_request *req;
+	unsigned long flags;
+	int err;
+
+	spin_lock_irqsave(&dd->lock, flags);
+	if (dd->next_req) {
+		spin_unlock_irqrestore(&dd->lock, flags);
+		return;
+	}
+	backlog = crypto_get_backlog(&dd->queue);
+	async_req = crypto_dequeue_request(&dd->queue);
+	spin_unlock_irqrestore(&dd->lock, flags);
+
+	if (!async_req)
+		return;
+
+	if (backlog)
+		backlog->complete(backlog, -EINPROGRESS);
+
+	req = ahash_request_cast(async_req);
+	ctx = ahash_request_ctx(req);
+
+	err = omap_sham_map_req(dd, req);
+	if (err) {
+		ctx->flags |= BIT(FLAGS_ERROR);
+		if (req->base.complete)
+			req->base.complete(&req->base, err);
+		return;
+	}
+
+	spin_lock_irqsave(&dd->lock, flags);
+	dd->next_req = req;
+	/* the engine went idle meanwhile, nobody else will pick it up */
+	if (!test_bit(FLAGS_BUSY, &dd->flags))
+		tasklet_schedule(&dd->done_task);
+	spin_unlock_irqrestore(&dd->lock, flags);
+}
+
 static void omap_sham_finish_req(struct ahash_request *req, int err)
 {
 	struct omap_sham_reqctx *ctx = ahash_request_ctx(req);
@@ -650,6 +750,8 @@ static void omap_sham_finish_req(struct ahash_request *req, int err)
 		ctx->flags |= BIT(FLAGS_ERROR);
 	}
 
+	omap_sham_unmap_req(dd, req);
+
 	/* atomic operation is not needed here */
 	dd->flags &= ~(BIT(FLAGS_BUSY) | BIT(FLAGS_FINAL) | BIT(FLAGS_CPU) |
 			BIT(FLAGS_DMA_READY) | BIT(FLAGS_OUTPUT_READY));
@@ -657,18 +759,16 @@ static void omap_sham_finish_req(struct ahash_request *req, int err)
 
 	if (req->base.complete)
 		req->base.complete(&req->base, err);
-
-	/* handle new request */
-	tasklet_schedule(&dd->done_task);
 }
 
 static int omap_sham_handle_queue(struct omap_sham_dev *dd,
 				  struct ahash_request *req)
 {
-	struct crypto_async_request *async_req, *backlog;
+	struct crypto_async_request *async_req = NULL, *backlog = NULL;
 	struct omap_sham_reqctx *ctx;
 	unsigned long flags;
 	int err = 0, ret = 0;
+	bool mapped = false;
 
 	spin_lock_irqsave(&dd->lock, flags);
 	if (req)
@@ -677,8 +777,15 @@ static int omap_sham_handle_queue(struct omap_sham_dev *dd,
 		spin_unlock_irqrestore(&dd->lock, flags);
 		return ret;
 	}
-	backlog = crypto_get_backlog(&dd->queue);
-	async_req = crypto_dequeue_request(&dd->queue);
+	if (dd->next_req) {
+		/* already dequeued and mapped behind the previous one */
+		async_req = &dd->next_req->base;
+		dd->next_req = NULL;
+		mapped = true;
+	} else {
+		backlog = crypto_get_backlog(&dd->queue);
+		async_req = crypto_dequeue_request(&dd->queue);
+	}
 	if (async_req)
 		set_bit(FLAGS_BUSY, &dd->flags);
 	spin_unlock_irqrestore(&dd->lock, flags);
@@ -697,6 +804,8 @@ static int omap_sham_handle_queue(struct omap_sham_dev *dd,
 						ctx->op, req->nbytes);
 
 	err = omap_sham_hw_init(dd);
+	if (!err && !mapped)
+		err = omap_sham_map_req(dd, req);
 	if (err)
 		goto err1;
 
@@ -723,9 +832,14 @@ static int omap_sham_handle_queue(struct omap_sham_dev *dd,
 		err = omap_sham_final_req(dd);
 	}
 err1:
-	if (err != -EINPROGRESS)
+	if (err != -EINPROGRESS) {
 		/* done_task will not finish it, so do it here */
 		omap_sham_finish_req(req, err);
+		/* handle new request */
+		tasklet_schedule(&dd->done_task);
+	} else {
+		omap_sham_prepare_next(dd);
+	}
 
 	dev_dbg(dd->dev, "exit, err: %d\n", err);
 
@@ -1071,6 +1185,8 @@ finish:
 	dev_dbg(dd->dev, "update done: err: %d\n", err);
 	/* finish curent request */
 	omap_sham_finish_req(dd->req, err);
+	/* starts the prepared next request right away */
+	omap_sham_handle_queue(dd, NULL);
 }
 
 static irqreturn_t omap_sham_irq(int irq, void *dev_id)
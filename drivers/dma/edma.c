@@ -0,0 +1,1342 @@
+/*
+ * TI EDMA DMA engine driver
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/edma.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include <asm/sizes.h>
+
+#include <mach/edma.h>
+
+/*
+ * This will go away when the private EDMA API is folded
+ * into this driver and the platform device(s) are
+ * instantiated in the arch code.
+ */
+#define EDMA_CTLRS	2
+#define EDMA_CHANS	EDMA_MAX_DMACH
+
+/*
+ * PaRAM slots owned by a channel, the first one is the channel's own
+ * slot. Longer transfers are split in batches of EDMA_MAX_SLOTS linked
+ * sets, a cyclic transfer keeps one extra slot to wrap around.
+ */
+#define EDMA_MAX_SLOTS		20
+#define EDMA_MAX_CYCLIC		(EDMA_MAX_SLOTS - 1)
+
+/* Completed descriptors kept per channel for reuse */
+#define EDMA_DESC_CACHE		4
+
+/* Largest A count used to split up memcpy transfers */
+#define EDMA_MEMCPY_ACNT	SZ_32K
+#define EDMA_MAX_CNT		(SZ_64K - 1)
+
+/*
+ * Memory to memory copies get their own public dma_device, so async_tx
+ * and net_dma keep them once slave clients turned the slave device
+ * private. Each memcpy channel sits on its own event queue, so copies
+ * are spread over the transfer controllers.
+ */
+#define EDMA_MAX_MEMCPY_CHANS	4
+
+static unsigned int memcpy_channels = 3;
+module_param(memcpy_channels, uint, S_IRUGO);
+MODULE_PARM_DESC(memcpy_channels, "Number of memcpy channels (default: 3)");
+
+static unsigned int memcpy_slots = 64;
+module_param(memcpy_slots, uint, S_IRUGO);
+MODULE_PARM_DESC(memcpy_slots,
+	"PaRAM slots shared by memcpy transfers (default: 64)");
+
+struct edma_pset {
+	struct edmacc_param		param;
+	dma_addr_t			addr;	/* memory side address */
+	u32				len;
+	int				slot;	/* memcpy: pool slot */
+};
+
+struct edma_desc {
+	struct dma_async_tx_descriptor	txd;
+	struct list_head		node;
+	bool				cyclic;
+	bool				memcpy;
+	bool				pooled;
+	int				pset_max;
+	int				pset_nr;
+	int				processed;
+	int				batch;
+	struct edma_pset		pset[0];
+};
+
+struct edma_cc;
+
+struct edma_chan {
+	struct dma_chan			chan;
+	struct edma_cc			*ecc;
+	struct tasklet_struct		tasklet;
+	spinlock_t			lock;
+	int				ch_num;		/* as requested */
+	int				hw_ch;		/* after xbar mapping */
+	bool				alloced;
+	bool				memcpy_chan;
+	enum dma_event_q		queue;
+	int				nr_slots;
+	int				slot[EDMA_MAX_SLOTS];
+	struct dma_slave_config		cfg;
+	struct edma_desc		*active;
+	struct list_head		queued;
+	struct list_head		issued;
+	struct list_head		completed;
+	struct list_head		unacked;	/* done, client owns */
+	struct list_head		free;
+	int				nr_free;
+	int				periods_done;
+	dma_cookie_t			last_completed;
+	dma_cookie_t			last_error;
+	enum dma_status			status;
+};
+
+/*
+ * PaRAM slots linked behind the channel slot of memcpy transfers, taken
+ * while at least one memcpy channel is allocated.
+ */
+struct edma_slot_pool {
+	spinlock_t			lock;
+	int				users;
+	int				nr;
+	int				nr_free;
+	int				*slot;
+	unsigned long			*used;
+};
+
+struct edma_cc {
+	int				ctlr;
+	struct dma_device		dma_slave;
+	struct edma_chan		slave_chans[EDMA_CHANS];
+	int				num_slave_chans;
+	struct dma_device		dma_memcpy;
+	struct edma_chan		memcpy_chans[EDMA_MAX_MEMCPY_CHANS];
+	int				num_memcpy_chans;
+	struct edma_slot_pool		pool;
+};
+
+static inline struct edma_cc *to_edma_cc(struct dma_device *d)
+{
+	return container_of(d, struct edma_cc, dma_slave);
+}
+
+static inline struct edma_chan *to_edma_chan(struct dma_chan *c)
+{
+	return container_of(c, struct edma_chan, chan);
+}
+
+static inline struct edma_desc *to_edma_desc(struct dma_async_tx_descriptor *tx)
+{
+	return container_of(tx, struct edma_desc, txd);
+}
+
+static dma_cookie_t edma_tx_submit(struct dma_async_tx_descriptor *tx)
+{
+	struct edma_chan *echan = to_edma_chan(tx->chan);
+	struct edma_desc *edesc = to_edma_desc(tx);
+	dma_cookie_t cookie;
+	unsigned long flags;
+
+	spin_lock_irqsave(&echan->lock, flags);
+
+	cookie = echan->chan.cookie;
+	if (++cookie < 0)
+		cookie = 1;
+	echan->chan.cookie = cookie;
+	tx->cookie = cookie;
+
+	list_add_tail(&edesc->node, &echan->queued);
+
+	spin_unlock_irqrestore(&echan->lock, flags);
+
+	return cookie;
+}
+
+/* Hand out a pool slot for every set but the first, all or nothing */
+static int edma_pool_get(struct edma_slot_pool *pool, struct edma_desc *edesc)
+{
+	unsigned long flags;
+	int i, idx;
+
+	edesc->pset[0].slot = -1;
+	if (edesc->pset_nr == 1)
+		return 0;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	if (pool->nr_free < edesc->pset_nr - 1) {
+		spin_unlock_irqrestore(&pool->lock, flags);
+		return -ENOMEM;
+	}
+
+	for (i = 1, idx = 0; i < edesc->pset_nr; i++, idx++) {
+		idx = find_next_zero_bit(pool->used, pool->nr, idx);
+		__set_bit(idx, pool->used);
+		edesc->pset[i].slot = idx;
+	}
+	pool->nr_free -= edesc->pset_nr - 1;
+	edesc->pooled = true;
+
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	return 0;
+}
+
+static void edma_pool_put(struct edma_slot_pool *pool, struct edma_desc *edesc)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	for (i = 1; i < edesc->pset_nr; i++)
+		__clear_bit(edesc->pset[i].slot, pool->used);
+	pool->nr_free += edesc->pset_nr - 1;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	edesc->pooled = false;
+}
+
+/* PaRAM slot set @i of @edesc is loaded into */
+static inline int edma_desc_slot(struct edma_chan *echan,
+				 struct edma_desc *edesc, int i)
+{
+	if (edesc->pooled && i)
+		return echan->ecc->pool.slot[edesc->pset[i].slot];
+	return echan->slot[i];
+}
+
+/* Called with echan->lock held */
+static void edma_desc_put(struct edma_chan *echan, struct edma_desc *edesc)
+{
+	if (edesc->pooled)
+		edma_pool_put(&echan->ecc->pool, edesc);
+
+	if (echan->nr_free < EDMA_DESC_CACHE) {
+		list_add(&edesc->node, &echan->free);
+		echan->nr_free++;
+	} else {
+		kfree(edesc);
+	}
+}
+
+/*
+ * Recycle a finished descriptor, unless the client did not ack it yet and
+ * may still use it. Called with echan->lock held.
+ */
+static void edma_desc_done(struct edma_chan *echan, struct edma_desc *edesc)
+{
+	if (async_tx_test_ack(&edesc->txd)) {
+		edma_desc_put(echan, edesc);
+		return;
+	}
+
+	if (edesc->pooled)
+		edma_pool_put(&echan->ecc->pool, edesc);
+	list_add_tail(&edesc->node, &echan->unacked);
+}
+
+/* Called with echan->lock held */
+static void edma_desc_reclaim(struct edma_chan *echan)
+{
+	struct edma_desc *edesc, *tmp;
+
+	list_for_each_entry_safe(edesc, tmp, &echan->unacked, node) {
+		if (async_tx_test_ack(&edesc->txd)) {
+			list_del(&edesc->node);
+			edma_desc_put(echan, edesc);
+		}
+	}
+}
+
+/* Take a descriptor from the channel cache, allocate one on a miss */
+static struct edma_desc *edma_desc_get(struct edma_chan *echan, int nr,
+		unsigned long tx_flags)
+{
+	struct edma_desc *edesc = NULL, *d;
+	unsigned long flags;
+
+	spin_lock_irqsave(&echan->lock, flags);
+	edma_desc_reclaim(echan);
+	list_for_each_entry(d, &echan->free, node) {
+		if (d->pset_max >= nr) {
+			list_del(&d->node);
+			echan->nr_free--;
+			edesc = d;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&echan->lock, flags);
+
+	if (!edesc) {
+		int max = max(nr, EDMA_MAX_SLOTS);
+
+		edesc = kzalloc(sizeof(*edesc) + max * sizeof(edesc->pset[0]),
+				GFP_NOWAIT);
+		if (!edesc)
+			return NULL;
+		edesc->pset_max = max;
+	}
+
+	dma_async_tx_descriptor_init(&edesc->txd, &echan->chan);
+	edesc->txd.tx_submit = edma_tx_submit;
+	edesc->txd.flags = tx_flags;
+	edesc->txd.callback = NULL;
+	edesc->txd.callback_param = NULL;
+	edesc->cyclic = false;
+	edesc->memcpy = false;
+	edesc->pooled = false;
+	edesc->pset_nr = nr;
+	edesc->processed = 0;
+	edesc->batch = 0;
+
+	return edesc;
+}
+
+/*
+ * Program the next batch of the active descriptor, or the first issued
+ * descriptor when the channel is idle, and start the channel.
+ * Called with echan->lock held.
+ */
+static void edma_execute(struct edma_chan *echan)
+{
+	struct edma_desc *edesc = echan->active;
+	int i, j, nslots;
+
+	if (!edesc) {
+		if (list_empty(&echan->issued))
+			return;
+		edesc = list_first_entry(&echan->issued, struct edma_desc,
+					 node);
+		list_del(&edesc->node);
+		echan->active = edesc;
+	}
+
+	/* pooled memcpy chains go out in one piece */
+	if (edesc->cyclic || edesc->pooled)
+		nslots = edesc->pset_nr;
+	else
+		nslots = min(edesc->pset_nr - edesc->processed,
+			     EDMA_MAX_SLOTS);
+	edesc->batch = nslots;
+
+	for (i = 0; i < nslots; i++) {
+		struct edmacc_param param;
+		int slot = edma_desc_slot(echan, edesc, i);
+
+		j = edesc->processed + i;
+		param = edesc->pset[j].param;
+
+		if (edesc->cyclic || i == nslots - 1)
+			param.opt |= TCINTEN;
+		else if (edesc->memcpy)
+			/* chain to ourselves, the next set needs a trigger */
+			param.opt |= TCCHEN;
+
+		edma_write_slot(slot, &param);
+		if (i)
+			edma_link(edma_desc_slot(echan, edesc, i - 1), slot);
+	}
+
+	if (edesc->cyclic) {
+		struct edmacc_param param = edesc->pset[0].param;
+
+		/* the last slot holds period 0 again and wraps to period 1 */
+		param.opt |= TCINTEN;
+		edma_write_slot(echan->slot[nslots], &param);
+		edma_link(echan->slot[nslots - 1], echan->slot[nslots]);
+		edma_link(echan->slot[nslots], echan->slot[1]);
+	}
+
+	echan->status = DMA_IN_PROGRESS;
+
+	if (edesc->memcpy)
+		edma_trigger_channel(echan->hw_ch);
+	else
+		edma_start(echan->hw_ch);
+}
+
+static void edma_callback(unsigned ch_num, u16 ch_status, void *data)
+{
+	struct edma_chan *echan = data;
+	struct edma_desc *edesc;
+
+	spin_lock(&echan->lock);
+
+	edesc = echan->active;
+	if (!edesc)
+		goto out;
+
+	if (ch_status != DMA_COMPLETE) {
+		dev_dbg(echan->chan.device->dev, "channel %d error %d\n",
+			echan->ch_num, ch_status);
+		edma_clean_channel(echan->hw_ch);
+		if (!edesc->memcpy) {
+			/* drop the missed event and let the transfer go on */
+			edma_start(echan->hw_ch);
+			goto out;
+		}
+		/* a copy is not retried, fail it and start the next one */
+		edma_stop(echan->hw_ch);
+		echan->last_error = edesc->txd.cookie;
+		goto done;
+	}
+
+	if (edesc->cyclic) {
+		echan->periods_done++;
+		tasklet_schedule(&echan->tasklet);
+		goto out;
+	}
+
+	edesc->processed += edesc->batch;
+	if (edesc->processed < edesc->pset_nr) {
+		edma_execute(echan);
+		goto out;
+	}
+
+done:
+	echan->last_completed = edesc->txd.cookie;
+	echan->active = NULL;
+	echan->status = DMA_SUCCESS;
+	list_add_tail(&edesc->node, &echan->completed);
+
+	edma_execute(echan);
+	tasklet_schedule(&echan->tasklet);
+out:
+	spin_unlock(&echan->lock);
+}
+
+static void edma_tasklet(unsigned long data)
+{
+	struct edma_chan *echan = (struct edma_chan *)data;
+	struct edma_desc *edesc, *tmp;
+	dma_async_tx_callback callback = NULL;
+	void *param = NULL;
+	unsigned long flags;
+	LIST_HEAD(list);
+	int periods;
+
+	spin_lock_irqsave(&echan->lock, flags);
+	list_splice_tail_init(&echan->completed, &list);
+	periods = echan->periods_done;
+	echan->periods_done = 0;
+	if (periods && echan->active && echan->active->cyclic) {
+		callback = echan->active->txd.callback;
+		param = echan->active->txd.callback_param;
+	}
+	spin_unlock_irqrestore(&echan->lock, flags);
+
+	if (callback)
+		while (periods--)
+			callback(param);
+
+	list_for_each_entry_safe(edesc, tmp, &list, node) {
+		if (edesc->txd.callback)
+			edesc->txd.callback(edesc->txd.callback_param);
+
+		spin_lock_irqsave(&echan->lock, flags);
+		list_del(&edesc->node);
+		edma_desc_done(echan, edesc);
+		spin_unlock_irqrestore(&echan->lock, flags);
+	}
+}
+
+static int edma_terminate_all(struct edma_chan *echan)
+{
+	struct edma_desc *edesc, *tmp;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&echan->lock, flags);
+
+	edma_stop(echan->hw_ch);
+	edma_clean_channel(echan->hw_ch);
+
+	if (echan->active) {
+		list_add(&echan->active->node, &list);
+		echan->active = NULL;
+	}
+	list_splice_tail_init(&echan->issued, &list);
+	list_splice_tail_init(&echan->queued, &list);
+	echan->periods_done = 0;
+	echan->status = DMA_SUCCESS;
+	echan->last_completed = echan->chan.cookie;
+
+	list_for_each_entry_safe(edesc, tmp, &list, node) {
+		list_del(&edesc->node);
+		edma_desc_put(echan, edesc);
+	}
+
+	spin_unlock_irqrestore(&echan->lock, flags);
+
+	return 0;
+}
+
+static int edma_control(struct dma_chan *chan, enum dma_ctrl_cmd cmd,
+			unsigned long arg)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	struct dma_slave_config *config;
+	int ret = 0;
+
+	switch (cmd) {
+	case DMA_TERMINATE_ALL:
+		ret = edma_terminate_all(echan);
+		break;
+	case DMA_SLAVE_CONFIG:
+		config = (struct dma_slave_config *)arg;
+		if (config->src_addr_width == DMA_SLAVE_BUSWIDTH_8_BYTES ||
+		    config->dst_addr_width == DMA_SLAVE_BUSWIDTH_8_BYTES)
+			return -EINVAL;
+		memcpy(&echan->cfg, config, sizeof(echan->cfg));
+		break;
+	case DMA_PAUSE:
+		if (!echan->active || echan->active->memcpy)
+			return -EINVAL;
+		edma_pause(echan->hw_ch);
+		echan->status = DMA_PAUSED;
+		break;
+	case DMA_RESUME:
+		if (echan->status != DMA_PAUSED)
+			return -EINVAL;
+		edma_resume(echan->hw_ch);
+		echan->status = DMA_IN_PROGRESS;
+		break;
+	default:
+		ret = -ENXIO;
+	}
+
+	return ret;
+}
+
+/*
+ * Fill a PaRAM set for one slave segment. Single word bursts use A
+ * synchronized transfers, one array per event; bigger bursts use AB
+ * synchronized transfers moving a whole burst per event.
+ */
+static int edma_config_pset(struct edma_chan *echan, struct edma_pset *pset,
+		dma_addr_t src, dma_addr_t dst, u32 burst, int dev_width,
+		u32 dma_length, enum dma_data_direction direction)
+{
+	struct edmacc_param *param = &pset->param;
+	int acnt, bcnt, ccnt, cidx;
+	int src_bidx, dst_bidx, src_cidx, dst_cidx;
+	bool absync;
+
+	acnt = dev_width;
+	if (burst <= 1) {
+		bcnt = dma_length / acnt;
+		ccnt = 1;
+		if (bcnt > EDMA_MAX_CNT) {
+			/* split in frames of EDMA_MAX_CNT arrays */
+			if (bcnt % EDMA_MAX_CNT)
+				goto err;
+			ccnt = bcnt / EDMA_MAX_CNT;
+			bcnt = EDMA_MAX_CNT;
+		}
+		cidx = acnt;
+		absync = false;
+	} else {
+		bcnt = burst;
+		ccnt = dma_length / (acnt * burst);
+		if (dma_length % (acnt * burst))
+			goto err;
+		cidx = acnt * burst;
+		absync = true;
+	}
+
+	if (!ccnt || ccnt > EDMA_MAX_CNT || dma_length % acnt)
+		goto err;
+
+	if (direction == DMA_TO_DEVICE) {
+		src_bidx = acnt;
+		src_cidx = cidx;
+		dst_bidx = 0;
+		dst_cidx = 0;
+		pset->addr = src;
+	} else {
+		src_bidx = 0;
+		src_cidx = 0;
+		dst_bidx = acnt;
+		dst_cidx = cidx;
+		pset->addr = dst;
+	}
+	pset->len = dma_length;
+
+	param->opt = EDMA_TCC(EDMA_CHAN_SLOT(echan->hw_ch));
+	if (absync)
+		param->opt |= SYNCDIM;
+	param->src = src;
+	param->dst = dst;
+	param->a_b_cnt = bcnt << 16 | acnt;
+	param->ccnt = ccnt;
+	param->src_dst_bidx = (dst_bidx << 16) | (src_bidx & 0xffff);
+	param->src_dst_cidx = (dst_cidx << 16) | (src_cidx & 0xffff);
+	param->link_bcntrld = (bcnt << 16) | 0xffff;
+
+	return 0;
+
+err:
+	dev_err(echan->chan.device->dev,
+		"%u bytes can't be moved in %d byte words, burst %u\n",
+		dma_length, dev_width, burst);
+	return -EINVAL;
+}
+
+static int edma_slave_params(struct edma_chan *echan,
+		enum dma_data_direction direction, dma_addr_t *dev_addr,
+		int *dev_width, u32 *burst)
+{
+	if (direction == DMA_FROM_DEVICE) {
+		*dev_addr = echan->cfg.src_addr;
+		*dev_width = echan->cfg.src_addr_width;
+		*burst = echan->cfg.src_maxburst;
+	} else if (direction == DMA_TO_DEVICE) {
+		*dev_addr = echan->cfg.dst_addr;
+		*dev_width = echan->cfg.dst_addr_width;
+		*burst = echan->cfg.dst_maxburst;
+	} else {
+		dev_err(echan->chan.device->dev, "bad direction\n");
+		return -EINVAL;
+	}
+
+	if (*dev_width == DMA_SLAVE_BUSWIDTH_UNDEFINED) {
+		dev_err(echan->chan.device->dev, "undefined slave buswidth\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static struct dma_async_tx_descriptor *edma_prep_slave_sg(
+	struct dma_chan *chan, struct scatterlist *sgl,
+	unsigned int sg_len, enum dma_data_direction direction,
+	unsigned long tx_flags)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	struct edma_desc *edesc;
+	struct scatterlist *sg;
+	unsigned long flags;
+	dma_addr_t dev_addr;
+	int dev_width, i, ret;
+	u32 burst;
+
+	if (unlikely(!echan || !sgl || !sg_len))
+		return NULL;
+
+	if (edma_slave_params(echan, direction, &dev_addr, &dev_width, &burst))
+		return NULL;
+
+	edesc = edma_desc_get(echan, sg_len, tx_flags);
+	if (!edesc)
+		return NULL;
+
+	for_each_sg(sgl, sg, sg_len, i) {
+		if (direction == DMA_TO_DEVICE)
+			ret = edma_config_pset(echan, &edesc->pset[i],
+					sg_dma_address(sg), dev_addr, burst,
+					dev_width, sg_dma_len(sg), direction);
+		else
+			ret = edma_config_pset(echan, &edesc->pset[i],
+					dev_addr, sg_dma_address(sg), burst,
+					dev_width, sg_dma_len(sg), direction);
+		if (ret)
+			goto err;
+	}
+
+	return &edesc->txd;
+
+err:
+	spin_lock_irqsave(&echan->lock, flags);
+	edma_desc_put(echan, edesc);
+	spin_unlock_irqrestore(&echan->lock, flags);
+	return NULL;
+}
+
+static struct dma_async_tx_descriptor *edma_prep_dma_cyclic(
+	struct dma_chan *chan, dma_addr_t buf_addr, size_t buf_len,
+	size_t period_len, enum dma_data_direction direction)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	struct edma_desc *edesc;
+	dma_addr_t dev_addr, addr = buf_addr;
+	int dev_width, i, ret, nperiods;
+	unsigned long flags;
+	u32 burst;
+
+	if (unlikely(!echan || !buf_len || !period_len))
+		return NULL;
+
+	if (edma_slave_params(echan, direction, &dev_addr, &dev_width, &burst))
+		return NULL;
+
+	nperiods = buf_len / period_len;
+	if (buf_len % period_len || nperiods > EDMA_MAX_CYCLIC) {
+		dev_err(chan->device->dev, "%zu/%zu: bad cyclic period\n",
+			buf_len, period_len);
+		return NULL;
+	}
+
+	edesc = edma_desc_get(echan, nperiods, DMA_PREP_INTERRUPT);
+	if (!edesc)
+		return NULL;
+	edesc->cyclic = true;
+
+	for (i = 0; i < nperiods; i++, addr += period_len) {
+		if (direction == DMA_TO_DEVICE)
+			ret = edma_config_pset(echan, &edesc->pset[i],
+					addr, dev_addr, burst, dev_width,
+					period_len, direction);
+		else
+			ret = edma_config_pset(echan, &edesc->pset[i],
+					dev_addr, addr, burst, dev_width,
+					period_len, direction);
+		if (ret)
+			goto err;
+	}
+
+	return &edesc->txd;
+
+err:
+	spin_lock_irqsave(&echan->lock, flags);
+	edma_desc_put(echan, edesc);
+	spin_unlock_irqrestore(&echan->lock, flags);
+	return NULL;
+}
+
+/* Bytes a single AB synchronized set moves out of @len */
+static inline size_t edma_memcpy_len(size_t len)
+{
+	if (len > EDMA_MAX_CNT)
+		return min_t(size_t, len / EDMA_MEMCPY_ACNT, EDMA_MAX_CNT) *
+			EDMA_MEMCPY_ACNT;
+	return len;
+}
+
+static void edma_memcpy_pset(struct edma_chan *echan, struct edma_pset *pset,
+		dma_addr_t dest, dma_addr_t src, size_t len)
+{
+	struct edmacc_param *param = &pset->param;
+	u32 acnt, bcnt;
+
+	if (len > EDMA_MAX_CNT) {
+		acnt = EDMA_MEMCPY_ACNT;
+		bcnt = len / acnt;
+	} else {
+		acnt = len;
+		bcnt = 1;
+	}
+
+	/* one trigger moves the whole AB synchronized set */
+	param->opt = EDMA_TCC(EDMA_CHAN_SLOT(echan->hw_ch)) | SYNCDIM;
+	param->src = src;
+	param->dst = dest;
+	param->a_b_cnt = bcnt << 16 | acnt;
+	param->ccnt = 1;
+	param->src_dst_bidx = (acnt << 16) | acnt;
+	param->src_dst_cidx = 0;
+	param->link_bcntrld = 0xffff;
+
+	pset->addr = dest;
+	pset->len = len;
+}
+
+static int edma_memcpy_nsets(size_t len)
+{
+	int nr = 0;
+
+	while (len) {
+		len -= edma_memcpy_len(len);
+		nr++;
+	}
+
+	return nr;
+}
+
+static struct dma_async_tx_descriptor *edma_prep_dma_memcpy(
+	struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
+	size_t len, unsigned long tx_flags)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	struct edma_desc *edesc;
+	unsigned long flags;
+	int i, nr;
+
+	if (unlikely(!echan || !len))
+		return NULL;
+
+	nr = edma_memcpy_nsets(len);
+	edesc = edma_desc_get(echan, nr, tx_flags);
+	if (!edesc)
+		return NULL;
+	edesc->memcpy = true;
+
+	if (edma_pool_get(&echan->ecc->pool, edesc))
+		goto err;
+
+	for (i = 0; i < nr; i++) {
+		size_t done = edma_memcpy_len(len);
+
+		edma_memcpy_pset(echan, &edesc->pset[i], dest, src, done);
+		src += done;
+		dest += done;
+		len -= done;
+	}
+
+	return &edesc->txd;
+
+err:
+	spin_lock_irqsave(&echan->lock, flags);
+	edma_desc_put(echan, edesc);
+	spin_unlock_irqrestore(&echan->lock, flags);
+	return NULL;
+}
+
+/*
+ * Walk both scatterlists and split the copy in sets that never cross an
+ * entry of either list. Only counts the sets when @edesc is NULL.
+ */
+static int edma_sg_sets(struct edma_chan *echan, struct edma_desc *edesc,
+		struct scatterlist *dst_sg, unsigned int dst_nents,
+		struct scatterlist *src_sg, unsigned int src_nents,
+		size_t *total)
+{
+	size_t dst_avail, src_avail, len, done;
+	dma_addr_t dst, src;
+	int nr = 0;
+
+	dst = sg_dma_address(dst_sg);
+	dst_avail = sg_dma_len(dst_sg);
+	src = sg_dma_address(src_sg);
+	src_avail = sg_dma_len(src_sg);
+	*total = 0;
+
+	for (;;) {
+		len = min(dst_avail, src_avail);
+		while (len) {
+			done = edma_memcpy_len(len);
+			if (edesc)
+				edma_memcpy_pset(echan, &edesc->pset[nr],
+						 dst, src, done);
+			nr++;
+			dst += done;
+			src += done;
+			len -= done;
+			dst_avail -= done;
+			src_avail -= done;
+			*total += done;
+		}
+
+		if (!dst_avail) {
+			if (--dst_nents == 0)
+				break;
+			dst_sg = sg_next(dst_sg);
+			dst = sg_dma_address(dst_sg);
+			dst_avail = sg_dma_len(dst_sg);
+		}
+
+		if (!src_avail) {
+			if (--src_nents == 0)
+				break;
+			src_sg = sg_next(src_sg);
+			src = sg_dma_address(src_sg);
+			src_avail = sg_dma_len(src_sg);
+		}
+	}
+
+	return nr;
+}
+
+static struct dma_async_tx_descriptor *edma_prep_dma_sg(
+	struct dma_chan *chan,
+	struct scatterlist *dst_sg, unsigned int dst_nents,
+	struct scatterlist *src_sg, unsigned int src_nents,
+	unsigned long tx_flags)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	struct edma_desc *edesc;
+	unsigned long flags;
+	size_t total;
+	int nr;
+
+	if (unlikely(!echan || !dst_nents || !src_nents))
+		return NULL;
+
+	nr = edma_sg_sets(echan, NULL, dst_sg, dst_nents, src_sg, src_nents,
+			  &total);
+	if (!nr)
+		return NULL;
+
+	edesc = edma_desc_get(echan, nr, tx_flags);
+	if (!edesc)
+		return NULL;
+	edesc->memcpy = true;
+
+	if (edma_pool_get(&echan->ecc->pool, edesc))
+		goto err;
+
+	edma_sg_sets(echan, edesc, dst_sg, dst_nents, src_sg, src_nents,
+		     &total);
+
+	return &edesc->txd;
+
+err:
+	spin_lock_irqsave(&echan->lock, flags);
+	edma_desc_put(echan, edesc);
+	spin_unlock_irqrestore(&echan->lock, flags);
+	return NULL;
+}
+
+static void edma_issue_pending(struct dma_chan *chan)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&echan->lock, flags);
+	list_splice_tail_init(&echan->queued, &echan->issued);
+	if (!echan->active)
+		edma_execute(echan);
+	spin_unlock_irqrestore(&echan->lock, flags);
+}
+
+/* Bytes left in the active descriptor, called with echan->lock held */
+static u32 edma_residue(struct edma_chan *echan)
+{
+	struct edma_desc *edesc = echan->active;
+	dma_addr_t src, dst, pos;
+	int i, first, last;
+	u32 residue = 0;
+
+	edma_get_position(echan->hw_ch, &src, &dst);
+
+	first = edesc->cyclic ? 0 : edesc->processed;
+	last = edesc->cyclic ? edesc->pset_nr : first + edesc->batch;
+
+	for (i = first; i < last; i++) {
+		struct edma_pset *pset = &edesc->pset[i];
+
+		pos = (pset->addr == pset->param.src) ? src : dst;
+		if (pos >= pset->addr && pos < pset->addr + pset->len) {
+			residue = pset->addr + pset->len - pos;
+			break;
+		}
+	}
+
+	/* whatever follows the set in flight */
+	for (i++; i < edesc->pset_nr; i++)
+		residue += edesc->pset[i].len;
+
+	return residue;
+}
+
+static enum dma_status edma_tx_status(struct dma_chan *chan,
+				      dma_cookie_t cookie,
+				      struct dma_tx_state *txstate)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	dma_cookie_t last_used, last_completed;
+	enum dma_status ret;
+	unsigned long flags;
+	u32 residue = 0;
+
+	spin_lock_irqsave(&echan->lock, flags);
+
+	last_used = chan->cookie;
+	last_completed = echan->last_completed;
+
+	ret = dma_async_is_complete(cookie, last_completed, last_used);
+	if (ret == DMA_SUCCESS && cookie == echan->last_error) {
+		ret = DMA_ERROR;
+	} else if (ret != DMA_SUCCESS) {
+		if (echan->active && echan->active->txd.cookie == cookie) {
+			residue = edma_residue(echan);
+			if (echan->status == DMA_PAUSED)
+				ret = DMA_PAUSED;
+		}
+	}
+
+	spin_unlock_irqrestore(&echan->lock, flags);
+
+	dma_set_tx_state(txstate, last_completed, last_used, residue);
+
+	return ret;
+}
+
+/*
+ * Take the memcpy slot pool for the first memcpy channel, out of what the
+ * other users of PaRAM left over. Called under the dmaengine list mutex.
+ */
+static void edma_pool_fill(struct edma_cc *ecc)
+{
+	struct edma_slot_pool *pool = &ecc->pool;
+	int i, ret;
+
+	if (pool->users++)
+		return;
+
+	for (i = 0; i < memcpy_slots; i++) {
+		ret = edma_alloc_slot(ecc->ctlr, EDMA_SLOT_ANY);
+		if (ret < 0)
+			break;
+		pool->slot[i] = ret;
+	}
+	bitmap_zero(pool->used, memcpy_slots);
+	pool->nr = pool->nr_free = i;
+
+	dev_dbg(ecc->dma_memcpy.dev, "%d chained memcpy slots\n", pool->nr);
+}
+
+/* Give the pool back with the last memcpy channel */
+static void edma_pool_drain(struct edma_cc *ecc)
+{
+	struct edma_slot_pool *pool = &ecc->pool;
+	int i;
+
+	if (--pool->users)
+		return;
+
+	WARN_ON(pool->nr_free != pool->nr);
+	for (i = 0; i < pool->nr; i++)
+		edma_free_slot(pool->slot[i]);
+	pool->nr = pool->nr_free = 0;
+}
+
+static int edma_alloc_chan_resources(struct dma_chan *chan)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	struct device *dev = chan->device->dev;
+	int ret, i, ctlr = echan->ecc->ctlr;
+
+	if (echan->memcpy_chan) {
+		/* any channel without an event will do */
+		ret = edma_alloc_channel(EDMA_CHANNEL_ANY, edma_callback,
+					 echan, echan->queue);
+		if (ret >= 0 && EDMA_CTLR(ret) != ctlr) {
+			edma_free_channel(ret);
+			ret = -EBUSY;
+		}
+	} else {
+		ret = edma_alloc_channel(echan->ch_num, edma_callback, echan,
+					 EVENTQ_DEFAULT);
+	}
+	if (ret < 0) {
+		dev_err(dev, "Can't allocate EDMA channel %d\n",
+			echan->ch_num);
+		return ret;
+	}
+
+	/* xbar events may end up on a different channel */
+	echan->hw_ch = ret;
+	echan->slot[0] = echan->hw_ch;
+	echan->alloced = true;
+
+	/* memcpy chains come from the shared pool */
+	echan->nr_slots = echan->memcpy_chan ? 1 : EDMA_MAX_SLOTS;
+	if (echan->memcpy_chan)
+		edma_pool_fill(echan->ecc);
+
+	for (i = 1; i < echan->nr_slots; i++) {
+		ret = edma_alloc_slot(ctlr, EDMA_SLOT_ANY);
+		if (ret < 0) {
+			dev_err(dev, "Can't allocate PaRAM slot\n");
+			goto err_slots;
+		}
+		echan->slot[i] = ret;
+	}
+
+	echan->chan.cookie = 1;
+	echan->last_completed = 1;
+	echan->last_error = 0;
+	echan->status = DMA_SUCCESS;
+
+	dev_dbg(dev, "allocated channel for %u:%u\n",
+		EDMA_CTLR(echan->hw_ch), EDMA_CHAN_SLOT(echan->hw_ch));
+
+	return 0;
+
+err_slots:
+	while (--i > 0)
+		edma_free_slot(echan->slot[i]);
+	edma_free_channel(echan->hw_ch);
+	echan->alloced = false;
+	return ret;
+}
+
+static void edma_free_chan_resources(struct dma_chan *chan)
+{
+	struct edma_chan *echan = to_edma_chan(chan);
+	struct edma_desc *edesc, *tmp;
+	int i;
+
+	edma_terminate_all(echan);
+	tasklet_kill(&echan->tasklet);
+
+	list_for_each_entry_safe(edesc, tmp, &echan->completed, node) {
+		list_del(&edesc->node);
+		if (edesc->pooled)
+			edma_pool_put(&echan->ecc->pool, edesc);
+		kfree(edesc);
+	}
+	list_for_each_entry_safe(edesc, tmp, &echan->unacked, node) {
+		list_del(&edesc->node);
+		kfree(edesc);
+	}
+	list_for_each_entry_safe(edesc, tmp, &echan->free, node) {
+		list_del(&edesc->node);
+		kfree(edesc);
+	}
+	echan->nr_free = 0;
+
+	if (echan->alloced) {
+		for (i = 1; i < echan->nr_slots; i++)
+			edma_free_slot(echan->slot[i]);
+		edma_free_channel(echan->hw_ch);
+		echan->alloced = false;
+		if (echan->memcpy_chan)
+			edma_pool_drain(echan->ecc);
+	}
+
+	dev_dbg(chan->device->dev, "freeing channel for %u\n", echan->ch_num);
+}
+
+static void __devinit edma_chan_init(struct edma_cc *ecc,
+				     struct dma_device *dma,
+				     struct edma_chan *echans, int nchans)
+{
+	int i;
+
+	for (i = 0; i < nchans; i++) {
+		struct edma_chan *echan = &echans[i];
+
+		echan->ecc = ecc;
+		if (dma == &ecc->dma_memcpy) {
+			echan->memcpy_chan = true;
+			echan->ch_num = EDMA_CHANNEL_ANY;
+			echan->queue = i % edma_cc[ecc->ctlr]->num_tc;
+		} else {
+			echan->ch_num = EDMA_CTLR_CHAN(ecc->ctlr, i);
+		}
+		echan->chan.device = dma;
+		spin_lock_init(&echan->lock);
+		INIT_LIST_HEAD(&echan->queued);
+		INIT_LIST_HEAD(&echan->issued);
+		INIT_LIST_HEAD(&echan->completed);
+		INIT_LIST_HEAD(&echan->unacked);
+		INIT_LIST_HEAD(&echan->free);
+		tasklet_init(&echan->tasklet, edma_tasklet,
+			     (unsigned long)echan);
+
+		list_add_tail(&echan->chan.device_node, &dma->channels);
+	}
+}
+
+static void edma_dma_init(struct edma_cc *ecc, struct dma_device *dma,
+			  struct device *dev)
+{
+	dma->device_prep_slave_sg = edma_prep_slave_sg;
+	dma->device_prep_dma_cyclic = edma_prep_dma_cyclic;
+	dma->device_prep_dma_memcpy = edma_prep_dma_memcpy;
+	dma->device_prep_dma_sg = edma_prep_dma_sg;
+	dma->device_alloc_chan_resources = edma_alloc_chan_resources;
+	dma->device_free_chan_resources = edma_free_chan_resources;
+	dma->device_issue_pending = edma_issue_pending;
+	dma->device_tx_status = edma_tx_status;
+	dma->device_control = edma_control;
+	dma->dev = dev;
+
+	INIT_LIST_HEAD(&dma->channels);
+}
+
+static int __devinit edma_probe(struct platform_device *pdev)
+{
+	struct edma_cc *ecc;
+	int ret;
+
+	if (pdev->id >= EDMA_CTLRS || !edma_cc[pdev->id])
+		return -ENODEV;
+
+	ecc = devm_kzalloc(&pdev->dev, sizeof(*ecc), GFP_KERNEL);
+	if (!ecc) {
+		dev_err(&pdev->dev, "Can't allocate controller\n");
+		return -ENOMEM;
+	}
+
+	ecc->ctlr = pdev->id;
+	ecc->num_slave_chans = min_t(unsigned, edma_cc[ecc->ctlr]->num_channels,
+				     EDMA_CHANS);
+
+	ecc->num_memcpy_chans = min_t(unsigned, memcpy_channels,
+				      EDMA_MAX_MEMCPY_CHANS);
+
+	dma_cap_zero(ecc->dma_slave.cap_mask);
+	dma_cap_set(DMA_SLAVE, ecc->dma_slave.cap_mask);
+	dma_cap_set(DMA_CYCLIC, ecc->dma_slave.cap_mask);
+
+	edma_dma_init(ecc, &ecc->dma_slave, &pdev->dev);
+
+	edma_chan_init(ecc, &ecc->dma_slave, ecc->slave_chans,
+		       ecc->num_slave_chans);
+
+	ret = dma_async_device_register(&ecc->dma_slave);
+	if (ret)
+		return ret;
+
+	if (ecc->num_memcpy_chans) {
+		struct edma_slot_pool *pool = &ecc->pool;
+
+		spin_lock_init(&pool->lock);
+		pool->slot = devm_kzalloc(&pdev->dev,
+					  memcpy_slots * sizeof(*pool->slot),
+					  GFP_KERNEL);
+		pool->used = devm_kzalloc(&pdev->dev,
+					  BITS_TO_LONGS(memcpy_slots) *
+					  sizeof(long), GFP_KERNEL);
+		if (!pool->slot || !pool->used) {
+			ret = -ENOMEM;
+			goto err_memcpy;
+		}
+
+		dma_cap_zero(ecc->dma_memcpy.cap_mask);
+		dma_cap_set(DMA_MEMCPY, ecc->dma_memcpy.cap_mask);
+		dma_cap_set(DMA_SG, ecc->dma_memcpy.cap_mask);
+
+		edma_dma_init(ecc, &ecc->dma_memcpy, &pdev->dev);
+
+		edma_chan_init(ecc, &ecc->dma_memcpy, ecc->memcpy_chans,
+			       ecc->num_memcpy_chans);
+
+		ret = dma_async_device_register(&ecc->dma_memcpy);
+		if (ret)
+			goto err_memcpy;
+	}
+
+	platform_set_drvdata(pdev, ecc);
+
+	dev_info(&pdev->dev, "TI EDMA DMA engine driver, %d memcpy channels\n",
+		 ecc->num_memcpy_chans);
+
+	return 0;
+
+err_memcpy:
+	dma_async_device_unregister(&ecc->dma_slave);
+	return ret;
+}
+
+static int __devexit edma_remove(struct platform_device *pdev)
+{
+	struct edma_cc *ecc = platform_get_drvdata(pdev);
+
+	if (ecc->num_memcpy_chans)
+		dma_async_device_unregister(&ecc->dma_memcpy);
+	dma_async_device_unregister(&ecc->dma_slave);
+
+	return 0;
+}
+
+static struct platform_driver edma_driver = {
+	.probe		= edma_probe,
+	.remove		= __devexit_p(edma_remove),
+	.driver = {
+		.name = "edma-dma-engine",
+		.owner = THIS_MODULE,
+	},
+};
+
+bool edma_filter_fn(struct dma_chan *chan, void *param)
+{
+	if (chan->device->dev->driver == &edma_driver.driver) {
+		struct edma_chan *echan = to_edma_chan(chan);
+		unsigned ch_req = *(unsigned *)param;
+
+		return ch_req == echan->ch_num;
+	}
+	return false;
+}
+EXPORT_SYMBOL(edma_filter_fn);
+
+static struct platform_device *pdev0, *pdev1;
+
+static const struct platform_device_info edma_dev_info0 = {
+	.name = "edma-dma-engine",
+	.id = 0,
+	.dma_mask = DMA_BIT_MASK(32),
+};
+
+static const struct platform_device_info edma_dev_info1 = {
+	.name = "edma-dma-engine",
+	.id = 1,
+	.dma_mask = DMA_BIT_MASK(32),
+};
+
+static int edma_init(void)
+{
+	int ret = platform_driver_register(&edma_driver);
+
+	if (ret)
+		return ret;
+
+	pdev0 = platform_device_register_full(
+			(struct platform_device_info *)&edma_dev_info0);
+	if (IS_ERR(pdev0)) {
+		ret = PTR_ERR(pdev0);
+		goto err_pdev0;
+	}
+
+	if (edma_cc[1]) {
+		pdev1 = platform_device_register_full(
+				(struct platform_device_info *)&edma_dev_info1);
+		if (IS_ERR(pdev1)) {
+			ret = PTR_ERR(pdev1);
+			pdev1 = NULL;
+			goto err_pdev1;
+		}
+	}
+
+	return 0;
+
+err_pdev1:
+	platform_device_unregister(pdev0);
+err_pdev0:
+	platform_driver_unregister(&edma_driver);
+	return ret;
+}
+subsys_initcall(edma_init);
+
+static void __exit edma_exit(void)
+{
+	if (pdev1)
+		platform_device_unregister(pdev1);
+	platform_device_unregister(pdev0);
+	platform_driver_unregister(&edma_driver);
+}
+module_exit(edma_exit);
+
+MODULE_AUTHOR("Texas Instruments");
+MODULE_DESCRIPTION("TI EDMA DMA engine driver");
+MODULE_LICENSE("GPL v2");
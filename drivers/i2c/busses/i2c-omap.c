@@ -40,6 +40,13 @@
 #include <linux/slab.h>
 #include <linux/i2c-omap.h>
 #include <linux/pm_runtime.h>
+#include <linux/dma-mapping.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+
+#ifdef CONFIG_OMAP3_EDMA
+#include <mach/edma.h>
+#endif
 
 /* I2C controller revisions */
 #define OMAP_I2C_OMAP1_REV_2		0x20
@@ -52,6 +59,12 @@
 /* timeout waiting for the controller to respond */
 #define OMAP_I2C_TIMEOUT (msecs_to_jiffies(1000))
 
+/* default length from which messages use the DMA, tunable through sysfs */
+#define OMAP_I2C_DMA_MIN_BYTES		64
+
+/* transfer latency histogram: bucket N counts transfers under 2^N usecs */
+#define OMAP_I2C_LAT_BUCKETS		20
+
 /* For OMAP3 I2C_IV has changed to I2C_WE (wakeup enable) */
 enum {
 	OMAP_I2C_REV_REG = 0,
@@ -172,9 +185,18 @@ enum {
 #define I2C_OMAP_ERRATA_I207		(1 << 0)
 #define I2C_OMAP3_1P153			(1 << 1)
 
+struct omap_i2c_stats {
+	u32			transfers;
+	u32			dma_msgs;
+	u32			chained_msgs;	/* started in ISR */
+	u32			lat_max_us;
+	u32			lat_hist[OMAP_I2C_LAT_BUCKETS];
+};
+
 struct omap_i2c_dev {
 	struct device		*dev;
 	void __iomem		*base;		/* virtual */
+	unsigned long		phys_base;
 	int			irq;
 	int			reg_shift;      /* bit shift for I2C register addresses */
 	struct completion	cmd_complete;
@@ -187,6 +209,19 @@ struct omap_i2c_dev {
 	u8			*buf;
 	u8			*regs;
 	size_t			buf_len;
+	struct i2c_msg		*msgs;		/* in flight */
+	int			msgs_num;
+	int			msg_idx;	/* message on the bus */
+	int			dma_rx_ch;	/* -1 if none */
+	int			dma_tx_ch;
+	int			dma_ch;		/* in use or -1 */
+	dma_addr_t		dma_addr;
+	u16			dma_len;
+	u16			dma_status;
+	unsigned		dma_min_bytes;
+	u8			dma_tail[32];	/* RX tail of a DMA message */
+	struct completion	dma_complete;
+	struct omap_i2c_stats	stats;
 	struct i2c_adapter	adapter;
 	u8			fifo_size;	/* use as flag and value
 						 * fifo_size==0 implies no fifo
@@ -513,37 +548,231 @@ static int omap_i2c_wait_for_bb(struct omap_i2c_dev *dev)
 }
 
 /*
- * Low level master read/write transaction.
+ * The DMA serves the RRDY/XRDY events of the messages it moves, while the
+ * CPU still handles the RDR/XDR drain events for their tail.
  */
-static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
-			     struct i2c_msg *msg, int stop)
+static void omap_i2c_dma_irqs(struct omap_i2c_dev *dev, int dma)
 {
-	struct omap_i2c_dev *dev = i2c_get_adapdata(adap);
-	int r;
+	struct omap_i2c_bus_platform_data *pdata = dev->dev->platform_data;
+	u16 rdy = OMAP_I2C_IE_RRDY | OMAP_I2C_IE_XRDY;
+
+	if (!dma)
+		omap_i2c_write_reg(dev, OMAP_I2C_IE_REG, dev->iestate);
+	else if (pdata->rev == OMAP_I2C_IP_VERSION_2)
+		omap_i2c_write_reg(dev, OMAP_I2C_IP_V2_IRQENABLE_CLR, rdy);
+	else
+		omap_i2c_write_reg(dev, OMAP_I2C_IE_REG, dev->iestate & ~rdy);
+}
+
+static bool omap_i2c_dma_wanted(struct omap_i2c_dev *dev, struct i2c_msg *msg)
+{
+	int ch = (msg->flags & I2C_M_RD) ? dev->dma_rx_ch : dev->dma_tx_ch;
+
+	return ch >= 0 && msg->len >= dev->dma_min_bytes &&
+		msg->len >= dev->fifo_size &&
+		virt_addr_valid(msg->buf) && !object_is_on_stack(msg->buf);
+}
+
+#ifdef CONFIG_OMAP3_EDMA
+static void omap_i2c_dma_callback(unsigned lch, u16 ch_status, void *data)
+{
+	struct omap_i2c_dev *dev = data;
+
+	dev->dma_status = ch_status;
+	complete(&dev->dma_complete);
+}
+
+/*
+ * Let the EDMA move the FIFO threshold sized chunks of @msg, one chunk per
+ * DMA request of the controller; the tail shorter than the threshold is left
+ * to the drain interrupts.  Returns 0 if the DMA is armed.
+ */
+static int omap_i2c_dma_map(struct omap_i2c_dev *dev, struct i2c_msg *msg)
+{
+	struct edmacc_param param;
+	unsigned long data_reg;
+	u16 thrsh = dev->fifo_size;
+	int rd = msg->flags & I2C_M_RD;
+	int ch = rd ? dev->dma_rx_ch : dev->dma_tx_ch;
+
+	dev->dma_len = msg->len - msg->len % thrsh;
+	dev->dma_addr = dma_map_single(dev->dev, msg->buf, dev->dma_len,
+				       rd ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	if (dma_mapping_error(dev->dev, dev->dma_addr)) {
+		dev->dma_len = 0;
+		return -ENOMEM;
+	}
+
+	data_reg = dev->phys_base +
+		   (dev->regs[OMAP_I2C_DATA_REG] << dev->reg_shift);
+
+	param.opt          = EDMA_TCC(EDMA_CHAN_SLOT(ch)) | TCINTEN | SYNCDIM;
+	param.a_b_cnt      = 1 | thrsh << 16;
+	if (rd) {
+		param.src          = data_reg;
+		param.dst          = dev->dma_addr;
+		param.src_dst_bidx = 1 << 16;
+		param.src_dst_cidx = thrsh << 16;
+	} else {
+		param.src          = dev->dma_addr;
+		param.dst          = data_reg;
+		param.src_dst_bidx = 1;
+		param.src_dst_cidx = thrsh;
+	}
+	param.link_bcntrld = 0xffff;
+	param.ccnt         = dev->dma_len / thrsh;
+	edma_write_slot(ch, &param);
+
+	INIT_COMPLETION(dev->dma_complete);
+	dev->dma_ch = ch;
+	edma_start(ch);
+
+	return 0;
+}
+
+/*
+ * Wait for the DMA of the current message to finish, or stop it if the
+ * message failed.  Returns 0 if the DMA moved all of its data.
+ */
+static int omap_i2c_dma_unmap(struct omap_i2c_dev *dev, struct i2c_msg *msg,
+			      int failed)
+{
+	int rd = msg->flags & I2C_M_RD;
+	int r = 0;
 	u16 w;
 
-	dev_dbg(dev->dev, "addr: 0x%04x, len: %d, flags: 0x%x, stop: %d\n",
-		msg->addr, msg->len, msg->flags, stop);
+	if (dev->dma_ch < 0)
+		return 0;
 
-	if (msg->len == 0)
-		return -EINVAL;
+	if (failed || !wait_for_completion_timeout(&dev->dma_complete,
+						   OMAP_I2C_TIMEOUT) ||
+	    dev->dma_status != DMA_COMPLETE) {
+		edma_stop(dev->dma_ch);
+		edma_clean_channel(dev->dma_ch);
+		r = -EIO;
+	}
+
+	dma_unmap_single(dev->dev, dev->dma_addr, dev->dma_len,
+			 rd ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
+
+	/*
+	 * The RX tail was drained into dma_tail, as the unmap invalidates the
+	 * cacheline it shares with the end of the DMA area.
+	 */
+	if (rd)
+		memcpy(msg->buf + dev->dma_len, dev->dma_tail,
+		       msg->len - dev->dma_len);
+
+	w = omap_i2c_read_reg(dev, OMAP_I2C_BUF_REG);
+	w &= ~(OMAP_I2C_BUF_RDMA_EN | OMAP_I2C_BUF_XDMA_EN);
+	omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, w);
+	omap_i2c_dma_irqs(dev, 0);
+
+	dev->dma_ch = -1;
+	dev->dma_len = 0;
+
+	return r;
+}
+
+/* Returns the allocated channel, -1 if none is wired up, or an error code */
+static int omap_i2c_dma_chan(struct omap_i2c_dev *dev,
+			     struct platform_device *pdev, const char *name)
+{
+	struct resource *res;
+
+	res = platform_get_resource_byname(pdev, IORESOURCE_DMA, name);
+	if (!res || !res->start)
+		return -1;
+
+	return edma_alloc_channel(res->start, omap_i2c_dma_callback, dev,
+				  EVENTQ_2);
+}
+
+static void omap_i2c_dma_release(struct omap_i2c_dev *dev)
+{
+	if (dev->dma_rx_ch >= 0)
+		edma_free_channel(dev->dma_rx_ch);
+	if (dev->dma_tx_ch >= 0)
+		edma_free_channel(dev->dma_tx_ch);
+	dev->dma_rx_ch = -1;
+	dev->dma_tx_ch = -1;
+}
+
+/*
+ * Both directions go through the EDMA or none does.  The 16-bit data
+ * register of the older IPs and the 1P153 erratum leave the FIFO to the CPU.
+ */
+static void omap_i2c_dma_request(struct omap_i2c_dev *dev,
+				 struct platform_device *pdev)
+{
+	struct omap_i2c_bus_platform_data *pdata = pdev->dev.platform_data;
+
+	if (!dev->fifo_size || dev->fifo_size > sizeof(dev->dma_tail) ||
+	    (pdata->flags & OMAP_I2C_FLAG_16BIT_DATA_REG) ||
+	    (dev->errata & I2C_OMAP3_1P153))
+		return;
+
+	dev->dma_rx_ch = omap_i2c_dma_chan(dev, pdev, "rx");
+	dev->dma_tx_ch = omap_i2c_dma_chan(dev, pdev, "tx");
+	if (dev->dma_rx_ch < 0 || dev->dma_tx_ch < 0) {
+		if (dev->dma_rx_ch != -1 || dev->dma_tx_ch != -1)
+			dev_warn(dev->dev, "no EDMA channels, using PIO\n");
+		omap_i2c_dma_release(dev);
+	}
+}
+#else
+static inline void omap_i2c_dma_request(struct omap_i2c_dev *dev,
+					struct platform_device *pdev)
+{
+}
+
+static inline void omap_i2c_dma_release(struct omap_i2c_dev *dev)
+{
+}
+
+static inline int omap_i2c_dma_map(struct omap_i2c_dev *dev,
+				   struct i2c_msg *msg)
+{
+	return -ENODEV;
+}
+
+static inline int omap_i2c_dma_unmap(struct omap_i2c_dev *dev,
+				     struct i2c_msg *msg, int failed)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Program the controller for @msg, the data moves during IRQ processing.
+ * This also runs in the ISR, to chain the messages of a combined transfer.
+ */
+static void omap_i2c_start_msg(struct omap_i2c_dev *dev,
+			       struct i2c_msg *msg, int stop)
+{
+	u16 w;
 
 	omap_i2c_write_reg(dev, OMAP_I2C_SA_REG, msg->addr);
 
 	/* REVISIT: Could the STB bit of I2C_CON be used with probing? */
-	dev->buf = msg->buf;
-	dev->buf_len = msg->len;
+	dev->buf = msg->buf + dev->dma_len;
+	dev->buf_len = msg->len - dev->dma_len;
+	if (dev->dma_ch >= 0 && (msg->flags & I2C_M_RD))
+		dev->buf = dev->dma_tail;
 
-	omap_i2c_write_reg(dev, OMAP_I2C_CNT_REG, dev->buf_len);
+	omap_i2c_write_reg(dev, OMAP_I2C_CNT_REG, msg->len);
 
-	/* Clear the FIFO Buffers */
+	/* Clear the FIFO Buffers, and hand the DMA requests to the EDMA */
 	w = omap_i2c_read_reg(dev, OMAP_I2C_BUF_REG);
+	w &= ~(OMAP_I2C_BUF_RDMA_EN | OMAP_I2C_BUF_XDMA_EN);
 	w |= OMAP_I2C_BUF_RXFIF_CLR | OMAP_I2C_BUF_TXFIF_CLR;
+	if (dev->dma_ch >= 0) {
+		w |= (msg->flags & I2C_M_RD) ? OMAP_I2C_BUF_RDMA_EN :
+					       OMAP_I2C_BUF_XDMA_EN;
+		omap_i2c_dma_irqs(dev, 1);
+	}
 	omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, w);
 
-	init_completion(&dev->cmd_complete);
-	dev->cmd_err = 0;
-
 	w = OMAP_I2C_CON_EN | OMAP_I2C_CON_MST | OMAP_I2C_CON_STT;
 
 	/* High speed configuration */
@@ -559,6 +788,53 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 		w |= OMAP_I2C_CON_STP;
 
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, w);
+}
+
+/*
+ * On ARDY of a message in a combined transfer, start the next one from the
+ * ISR instead of waking up the caller, so that the repeated start goes out
+ * right away.  Messages moved by DMA are set up by the caller, and so are all
+ * messages on the hardware needing STT and STP written separately.
+ */
+static bool omap_i2c_chain_next(struct omap_i2c_dev *dev)
+{
+	int idx = dev->msg_idx + 1;
+	struct i2c_msg *next = &dev->msgs[idx];
+
+	if (dev->b_hw || dev->dma_ch >= 0 || idx >= dev->msgs_num ||
+	    !next->len || omap_i2c_dma_wanted(dev, next))
+		return false;
+
+	dev->msg_idx = idx;
+	dev->stats.chained_msgs++;
+	omap_i2c_start_msg(dev, next, idx == dev->msgs_num - 1);
+
+	return true;
+}
+
+/*
+ * Low level master read/write transaction.
+ */
+static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
+			     struct i2c_msg *msg, int stop)
+{
+	struct omap_i2c_dev *dev = i2c_get_adapdata(adap);
+	int r, dma_err;
+	u16 w;
+
+	dev_dbg(dev->dev, "addr: 0x%04x, len: %d, flags: 0x%x, stop: %d\n",
+		msg->addr, msg->len, msg->flags, stop);
+
+	if (msg->len == 0)
+		return -EINVAL;
+
+	init_completion(&dev->cmd_complete);
+	dev->cmd_err = 0;
+
+	if (omap_i2c_dma_wanted(dev, msg) && !omap_i2c_dma_map(dev, msg))
+		dev->stats.dma_msgs++;
+
+	omap_i2c_start_msg(dev, msg, stop);
 
 	/*
 	 * Don't write stt and stp together on some hardware.
@@ -573,11 +849,13 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 			if (time_after(jiffies, delay)) {
 				dev_err(dev->dev, "controller timed out "
 				"waiting for start condition to finish\n");
+				omap_i2c_dma_unmap(dev, msg, 1);
 				return -ETIMEDOUT;
 			}
 			cpu_relax();
 		}
 
+		w = omap_i2c_read_reg(dev, OMAP_I2C_CON_REG);
 		w |= OMAP_I2C_CON_STP;
 		w &= ~OMAP_I2C_CON_STT;
 		omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, w);
@@ -590,6 +868,12 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 	r = wait_for_completion_timeout(&dev->cmd_complete,
 					OMAP_I2C_TIMEOUT);
 	dev->buf_len = 0;
+	dma_err = omap_i2c_dma_unmap(dev, msg, r <= 0 || dev->cmd_err);
+
+	/* The ISR may have gone on with the next messages */
+	msg = &dev->msgs[dev->msg_idx];
+	stop = (dev->msg_idx == dev->msgs_num - 1);
+
 	if (r < 0)
 		return r;
 	if (r == 0) {
@@ -599,7 +883,7 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 	}
 
 	if (likely(!dev->cmd_err))
-		return 0;
+		return dma_err;
 
 	/* We have an error */
 	if (dev->cmd_err & (OMAP_I2C_STAT_AL | OMAP_I2C_STAT_ROVR |
@@ -621,6 +905,16 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 	return -EIO;
 }
 
+static void omap_i2c_account(struct omap_i2c_dev *dev, ktime_t start)
+{
+	struct omap_i2c_stats *stats = &dev->stats;
+	u32 us = ktime_us_delta(ktime_get(), start);
+
+	stats->transfers++;
+	stats->lat_hist[min(fls(us), OMAP_I2C_LAT_BUCKETS - 1)]++;
+	if (us > stats->lat_max_us)
+		stats->lat_max_us = us;
+}
 
 /*
  * Prepare controller for a transaction and call omap_i2c_xfer_msg
@@ -630,6 +924,7 @@ static int
 omap_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 {
 	struct omap_i2c_dev *dev = i2c_get_adapdata(adap);
+	ktime_t start = ktime_get();
 	int i;
 	int r;
 
@@ -642,11 +937,15 @@ omap_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 	if (dev->set_mpu_wkup_lat != NULL)
 		dev->set_mpu_wkup_lat(dev->dev, dev->latency);
 
-	for (i = 0; i < num; i++) {
+	dev->msgs = msgs;
+	dev->msgs_num = num;
+	for (i = 0; i < num; i = dev->msg_idx + 1) {
+		dev->msg_idx = i;
 		r = omap_i2c_xfer_msg(adap, &msgs[i], (i == (num - 1)));
 		if (r != 0)
 			break;
 	}
+	dev->msgs_num = 0;
 
 	if (dev->set_mpu_wkup_lat != NULL)
 		dev->set_mpu_wkup_lat(dev->dev, -1);
@@ -657,6 +956,7 @@ omap_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 	omap_i2c_wait_for_bb(dev);
 out:
 	pm_runtime_put(dev->dev);
+	omap_i2c_account(dev, start);
 	return r;
 }
 
@@ -846,6 +1146,8 @@ complete:
 				(OMAP_I2C_STAT_RRDY | OMAP_I2C_STAT_RDR |
 				OMAP_I2C_STAT_XRDY | OMAP_I2C_STAT_XDR |
 				OMAP_I2C_STAT_ARDY));
+			if (!err && !dev->cmd_err && omap_i2c_chain_next(dev))
+				return IRQ_HANDLED;
 			omap_i2c_complete_cmd(dev, err);
 			return IRQ_HANDLED;
 		}
@@ -958,6 +1260,84 @@ complete:
 	return count ? IRQ_HANDLED : IRQ_NONE;
 }
 
+static ssize_t omap_i2c_dma_min_bytes_show(struct device *d,
+		struct device_attribute *attr, char *buf)
+{
+	struct omap_i2c_dev *dev = dev_get_drvdata(d);
+
+	return sprintf(buf, "%u\n", dev->dma_min_bytes);
+}
+
+static ssize_t omap_i2c_dma_min_bytes_store(struct device *d,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct omap_i2c_dev *dev = dev_get_drvdata(d);
+	unsigned long val;
+
+	if (strict_strtoul(buf, 0, &val) || val > USHRT_MAX)
+		return -EINVAL;
+
+	i2c_lock_adapter(&dev->adapter);
+	dev->dma_min_bytes = val;
+	i2c_unlock_adapter(&dev->adapter);
+
+	return count;
+}
+
+static DEVICE_ATTR(dma_min_bytes, S_IRUGO | S_IWUSR,
+		   omap_i2c_dma_min_bytes_show, omap_i2c_dma_min_bytes_store);
+
+static ssize_t omap_i2c_latency_show(struct device *d,
+		struct device_attribute *attr, char *buf)
+{
+	struct omap_i2c_dev *dev = dev_get_drvdata(d);
+	struct omap_i2c_stats stats;
+	ssize_t len;
+	int i;
+
+	i2c_lock_adapter(&dev->adapter);
+	stats = dev->stats;
+	i2c_unlock_adapter(&dev->adapter);
+
+	len = sprintf(buf, "transfers: %u\ndma messages: %u\n"
+		      "chained messages: %u\nmax: %u us\n",
+		      stats.transfers, stats.dma_msgs, stats.chained_msgs,
+		      stats.lat_max_us);
+	for (i = 0; i < OMAP_I2C_LAT_BUCKETS - 1; i++)
+		len += sprintf(buf + len, "< %u us: %u\n", 1 << i,
+			       stats.lat_hist[i]);
+	len += sprintf(buf + len, ">= %u us: %u\n", 1 << i,
+		       stats.lat_hist[i]);
+
+	return len;
+}
+
+/* Any write resets the statistics */
+static ssize_t omap_i2c_latency_store(struct device *d,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct omap_i2c_dev *dev = dev_get_drvdata(d);
+
+	i2c_lock_adapter(&dev->adapter);
+	memset(&dev->stats, 0, sizeof(dev->stats));
+	i2c_unlock_adapter(&dev->adapter);
+
+	return count;
+}
+
+static DEVICE_ATTR(latency, S_IRUGO | S_IWUSR,
+		   omap_i2c_latency_show, omap_i2c_latency_store);
+
+static struct attribute *omap_i2c_attrs[] = {
+	&dev_attr_dma_min_bytes.attr,
+	&dev_attr_latency.attr,
+	NULL,
+};
+
+static const struct attribute_group omap_i2c_attr_group = {
+	.attrs = omap_i2c_attrs,
+};
+
 static const struct i2c_algorithm omap_i2c_algo = {
 	.master_xfer	= omap_i2c_xfer,
 	.functionality	= omap_i2c_func,
@@ -1010,6 +1390,12 @@ omap_i2c_probe(struct platform_device *pdev)
 	dev->speed = speed;
 	dev->dev = &pdev->dev;
 	dev->irq = irq->start;
+	dev->phys_base = mem->start;
+	dev->dma_rx_ch = -1;
+	dev->dma_tx_ch = -1;
+	dev->dma_ch = -1;
+	dev->dma_min_bytes = OMAP_I2C_DMA_MIN_BYTES;
+	init_completion(&dev->dma_complete);
 	dev->base = ioremap(mem->start, resource_size(mem));
 	if (!dev->base) {
 		r = -ENOMEM;
@@ -1062,6 +1448,8 @@ omap_i2c_probe(struct platform_device *pdev)
 	/* reset ASAP, clearing any IRQs */
 	omap_i2c_init(dev);
 
+	omap_i2c_dma_request(dev, pdev);
+
 	isr = (dev->rev < OMAP_I2C_OMAP1_REV_2) ? omap_i2c_omap1_isr :
 								   omap_i2c_isr;
 	r = request_irq(dev->irq, isr, 0, pdev->name, dev);
@@ -1092,11 +1480,20 @@ omap_i2c_probe(struct platform_device *pdev)
 		goto err_free_irq;
 	}
 
+	r = sysfs_create_group(&pdev->dev.kobj, &omap_i2c_attr_group);
+	if (r) {
+		dev_err(dev->dev, "failure creating sysfs attributes\n");
+		goto err_del_adapter;
+	}
+
 	return 0;
 
+err_del_adapter:
+	i2c_del_adapter(adap);
 err_free_irq:
 	free_irq(dev->irq, dev);
 err_unuse_clocks:
+	omap_i2c_dma_release(dev);
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, 0);
 	pm_runtime_put(dev->dev);
 	iounmap(dev->base);
@@ -1115,10 +1512,12 @@ omap_i2c_remove(struct platform_device *pdev)
 	struct omap_i2c_dev	*dev = platform_get_drvdata(pdev);
 	struct resource		*mem;
 
+	sysfs_remove_group(&pdev->dev.kobj, &omap_i2c_attr_group);
 	platform_set_drvdata(pdev, NULL);
 
 	free_irq(dev->irq, dev);
 	i2c_del_adapter(&dev->adapter);
+	omap_i2c_dma_release(dev);
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, 0);
 	iounmap(dev->base);
 	kfree(dev);
@@ -21,107 +21,37 @@
 #include <linux/input.h>
 #include <linux/slab.h>
 #include <linux/interrupt.h>
-#include <linux/clk.h>
 #include <linux/platform_device.h>
 #include <linux/io.h>
-#include <linux/input/ti_tscadc.h>
+#include <linux/mfd/ti_tscadc.h>
 #include <linux/delay.h>
-#include <linux/pm_runtime.h>
-
-#define TSCADC_REG_IRQEOI		0x020
-#define TSCADC_REG_RAWIRQSTATUS		0x024
-#define TSCADC_REG_IRQSTATUS		0x028
-#define TSCADC_REG_IRQENABLE		0x02C
-#define TSCADC_REG_IRQCLR		0x030
-#define TSCADC_REG_IRQWAKEUP		0x034
-#define TSCADC_REG_CTRL			0x040
-#define TSCADC_REG_ADCFSM		0x044
-#define TSCADC_REG_CLKDIV		0x04C
-#define TSCADC_REG_SE			0x054
-#define TSCADC_REG_IDLECONFIG		0x058
-#define TSCADC_REG_CHARGECONFIG		0x05C
-#define TSCADC_REG_CHARGEDELAY		0x060
-#define TSCADC_REG_STEPCONFIG(n)	(0x64 + ((n-1) * 8))
-#define TSCADC_REG_STEPDELAY(n)		(0x68 + ((n-1) * 8))
-#define TSCADC_REG_STEPCONFIG13		0x0C4
-#define TSCADC_REG_STEPDELAY13		0x0C8
-#define TSCADC_REG_STEPCONFIG14		0x0CC
-#define TSCADC_REG_STEPDELAY14		0x0D0
-#define TSCADC_REG_FIFO0CNT		0xE4
-#define TSCADC_REG_FIFO0THR		0xE8
-#define TSCADC_REG_FIFO1CNT		0xF0
-#define TSCADC_REG_FIFO1THR		0xF4
-#define TSCADC_REG_FIFO0		0x100
-#define TSCADC_REG_FIFO1		0x200
-
-/*	Register Bitfields	*/
-#define TSCADC_IRQWKUP_ENB		BIT(0)
-#define TSCADC_IRQWKUP_DISABLE		0x00
-#define TSCADC_STPENB_STEPENB		0x7FFF
-#define TSCADC_IRQENB_FIFO0THRES	BIT(2)
-#define TSCADC_IRQENB_FIFO1THRES	BIT(5)
-#define TSCADC_IRQENB_PENUP		BIT(9)
-#define TSCADC_IRQENB_HW_PEN		BIT(0)
-#define TSCADC_STEPCONFIG_MODE_HWSYNC	0x2
-#define TSCADC_STEPCONFIG_2SAMPLES_AVG	(1 << 4)
-#define TSCADC_STEPCONFIG_XPP		BIT(5)
-#define TSCADC_STEPCONFIG_XNN		BIT(6)
-#define TSCADC_STEPCONFIG_YPP		BIT(7)
-#define TSCADC_STEPCONFIG_YNN		BIT(8)
-#define TSCADC_STEPCONFIG_XNP		BIT(9)
-#define TSCADC_STEPCONFIG_YPN		BIT(10)
-#define TSCADC_STEPCONFIG_RFP		(1 << 12)
-#define TSCADC_STEPCONFIG_INM		(1 << 18)
-#define TSCADC_STEPCONFIG_INP_4		(1 << 19)
-#define TSCADC_STEPCONFIG_INP		(1 << 20)
-#define TSCADC_STEPCONFIG_INP_5		(1 << 21)
-#define TSCADC_STEPCONFIG_FIFO1		(1 << 26)
-#define TSCADC_STEPCONFIG_IDLE_INP	(1 << 22)
-#define TSCADC_STEPCONFIG_OPENDLY	0x018
-#define TSCADC_STEPCONFIG_SAMPLEDLY	0x88
-#define TSCADC_STEPCONFIG_Z1		(3 << 19)
-#define TSCADC_STEPCHARGE_INM_SWAP	BIT(16)
-#define TSCADC_STEPCHARGE_INM		BIT(15)
-#define TSCADC_STEPCHARGE_INP_SWAP	BIT(20)
-#define TSCADC_STEPCHARGE_INP		BIT(19)
-#define TSCADC_STEPCHARGE_RFM		(1 << 23)
-#define TSCADC_STEPCHARGE_DELAY		0x1
-#define TSCADC_CNTRLREG_TSCSSENB	BIT(0)
-#define TSCADC_CNTRLREG_STEPID		BIT(1)
-#define TSCADC_CNTRLREG_STEPCONFIGWRT	BIT(2)
-#define TSCADC_CNTRLREG_POWERDOWN	BIT(4)
-#define TSCADC_CNTRLREG_TSCENB		BIT(7)
-#define TSCADC_CNTRLREG_4WIRE		(0x1 << 5)
-#define TSCADC_CNTRLREG_5WIRE		(0x1 << 6)
-#define TSCADC_CNTRLREG_8WIRE		(0x3 << 5)
-#define TSCADC_ADCFSM_STEPID		0x10
-#define TSCADC_ADCFSM_FSM		BIT(5)
-
-#define ADC_CLK				3000000
 
 #define MAX_12BIT                       ((1 << 12) - 1)
 
 int pen = 1;
 unsigned int bckup_x = 0, bckup_y = 0;
 
+#define TSC_DEFAULT_STEPS		6
+
 struct tscadc {
 	struct input_dev	*input;
+	struct ti_tscadc_dev	*mfd_tscadc;
 	int			wires;
 	int			x_plate_resistance;
+	int			steps_to_configure;
+	u32			step_mask;
 	int			irq;
-	void __iomem		*tsc_base;
-	unsigned int		ctrl;
 };
 
 static unsigned int tscadc_readl(struct tscadc *ts, unsigned int reg)
 {
-	return readl(ts->tsc_base + reg);
+	return readl(ts->mfd_tscadc->tscadc_base + reg);
 }
 
 static void tscadc_writel(struct tscadc *tsc, unsigned int reg,
 					unsigned int val)
 {
-	writel(val, tsc->tsc_base + reg);
+	writel(val, tsc->mfd_tscadc->tscadc_base + reg);
 }
 
 static void tsc_step_config(struct tscadc *ts_dev)
@@ -129,7 +59,7 @@ static void tsc_step_config(struct tscadc *ts_dev)
 	unsigned int	stepconfigx = 0, stepconfigy = 0;
 	unsigned int	delay, chargeconfig = 0;
 	unsigned int	stepconfigz1 = 0, stepconfigz2 = 0;
-	int i;
+	int i, steps = ts_dev->steps_to_configure;
 
 	/* Configure the Step registers */
 
@@ -154,14 +84,19 @@ static void tsc_step_config(struct tscadc *ts_dev)
 		break;
 	}
 
-	for (i = 1; i < 7; i++) {
+	/*
+	 * All touchscreen samples go to FIFO0 in step order: X in steps
+	 * 1..n, Y in steps n+1..2n, then Z1 and Z2.  FIFO1 belongs to the
+	 * ADC cell.
+	 */
+	for (i = 1; i <= steps; i++) {
 		tscadc_writel(ts_dev, TSCADC_REG_STEPCONFIG(i), stepconfigx);
 		tscadc_writel(ts_dev, TSCADC_REG_STEPDELAY(i), delay);
 	}
 
 	stepconfigy = TSCADC_STEPCONFIG_MODE_HWSYNC |
 			TSCADC_STEPCONFIG_2SAMPLES_AVG | TSCADC_STEPCONFIG_YNN |
-			TSCADC_STEPCONFIG_INM | TSCADC_STEPCONFIG_FIFO1;
+			TSCADC_STEPCONFIG_INM;
 	switch (ts_dev->wires) {
 	case 4:
 		stepconfigy |= TSCADC_STEPCONFIG_YPP;
@@ -175,7 +110,7 @@ static void tsc_step_config(struct tscadc *ts_dev)
 		break;
 	}
 
-	for (i = 7; i < 13; i++) {
+	for (i = steps + 1; i <= 2 * steps; i++) {
 		tscadc_writel(ts_dev, TSCADC_REG_STEPCONFIG(i), stepconfigy);
 		tscadc_writel(ts_dev, TSCADC_REG_STEPDELAY(i), delay);
 	}
@@ -191,25 +126,64 @@ static void tsc_step_config(struct tscadc *ts_dev)
 				TSCADC_STEPCONFIG_2SAMPLES_AVG |
 				TSCADC_STEPCONFIG_XNP |
 				TSCADC_STEPCONFIG_YPN | TSCADC_STEPCONFIG_INM;
-	stepconfigz2 = stepconfigz1 | TSCADC_STEPCONFIG_Z1 |
-				TSCADC_STEPCONFIG_FIFO1;
-	tscadc_writel(ts_dev, TSCADC_REG_STEPCONFIG13, stepconfigz1);
-	tscadc_writel(ts_dev, TSCADC_REG_STEPDELAY13, delay);
-	tscadc_writel(ts_dev, TSCADC_REG_STEPCONFIG14, stepconfigz2);
-	tscadc_writel(ts_dev, TSCADC_REG_STEPDELAY14, delay);
-
-	tscadc_writel(ts_dev, TSCADC_REG_SE, TSCADC_STPENB_STEPENB);
+	stepconfigz2 = stepconfigz1 | TSCADC_STEPCONFIG_Z1;
+	tscadc_writel(ts_dev, TSCADC_REG_STEPCONFIG(2 * steps + 1),
+			stepconfigz1);
+	tscadc_writel(ts_dev, TSCADC_REG_STEPDELAY(2 * steps + 1), delay);
+	tscadc_writel(ts_dev, TSCADC_REG_STEPCONFIG(2 * steps + 2),
+			stepconfigz2);
+	tscadc_writel(ts_dev, TSCADC_REG_STEPDELAY(2 * steps + 2), delay);
+
+	/* FIFO0 threshold needs to be configured to the value minus 1 */
+	tscadc_writel(ts_dev, TSCADC_REG_FIFO0THR, 2 * steps + 1);
+
+	/* charge step plus steps 1 .. 2n + 2 */
+	ts_dev->step_mask = TSCADC_STPENB_STEP(2 * steps + 3) - 1;
+	ti_tscadc_se_set(ts_dev->mfd_tscadc, ts_dev->step_mask);
 }
 
-static void tsc_idle_config(struct tscadc *ts_config)
+/*
+ * Of a run of samples of one coordinate, report the one closest to its
+ * predecessor; this filters out the settling noise of the panel.
+ */
+static unsigned int tsc_read_coordinate(struct tscadc *ts_dev, int steps)
 {
-	/* Idle mode touch screen config */
-	unsigned int	 idleconfig;
+	unsigned int	read, val = 0;
+	unsigned int	prev_val = ~0, prev_diff = ~0, cur_diff;
+	int		i;
+
+	for (i = 0; i < steps; i++) {
+		read = tscadc_readl(ts_dev, TSCADC_REG_FIFO0) &
+				TSCADC_FIFO_DATA;
+		if (read > prev_val)
+			cur_diff = read - prev_val;
+		else
+			cur_diff = prev_val - read;
+
+		if (cur_diff < prev_diff) {
+			prev_diff = cur_diff;
+			val = read;
+		}
 
-	idleconfig = TSCADC_STEPCONFIG_YNN | TSCADC_STEPCONFIG_INM |
-			TSCADC_STEPCONFIG_IDLE_INP | TSCADC_STEPCONFIG_YPN;
+		prev_val = read;
+	}
 
-	tscadc_writel(ts_config, TSCADC_REG_IDLECONFIG, idleconfig);
+	return val;
+}
+
+/*
+ * The pen is up once the sequencer has left the touchscreen steps,
+ * either idling or running steps that belong to the ADC cell.
+ */
+static bool tsc_pen_up(struct tscadc *ts_dev)
+{
+	unsigned int stepid;
+
+	stepid = tscadc_readl(ts_dev, TSCADC_REG_ADCFSM) & 0x1f;
+
+	return stepid == TSCADC_ADCFSM_STEPID ||
+		(stepid < TSCADC_ADCFSM_STEPID &&
+		 stepid >= 2 * ts_dev->steps_to_configure + 2);
 }
 
 static irqreturn_t tscadc_interrupt(int irq, void *dev)
@@ -217,48 +191,16 @@ static irqreturn_t tscadc_interrupt(int irq, void *dev)
 	struct tscadc		*ts_dev = (struct tscadc *)dev;
 	struct input_dev	*input_dev = ts_dev->input;
 	unsigned int		status, irqclr = 0;
-	int			i;
-	int			fsm = 0, fifo0count = 0, fifo1count = 0;
-	unsigned int		readx1 = 0, ready1 = 0;
-	unsigned int		prev_val_x = ~0, prev_val_y = ~0;
-	unsigned int		prev_diff_x = ~0, prev_diff_y = ~0;
-	unsigned int		cur_diff_x = 0, cur_diff_y = 0;
 	unsigned int		val_x = 0, val_y = 0, diffx = 0, diffy = 0;
 	unsigned int		z1 = 0, z2 = 0, z = 0;
 
 	status = tscadc_readl(ts_dev, TSCADC_REG_IRQSTATUS);
+	if (!(status & (TSCADC_IRQENB_FIFO0THRES | TSCADC_IRQENB_HW_PEN)))
+		return IRQ_NONE;
 
-	if (status & TSCADC_IRQENB_FIFO1THRES) {
-		fifo0count = tscadc_readl(ts_dev, TSCADC_REG_FIFO0CNT);
-		fifo1count = tscadc_readl(ts_dev, TSCADC_REG_FIFO1CNT);
-		for (i = 0; i < (fifo0count-1); i++) {
-			readx1 = tscadc_readl(ts_dev, TSCADC_REG_FIFO0);
-			readx1 = readx1 & 0xfff;
-			if (readx1 > prev_val_x)
-				cur_diff_x = readx1 - prev_val_x;
-			else
-				cur_diff_x = prev_val_x - readx1;
-
-			if (cur_diff_x < prev_diff_x) {
-				prev_diff_x = cur_diff_x;
-				val_x = readx1;
-			}
-
-			prev_val_x = readx1;
-			ready1 = tscadc_readl(ts_dev, TSCADC_REG_FIFO1);
-				ready1 &= 0xfff;
-			if (ready1 > prev_val_y)
-				cur_diff_y = ready1 - prev_val_y;
-			else
-				cur_diff_y = prev_val_y - ready1;
-
-			if (cur_diff_y < prev_diff_y) {
-				prev_diff_y = cur_diff_y;
-				val_y = ready1;
-			}
-
-			prev_val_y = ready1;
-		}
+	if (status & TSCADC_IRQENB_FIFO0THRES) {
+		val_x = tsc_read_coordinate(ts_dev, ts_dev->steps_to_configure);
+		val_y = tsc_read_coordinate(ts_dev, ts_dev->steps_to_configure);
 
 		if (val_x > bckup_x) {
 			diffx = val_x - bckup_x;
@@ -271,7 +213,7 @@ static irqreturn_t tscadc_interrupt(int irq, void *dev)
 		bckup_y = val_y;
 
 		z1 = ((tscadc_readl(ts_dev, TSCADC_REG_FIFO0)) & 0xfff);
-		z2 = ((tscadc_readl(ts_dev, TSCADC_REG_FIFO1)) & 0xfff);
+		z2 = ((tscadc_readl(ts_dev, TSCADC_REG_FIFO0)) & 0xfff);
 
 		if ((z1 != 0) && (z2 != 0)) {
 			/*
@@ -305,7 +247,7 @@ static irqreturn_t tscadc_interrupt(int irq, void *dev)
 				}
 			}
 		}
-		irqclr |= TSCADC_IRQENB_FIFO1THRES;
+		irqclr |= TSCADC_IRQENB_FIFO0THRES;
 	}
 
 	udelay(315);
@@ -313,8 +255,7 @@ static irqreturn_t tscadc_interrupt(int irq, void *dev)
 	status = tscadc_readl(ts_dev, TSCADC_REG_RAWIRQSTATUS);
 	if (status & TSCADC_IRQENB_PENUP) {
 		/* Pen up event */
-		fsm = tscadc_readl(ts_dev, TSCADC_REG_ADCFSM);
-		if (fsm == 0x10) {
+		if (tsc_pen_up(ts_dev)) {
 			pen = 1;
 			bckup_x = 0;
 			bckup_y = 0;
@@ -333,7 +274,7 @@ static irqreturn_t tscadc_interrupt(int irq, void *dev)
 	/* check pending interrupts */
 	tscadc_writel(ts_dev, TSCADC_REG_IRQEOI, 0x0);
 
-	tscadc_writel(ts_dev, TSCADC_REG_SE, TSCADC_STPENB_STEPENB);
+	ti_tscadc_se_update(ts_dev->mfd_tscadc);
 	return IRQ_HANDLED;
 }
 
@@ -346,15 +287,13 @@ static	int __devinit tscadc_probe(struct platform_device *pdev)
 	struct tscadc			*ts_dev;
 	struct input_dev		*input_dev;
 	int				err;
-	int				clk_value;
-	int				clock_rate, irqenable, ctrl;
-	struct	tsc_data		*pdata = pdev->dev.platform_data;
-	struct resource			*res;
-	struct clk			*clk;
-
-	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-	if (!res) {
-		dev_err(&pdev->dev, "no memory resource defined.\n");
+	int				irqenable, adc_steps = 0;
+	struct ti_tscadc_dev		*tscadc_dev = ti_tscadc_dev_get(pdev);
+	struct mfd_tscadc_board		*pdata;
+
+	pdata = tscadc_dev->dev->platform_data;
+	if (!pdata || !pdata->tsc_init) {
+		dev_err(&pdev->dev, "Could not find platform data\n");
 		return -EINVAL;
 	}
 
@@ -364,11 +303,24 @@ static	int __devinit tscadc_probe(struct platform_device *pdev)
 		dev_err(&pdev->dev, "failed to allocate memory.\n");
 		return -ENOMEM;
 	}
-
-	ts_dev->irq = platform_get_irq(pdev, 0);
-	if (ts_dev->irq < 0) {
-		dev_err(&pdev->dev, "no irq ID is specified.\n");
-		return -ENODEV;
+	tscadc_dev->tsc = ts_dev;
+	ts_dev->mfd_tscadc = tscadc_dev;
+	ts_dev->irq = tscadc_dev->irq;
+
+	ts_dev->wires = pdata->tsc_init->wires;
+	ts_dev->x_plate_resistance = pdata->tsc_init->x_plate_resistance;
+	ts_dev->steps_to_configure = pdata->tsc_init->steps_to_configure;
+	if (!ts_dev->steps_to_configure)
+		ts_dev->steps_to_configure = TSC_DEFAULT_STEPS;
+
+	/* X and Y samples plus Z1/Z2 must leave room for the ADC steps */
+	if (pdata->adc_init)
+		adc_steps = pdata->adc_init->adc_channels;
+	if (2 * ts_dev->steps_to_configure + 2 + adc_steps > TOTAL_STEPS) {
+		dev_err(&pdev->dev, "too many steps: %d touchscreen, %d adc\n",
+				2 * ts_dev->steps_to_configure + 2, adc_steps);
+		err = -EINVAL;
+		goto err_free_mem;
 	}
 
 	input_dev = input_allocate_device();
@@ -379,83 +331,19 @@ static	int __devinit tscadc_probe(struct platform_device *pdev)
 	}
 	ts_dev->input = input_dev;
 
-	res =  request_mem_region(res->start, resource_size(res), pdev->name);
-	if (!res) {
-		dev_err(&pdev->dev, "failed to reserve registers.\n");
-		err = -EBUSY;
-		goto err_free_mem;
-	}
-
-	ts_dev->tsc_base = ioremap(res->start, resource_size(res));
-	if (!ts_dev->tsc_base) {
-		dev_err(&pdev->dev, "failed to map registers.\n");
-		err = -ENOMEM;
-		goto err_release_mem;
-	}
-
-	err = request_irq(ts_dev->irq, tscadc_interrupt, IRQF_DISABLED,
+	err = request_irq(ts_dev->irq, tscadc_interrupt, IRQF_SHARED,
 				pdev->dev.driver->name, ts_dev);
 	if (err) {
 		dev_err(&pdev->dev, "failed to allocate irq.\n");
-		goto err_unmap_regs;
+		goto err_free_input;
 	}
 
-	pm_runtime_enable(&pdev->dev);
-	pm_runtime_get_sync(&pdev->dev);
-
-	clk = clk_get(&pdev->dev, "adc_tsc_fck");
-	if (IS_ERR(clk)) {
-		dev_err(&pdev->dev, "failed to get TSC fck\n");
-		err = PTR_ERR(clk);
-		goto err_free_irq;
-	}
-	clock_rate = clk_get_rate(clk);
-	clk_put(clk);
-	clk_value = clock_rate / ADC_CLK;
-	if (clk_value < 7) {
-		dev_err(&pdev->dev, "clock input less than min clock requirement\n");
-		err = -EINVAL;
-		goto err_fail;
-	}
-	/* TSCADC_CLKDIV needs to be configured to the value minus 1 */
-	clk_value = clk_value - 1;
-	tscadc_writel(ts_dev, TSCADC_REG_CLKDIV, clk_value);
-
-	ts_dev->wires = pdata->wires;
-	ts_dev->x_plate_resistance = pdata->x_plate_resistance;
-
-	/* Set the control register bits */
-	ctrl = TSCADC_CNTRLREG_STEPCONFIGWRT |
-			TSCADC_CNTRLREG_TSCENB |
-			TSCADC_CNTRLREG_STEPID;
-	switch (ts_dev->wires) {
-	case 4:
-		ctrl |= TSCADC_CNTRLREG_4WIRE;
-		break;
-	case 5:
-		ctrl |= TSCADC_CNTRLREG_5WIRE;
-		break;
-	case 8:
-		ctrl |= TSCADC_CNTRLREG_8WIRE;
-		break;
-	}
-	tscadc_writel(ts_dev, TSCADC_REG_CTRL, ctrl);
-	ts_dev->ctrl = ctrl;
-
-	/* Set register bits for Idel Config Mode */
-	tsc_idle_config(ts_dev);
-
 	/* IRQ Enable */
-	irqenable = TSCADC_IRQENB_FIFO1THRES;
+	irqenable = TSCADC_IRQENB_FIFO0THRES;
 	tscadc_writel(ts_dev, TSCADC_REG_IRQENABLE, irqenable);
 
 	tsc_step_config(ts_dev);
 
-	tscadc_writel(ts_dev, TSCADC_REG_FIFO1THR, 6);
-
-	ctrl |= TSCADC_CNTRLREG_TSCSSENB;
-	tscadc_writel(ts_dev, TSCADC_REG_CTRL, ctrl);
-
 	input_dev->name = "ti-tsc-adcc";
 	input_dev->dev.parent = &pdev->dev;
 
@@ -476,17 +364,14 @@ static	int __devinit tscadc_probe(struct platform_device *pdev)
 	return 0;
 
 err_fail:
-	pm_runtime_put_sync(&pdev->dev);
-	pm_runtime_disable(&pdev->dev);
-err_free_irq:
+	ti_tscadc_se_clr(tscadc_dev, ts_dev->step_mask);
+	tscadc_writel(ts_dev, TSCADC_REG_IRQCLR, irqenable);
 	free_irq(ts_dev->irq, ts_dev);
-err_unmap_regs:
-	iounmap(ts_dev->tsc_base);
-err_release_mem:
-	release_mem_region(res->start, resource_size(res));
+err_free_input:
 	input_free_device(ts_dev->input);
 err_free_mem:
 	platform_set_drvdata(pdev, NULL);
+	tscadc_dev->tsc = NULL;
 	kfree(ts_dev);
 	return err;
 }
@@ -494,20 +379,14 @@ err_free_mem:
 static int __devexit tscadc_remove(struct platform_device *pdev)
 {
 	struct tscadc		*ts_dev = platform_get_drvdata(pdev);
-	struct resource		*res;
 
-	tscadc_writel(ts_dev, TSCADC_REG_SE, 0x00);
+	ti_tscadc_se_clr(ts_dev->mfd_tscadc, ts_dev->step_mask);
+	tscadc_writel(ts_dev, TSCADC_REG_IRQCLR, TSCADC_IRQENB_FIFO0THRES);
 	free_irq(ts_dev->irq, ts_dev);
 
 	input_unregister_device(ts_dev->input);
 
-	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-	iounmap(ts_dev->tsc_base);
-	release_mem_region(res->start, resource_size(res));
-
-	pm_runtime_put_sync(&pdev->dev);
-	pm_runtime_disable(&pdev->dev);
-
+	ts_dev->mfd_tscadc->tsc = NULL;
 	kfree(ts_dev);
 
 	device_init_wakeup(&pdev->dev, 0);
@@ -524,7 +403,7 @@ static int tscadc_suspend(struct platform_device *pdev, pm_message_t state)
 		idle = tscadc_readl(ts_dev, TSCADC_REG_IRQENABLE);
 		tscadc_writel(ts_dev, TSCADC_REG_IRQENABLE,
 				(idle | TSCADC_IRQENB_HW_PEN));
-		tscadc_writel(ts_dev, TSCADC_REG_SE, 0x00);
+		ti_tscadc_se_clr(ts_dev->mfd_tscadc, ts_dev->step_mask);
 		tscadc_writel(ts_dev, TSCADC_REG_IRQWAKEUP, TSCADC_IRQWKUP_ENB);
 	} else {
 	/* module disable */
@@ -534,8 +413,6 @@ static int tscadc_suspend(struct platform_device *pdev, pm_message_t state)
 				TSCADC_CNTRLREG_POWERDOWN));
 	}
 
-	pm_runtime_put_sync(&pdev->dev);
-
 	return 0;
 
 }
@@ -543,9 +420,6 @@ static int tscadc_suspend(struct platform_device *pdev, pm_message_t state)
 static int tscadc_resume(struct platform_device *pdev)
 {
 	struct tscadc *ts_dev = platform_get_drvdata(pdev);
-	unsigned int restore;
-
-	pm_runtime_get_sync(&pdev->dev);
 
 	if (device_may_wakeup(&pdev->dev)) {
 		tscadc_writel(ts_dev, TSCADC_REG_IRQWAKEUP,
@@ -553,18 +427,9 @@ static int tscadc_resume(struct platform_device *pdev)
 		tscadc_writel(ts_dev, TSCADC_REG_IRQCLR, TSCADC_IRQENB_HW_PEN);
 	}
 
-	/* context restore */
-	tscadc_writel(ts_dev, TSCADC_REG_CTRL, ts_dev->ctrl);
-	/* Make sure ADC is powered up */
-	restore = tscadc_readl(ts_dev, TSCADC_REG_CTRL);
-	restore &= ~(TSCADC_CNTRLREG_POWERDOWN);
-	tscadc_writel(ts_dev, TSCADC_REG_CTRL, restore);
-	tsc_idle_config(ts_dev);
+	/* context restore; CTRL and CLKDIV are restored by the core */
+	tscadc_writel(ts_dev, TSCADC_REG_IRQENABLE, TSCADC_IRQENB_FIFO0THRES);
 	tsc_step_config(ts_dev);
-	tscadc_writel(ts_dev, TSCADC_REG_FIFO1THR, 6);
-	restore = tscadc_readl(ts_dev, TSCADC_REG_CTRL);
-	tscadc_writel(ts_dev, TSCADC_REG_CTRL,
-			(restore | TSCADC_CNTRLREG_TSCSSENB));
 
 	return 0;
 }
@@ -0,0 +1,323 @@
+/*
+ * TI Touch Screen / ADC MFD driver
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/interrupt.h>
+#include <linux/clk.h>
+#include <linux/platform_device.h>
+#include <linux/io.h>
+#include <linux/pm_runtime.h>
+#include <linux/mfd/core.h>
+#include <linux/mfd/ti_tscadc.h>
+
+static void tscadc_writel(struct ti_tscadc_dev *tsadc, unsigned int reg,
+					unsigned int val)
+{
+	writel(val, tsadc->tscadc_base + reg);
+}
+
+/*
+ * The step enable register is shared by both cells.  Steps running in
+ * one-shot mode are cleared by the sequencer once they complete, so
+ * every write has to carry the steps the other cell still wants,
+ * including one-shot steps whose sample has not been read yet.
+ */
+void ti_tscadc_se_set(struct ti_tscadc_dev *tsadc, u32 val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tsadc->reg_lock, flags);
+	tsadc->reg_se_cache |= val;
+	tscadc_writel(tsadc, TSCADC_REG_SE,
+		      tsadc->reg_se_cache | tsadc->reg_se_once);
+	spin_unlock_irqrestore(&tsadc->reg_lock, flags);
+}
+EXPORT_SYMBOL_GPL(ti_tscadc_se_set);
+
+void ti_tscadc_se_clr(struct ti_tscadc_dev *tsadc, u32 val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tsadc->reg_lock, flags);
+	tsadc->reg_se_cache &= ~val;
+	tscadc_writel(tsadc, TSCADC_REG_SE,
+		      tsadc->reg_se_cache | tsadc->reg_se_once);
+	spin_unlock_irqrestore(&tsadc->reg_lock, flags);
+}
+EXPORT_SYMBOL_GPL(ti_tscadc_se_clr);
+
+/*
+ * Run steps once without adding them to the cached enable mask.  They
+ * stay pending, and are rewritten by the other cell, until the caller
+ * has read their samples and calls ti_tscadc_se_done().
+ */
+void ti_tscadc_se_set_once(struct ti_tscadc_dev *tsadc, u32 val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tsadc->reg_lock, flags);
+	tsadc->reg_se_once |= val;
+	tscadc_writel(tsadc, TSCADC_REG_SE,
+		      tsadc->reg_se_cache | tsadc->reg_se_once);
+	spin_unlock_irqrestore(&tsadc->reg_lock, flags);
+}
+EXPORT_SYMBOL_GPL(ti_tscadc_se_set_once);
+
+void ti_tscadc_se_done(struct ti_tscadc_dev *tsadc, u32 val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tsadc->reg_lock, flags);
+	tsadc->reg_se_once &= ~val;
+	spin_unlock_irqrestore(&tsadc->reg_lock, flags);
+}
+EXPORT_SYMBOL_GPL(ti_tscadc_se_done);
+
+void ti_tscadc_se_update(struct ti_tscadc_dev *tsadc)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tsadc->reg_lock, flags);
+	tscadc_writel(tsadc, TSCADC_REG_SE,
+		      tsadc->reg_se_cache | tsadc->reg_se_once);
+	spin_unlock_irqrestore(&tsadc->reg_lock, flags);
+}
+EXPORT_SYMBOL_GPL(ti_tscadc_se_update);
+
+static void tscadc_idle_config(struct ti_tscadc_dev *tsadc)
+{
+	unsigned int idleconfig;
+
+	idleconfig = TSCADC_STEPCONFIG_YNN | TSCADC_STEPCONFIG_INM |
+			TSCADC_STEPCONFIG_IDLE_INP | TSCADC_STEPCONFIG_YPN;
+
+	tscadc_writel(tsadc, TSCADC_REG_IDLECONFIG, idleconfig);
+}
+
+static int __devinit ti_tscadc_probe(struct platform_device *pdev)
+{
+	struct ti_tscadc_dev	*tscadc;
+	struct resource		*res;
+	struct clk		*clk;
+	struct mfd_tscadc_board	*pdata = pdev->dev.platform_data;
+	struct mfd_cell		*cell;
+	int			err, ctrl;
+	int			clk_value, clock_rate;
+	int			tsc_wires = 0, adc_channels = 0, total_channels;
+
+	if (!pdata) {
+		dev_err(&pdev->dev, "Could not find platform data\n");
+		return -EINVAL;
+	}
+
+	if (pdata->tsc_init)
+		tsc_wires = pdata->tsc_init->wires;
+
+	if (pdata->adc_init)
+		adc_channels = pdata->adc_init->adc_channels;
+
+	total_channels = tsc_wires + adc_channels;
+	if (!total_channels || total_channels > TOTAL_CHANNELS) {
+		dev_err(&pdev->dev, "invalid number of analog inputs: %d\n",
+				total_channels);
+		return -EINVAL;
+	}
+
+	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	if (!res) {
+		dev_err(&pdev->dev, "no memory resource defined.\n");
+		return -EINVAL;
+	}
+
+	/* Allocate memory for device */
+	tscadc = kzalloc(sizeof(struct ti_tscadc_dev), GFP_KERNEL);
+	if (!tscadc) {
+		dev_err(&pdev->dev, "failed to allocate memory.\n");
+		return -ENOMEM;
+	}
+	tscadc->dev = &pdev->dev;
+	spin_lock_init(&tscadc->reg_lock);
+
+	tscadc->irq = platform_get_irq(pdev, 0);
+	if (tscadc->irq < 0) {
+		dev_err(&pdev->dev, "no irq ID is specified.\n");
+		err = -ENODEV;
+		goto err_free_mem;
+	}
+
+	res = request_mem_region(res->start, resource_size(res), pdev->name);
+	if (!res) {
+		dev_err(&pdev->dev, "failed to reserve registers.\n");
+		err = -EBUSY;
+		goto err_free_mem;
+	}
+
+	tscadc->tscadc_base = ioremap(res->start, resource_size(res));
+	if (!tscadc->tscadc_base) {
+		dev_err(&pdev->dev, "failed to map registers.\n");
+		err = -ENOMEM;
+		goto err_release_mem;
+	}
+
+	pm_runtime_enable(&pdev->dev);
+	pm_runtime_get_sync(&pdev->dev);
+
+	clk = clk_get(&pdev->dev, "adc_tsc_fck");
+	if (IS_ERR(clk)) {
+		dev_err(&pdev->dev, "failed to get TSC fck\n");
+		err = PTR_ERR(clk);
+		goto err_fail;
+	}
+	clock_rate = clk_get_rate(clk);
+	clk_put(clk);
+	clk_value = clock_rate / ADC_CLK;
+	if (clk_value < 7) {
+		dev_err(&pdev->dev, "clock input less than min clock requirement\n");
+		err = -EINVAL;
+		goto err_fail;
+	}
+	/* TSCADC_CLKDIV needs to be configured to the value minus 1 */
+	tscadc->clk_div = clk_value - 1;
+	tscadc_writel(tscadc, TSCADC_REG_CLKDIV, tscadc->clk_div);
+
+	/* Set the control register bits */
+	ctrl = TSCADC_CNTRLREG_STEPCONFIGWRT | TSCADC_CNTRLREG_STEPID;
+	if (tsc_wires > 0) {
+		ctrl |= TSCADC_CNTRLREG_TSCENB;
+		switch (tsc_wires) {
+		case 4:
+			ctrl |= TSCADC_CNTRLREG_4WIRE;
+			break;
+		case 5:
+			ctrl |= TSCADC_CNTRLREG_5WIRE;
+			break;
+		case 8:
+			ctrl |= TSCADC_CNTRLREG_8WIRE;
+			break;
+		}
+	}
+	tscadc_writel(tscadc, TSCADC_REG_CTRL, ctrl);
+
+	/* Set register bits for Idle Config Mode */
+	tscadc_idle_config(tscadc);
+
+	/* Nothing is sampled until a cell enables its steps */
+	tscadc_writel(tscadc, TSCADC_REG_SE, 0);
+
+	ctrl |= TSCADC_CNTRLREG_TSCSSENB;
+	tscadc_writel(tscadc, TSCADC_REG_CTRL, ctrl);
+	tscadc->ctrl = ctrl;
+
+	/* TSC Cell */
+	if (tsc_wires > 0) {
+		cell = &tscadc->cells[tscadc->used_cells++];
+		cell->name = "tsc";
+		cell->platform_data = &tscadc;
+		cell->pdata_size = sizeof(tscadc);
+	}
+
+	/* ADC Cell */
+	if (adc_channels > 0) {
+		cell = &tscadc->cells[tscadc->used_cells++];
+		cell->name = "tiadc";
+		cell->platform_data = &tscadc;
+		cell->pdata_size = sizeof(tscadc);
+	}
+
+	err = mfd_add_devices(&pdev->dev, pdev->id, tscadc->cells,
+			tscadc->used_cells, NULL, 0);
+	if (err < 0)
+		goto err_fail;
+
+	platform_set_drvdata(pdev, tscadc);
+	return 0;
+
+err_fail:
+	pm_runtime_put_sync(&pdev->dev);
+	pm_runtime_disable(&pdev->dev);
+	iounmap(tscadc->tscadc_base);
+err_release_mem:
+	release_mem_region(res->start, resource_size(res));
+err_free_mem:
+	platform_set_drvdata(pdev, NULL);
+	kfree(tscadc);
+	return err;
+}
+
+static int __devexit ti_tscadc_remove(struct platform_device *pdev)
+{
+	struct ti_tscadc_dev	*tscadc = platform_get_drvdata(pdev);
+	struct resource		*res;
+
+	mfd_remove_devices(tscadc->dev);
+
+	tscadc_writel(tscadc, TSCADC_REG_SE, 0x00);
+
+	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	iounmap(tscadc->tscadc_base);
+	release_mem_region(res->start, resource_size(res));
+
+	pm_runtime_put_sync(&pdev->dev);
+	pm_runtime_disable(&pdev->dev);
+
+	kfree(tscadc);
+
+	platform_set_drvdata(pdev, NULL);
+	return 0;
+}
+
+static int ti_tscadc_suspend(struct platform_device *pdev, pm_message_t state)
+{
+	pm_runtime_put_sync(&pdev->dev);
+
+	return 0;
+}
+
+static int ti_tscadc_resume(struct platform_device *pdev)
+{
+	struct ti_tscadc_dev *tscadc = platform_get_drvdata(pdev);
+
+	pm_runtime_get_sync(&pdev->dev);
+
+	/* context restore; the cells restore their own steps */
+	tscadc_writel(tscadc, TSCADC_REG_CLKDIV, tscadc->clk_div);
+	tscadc_writel(tscadc, TSCADC_REG_CTRL,
+			tscadc->ctrl & ~TSCADC_CNTRLREG_TSCSSENB);
+	tscadc_idle_config(tscadc);
+	tscadc_writel(tscadc, TSCADC_REG_SE, 0);
+	tscadc_writel(tscadc, TSCADC_REG_CTRL, tscadc->ctrl);
+
+	return 0;
+}
+
+static struct platform_driver ti_tscadc_driver = {
+	.probe	= ti_tscadc_probe,
+	.remove	= __devexit_p(ti_tscadc_remove),
+	.driver	= {
+		.name	= "ti_tscadc",
+		.owner	= THIS_MODULE,
+	},
+	.suspend = ti_tscadc_suspend,
+	.resume	 = ti_tscadc_resume,
+};
+
+module_platform_driver(ti_tscadc_driver);
+
+MODULE_DESCRIPTION("TI touchscreen / ADC MFD controller driver");
+MODULE_LICENSE("GPL");
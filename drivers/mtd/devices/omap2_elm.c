@@ -54,6 +54,15 @@
 #define ELM_ERROR_LOCATION_14		0x8b8
 #define ELM_ERROR_LOCATION_15		0x8bc
 
+/* Register sets of syndrome polynomial 1..7 follow the first one */
+#define ELM_SYNDROME_FRAGMENT_SIZE	0x40
+#define ELM_ERROR_LOCATION_SIZE		0x100
+
+#define ELM_SYNDROME_OFFSET(sector, reg)	\
+	((reg) + (sector) * ELM_SYNDROME_FRAGMENT_SIZE)
+#define ELM_LOCATION_OFFSET(sector, reg)	\
+	((reg) + (sector) * ELM_ERROR_LOCATION_SIZE)
+
 /* ELM System Configuration Register */
 #define ELM_SYSCONFIG_SOFTRESET		BIT(1)
 #define ELM_SYSCONFIG_SIDLE_MASK	(3 << 3)
@@ -117,6 +126,7 @@
 
 static void  __iomem *elm_base;
 static struct completion elm_completion;
+static struct completion elm_page_completion;
 static struct mtd_info *mtd;
 static int bch_scheme;
 
@@ -174,13 +184,11 @@ void omap_configure_elm(struct mtd_info *mtd_info, int bch_type)
 EXPORT_SYMBOL(omap_configure_elm);
 
 /**
- * omap_elm_load_syndrome - Load ELM syndrome reg
- * @bch_type:	type of BCH ECC scheme
+ * omap_elm_load_sector_syndrome - Load syndrome reg of one polynomial
+ * @sector:	syndrome polynomial (sector) number
  * @syndrome:	Syndrome polynomial
- *
- * Load the syndrome polynomial to syndrome registers
  */
-void omap_elm_load_syndrome(int bch_type, char *syndrome)
+static void omap_elm_load_sector_syndrome(int sector, u8 *syndrome)
 {
 	int reg_val;
 	int i;
@@ -188,21 +196,44 @@ void omap_elm_load_syndrome(int bch_type, char *syndrome)
 	for (i = 0; i < 4; i++) {
 		reg_val = syndrome[0] | syndrome[1] << 8 |
 			syndrome[2] << 16 | syndrome[3] << 24;
-		elm_write_reg(ELM_SYNDROME_FRAGMENT_0 + i * 4, reg_val);
+		elm_write_reg(ELM_SYNDROME_OFFSET(sector,
+				ELM_SYNDROME_FRAGMENT_0 + i * 4), reg_val);
 		syndrome += 4;
 	}
 }
 
 /**
- * omap_elm_start_processing - Start calculting error location
+ * omap_elm_load_syndrome - Load ELM syndrome reg
+ * @bch_type:	type of BCH ECC scheme
+ * @syndrome:	Syndrome polynomial
+ *
+ * Load the syndrome polynomial to syndrome registers
  */
-void omap_elm_start_processing(void)
+void omap_elm_load_syndrome(int bch_type, char *syndrome)
+{
+	omap_elm_load_sector_syndrome(0, (u8 *)syndrome);
+}
+
+/**
+ * omap_elm_start_sector - Start calculting error location of one polynomial
+ * @sector:	syndrome polynomial (sector) number
+ */
+static void omap_elm_start_sector(int sector)
 {
 	u32 reg_val;
+	int offset = ELM_SYNDROME_OFFSET(sector, ELM_SYNDROME_FRAGMENT_6);
 
-	reg_val = elm_read_reg(ELM_SYNDROME_FRAGMENT_6);
+	reg_val = elm_read_reg(offset);
 	reg_val |= ELM_SYNDROME_VALID;
-	elm_write_reg(ELM_SYNDROME_FRAGMENT_6, reg_val);
+	elm_write_reg(offset, reg_val);
+}
+
+/**
+ * omap_elm_start_processing - Start calculting error location
+ */
+void omap_elm_start_processing(void)
+{
+	omap_elm_start_sector(0);
 }
 
 void rotate_ecc_bytes(u8 *src, u8 *dst)
@@ -247,12 +278,101 @@ int omap_elm_decode_bch_error(int bch_type, char *ecc_calc,
 }
 EXPORT_SYMBOL(omap_elm_decode_bch_error);
 
+/**
+ * omap_elm_decode_bch_page - Locate error pos of all sectors in a page
+ * @bch_type:	Type of BCH ECC scheme
+ * @ecc_calc:	Syndrome bytes of each sector, BCH8_ECC_OOB_BYTES apart
+ * @err_vec:	Per sector error vector, one entry per sector
+ * @nsectors:	Number of sectors in the page, at most ELM_MAX_SECTORS
+ *
+ * Sectors with error_reported set in @err_vec are loaded into their own
+ * syndrome polynomial and processed in page mode, so the error locations
+ * of the whole page are available after a single PAGE_VALID interrupt.
+ * Returns the number of sectors that could not be corrected.
+ */
+int omap_elm_decode_bch_page(int bch_type, u8 *ecc_calc,
+		struct elm_errorvec *err_vec, int nsectors)
+{
+	u8 ecc_data[BCH_MAX_ECC_BYTES_PER_SECTOR];
+	u32 reg_val, page_ctrl = 0;
+	int i, j, offset, failed = 0;
+
+	if (nsectors > ELM_MAX_SECTORS)
+		return -EINVAL;
+
+	for (i = 0; i < nsectors; i++) {
+		err_vec[i].error_count = 0;
+		err_vec[i].error_uncorrectable = false;
+
+		if (!err_vec[i].error_reported)
+			continue;
+
+		memset(ecc_data, 0, sizeof(ecc_data));
+		rotate_ecc_bytes(ecc_calc + i * BCH8_ECC_OOB_BYTES, ecc_data);
+		omap_elm_load_sector_syndrome(i, ecc_data);
+		page_ctrl |= PAGE_MODE_SECTOR_0 << i;
+	}
+
+	if (!page_ctrl)
+		return 0;
+
+	/* Switch to page mode, only PAGE_VALID interrupts the cpu */
+	elm_write_reg(ELM_IRQSTATUS, INTR_STATUS_PAGE_VALID |
+			INTR_STATUS_LOC_VALID_7 | INTR_STATUS_LOC_VALID_6 |
+			INTR_STATUS_LOC_VALID_5 | INTR_STATUS_LOC_VALID_4 |
+			INTR_STATUS_LOC_VALID_3 | INTR_STATUS_LOC_VALID_2 |
+			INTR_STATUS_LOC_VALID_1 | INTR_STATUS_LOC_VALID_0);
+	elm_write_reg(ELM_IRQENABLE, INTR_EN_PAGE_MASK);
+	elm_write_reg(ELM_PAGE_CTRL, page_ctrl);
+
+	for (i = 0; i < nsectors; i++)
+		if (page_ctrl & (PAGE_MODE_SECTOR_0 << i))
+			omap_elm_start_sector(i);
+
+	wait_for_completion(&elm_page_completion);
+
+	for (i = 0; i < nsectors; i++) {
+		if (!(page_ctrl & (PAGE_MODE_SECTOR_0 << i)))
+			continue;
+
+		offset = ELM_LOCATION_OFFSET(i, ELM_LOCATION_STATUS);
+		reg_val = elm_read_reg(offset);
+
+		if (!(reg_val & ECC_CORRECTABLE_MASK)) {
+			err_vec[i].error_uncorrectable = true;
+			failed++;
+			continue;
+		}
+
+		err_vec[i].error_count = reg_val & ECC_NB_ERRORS_MASK;
+		for (j = 0; j < err_vec[i].error_count; j++) {
+			offset = ELM_LOCATION_OFFSET(i,
+					ELM_ERROR_LOCATION_0 + j * 4);
+			err_vec[i].error_loc[j] = elm_read_reg(offset) &
+					ECC_ERROR_LOCATION_MASK;
+		}
+	}
+
+	/* Back to continuous mode for omap_elm_decode_bch_error() */
+	elm_write_reg(ELM_PAGE_CTRL, 0);
+	elm_write_reg(ELM_IRQENABLE, INTR_EN_LOCATION_MASK_0);
+
+	return failed;
+}
+EXPORT_SYMBOL(omap_elm_decode_bch_page);
+
 static irqreturn_t omap_elm_isr(int this_irq, void *dev_id)
 {
 	u32 reg_val;
 
 	reg_val = elm_read_reg(ELM_IRQSTATUS);
 
+	if (reg_val & INTR_STATUS_PAGE_VALID) {
+		elm_write_reg(ELM_IRQSTATUS, reg_val);
+		complete(&elm_page_completion);
+		return IRQ_HANDLED;
+	}
+
 	if (reg_val & INTR_STATUS_LOC_VALID_0) {
 		elm_write_reg(ELM_IRQSTATUS, reg_val & INTR_STATUS_LOC_VALID_0);
 		complete(&elm_completion);
@@ -305,6 +425,7 @@ static int omap_elm_probe(struct platform_device *pdev)
 	}
 
 	init_completion(&elm_completion);
+	init_completion(&elm_page_completion);
 	return ret_status;
 
 err_irq:
@@ -800,66 +800,103 @@ static int omap_compare_ecc(u8 *ecc_data1,	/* read from NAND memory */
  * @buf:	buffer to store read data
  * @page:	page number to read
  *
- * For BCH ECC scheme, GPMC used for syndrome calculation and ELM module
- * used for error correction.
+ * Data and spare area are fetched in one sequential transfer while the
+ * GPMC generates the ECC of all sectors at once. The syndrome of each
+ * sector is the generated ECC xor'ed with the ECC stored in the spare
+ * area; all non-zero syndromes are handed to the ELM in page mode so the
+ * error locations of the whole page come back with a single interrupt.
  */
 static int omap_read_page_bch(struct mtd_info *mtd, struct nand_chip *chip,
 				uint8_t *buf, int page)
 {
-	int i, eccsize = chip->ecc.size;
+	struct omap_nand_info *info = container_of(mtd, struct omap_nand_info,
+							mtd);
+	struct elm_errorvec err_vec[ELM_MAX_SECTORS];
+	unsigned int dev_width = (chip->options & NAND_BUSWIDTH_16) ? 1 : 0;
+	int eccsize = chip->ecc.size;
 	int eccbytes = chip->ecc.bytes;
 	int eccsteps = chip->ecc.steps;
-	uint8_t *p = buf;
 	uint8_t *ecc_calc = chip->buffers->ecccalc;
 	uint8_t *ecc_code = chip->buffers->ecccode;
 	uint32_t *eccpos = chip->ecc.layout->eccpos;
-	uint8_t *oob = &chip->oob_poi[eccpos[0]];
-	uint32_t data_pos;
-	uint32_t oob_pos;
+	u8 syndrome[ELM_MAX_SECTORS * BCH8_ECC_OOB_BYTES];
+	int i, j, erased, pending = 0;
 
-	struct omap_nand_info *info = container_of(mtd, struct omap_nand_info,
-							mtd);
-	data_pos = 0;
-	/* oob area start */
-	oob_pos = (eccsize * eccsteps) + chip->ecc.layout->eccpos[0];
-
-	for (i = 0; eccsteps; eccsteps--, i += eccbytes, p += eccsize,
-				oob += eccbytes) {
-		chip->ecc.hwctl(mtd, NAND_ECC_READ);
-		/* read data */
-		chip->cmdfunc(mtd, NAND_CMD_RNDOUT, data_pos, page);
-		chip->read_buf(mtd, p, eccsize);
-
-		/* read respective ecc from oob area */
-		chip->cmdfunc(mtd, NAND_CMD_RNDOUT, oob_pos, page);
-
-		if (info->ecc_opt == OMAP_ECC_BCH8_CODE_HW)
-			chip->read_buf(mtd, oob, 13);
-		else
-			chip->read_buf(mtd, oob, eccbytes);
-		/* read syndrome */
-		chip->ecc.calculate(mtd, p, &ecc_calc[i]);
+	gpmc_enable_hwecc_bch_page(info->ecc_opt, info->gpmc_cs, dev_width,
+					eccsteps);
 
-		data_pos += eccsize;
-		oob_pos += eccbytes;
+	/* page buffer and oob_poi are contiguous when reading to databuf */
+	if (buf + mtd->writesize == chip->oob_poi) {
+		chip->read_buf(mtd, buf, mtd->writesize + mtd->oobsize);
+	} else {
+		chip->read_buf(mtd, buf, mtd->writesize);
+		chip->read_buf(mtd, chip->oob_poi, mtd->oobsize);
 	}
 
+	gpmc_calculate_ecc_bch_page(info->ecc_opt, eccsteps, ecc_calc,
+					eccbytes);
+
 	for (i = 0; i < chip->ecc.total; i++)
 		ecc_code[i] = chip->oob_poi[eccpos[i]];
 
-	eccsteps = chip->ecc.steps;
-	p = buf;
+	for (i = 0; i < eccsteps; i++) {
+		u8 *code = &ecc_code[i * eccbytes];
+		u8 *calc = &ecc_calc[i * eccbytes];
+		u8 *syn = &syndrome[i * BCH8_ECC_OOB_BYTES];
+
+		err_vec[i].error_reported = false;
+
+		/* check if area is flashed */
+		erased = 1;
+		for (j = 0; j < BCH8_ECC_OOB_BYTES; j++)
+			if (code[j] != 0xFF)
+				erased = 0;
+		if (erased)
+			continue;
+
+		for (j = 0; j < BCH8_ECC_OOB_BYTES; j++) {
+			syn[j] = calc[j] ^ code[j];
+			if (syn[j])
+				err_vec[i].error_reported = true;
+		}
+
+		if (err_vec[i].error_reported)
+			pending++;
+	}
 
-	for (i = 0 ; eccsteps; eccsteps--, i += eccbytes, p += eccsize) {
-		int stat;
+	if (!pending)
+		return 0;
 
-		stat = chip->ecc.correct(mtd, p, &ecc_code[i], &ecc_calc[i]);
+	omap_elm_decode_bch_page(OMAP_BCH8_ECC, syndrome, err_vec, eccsteps);
 
-		if (stat < 0)
+	for (i = 0; i < eccsteps; i++) {
+		u8 *dat = buf + i * eccsize;
+
+		if (!err_vec[i].error_reported)
+			continue;
+
+		if (err_vec[i].error_uncorrectable) {
 			mtd->ecc_stats.failed++;
-		else
-			mtd->ecc_stats.corrected += stat;
+			continue;
+		}
+
+		for (j = 0; j < err_vec[i].error_count; j++) {
+			u32 bit_pos, byte_pos;
+
+			if (err_vec[i].error_loc[j] >= BCH8_ECC_MAX)
+				continue;
+
+			bit_pos   = err_vec[i].error_loc[j] % 8;
+			byte_pos  = (BCH8_ECC_MAX -
+					err_vec[i].error_loc[j] - 1) / 8;
+			/* ecc bytes themselves are not corrected */
+			if (byte_pos < eccsize)
+				dat[byte_pos] ^= 1 << bit_pos;
+		}
+
+		mtd->ecc_stats.corrected += err_vec[i].error_count;
 	}
+
 	return 0;
 }
 
@@ -1274,6 +1311,15 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 			omap_oobinfo.eccpos[i] = i+offset;
 
 		info->nand.ecc.layout = &omap_oobinfo;
+
+		/* whole page in one go, ELM decodes up to 8 sectors at once */
+		if (pdata->elm_used &&
+		    pdata->ecc_opt == OMAP_ECC_BCH8_CODE_HW &&
+		    info->mtd.writesize / info->nand.ecc.size <=
+							ELM_MAX_SECTORS &&
+		    omap_oobinfo.eccbytes == info->nand.ecc.bytes *
+				info->mtd.writesize / info->nand.ecc.size)
+			info->nand.ecc.read_page = omap_read_page_bch;
 	}
 
 	/* second phase scan */
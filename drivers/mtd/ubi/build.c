@@ -571,23 +571,25 @@ static void free_internal_volumes(struct ubi_device *ubi)
 /**
  * attach_by_scanning - attach an MTD device using scanning method.
  * @ubi: UBI device descriptor
+ * @force_scan: do not use the fastmap, scan the whole device
  *
  * This function returns zero in case of success and a negative error code in
  * case of failure.
  *
- * Note, currently this is the only method to attach UBI devices. Hopefully in
- * the future we'll have more scalable attaching methods and avoid full media
- * scanning. But even in this case scanning will be needed as a fall-back
- * attaching method if there are some on-flash table corruptions.
+ * Note, if the device contains a fastmap, the scanning information is built
+ * from it and only few PEBs are actually scanned (see fastmap.c). Full media
+ * scanning is the fall-back attaching method if the fastmap is absent, or
+ * does not match the volume table.
  */
-static int attach_by_scanning(struct ubi_device *ubi)
+static int attach_by_scanning(struct ubi_device *ubi, int force_scan)
 {
-	int err;
+	int err, fastmap;
 	struct ubi_scan_info *si;
 
-	si = ubi_scan(ubi);
+	si = ubi_scan(ubi, force_scan);
 	if (IS_ERR(si))
 		return PTR_ERR(si);
+	fastmap = si->fastmap;
 
 	ubi->bad_peb_count = si->bad_peb_count;
 	ubi->good_peb_count = ubi->peb_count - ubi->bad_peb_count;
@@ -597,6 +599,12 @@ static int attach_by_scanning(struct ubi_device *ubi)
 	ubi_msg("max. sequence number:       %llu", si->max_sqnum);
 
 	err = ubi_read_volume_table(ubi, si);
+	if (err == -EINVAL && fastmap) {
+		ubi_scan_destroy_si(si);
+		ubi_fastmap_close(ubi);
+		ubi_warn("fastmap does not match volume table, scanning");
+		return attach_by_scanning(ubi, 1);
+	}
 	if (err)
 		goto out_si;
 
@@ -608,6 +616,10 @@ static int attach_by_scanning(struct ubi_device *ubi)
 	if (err)
 		goto out_wl;
 
+	err = ubi_fastmap_init(ubi);
+	if (err)
+		goto out_wl;
+
 	ubi_scan_destroy_si(si);
 	return 0;
 
@@ -618,6 +630,7 @@ out_vtbl:
 	vfree(ubi->vtbl);
 out_si:
 	ubi_scan_destroy_si(si);
+	ubi_fastmap_close(ubi);
 	return err;
 }
 
@@ -934,6 +947,7 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	mutex_init(&ubi->buf_mutex);
 	mutex_init(&ubi->ckvol_mutex);
 	mutex_init(&ubi->device_mutex);
+	mutex_init(&ubi->fm_mutex);
 	spin_lock_init(&ubi->volumes_lock);
 
 	ubi_msg("attaching mtd%d to ubi%d", mtd->index, ubi_num);
@@ -957,7 +971,7 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	if (err)
 		goto out_free;
 
-	err = attach_by_scanning(ubi);
+	err = attach_by_scanning(ubi, 0);
 	if (err) {
 		dbg_err("failed to attach by scanning, error %d", err);
 		goto out_debugging;
@@ -1024,6 +1038,7 @@ out_uif:
 	uif_close(ubi);
 out_detach:
 	ubi_wl_close(ubi);
+	ubi_fastmap_close(ubi);
 	free_internal_volumes(ubi);
 	vfree(ubi->vtbl);
 out_debugging:
@@ -1094,9 +1109,13 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	 */
 	get_device(&ubi->dev);
 
+	/* Save the final state, so that the next attach does not scan */
+	ubi_update_fastmap(ubi);
+
 	ubi_debugfs_exit_dev(ubi);
 	uif_close(ubi);
 	ubi_wl_close(ubi);
+	ubi_fastmap_close(ubi);
 	free_internal_volumes(ubi);
 	vfree(ubi->vtbl);
 	put_mtd_device(ubi->mtd);
@@ -0,0 +1,1284 @@
+/*
+ * Copyright (c) International Business Machines Corp., 2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * UBI fastmap.
+ *
+ * Attaching by scanning reads the headers of every physical eraseblock, which
+ * takes long on large flashes. The fastmap is a checkpoint of the state which
+ * scanning would produce: the erase counters of all PEBs, which of them are
+ * free, used, to be scrubbed or to be erased, and the EBA tables of all
+ * volumes. It is stored in the fastmap internal volumes (see
+ * %UBI_FM_SB_VOLUME_ID), and its first PEB (the anchor) is one of the first
+ * %UBI_FM_MAX_START PEBs, so it is found by looking at few PEBs only.
+ *
+ * The fastmap is not updated on every change. Instead, UBI keeps the
+ * following two rules, which make it possible to attach from an old fastmap:
+ *
+ * o new data is only written to PEBs of the pool (@ubi->fm_pool), which is
+ *   recorded in the fastmap. The attach code scans the pool PEBs, and the
+ *   newer copy of a LEB wins as usual. When the pool runs empty, it is
+ *   refilled and a new fastmap is written;
+ * o a PEB the fastmap records as used is not erased before a new fastmap,
+ *   which does not record it as used any longer, is written.
+ *
+ * PEBs which the fastmap does not describe at all (bad, corrupted, alien PEBs
+ * and PEBs which were being moved or erased when it was written) are scanned
+ * at attach time as well. The sequence numbers of the LEBs are not stored, so
+ * when a scanned PEB contains a LEB the fastmap also refers to, the VID header
+ * of the PEB the fastmap refers to is read to find out which copy is newer.
+ *
+ * An outdated fastmap must never be found, so the anchor of the old fastmap is
+ * erased synchronously when a new one is written, and when the fastmap has to
+ * be dropped because a new one could not be written. If the newest anchor
+ * turns out to be invalid, or the fastmap does not match the volume table, UBI
+ * falls back to attaching by scanning.
+ *
+ * The fastmap occupies at most %UBI_FM_MAX_BLOCKS PEBs; twice as many PEBs are
+ * reserved, because the new fastmap is written before the old one is erased.
+ */
+
+#include <linux/crc32.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include "ubi.h"
+
+/* States of the PEBs while a fastmap is assembled, see 'fm_fill()' */
+enum {
+	FM_ST_UNLISTED = 0,
+	FM_ST_FREE,
+	FM_ST_USED,
+	FM_ST_SCRUB,
+	FM_ST_ERASE,
+	FM_ST_POOL,
+	FM_ST_FM,
+	FM_ST_MAYBE_USED,
+	FM_ST_MAYBE_SCRUB,
+};
+
+/*
+ * How many times the pool is refilled without fastmap before writing a
+ * fastmap is tried again after a failure.
+ */
+#define FM_RETRY_REFILLS 8
+
+/**
+ * fm_data - get the next structure of a fastmap being parsed.
+ * @buf: the fastmap
+ * @size: size of the fastmap
+ * @pos: current position in @buf, advanced by @len
+ * @len: length of the structure
+ *
+ * This function returns a pointer to the structure or %NULL if the fastmap
+ * ends before it.
+ */
+static void *fm_data(void *buf, size_t size, size_t *pos, size_t len)
+{
+	void *p;
+
+	if (*pos + len > size)
+		return NULL;
+
+	p = buf + *pos;
+	*pos += len;
+	return p;
+}
+
+/**
+ * fm_mark - check and mark a PEB listed in the fastmap.
+ * @ubi: UBI device description object
+ * @seen: bitmap of the PEBs listed so far
+ * @pnum: the physical eraseblock number
+ *
+ * This function returns non-zero if @pnum is out of range or listed twice.
+ */
+static int fm_mark(struct ubi_device *ubi, unsigned long *seen, int pnum)
+{
+	if (pnum < 0 || pnum >= ubi->peb_count) {
+		ubi_err("bad PEB %d in fastmap", pnum);
+		return 1;
+	}
+	if (test_and_set_bit(pnum, seen)) {
+		ubi_err("PEB %d is listed twice in fastmap", pnum);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * fm_add_ec - account an erase counter.
+ * @si: scanning information
+ * @ec: the erase counter
+ */
+static void fm_add_ec(struct ubi_scan_info *si, int ec)
+{
+	si->ec_sum += ec;
+	si->ec_count += 1;
+	if (ec > si->max_ec)
+		si->max_ec = ec;
+	if (ec < si->min_ec)
+		si->min_ec = ec;
+}
+
+/**
+ * scan_peb - scan a PEB the fastmap does not know the contents of.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @pnum: the physical eraseblock to scan
+ * @vh: VID header buffer
+ *
+ * If the PEB contains a LEB the fastmap refers to as well, the sequence number
+ * of the fastmap copy is read first, so that 'ubi_scan_add_used()' picks the
+ * newer copy. This function returns zero in case of success and a negative
+ * error code in case of failure.
+ */
+static int scan_peb(struct ubi_device *ubi, struct ubi_scan_info *si, int pnum,
+		    struct ubi_vid_hdr *vh)
+{
+	int err, vol_id, lnum;
+	struct ubi_scan_volume *sv;
+	struct ubi_scan_leb *seb;
+
+	err = ubi_io_is_bad(ubi, pnum);
+	if (err < 0)
+		return err;
+	if (err)
+		goto scan;
+
+	err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+	if (err < 0)
+		return err;
+	if (err && err != UBI_IO_BITFLIPS)
+		goto scan;
+
+	vol_id = be32_to_cpu(vh->vol_id);
+	lnum = be32_to_cpu(vh->lnum);
+	sv = ubi_scan_find_sv(si, vol_id);
+	if (!sv)
+		goto scan;
+	seb = ubi_scan_find_seb(sv, lnum);
+	if (!seb || seb->sqnum)
+		goto scan;
+
+	err = ubi_io_read_vid_hdr(ubi, seb->pnum, vh, 0);
+	if (err < 0)
+		return err;
+	if ((err && err != UBI_IO_BITFLIPS) ||
+	    be32_to_cpu(vh->vol_id) != vol_id ||
+	    be32_to_cpu(vh->lnum) != lnum) {
+		ubi_err("fastmap maps LEB %d:%d to PEB %d, which does not "
+			"contain it", vol_id, lnum, seb->pnum);
+		return -EINVAL;
+	}
+	seb->sqnum = be64_to_cpu(vh->sqnum);
+	seb->copy_flag = vh->copy_flag;
+
+scan:
+	return ubi_scan_peb(ubi, si, pnum);
+}
+
+/**
+ * fm_attach - build scanning information from a fastmap.
+ * @ubi: UBI device description object
+ * @si: scanning information to fill
+ * @buf: the fastmap, starting with the super block
+ * @size: size of the fastmap
+ *
+ * This function returns zero in case of success, %UBI_NO_FASTMAP if the
+ * fastmap is inconsistent, and a negative error code in case of failure. In
+ * case of success @ubi->fm describes the fastmap.
+ */
+static int fm_attach(struct ubi_device *ubi, struct ubi_scan_info *si,
+		     void *buf, size_t size)
+{
+	int i, j, n, err, pnum, ec, vol_id, pool_size, vol_count, unlisted;
+	size_t pos = sizeof(struct ubi_fm_sb), vols_pos;
+	struct ubi_fm_sb *fmsb = buf;
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_scan_pool *fmpl;
+	struct ubi_fm_volhdr *fmvhdr;
+	struct ubi_fm_ec *fmec[4];
+	struct ubi_fastmap_layout *fm;
+	struct ubi_vid_hdr *vh;
+	unsigned long *seen, *scrub;
+	int *used_ec;
+	__be32 *pool, *eba;
+
+	/* First check that all the structures are there */
+	fmhdr = fm_data(buf, size, &pos, sizeof(struct ubi_fm_hdr));
+	if (!fmhdr || be32_to_cpu(fmhdr->magic) != UBI_FM_HDR_MAGIC)
+		return UBI_NO_FASTMAP;
+
+	i = be32_to_cpu(fmhdr->image_seq);
+	if (ubi->image_seq && i && ubi->image_seq != i) {
+		ubi_err("bad image sequence number %d in fastmap, expected %d",
+			i, ubi->image_seq);
+		return UBI_NO_FASTMAP;
+	}
+
+	fmpl = fm_data(buf, size, &pos, sizeof(struct ubi_fm_scan_pool));
+	if (!fmpl || be32_to_cpu(fmpl->magic) != UBI_FM_POOL_MAGIC)
+		return UBI_NO_FASTMAP;
+	pool_size = be32_to_cpu(fmpl->size);
+	if (pool_size < 0 || pool_size > UBI_FM_MAX_POOL_SIZE)
+		return UBI_NO_FASTMAP;
+	pool = fm_data(buf, size, &pos, pool_size * sizeof(__be32));
+	if (!pool)
+		return UBI_NO_FASTMAP;
+
+	vol_count = be32_to_cpu(fmhdr->vol_count);
+	if (vol_count < 0 || vol_count > UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT)
+		return UBI_NO_FASTMAP;
+	vols_pos = pos;
+	for (i = 0; i < vol_count; i++) {
+		fmvhdr = fm_data(buf, size, &pos, sizeof(struct ubi_fm_volhdr));
+		if (!fmvhdr || be32_to_cpu(fmvhdr->magic) != UBI_FM_VHDR_MAGIC)
+			return UBI_NO_FASTMAP;
+		n = be32_to_cpu(fmvhdr->reserved_pebs);
+		if (n < 0 || n > ubi->peb_count ||
+		    !fm_data(buf, size, &pos, n * sizeof(__be32)))
+			return UBI_NO_FASTMAP;
+	}
+
+	for (i = 0; i < 4; i++) {
+		n = be32_to_cpu((&fmhdr->free_peb_count)[i]);
+		if (n < 0 || n > ubi->peb_count)
+			return UBI_NO_FASTMAP;
+		fmec[i] = fm_data(buf, size, &pos,
+				  n * sizeof(struct ubi_fm_ec));
+		if (!fmec[i])
+			return UBI_NO_FASTMAP;
+	}
+
+	err = -ENOMEM;
+	n = BITS_TO_LONGS(ubi->peb_count);
+	seen = kcalloc(n, sizeof(unsigned long), GFP_KERNEL);
+	if (!seen)
+		return err;
+	scrub = kcalloc(n, sizeof(unsigned long), GFP_KERNEL);
+	if (!scrub)
+		goto out_seen;
+	used_ec = vmalloc(ubi->peb_count * sizeof(int));
+	if (!used_ec)
+		goto out_scrub;
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh)
+		goto out_used_ec;
+	fm = kzalloc(sizeof(struct ubi_fastmap_layout), GFP_KERNEL);
+	if (!fm)
+		goto out_vh;
+
+	for (i = 0; i < ubi->peb_count; i++)
+		used_ec[i] = -1;
+
+	/* The PEBs of the fastmap itself */
+	for (i = 0; i < be32_to_cpu(fmsb->used_blocks); i++) {
+		struct ubi_wl_entry *e;
+
+		pnum = be32_to_cpu(fmsb->block_loc[i]);
+		ec = be32_to_cpu(fmsb->block_ec[i]);
+		if (fm_mark(ubi, seen, pnum))
+			goto out_bad;
+
+		e = kmem_cache_alloc(ubi_wl_entry_slab, GFP_KERNEL);
+		if (!e) {
+			err = -ENOMEM;
+			goto out_fm;
+		}
+		e->pnum = pnum;
+		e->ec = ec;
+		fm->e[i] = e;
+		fm->used_blocks += 1;
+		fm_add_ec(si, ec);
+	}
+
+	for (i = 0; i < pool_size; i++)
+		if (fm_mark(ubi, seen, be32_to_cpu(pool[i])))
+			goto out_bad;
+
+	/* Free, used, scrub and erase lists */
+	for (i = 0; i < 4; i++) {
+		n = be32_to_cpu((&fmhdr->free_peb_count)[i]);
+		for (j = 0; j < n; j++) {
+			pnum = be32_to_cpu(fmec[i][j].pnum);
+			ec = be32_to_cpu(fmec[i][j].ec);
+			if (fm_mark(ubi, seen, pnum))
+				goto out_bad;
+			if (ec < 0 || ec > UBI_MAX_ERASECOUNTER) {
+				ubi_err("bad erase counter %d of PEB %d in "
+					"fastmap", ec, pnum);
+				goto out_bad;
+			}
+
+			err = 0;
+			switch (i) {
+			case 0:
+				err = ubi_scan_add_to_list(si, pnum, ec, 0,
+							   &si->free);
+				break;
+			case 2:
+				set_bit(pnum, scrub);
+				/* Fall through */
+			case 1:
+				used_ec[pnum] = ec;
+				break;
+			case 3:
+				/*
+				 * The PEB might have gone bad when it was
+				 * erased after the fastmap had been written.
+				 */
+				err = ubi_io_is_bad(ubi, pnum);
+				if (err > 0) {
+					si->bad_peb_count += 1;
+					continue;
+				}
+				if (!err)
+					err = ubi_scan_add_to_list(si, pnum, ec,
+								   0,
+								   &si->erase);
+				break;
+			}
+			if (err)
+				goto out_fm;
+			fm_add_ec(si, ec);
+		}
+	}
+
+	/* Volumes */
+	pos = vols_pos;
+	for (i = 0; i < vol_count; i++) {
+		int vol_type, used_ebs, data_pad, last_eb_bytes;
+
+		fmvhdr = fm_data(buf, size, &pos, sizeof(struct ubi_fm_volhdr));
+		n = be32_to_cpu(fmvhdr->reserved_pebs);
+		eba = fm_data(buf, size, &pos, n * sizeof(__be32));
+
+		vol_id = be32_to_cpu(fmvhdr->vol_id);
+		vol_type = fmvhdr->vol_type;
+		used_ebs = be32_to_cpu(fmvhdr->used_ebs);
+		data_pad = be32_to_cpu(fmvhdr->data_pad);
+		last_eb_bytes = be32_to_cpu(fmvhdr->last_eb_bytes);
+		if ((vol_id < 0 || vol_id >= UBI_MAX_VOLUMES) &&
+		    vol_id != UBI_LAYOUT_VOLUME_ID) {
+			ubi_err("bad volume ID %d in fastmap", vol_id);
+			goto out_bad;
+		}
+		if (vol_type != UBI_VID_DYNAMIC && vol_type != UBI_VID_STATIC) {
+			ubi_err("bad type of volume %d in fastmap", vol_id);
+			goto out_bad;
+		}
+
+		memset(vh, 0, sizeof(struct ubi_vid_hdr));
+		vh->vol_type = vol_type;
+		vh->compat = fmvhdr->compat;
+		vh->vol_id = cpu_to_be32(vol_id);
+		vh->used_ebs = cpu_to_be32(used_ebs);
+		vh->data_pad = cpu_to_be32(data_pad);
+
+		for (j = 0; j < n; j++) {
+			if (be32_to_cpu(eba[j]) == UBI_FM_UNMAPPED)
+				continue;
+
+			pnum = be32_to_cpu(eba[j]);
+			if (pnum < 0 || pnum >= ubi->peb_count ||
+			    used_ec[pnum] < 0) {
+				ubi_err("LEB %d:%d is mapped to PEB %d, which "
+					"is not used in fastmap", vol_id, j,
+					pnum);
+				goto out_bad;
+			}
+
+			vh->lnum = cpu_to_be32(j);
+			if (vol_type == UBI_VID_STATIC) {
+				int data_size = ubi->leb_size - data_pad;
+
+				if (j == used_ebs - 1)
+					data_size = last_eb_bytes;
+				vh->data_size = cpu_to_be32(data_size);
+			}
+
+			err = ubi_scan_add_used(ubi, si, pnum, used_ec[pnum],
+						vh, test_bit(pnum, scrub));
+			if (err == -ENOMEM)
+				goto out_fm;
+			if (err)
+				goto out_bad;
+			used_ec[pnum] = -1;
+		}
+	}
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++)
+		if (used_ec[pnum] >= 0) {
+			ubi_err("used PEB %d is not mapped in fastmap", pnum);
+			goto out_bad;
+		}
+
+	unlisted = ubi->peb_count - bitmap_weight(seen, ubi->peb_count);
+	if (unlisted != be32_to_cpu(fmhdr->untracked_peb_count)) {
+		ubi_err("fastmap does not describe %d PEBs, expected %d",
+			unlisted, be32_to_cpu(fmhdr->untracked_peb_count));
+		goto out_bad;
+	}
+
+	si->max_sqnum = max_t(unsigned long long, be64_to_cpu(fmsb->sqnum),
+			      be64_to_cpu(fmhdr->global_sqnum));
+
+	/*
+	 * Now scan the pool and the PEBs the fastmap does not describe. The
+	 * pool goes first, as it contains the newest data.
+	 */
+	for (i = 0; i < pool_size; i++) {
+		err = scan_peb(ubi, si, be32_to_cpu(pool[i]), vh);
+		if (err)
+			goto out_err;
+	}
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (test_bit(pnum, seen))
+			continue;
+		cond_resched();
+		err = scan_peb(ubi, si, pnum, vh);
+		if (err)
+			goto out_err;
+	}
+
+	ubi_msg("attached by fastmap, scanned %d PEBs",
+		pool_size + unlisted);
+	si->fastmap = 1;
+	ubi->fm = fm;
+	err = 0;
+	goto out_vh;
+
+out_err:
+	if (err == -ENOMEM)
+		goto out_fm;
+out_bad:
+	err = UBI_NO_FASTMAP;
+out_fm:
+	for (i = 0; i < fm->used_blocks; i++)
+		kmem_cache_free(ubi_wl_entry_slab, fm->e[i]);
+	kfree(fm);
+out_vh:
+	ubi_free_vid_hdr(ubi, vh);
+out_used_ec:
+	vfree(used_ec);
+out_scrub:
+	kfree(scrub);
+out_seen:
+	kfree(seen);
+	return err;
+}
+
+/**
+ * read_fastmap - read and check the fastmap.
+ * @ubi: UBI device description object
+ * @anchor: the anchor PEB
+ * @sqnum: sequence number of the anchor VID header
+ * @vh: VID header buffer
+ * @fm_buf: the fastmap is returned here
+ * @fm_size: size of the fastmap is returned here
+ *
+ * This function reads all the PEBs of the fastmap and checks the CRCs. It
+ * returns zero in case of success, %UBI_NO_FASTMAP if the fastmap is not
+ * valid, and a negative error code in case of failure.
+ */
+static int read_fastmap(struct ubi_device *ubi, int anchor,
+			unsigned long long sqnum, struct ubi_vid_hdr *vh,
+			void **fm_buf, size_t *fm_size)
+{
+	int i, err, pnum, used_blocks;
+	uint32_t crc;
+	size_t size;
+	struct ubi_fm_sb *fmsb;
+	void *buf;
+
+	fmsb = kmalloc(sizeof(struct ubi_fm_sb), GFP_KERNEL);
+	if (!fmsb)
+		return -ENOMEM;
+
+	err = ubi_io_read_data(ubi, fmsb, anchor, 0, sizeof(struct ubi_fm_sb));
+	if (err && err != UBI_IO_BITFLIPS) {
+		ubi_err("cannot read fastmap super block from PEB %d, error %d",
+			anchor, err);
+		err = UBI_NO_FASTMAP;
+		goto out_sb;
+	}
+
+	crc = crc32(UBI_CRC32_INIT, fmsb, sizeof(struct ubi_fm_sb) - 4);
+	used_blocks = be32_to_cpu(fmsb->used_blocks);
+	if (be32_to_cpu(fmsb->magic) != UBI_FM_SB_MAGIC ||
+	    crc != be32_to_cpu(fmsb->sb_crc)) {
+		ubi_err("bad fastmap super block in PEB %d", anchor);
+		err = UBI_NO_FASTMAP;
+		goto out_sb;
+	}
+	if (fmsb->version != UBI_FM_FMT_VERSION) {
+		ubi_err("fastmap version is %d, this UBI supports %d",
+			fmsb->version, UBI_FM_FMT_VERSION);
+		err = UBI_NO_FASTMAP;
+		goto out_sb;
+	}
+	if (be64_to_cpu(fmsb->sqnum) != sqnum || used_blocks < 1 ||
+	    used_blocks > UBI_FM_MAX_BLOCKS ||
+	    be32_to_cpu(fmsb->block_loc[0]) != anchor) {
+		ubi_err("inconsistent fastmap super block in PEB %d", anchor);
+		err = UBI_NO_FASTMAP;
+		goto out_sb;
+	}
+
+	size = used_blocks * ubi->leb_size;
+	buf = vmalloc(size);
+	if (!buf) {
+		err = -ENOMEM;
+		goto out_sb;
+	}
+
+	for (i = 0; i < used_blocks; i++) {
+		pnum = be32_to_cpu(fmsb->block_loc[i]);
+		if (pnum < 0 || pnum >= ubi->peb_count)
+			goto out_bad;
+
+		if (i > 0) {
+			err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+			if ((err && err != UBI_IO_BITFLIPS) ||
+			    be32_to_cpu(vh->vol_id) != UBI_FM_DATA_VOLUME_ID ||
+			    be32_to_cpu(vh->lnum) != i)
+				goto out_bad;
+		}
+
+		err = ubi_io_read_data(ubi, buf + i * ubi->leb_size, pnum, 0,
+				       ubi->leb_size);
+		if (err && err != UBI_IO_BITFLIPS)
+			goto out_bad;
+	}
+
+	crc = crc32(UBI_CRC32_INIT, buf + sizeof(struct ubi_fm_sb),
+		    size - sizeof(struct ubi_fm_sb));
+	if (crc != be32_to_cpu(fmsb->data_crc))
+		goto out_bad;
+
+	*fm_buf = buf;
+	*fm_size = size;
+	kfree(fmsb);
+	return 0;
+
+out_bad:
+	ubi_err("fastmap data in PEB %d is not valid", pnum);
+	vfree(buf);
+	err = UBI_NO_FASTMAP;
+out_sb:
+	kfree(fmsb);
+	return err;
+}
+
+/**
+ * ubi_scan_fastmap - attach an MTD device using the fastmap.
+ * @ubi: UBI device description object
+ * @si: empty scanning information to fill
+ *
+ * This function looks for the newest fastmap anchor among the first
+ * %UBI_FM_MAX_START PEBs and builds the scanning information from the
+ * fastmap. It returns zero in case of success, %UBI_NO_FASTMAP if the device
+ * has to be scanned, and a negative error code in case of failure. Note, @si
+ * may be partially filled when %UBI_NO_FASTMAP is returned.
+ */
+int ubi_scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int err, pnum, anchor = -1, image_seq;
+	unsigned long long sqnum = 0;
+	struct ubi_ec_hdr *ech;
+	struct ubi_vid_hdr *vh;
+	void *buf = NULL;
+	size_t size;
+
+	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+	if (!ech)
+		return -ENOMEM;
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh) {
+		err = -ENOMEM;
+		goto out_ech;
+	}
+
+	for (pnum = 0; pnum < ubi->peb_count && pnum < UBI_FM_MAX_START;
+	     pnum++) {
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out;
+		if (err)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+		if (err < 0)
+			goto out;
+		if (err == UBI_IO_BAD_HDR || err == UBI_IO_BAD_HDR_EBADMSG) {
+			/*
+			 * This might be an anchor which was being written when
+			 * a power cut happened. Its predecessor is outdated
+			 * then, so do not use any fastmap.
+			 */
+			ubi_msg("corrupted VID header in PEB %d, scanning",
+				pnum);
+			err = UBI_NO_FASTMAP;
+			goto out;
+		}
+		if (err == UBI_IO_FF || err == UBI_IO_FF_BITFLIPS)
+			continue;
+
+		if (be32_to_cpu(vh->vol_id) != UBI_FM_SB_VOLUME_ID)
+			continue;
+		if (anchor < 0 || be64_to_cpu(vh->sqnum) > sqnum) {
+			anchor = pnum;
+			sqnum = be64_to_cpu(vh->sqnum);
+		}
+	}
+
+	if (anchor < 0) {
+		dbg_bld("no fastmap found");
+		err = UBI_NO_FASTMAP;
+		goto out;
+	}
+
+	err = ubi_io_read_ec_hdr(ubi, anchor, ech, 0);
+	if ((err && err != UBI_IO_BITFLIPS) || ech->version != UBI_VERSION) {
+		ubi_err("bad EC header in fastmap anchor PEB %d", anchor);
+		err = UBI_NO_FASTMAP;
+		goto out;
+	}
+
+	image_seq = be32_to_cpu(ech->image_seq);
+	if (image_seq)
+		ubi->image_seq = image_seq;
+
+	err = read_fastmap(ubi, anchor, sqnum, vh, &buf, &size);
+	if (err)
+		goto out;
+
+	dbg_bld("fastmap anchor at PEB %d, sqnum %llu, %zd bytes",
+		anchor, sqnum, size);
+	err = fm_attach(ubi, si, buf, size);
+	vfree(buf);
+
+out:
+	if (err < 0 && err != -ENOMEM) {
+		ubi_err("error %d while attaching by fastmap", err);
+		err = UBI_NO_FASTMAP;
+	}
+	if (err == UBI_NO_FASTMAP) {
+		if (anchor >= 0)
+			ubi_warn("cannot use fastmap, scanning");
+		ubi->image_seq = 0;
+	}
+	ubi_free_vid_hdr(ubi, vh);
+out_ech:
+	kfree(ech);
+	return err;
+}
+
+/**
+ * enough_free - check if there are enough free PEBs.
+ * @ubi: UBI device description object
+ * @n: how many free PEBs are needed
+ *
+ * Note, @ubi->wl_lock has to be locked.
+ */
+static int enough_free(struct ubi_device *ubi, int n)
+{
+	struct rb_node *p;
+
+	for (p = rb_first(&ubi->free); p && n > 0; p = rb_next(p))
+		n -= 1;
+	return n <= 0;
+}
+
+/**
+ * fm_fill - take a snapshot of the UBI state and serialize it.
+ * @ubi: UBI device description object
+ * @new_fm: the PEBs the fastmap will be written to
+ *
+ * This function refills the pool and assembles the fastmap in @ubi->fm_buf.
+ * Everything except the sequence number and the CRCs of the super block is
+ * filled in. In case of success the pool is held back (nothing is handed out
+ * of it) until the fastmap is written. Returns zero in case of success and a
+ * negative error code in case of failure.
+ */
+static int fm_fill(struct ubi_device *ubi, struct ubi_fastmap_layout *new_fm)
+{
+	static const int lists[4] = {
+		FM_ST_FREE, FM_ST_USED, FM_ST_SCRUB, FM_ST_ERASE,
+	};
+	int i, j, pnum, count, vol_count = 0, untracked = 0, err = 0;
+	unsigned long long sqnum;
+	unsigned char *state = ubi->fm_state;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_fastmap_layout *old_fm = ubi->fm;
+	void *buf = ubi->fm_buf;
+	size_t pos = 0, len;
+	struct ubi_fm_sb *fmsb;
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_scan_pool *fmpl;
+	struct ubi_fm_volhdr *fmvhdr;
+	struct ubi_fm_ec *fmec;
+	struct ubi_volume *vol;
+	struct ubi_wl_entry *e;
+	struct ubi_work *wrk;
+	struct rb_node *rb;
+	__be32 *p;
+
+	memset(buf, 0, ubi->fm_size);
+	memset(state, FM_ST_UNLISTED, ubi->peb_count);
+
+	spin_lock(&ubi->ltree_lock);
+	sqnum = ubi->global_sqnum;
+	spin_unlock(&ubi->ltree_lock);
+
+	spin_lock(&ubi->volumes_lock);
+	spin_lock(&ubi->wl_lock);
+
+	ubi_wl_refill_pool(ubi);
+
+	/*
+	 * Used PEBs are only recorded as used if an EBA table refers to them,
+	 * the others are scanned at attach time.
+	 */
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb)
+		state[e->pnum] = FM_ST_FREE;
+	ubi_rb_for_each_entry(rb, e, &ubi->used, u.rb)
+		state[e->pnum] = FM_ST_MAYBE_USED;
+	ubi_rb_for_each_entry(rb, e, &ubi->erroneous, u.rb)
+		state[e->pnum] = FM_ST_MAYBE_USED;
+	ubi_rb_for_each_entry(rb, e, &ubi->scrub, u.rb)
+		state[e->pnum] = FM_ST_MAYBE_SCRUB;
+	for (i = 0; i < UBI_PROT_QUEUE_LEN; i++)
+		list_for_each_entry(e, &ubi->pq[i], u.list)
+			state[e->pnum] = FM_ST_MAYBE_USED;
+	if (ubi->move_from)
+		state[ubi->move_from->pnum] = FM_ST_MAYBE_USED;
+	if (ubi->move_to)
+		state[ubi->move_to->pnum] = FM_ST_MAYBE_USED;
+	list_for_each_entry(wrk, &ubi->works, list)
+		if (ubi_is_erase_work(wrk))
+			state[wrk->e->pnum] = FM_ST_ERASE;
+	for (i = 0; i < pool->size; i++)
+		state[pool->pebs[i]] = FM_ST_POOL;
+	if (old_fm)
+		for (i = 0; i < old_fm->used_blocks; i++)
+			state[old_fm->e[i]->pnum] = FM_ST_ERASE;
+	for (i = 0; i < new_fm->used_blocks; i++)
+		state[new_fm->e[i]->pnum] = FM_ST_FM;
+
+	fmsb = buf;
+	pos = sizeof(struct ubi_fm_sb);
+	fmhdr = buf + pos;
+	pos += sizeof(struct ubi_fm_hdr);
+	fmpl = buf + pos;
+	pos += sizeof(struct ubi_fm_scan_pool);
+
+	fmpl->magic = cpu_to_be32(UBI_FM_POOL_MAGIC);
+	fmpl->size = cpu_to_be32(pool->size);
+	p = buf + pos;
+	for (i = 0; i < pool->size; i++)
+		p[i] = cpu_to_be32(pool->pebs[i]);
+	pos += pool->size * sizeof(__be32);
+
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		vol = ubi->volumes[i];
+		if (!vol)
+			continue;
+
+		len = sizeof(struct ubi_fm_volhdr) +
+		      vol->reserved_pebs * sizeof(__be32);
+		if (pos + len > ubi->fm_size) {
+			err = -ENOSPC;
+			goto out_unlock;
+		}
+
+		fmvhdr = buf + pos;
+		fmvhdr->magic = cpu_to_be32(UBI_FM_VHDR_MAGIC);
+		fmvhdr->vol_id = cpu_to_be32(vol->vol_id);
+		if (vol->vol_type == UBI_DYNAMIC_VOLUME)
+			fmvhdr->vol_type = UBI_VID_DYNAMIC;
+		else
+			fmvhdr->vol_type = UBI_VID_STATIC;
+		if (vol->vol_id == UBI_LAYOUT_VOLUME_ID)
+			fmvhdr->compat = UBI_LAYOUT_VOLUME_COMPAT;
+		fmvhdr->reserved_pebs = cpu_to_be32(vol->reserved_pebs);
+		fmvhdr->used_ebs = cpu_to_be32(vol->used_ebs);
+		fmvhdr->data_pad = cpu_to_be32(vol->data_pad);
+		fmvhdr->last_eb_bytes = cpu_to_be32(vol->last_eb_bytes);
+
+		p = (__be32 *)(fmvhdr + 1);
+		for (j = 0; j < vol->reserved_pebs; j++) {
+			pnum = vol->eba_tbl[j];
+			if (pnum >= 0 && state[pnum] == FM_ST_MAYBE_USED)
+				state[pnum] = FM_ST_USED;
+			else if (pnum >= 0 && state[pnum] == FM_ST_MAYBE_SCRUB)
+				state[pnum] = FM_ST_SCRUB;
+			else
+				/* Unmapped, or in transit - will be scanned */
+				pnum = UBI_FM_UNMAPPED;
+			p[j] = cpu_to_be32(pnum);
+		}
+
+		pos += len;
+		vol_count += 1;
+	}
+
+	for (i = 0; i < 4; i++) {
+		count = 0;
+		for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+			if (state[pnum] != lists[i])
+				continue;
+
+			if (pos + sizeof(struct ubi_fm_ec) > ubi->fm_size) {
+				err = -ENOSPC;
+				goto out_unlock;
+			}
+			fmec = buf + pos;
+			fmec->pnum = cpu_to_be32(pnum);
+			fmec->ec = cpu_to_be32(ubi->lookuptbl[pnum]->ec);
+			pos += sizeof(struct ubi_fm_ec);
+			count += 1;
+		}
+		(&fmhdr->free_peb_count)[i] = cpu_to_be32(count);
+	}
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++)
+		if (state[pnum] == FM_ST_UNLISTED ||
+		    state[pnum] == FM_ST_MAYBE_USED ||
+		    state[pnum] == FM_ST_MAYBE_SCRUB)
+			untracked += 1;
+
+	fmhdr->magic = cpu_to_be32(UBI_FM_HDR_MAGIC);
+	fmhdr->bad_peb_count = cpu_to_be32(ubi->bad_peb_count);
+	fmhdr->corr_peb_count = cpu_to_be32(ubi->corr_peb_count);
+	fmhdr->untracked_peb_count = cpu_to_be32(untracked);
+	fmhdr->vol_count = cpu_to_be32(vol_count);
+	fmhdr->global_sqnum = cpu_to_be64(sqnum);
+	fmhdr->image_seq = cpu_to_be32(ubi->image_seq);
+
+	/* Nothing may be written to the pool before the fastmap is */
+	pool->used = pool->size;
+
+out_unlock:
+	spin_unlock(&ubi->wl_lock);
+	spin_unlock(&ubi->volumes_lock);
+	if (err) {
+		ubi_err("fastmap does not fit %zd bytes", ubi->fm_size);
+		return err;
+	}
+
+	fmsb->magic = cpu_to_be32(UBI_FM_SB_MAGIC);
+	fmsb->version = UBI_FM_FMT_VERSION;
+	fmsb->used_blocks = cpu_to_be32(new_fm->used_blocks);
+	for (i = 0; i < new_fm->used_blocks; i++) {
+		fmsb->block_loc[i] = cpu_to_be32(new_fm->e[i]->pnum);
+		fmsb->block_ec[i] = cpu_to_be32(new_fm->e[i]->ec);
+	}
+
+	dbg_gen("fastmap: %d volumes, %d pool PEBs, %d untracked PEBs",
+		vol_count, pool->size, untracked);
+	return 0;
+}
+
+/**
+ * fm_write - write the assembled fastmap to flash.
+ * @ubi: UBI device description object
+ * @new_fm: the PEBs to write the fastmap to
+ *
+ * The anchor is written first: if a power cut interrupts writing, the newest
+ * anchor is invalid and the attach code falls back to scanning, instead of
+ * using the previous fastmap, which does not know about the PEBs written
+ * here. Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+static int fm_write(struct ubi_device *ubi, struct ubi_fastmap_layout *new_fm)
+{
+	int i, err = 0;
+	unsigned long long sqnum[UBI_FM_MAX_BLOCKS];
+	struct ubi_fm_sb *fmsb = ubi->fm_buf;
+	struct ubi_vid_hdr *vh;
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vh)
+		return -ENOMEM;
+
+	/* The anchor gets the highest sequence number of the fastmap */
+	for (i = 1; i < new_fm->used_blocks; i++)
+		sqnum[i] = ubi_next_sqnum(ubi);
+	sqnum[0] = ubi_next_sqnum(ubi);
+
+	fmsb->sqnum = cpu_to_be64(sqnum[0]);
+	fmsb->data_crc = cpu_to_be32(crc32(UBI_CRC32_INIT,
+					   ubi->fm_buf + sizeof(*fmsb),
+					   ubi->fm_size - sizeof(*fmsb)));
+	fmsb->sb_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, fmsb,
+					 sizeof(*fmsb) - 4));
+
+	vh->vol_type = UBI_VID_DYNAMIC;
+	vh->compat = UBI_FM_VOLUME_COMPAT;
+	for (i = 0; i < new_fm->used_blocks; i++) {
+		int pnum = new_fm->e[i]->pnum;
+
+		if (i == 0)
+			vh->vol_id = cpu_to_be32(UBI_FM_SB_VOLUME_ID);
+		else
+			vh->vol_id = cpu_to_be32(UBI_FM_DATA_VOLUME_ID);
+		vh->lnum = cpu_to_be32(i);
+		vh->sqnum = cpu_to_be64(sqnum[i]);
+
+		err = ubi_io_write_vid_hdr(ubi, pnum, vh);
+		if (err) {
+			ubi_err("cannot write fastmap VID header to PEB %d",
+				pnum);
+			break;
+		}
+
+		err = ubi_io_write_data(ubi, ubi->fm_buf + i * ubi->leb_size,
+					pnum, 0, ubi->leb_size);
+		if (err) {
+			ubi_err("cannot write fastmap to PEB %d", pnum);
+			break;
+		}
+	}
+
+	ubi_free_vid_hdr(ubi, vh);
+	return err;
+}
+
+/**
+ * put_fm_pebs - return the PEBs of a fastmap.
+ * @ubi: UBI device description object
+ * @fm: the fastmap
+ * @sync: erase the anchor synchronously
+ *
+ * This function frees @fm. It returns zero in case of success and a negative
+ * error code if the anchor could not be erased, in which case @fm is not
+ * freed and UBI is switched to R/O mode.
+ */
+static int put_fm_pebs(struct ubi_device *ubi, struct ubi_fastmap_layout *fm,
+		       int sync)
+{
+	int i, err;
+
+	err = ubi_wl_put_fm_peb(ubi, fm->e[0], sync);
+	if (err) {
+		ubi_err("cannot erase fastmap anchor PEB %d, error %d",
+			fm->e[0]->pnum, err);
+		ubi_ro_mode(ubi);
+		return err;
+	}
+
+	for (i = 1; i < fm->used_blocks; i++)
+		if (ubi_wl_put_fm_peb(ubi, fm->e[i], 0))
+			ubi_ro_mode(ubi);
+
+	kfree(fm);
+	return 0;
+}
+
+/**
+ * invalidate_fastmap - make sure the current fastmap is not used any more.
+ * @ubi: UBI device description object
+ *
+ * This function erases the anchor of the current fastmap. Until the next
+ * fastmap is written, the device is attached by scanning. Returns zero in case
+ * of success and a negative error code in case of failure.
+ */
+static int invalidate_fastmap(struct ubi_device *ubi)
+{
+	int err;
+
+	if (!ubi->fm)
+		return 0;
+
+	ubi_warn("invalidate fastmap");
+	err = put_fm_pebs(ubi, ubi->fm, 1);
+	if (err)
+		return err;
+
+	ubi->fm = NULL;
+	if (ubi->fm_used)
+		bitmap_zero(ubi->fm_used, ubi->peb_count);
+	return 0;
+}
+
+/**
+ * update_fastmap - write a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function refills the pool, writes a new fastmap and returns the PEBs
+ * of the old one. If the new fastmap cannot be written, the old one is
+ * invalidated. Returns zero in case of success and a negative error code in
+ * case of failure. Note, @ubi->fm_mutex has to be locked.
+ */
+static int update_fastmap(struct ubi_device *ubi)
+{
+	int i, err, held = 0, blocks = ubi->fm_size / ubi->leb_size;
+	struct ubi_fastmap_layout *new_fm, *old_fm = ubi->fm;
+
+	if (ubi->ro_mode)
+		return -EROFS;
+
+	new_fm = kzalloc(sizeof(struct ubi_fastmap_layout), GFP_NOFS);
+	if (!new_fm)
+		return -ENOMEM;
+
+	for (i = 0; i < blocks; i++) {
+		new_fm->e[i] = ubi_wl_get_fm_peb(ubi, i == 0);
+		if (!new_fm->e[i]) {
+			dbg_gen("no free PEB for fastmap block %d", i);
+			err = -ENOSPC;
+			goto out_put;
+		}
+		new_fm->used_blocks += 1;
+	}
+
+	err = fm_fill(ubi, new_fm);
+	if (err)
+		goto out_put;
+	held = 1;
+
+	err = fm_write(ubi, new_fm);
+	if (err)
+		goto out_put;
+
+	/* The new fastmap records the pool, it may be used now */
+	spin_lock(&ubi->wl_lock);
+	ubi->fm_pool.used = 0;
+	spin_unlock(&ubi->wl_lock);
+
+	bitmap_zero(ubi->fm_used, ubi->peb_count);
+	for (i = 0; i < ubi->peb_count; i++)
+		if (ubi->fm_state[i] == FM_ST_USED ||
+		    ubi->fm_state[i] == FM_ST_SCRUB)
+			__set_bit(i, ubi->fm_used);
+
+	ubi->fm = new_fm;
+	if (old_fm)
+		return put_fm_pebs(ubi, old_fm, 1);
+	return 0;
+
+out_put:
+	ubi_warn("cannot write fastmap, error %d", err);
+	for (i = 0; i < new_fm->used_blocks; i++)
+		if (ubi_wl_put_fm_peb(ubi, new_fm->e[i], 0))
+			ubi_ro_mode(ubi);
+	kfree(new_fm);
+
+	/*
+	 * The old fastmap records the pool PEBs as free, so the pool stays
+	 * held back unless that fastmap is gone from flash.
+	 */
+	if (!invalidate_fastmap(ubi) && held) {
+		spin_lock(&ubi->wl_lock);
+		ubi->fm_pool.used = 0;
+		spin_unlock(&ubi->wl_lock);
+	}
+	ubi->fm_retry = FM_RETRY_REFILLS;
+	return err;
+}
+
+/**
+ * ubi_update_fastmap - write a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+int ubi_update_fastmap(struct ubi_device *ubi)
+{
+	int err;
+
+	if (!ubi->fm_pool.max_size)
+		return 0;
+
+	mutex_lock(&ubi->fm_mutex);
+	err = update_fastmap(ubi);
+	mutex_unlock(&ubi->fm_mutex);
+	return err;
+}
+
+/**
+ * ubi_fastmap_refill_pool - refill the pool if it is empty.
+ * @ubi: UBI device description object
+ *
+ * This function writes a new fastmap with a new pool. If there is no fastmap
+ * on flash, because writing it has failed recently, the pool is just refilled
+ * from the free tree. Returns zero if the pool is not empty, %-EAGAIN if it
+ * is and there are not enough free PEBs at the moment, and other negative
+ * error codes in case of failure.
+ */
+int ubi_fastmap_refill_pool(struct ubi_device *ubi)
+{
+	int err = 0, blocks = ubi->fm_size / ubi->leb_size;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+
+	mutex_lock(&ubi->fm_mutex);
+	spin_lock(&ubi->wl_lock);
+	if (pool->used < pool->size)
+		goto out_unlock;
+
+	if (!enough_free(ubi, blocks + 1) && ubi->works_count) {
+		/* Wait for the pending erasures rather than lose fastmap */
+		err = -EAGAIN;
+		goto out_unlock;
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	if (ubi->fm || --ubi->fm_retry <= 0)
+		update_fastmap(ubi);
+
+	spin_lock(&ubi->wl_lock);
+	if (!ubi->fm && pool->used == pool->size)
+		ubi_wl_refill_pool(ubi);
+	if (pool->used == pool->size)
+		err = -EAGAIN;
+
+out_unlock:
+	spin_unlock(&ubi->wl_lock);
+	mutex_unlock(&ubi->fm_mutex);
+	return err;
+}
+
+/**
+ * ubi_fastmap_prepare_erase - prepare erasure of a PEB.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock which is going to be erased
+ *
+ * If the fastmap on flash records @pnum as used, a new fastmap is written
+ * first, or the current one is invalidated. This function returns zero if
+ * @pnum may be erased and a negative error code if not.
+ */
+int ubi_fastmap_prepare_erase(struct ubi_device *ubi, int pnum)
+{
+	int err = 0;
+
+	if (!ubi->fm_used)
+		return 0;
+
+	mutex_lock(&ubi->fm_mutex);
+	if (ubi->fm && test_bit(pnum, ubi->fm_used)) {
+		dbg_gen("PEB %d is used in fastmap, write a new one", pnum);
+		err = update_fastmap(ubi);
+		if (!ubi->fm || !test_bit(pnum, ubi->fm_used))
+			err = 0;
+		else if (!err)
+			err = -EINVAL;
+	}
+	mutex_unlock(&ubi->fm_mutex);
+	return err;
+}
+
+/**
+ * ubi_fastmap_init - initialize fastmap for an attached UBI device.
+ * @ubi: UBI device description object
+ *
+ * This function reserves PEBs for the fastmap, allocates the buffers, and
+ * writes the first fastmap. If fastmap cannot be used on this device, it is
+ * disabled and the fastmap found at attach time, if any, is invalidated.
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+int ubi_fastmap_init(struct ubi_device *ubi)
+{
+	int blocks, err;
+	size_t size;
+
+	size = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr) +
+	       sizeof(struct ubi_fm_scan_pool) +
+	       ubi->peb_count * sizeof(struct ubi_fm_ec) +
+	       (ubi->vtbl_slots + UBI_INT_VOL_COUNT) *
+	       sizeof(struct ubi_fm_volhdr) +
+	       ubi->peb_count * sizeof(__be32);
+	blocks = DIV_ROUND_UP(size, ubi->leb_size);
+	if (blocks > UBI_FM_MAX_BLOCKS) {
+		ubi_warn("fastmap would take %d PEBs, max. is %d, not used",
+			 blocks, UBI_FM_MAX_BLOCKS);
+		goto out_disable;
+	}
+
+	spin_lock(&ubi->volumes_lock);
+	if (ubi->avail_pebs < 2 * blocks) {
+		spin_unlock(&ubi->volumes_lock);
+		ubi_warn("no enough PEBs for fastmap (%d, need %d), not used",
+			 ubi->avail_pebs, 2 * blocks);
+		goto out_disable;
+	}
+	ubi->avail_pebs -= 2 * blocks;
+	ubi->rsvd_pebs += 2 * blocks;
+	spin_unlock(&ubi->volumes_lock);
+
+	err = -ENOMEM;
+	ubi->fm_size = blocks * ubi->leb_size;
+	ubi->fm_buf = vmalloc(ubi->fm_size);
+	if (!ubi->fm_buf)
+		goto out_free;
+	ubi->fm_state = vmalloc(ubi->peb_count);
+	if (!ubi->fm_state)
+		goto out_free;
+	ubi->fm_used = kcalloc(BITS_TO_LONGS(ubi->peb_count),
+			       sizeof(unsigned long), GFP_KERNEL);
+	if (!ubi->fm_used)
+		goto out_free;
+
+	ubi->fm_pool.max_size = clamp(ubi->peb_count / 100,
+				      UBI_FM_MIN_POOL_SIZE,
+				      UBI_FM_MAX_POOL_SIZE);
+	ubi_msg("fastmap:                    %d PEBs, pool of %d PEBs",
+		blocks, ubi->fm_pool.max_size);
+
+	if (!ubi->ro_mode)
+		ubi_update_fastmap(ubi);
+	return 0;
+
+out_free:
+	vfree(ubi->fm_buf);
+	vfree(ubi->fm_state);
+	ubi->fm_buf = NULL;
+	ubi->fm_state = NULL;
+	return err;
+
+out_disable:
+	return invalidate_fastmap(ubi);
+}
+
+/**
+ * ubi_fastmap_close - free fastmap resources.
+ * @ubi: UBI device description object
+ */
+void ubi_fastmap_close(struct ubi_device *ubi)
+{
+	int i;
+
+	if (ubi->fm) {
+		for (i = 0; i < ubi->fm->used_blocks; i++)
+			kmem_cache_free(ubi_wl_entry_slab, ubi->fm->e[i]);
+		kfree(ubi->fm);
+		ubi->fm = NULL;
+	}
+
+	ubi->fm_pool.max_size = 0;
+	vfree(ubi->fm_buf);
+	vfree(ubi->fm_state);
+	kfree(ubi->fm_used);
+	ubi->fm_buf = NULL;
+	ubi->fm_state = NULL;
+	ubi->fm_used = NULL;
+}
@@ -110,6 +110,7 @@ struct ubi_scan_volume {
  * @ec_sum: a temporary variable used when calculating @mean_ec
  * @ec_count: a temporary variable used when calculating @mean_ec
  * @scan_leb_slab: slab cache for &struct ubi_scan_leb objects
+ * @fastmap: non-zero if the information comes from a fastmap
  *
  * This data structure contains the result of scanning and may be used by other
  * UBI sub-systems to build final UBI data structures, further error-recovery
@@ -136,6 +137,7 @@ struct ubi_scan_info {
 	uint64_t ec_sum;
 	int ec_count;
 	struct kmem_cache *scan_leb_slab;
+	int fastmap;
 };
 
 struct ubi_device;
@@ -168,7 +170,10 @@ struct ubi_scan_leb *ubi_scan_get_free_peb(struct ubi_device *ubi,
 					   struct ubi_scan_info *si);
 int ubi_scan_erase_peb(struct ubi_device *ubi, const struct ubi_scan_info *si,
 		       int pnum, int ec);
-struct ubi_scan_info *ubi_scan(struct ubi_device *ubi);
+int ubi_scan_add_to_list(struct ubi_scan_info *si, int pnum, int ec,
+			 int to_head, struct list_head *list);
+int ubi_scan_peb(struct ubi_device *ubi, struct ubi_scan_info *si, int pnum);
+struct ubi_scan_info *ubi_scan(struct ubi_device *ubi, int force_scan);
 void ubi_scan_destroy_si(struct ubi_scan_info *si);
 
 #endif /* !__UBI_SCAN_H__ */
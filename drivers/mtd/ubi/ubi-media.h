@@ -375,4 +375,159 @@ struct ubi_vtbl_record {
 	__be32  crc;
 } __packed;
 
+/* UBI fastmap on-flash data structures */
+
+/*
+ * The fastmap is stored in two internal volumes. The super block volume has
+ * only one LEB (the "anchor"), which always lives in one of the first
+ * %UBI_FM_MAX_START physical eraseblocks so that it can be found quickly. The
+ * data volume contains the rest of the fastmap if it does not fit the anchor.
+ * Both volumes are "delete" compatible, so UBI implementations which do not
+ * support fastmap simply erase them.
+ */
+#define UBI_FM_SB_VOLUME_ID	(UBI_INTERNAL_VOL_START + 1)
+#define UBI_FM_DATA_VOLUME_ID	(UBI_INTERNAL_VOL_START + 2)
+#define UBI_FM_VOLUME_COMPAT	UBI_COMPAT_DELETE
+
+/* Fastmap on-flash format version */
+#define UBI_FM_FMT_VERSION	1
+
+/* The anchor PEB is looked for among the first %UBI_FM_MAX_START PEBs */
+#define UBI_FM_MAX_START	64
+
+/* Maximum number of PEBs the fastmap may occupy */
+#define UBI_FM_MAX_BLOCKS	32
+
+/* Bounds of the pool of PEBs which are scanned at attach time */
+#define UBI_FM_MIN_POOL_SIZE	8
+#define UBI_FM_MAX_POOL_SIZE	256
+
+/* Fastmap structure magic numbers */
+#define UBI_FM_SB_MAGIC		0x7B11D69F
+#define UBI_FM_HDR_MAGIC	0xD4B82EF7
+#define UBI_FM_POOL_MAGIC	0x67AF4D08
+#define UBI_FM_VHDR_MAGIC	0xFA370ED1
+
+/* EBA table entry of an unmapped LEB */
+#define UBI_FM_UNMAPPED		0xFFFFFFFF
+
+/**
+ * struct ubi_fm_sb - UBI fastmap super block.
+ * @magic: fastmap super block magic number (%UBI_FM_SB_MAGIC)
+ * @version: format version of this fastmap (%UBI_FM_FMT_VERSION)
+ * @padding1: reserved for future, zeroes
+ * @data_crc: CRC checksum of the fastmap data following the super block
+ * @used_blocks: number of PEBs used by this fastmap
+ * @block_loc: physical eraseblocks the fastmap is stored in
+ * @block_ec: erase counters of the @block_loc eraseblocks
+ * @sqnum: sequence number of the anchor VID header
+ * @padding2: reserved for future, zeroes
+ * @sb_crc: CRC checksum of this super block
+ *
+ * The super block is stored at the beginning of the anchor LEB. The fastmap
+ * data (&struct ubi_fm_hdr and everything after it) directly follows it and
+ * may continue in LEBs of the fastmap data volume, in @block_loc order.
+ */
+struct ubi_fm_sb {
+	__be32 magic;
+	__u8 version;
+	__u8 padding1[3];
+	__be32 data_crc;
+	__be32 used_blocks;
+	__be32 block_loc[UBI_FM_MAX_BLOCKS];
+	__be32 block_ec[UBI_FM_MAX_BLOCKS];
+	__be64 sqnum;
+	__u8 padding2[28];
+	__be32 sb_crc;
+} __packed;
+
+/**
+ * struct ubi_fm_hdr - header of the fastmap data.
+ * @magic: fastmap header magic number (%UBI_FM_HDR_MAGIC)
+ * @free_peb_count: number of free PEBs known by this fastmap
+ * @used_peb_count: number of used PEBs known by this fastmap
+ * @scrub_peb_count: number of to be scrubbed PEBs known by this fastmap
+ * @erase_peb_count: number of PEBs which have to be erased
+ * @bad_peb_count: number of bad PEBs
+ * @corr_peb_count: number of corrupted PEBs which are preserved
+ * @untracked_peb_count: number of PEBs this fastmap does not describe (bad,
+ *                       corrupted, alien PEBs and PEBs which were being moved
+ *                       or erased when the fastmap was written)
+ * @vol_count: number of volume records
+ * @global_sqnum: the global sequence counter when the fastmap was taken
+ * @image_seq: image sequence number
+ * @padding: reserved for future, zeroes
+ *
+ * The header is followed by a &struct ubi_fm_scan_pool, @vol_count volume
+ * records, and @free_peb_count, @used_peb_count, @scrub_peb_count and
+ * @erase_peb_count &struct ubi_fm_ec records, in this order. The untracked
+ * PEBs are scanned at attach time, just like the pool.
+ */
+struct ubi_fm_hdr {
+	__be32 magic;
+	__be32 free_peb_count;
+	__be32 used_peb_count;
+	__be32 scrub_peb_count;
+	__be32 erase_peb_count;
+	__be32 bad_peb_count;
+	__be32 corr_peb_count;
+	__be32 untracked_peb_count;
+	__be32 vol_count;
+	__be64 global_sqnum;
+	__be32 image_seq;
+	__u8 padding[16];
+} __packed;
+
+/**
+ * struct ubi_fm_scan_pool - PEBs which have to be scanned at attach time.
+ * @magic: pool magic number (%UBI_FM_POOL_MAGIC)
+ * @size: number of PEBs in the pool
+ *
+ * New data is written only to PEBs of the pool recorded in the current
+ * fastmap, so these are the only PEBs which may have changed since the
+ * fastmap was written. The structure is followed by @size __be32 PEB
+ * numbers.
+ */
+struct ubi_fm_scan_pool {
+	__be32 magic;
+	__be32 size;
+} __packed;
+
+/**
+ * struct ubi_fm_ec - a PEB and its erase counter.
+ * @pnum: physical eraseblock number
+ * @ec: erase counter
+ */
+struct ubi_fm_ec {
+	__be32 pnum;
+	__be32 ec;
+} __packed;
+
+/**
+ * struct ubi_fm_volhdr - fastmap volume record header.
+ * @magic: volume record magic number (%UBI_FM_VHDR_MAGIC)
+ * @vol_id: volume ID
+ * @vol_type: volume type (%UBI_VID_DYNAMIC or %UBI_VID_STATIC)
+ * @compat: compatibility flags of the volume
+ * @padding1: reserved for future, zeroes
+ * @reserved_pebs: number of entries in the EBA table which follows
+ * @used_ebs: number of used LEBs (static volumes only)
+ * @data_pad: data padding of the volume
+ * @last_eb_bytes: amount of data in the last LEB (static volumes only)
+ *
+ * The header is followed by @reserved_pebs __be32 PEB numbers, unmapped LEBs
+ * are marked by %UBI_FM_UNMAPPED.
+ */
+struct ubi_fm_volhdr {
+	__be32 magic;
+	__be32 vol_id;
+	__u8 vol_type;
+	__u8 compat;
+	__u8 padding1[2];
+	__be32 reserved_pebs;
+	__be32 used_ebs;
+	__be32 data_pad;
+	__be32 last_eb_bytes;
+} __packed;
+
 #endif /* !__UBI_MEDIA_H__ */
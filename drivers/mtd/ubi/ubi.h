@@ -107,6 +107,9 @@ enum {
 	UBI_IO_BITFLIPS,
 };
 
+/* Returned by 'ubi_scan_fastmap()' if there is no usable fastmap on flash */
+#define UBI_NO_FASTMAP 1
+
 /*
  * Return codes of the 'ubi_eba_copy_leb()' function.
  *
@@ -193,6 +196,55 @@ struct ubi_rename_entry {
 };
 
 struct ubi_volume_desc;
+struct ubi_device;
+
+/**
+ * struct ubi_work - UBI work description data structure.
+ * @list: a link in the list of pending works
+ * @func: worker function
+ * @e: physical eraseblock to erase
+ * @torture: if the physical eraseblock has to be tortured
+ *
+ * The @func pointer points to the worker function. If the @cancel argument is
+ * not zero, the worker has to free the resources and exit immediately. The
+ * worker has to return zero in case of success and a negative error code in
+ * case of failure.
+ */
+struct ubi_work {
+	struct list_head list;
+	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
+	/* The below fields are only relevant to erasure works */
+	struct ubi_wl_entry *e;
+	int torture;
+};
+
+/**
+ * struct ubi_fastmap_layout - in-memory description of the on-flash fastmap.
+ * @e: wear-leveling entries of the PEBs holding the fastmap
+ * @used_blocks: number of PEBs the fastmap occupies
+ */
+struct ubi_fastmap_layout {
+	struct ubi_wl_entry *e[UBI_FM_MAX_BLOCKS];
+	int used_blocks;
+};
+
+/**
+ * struct ubi_fm_pool - pool of PEBs new data is written to.
+ * @pebs: PEB numbers of the pool
+ * @used: how many PEBs of the pool have already been handed out
+ * @size: how many PEBs the pool contains
+ * @max_size: maximum pool size, zero if fastmap is not used on this device
+ *
+ * All PEBs of the pool are recorded in the on-flash fastmap, which makes the
+ * attach code scan them. PEBs which are not handed out yet are not in any of
+ * the WL sub-system RB-trees.
+ */
+struct ubi_fm_pool {
+	int pebs[UBI_FM_MAX_POOL_SIZE];
+	int used;
+	int size;
+	int max_size;
+};
 
 /**
  * struct ubi_volume - UBI volume description data structure.
@@ -390,6 +442,16 @@ struct ubi_wl_entry;
  * @buf_mutex: protects @peb_buf1 and @peb_buf2
  * @ckvol_mutex: serializes static volume checking when opening
  *
+ * @fm: the fastmap currently stored on flash, %NULL if there is none
+ * @fm_pool: the pool of PEBs recorded in @fm (protected by @wl_lock)
+ * @fm_mutex: serializes fastmap updates and protects the other @fm_* fields
+ * @fm_buf: buffer the fastmap is assembled in
+ * @fm_size: size of @fm_buf, a multiple of the LEB size
+ * @fm_used: bitmap of PEBs which @fm records as used
+ * @fm_state: per-PEB scratch array used when the fastmap is assembled
+ * @fm_retry: how many times to refill the pool without a fastmap before
+ *            re-trying to write one after a failure
+ *
  * @dbg: debugging information for this UBI device
  */
 struct ubi_device {
@@ -474,6 +536,15 @@ struct ubi_device {
 	struct mutex buf_mutex;
 	struct mutex ckvol_mutex;
 
+	struct ubi_fastmap_layout *fm;
+	struct ubi_fm_pool fm_pool;
+	struct mutex fm_mutex;
+	void *fm_buf;
+	size_t fm_size;
+	unsigned long *fm_used;
+	unsigned char *fm_state;
+	int fm_retry;
+
 	struct ubi_debug_info *dbg;
 };
 
@@ -534,6 +605,7 @@ int ubi_eba_atomic_leb_change(struct ubi_device *ubi, struct ubi_volume *vol,
 int ubi_eba_copy_leb(struct ubi_device *ubi, int from, int to,
 		     struct ubi_vid_hdr *vid_hdr);
 int ubi_eba_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
+unsigned long long ubi_next_sqnum(struct ubi_device *ubi);
 
 /* wl.c */
 int ubi_wl_get_peb(struct ubi_device *ubi, int dtype);
@@ -543,6 +615,38 @@ int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
+int ubi_is_erase_work(struct ubi_work *wrk);
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor);
+int ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e,
+		      int sync);
+void ubi_wl_refill_pool(struct ubi_device *ubi);
+
+/* fastmap.c */
+#ifdef CONFIG_MTD_UBI_FASTMAP
+int ubi_scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si);
+int ubi_fastmap_init(struct ubi_device *ubi);
+int ubi_update_fastmap(struct ubi_device *ubi);
+int ubi_fastmap_refill_pool(struct ubi_device *ubi);
+int ubi_fastmap_prepare_erase(struct ubi_device *ubi, int pnum);
+void ubi_fastmap_close(struct ubi_device *ubi);
+#else
+static inline int ubi_scan_fastmap(struct ubi_device *ubi,
+				   struct ubi_scan_info *si)
+{
+	return UBI_NO_FASTMAP;
+}
+static inline int ubi_fastmap_init(struct ubi_device *ubi) { return 0; }
+static inline int ubi_update_fastmap(struct ubi_device *ubi) { return 0; }
+static inline int ubi_fastmap_refill_pool(struct ubi_device *ubi)
+{
+	return -ENOSPC;
+}
+static inline int ubi_fastmap_prepare_erase(struct ubi_device *ubi, int pnum)
+{
+	return 0;
+}
+static inline void ubi_fastmap_close(struct ubi_device *ubi) {}
+#endif
 
 /* io.c */
 int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
@@ -92,6 +92,12 @@
  * Depending on the sub-state, wear-leveling entries of the used physical
  * eraseblocks may be kept in one of those structures.
  *
+ * When fastmap is used, there is one more place where free physical
+ * eraseblocks live: the fastmap pool (@ubi->fm_pool). The attach code only
+ * scans the PEBs of the pool, so PEBs are handed out (to users and to the
+ * wear-leveling worker) only from the pool, and a new fastmap is written each
+ * time the pool is refilled from the @wl->free tree.
+ *
  * Note, in this implementation, we keep a small in-RAM object for each physical
  * eraseblock. This is surely not a scalable solution. But it appears to be good
  * enough for moderately large flashes and it is simple. In future, one may
@@ -142,26 +148,6 @@
  */
 #define WL_MAX_FAILURES 32
 
-/**
- * struct ubi_work - UBI work description data structure.
- * @list: a link in the list of pending works
- * @func: worker function
- * @e: physical eraseblock to erase
- * @torture: if the physical eraseblock has to be tortured
- *
- * The @func pointer points to the worker function. If the @cancel argument is
- * not zero, the worker has to free the resources and exit immediately. The
- * worker has to return zero in case of success and a negative error code in
- * case of failure.
- */
-struct ubi_work {
-	struct list_head list;
-	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
-	/* The below fields are only relevant to erasure works */
-	struct ubi_wl_entry *e;
-	int torture;
-};
-
 #ifdef CONFIG_MTD_UBI_DEBUG
 static int paranoid_check_ec(struct ubi_device *ubi, int pnum, int ec);
 static int paranoid_check_in_wl_tree(const struct ubi_device *ubi,
@@ -379,13 +365,72 @@ static struct ubi_wl_entry *find_wl_entry(struct rb_root *root, int max)
 	return e;
 }
 
+/**
+ * get_peb_from_pool - get a physical eraseblock from the fastmap pool.
+ * @ubi: UBI device description object
+ *
+ * This function hands out the next PEB of the fastmap pool and refills the
+ * pool if it is exhausted. Returns a physical eraseblock in case of success
+ * and a negative error code in case of failure.
+ */
+static int get_peb_from_pool(struct ubi_device *ubi)
+{
+	int err;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_wl_entry *e;
+
+	while (1) {
+		spin_lock(&ubi->wl_lock);
+		if (pool->used < pool->size) {
+			e = ubi->lookuptbl[pool->pebs[pool->used]];
+			pool->used += 1;
+			prot_queue_add(ubi, e);
+			spin_unlock(&ubi->wl_lock);
+			break;
+		}
+		spin_unlock(&ubi->wl_lock);
+
+		err = ubi_fastmap_refill_pool(ubi);
+		if (err == -EAGAIN) {
+			/*
+			 * There are not enough free PEBs to refill the pool and
+			 * to write the fastmap, but some are being erased.
+			 */
+			spin_lock(&ubi->wl_lock);
+			if (ubi->works_count == 0) {
+				ubi_assert(list_empty(&ubi->works));
+				ubi_err("no free eraseblocks");
+				spin_unlock(&ubi->wl_lock);
+				return -ENOSPC;
+			}
+			spin_unlock(&ubi->wl_lock);
+
+			dbg_wl("do one work synchronously");
+			err = do_work(ubi);
+		}
+		if (err)
+			return err;
+	}
+
+	dbg_wl("PEB %d EC %d from the pool", e->pnum, e->ec);
+	err = ubi_dbg_check_all_ff(ubi, e->pnum, ubi->vid_hdr_aloffset,
+				   ubi->peb_size - ubi->vid_hdr_aloffset);
+	if (err) {
+		ubi_err("new PEB %d does not contain all 0xFF bytes", e->pnum);
+		return err;
+	}
+
+	return e->pnum;
+}
+
 /**
  * ubi_wl_get_peb - get a physical eraseblock.
  * @ubi: UBI device description object
  * @dtype: type of data which will be stored in this physical eraseblock
  *
  * This function returns a physical eraseblock in case of success and a
- * negative error code in case of failure. Might sleep.
+ * negative error code in case of failure. Might sleep. When fastmap is used,
+ * the physical eraseblock comes from the fastmap pool and @dtype is ignored.
  */
 int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
 {
@@ -395,6 +440,9 @@ int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
 	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
 		   dtype == UBI_UNKNOWN);
 
+	if (ubi->fm_pool.max_size)
+		return get_peb_from_pool(ubi);
+
 retry:
 	spin_lock(&ubi->wl_lock);
 	if (!ubi->free.rb_node) {
@@ -653,6 +701,64 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
 	return 0;
 }
 
+/**
+ * find_wl_target - find the physical eraseblock to move data to.
+ * @ubi: UBI device description object
+ *
+ * This function returns a highly worn-out free physical eraseblock or %NULL if
+ * there is none. When fastmap is used, the PEB with the highest erase counter
+ * is picked from the fastmap pool, otherwise from the @ubi->free tree. Note,
+ * @ubi->wl_lock has to be locked.
+ */
+static struct ubi_wl_entry *find_wl_target(struct ubi_device *ubi)
+{
+	int i;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_wl_entry *e = NULL, *e1;
+
+	if (!pool->max_size) {
+		if (!ubi->free.rb_node)
+			return NULL;
+		return find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+	}
+
+	for (i = pool->used; i < pool->size; i++) {
+		e1 = ubi->lookuptbl[pool->pebs[i]];
+		if (!e || e1->ec > e->ec)
+			e = e1;
+	}
+
+	return e;
+}
+
+/**
+ * take_wl_target - take the physical eraseblock found by 'find_wl_target()'.
+ * @ubi: UBI device description object
+ * @e: the physical eraseblock to take
+ *
+ * Note, @ubi->wl_lock has to be locked.
+ */
+static void take_wl_target(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	int i;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+
+	if (!pool->max_size) {
+		paranoid_check_in_wl_tree(ubi, e, &ubi->free);
+		rb_erase(&e->u.rb, &ubi->free);
+		return;
+	}
+
+	/* Swap it with the next PEB to be handed out and skip it */
+	for (i = pool->used; i < pool->size; i++)
+		if (pool->pebs[i] == e->pnum)
+			break;
+	ubi_assert(i < pool->size);
+	pool->pebs[i] = pool->pebs[pool->used];
+	pool->pebs[pool->used] = e->pnum;
+	pool->used += 1;
+}
+
 /**
  * wear_leveling_worker - wear-leveling worker function.
  * @ubi: UBI device description object
@@ -680,12 +786,21 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		return -ENOMEM;
 
 	mutex_lock(&ubi->move_mutex);
+
+	/*
+	 * With fastmap the target PEB has to come from the pool, make sure it
+	 * is not empty. If it cannot be refilled, the free PEBs are still
+	 * waiting to be erased and the movement is cancelled below.
+	 */
+	if (ubi->fm_pool.max_size)
+		ubi_fastmap_refill_pool(ubi);
+
 	spin_lock(&ubi->wl_lock);
 	ubi_assert(!ubi->move_from && !ubi->move_to);
 	ubi_assert(!ubi->move_to_put);
 
-	if (!ubi->free.rb_node ||
-	    (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
+	e2 = find_wl_target(ubi);
+	if (!e2 || (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
 		/*
 		 * No free physical eraseblocks? Well, they must be waiting in
 		 * the queue to be erased. Cancel movement - it will be
@@ -697,7 +812,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * triggered again.
 		 */
 		dbg_wl("cancel WL, a list is empty: free %d, used %d",
-		       !ubi->free.rb_node, !ubi->used.rb_node);
+		       !e2, !ubi->used.rb_node);
 		goto out_cancel;
 	}
 
@@ -708,7 +823,6 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * counters differ much enough, start wear-leveling.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD)) {
 			dbg_wl("no WL needed: min used EC %d, max free EC %d",
@@ -723,14 +837,12 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		/* Perform scrubbing */
 		scrubbing = 1;
 		e1 = rb_entry(rb_first(&ubi->scrub), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 		paranoid_check_in_wl_tree(ubi, e1, &ubi->scrub);
 		rb_erase(&e1->u.rb, &ubi->scrub);
 		dbg_wl("scrub PEB %d to PEB %d", e1->pnum, e2->pnum);
 	}
 
-	paranoid_check_in_wl_tree(ubi, e2, &ubi->free);
-	rb_erase(&e2->u.rb, &ubi->free);
+	take_wl_target(ubi, e2);
 	ubi->move_from = e1;
 	ubi->move_to = e2;
 	spin_unlock(&ubi->wl_lock);
@@ -961,7 +1073,16 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 	 * the WL worker has to be scheduled anyway.
 	 */
 	if (!ubi->scrub.rb_node) {
-		if (!ubi->used.rb_node || !ubi->free.rb_node)
+		/*
+		 * With fastmap the WL worker picks its target from the pool,
+		 * and only refills the pool from the free tree if it is empty.
+		 * Judge by the same PEBs.
+		 */
+		e2 = find_wl_target(ubi);
+		if (!e2 && ubi->fm_pool.max_size && ubi->free.rb_node)
+			e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+
+		if (!ubi->used.rb_node || !e2)
 			/* No physical eraseblocks - no deal */
 			goto out_unlock;
 
@@ -972,7 +1093,6 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 		 * %UBI_WL_THRESHOLD.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD))
 			goto out_unlock;
@@ -1027,6 +1147,15 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 
 	dbg_wl("erase PEB %d EC %d", pnum, e->ec);
 
+	/* Do not destroy data the fastmap on flash still refers to */
+	err = ubi_fastmap_prepare_erase(ubi, pnum);
+	if (err) {
+		ubi_err("cannot erase PEB %d, error %d", pnum, err);
+		kfree(wl_wrk);
+		kmem_cache_free(ubi_wl_entry_slab, e);
+		goto out_ro;
+	}
+
 	err = sync_erase(ubi, e, wl_wrk->torture);
 	if (!err) {
 		/* Fine, we've erased it successfully */
@@ -1312,6 +1441,109 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	return 0;
 }
 
+/**
+ * ubi_is_erase_work - check if a work is an erase work.
+ * @wrk: the work object
+ */
+int ubi_is_erase_work(struct ubi_work *wrk)
+{
+	return wrk->func == erase_worker;
+}
+
+/**
+ * ubi_wl_get_fm_peb - get a physical eraseblock to write the fastmap to.
+ * @ubi: UBI device description object
+ * @anchor: the fastmap super block will be written to this PEB
+ *
+ * This function takes a free physical eraseblock with low erase counter, as
+ * the fastmap is re-written often. The anchor PEB has to be one of the first
+ * %UBI_FM_MAX_START PEBs, because only those are looked at when attaching.
+ * Unlike 'ubi_wl_get_peb()', this function does not wait for free PEBs and
+ * returns %NULL if there is no suitable one.
+ */
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor)
+{
+	struct rb_node *p;
+	struct ubi_wl_entry *e = NULL;
+
+	spin_lock(&ubi->wl_lock);
+	for (p = rb_first(&ubi->free); p; p = rb_next(p)) {
+		e = rb_entry(p, struct ubi_wl_entry, u.rb);
+		if (!anchor || e->pnum < UBI_FM_MAX_START)
+			break;
+		e = NULL;
+	}
+	if (e) {
+		rb_erase(&e->u.rb, &ubi->free);
+		dbg_wl("PEB %d EC %d for the fastmap", e->pnum, e->ec);
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	return e;
+}
+
+/**
+ * ubi_wl_put_fm_peb - return a fastmap physical eraseblock.
+ * @ubi: UBI device description object
+ * @e: the physical eraseblock to return
+ * @sync: erase the physical eraseblock synchronously
+ *
+ * This function returns a physical eraseblock obtained with
+ * 'ubi_wl_get_fm_peb()' or belonging to the fastmap found when attaching. If
+ * @sync is not zero, the PEB is erased before this function returns, which is
+ * used to make sure an outdated fastmap cannot be found after a power cut.
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+int ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e,
+		      int sync)
+{
+	int err;
+
+	dbg_wl("return fastmap PEB %d EC %d, sync %d", e->pnum, e->ec, sync);
+	if (!sync)
+		return schedule_erase(ubi, e, 0);
+
+	err = sync_erase(ubi, e, 0);
+	if (err)
+		return err;
+
+	spin_lock(&ubi->wl_lock);
+	wl_tree_add(e, &ubi->free);
+	spin_unlock(&ubi->wl_lock);
+	return 0;
+}
+
+/**
+ * ubi_wl_refill_pool - refill the fastmap pool from the free tree.
+ * @ubi: UBI device description object
+ *
+ * This function moves the PEBs of the pool which have not been handed out yet
+ * to its beginning and tops the pool up with free PEBs. Like for long term
+ * data, PEBs with high erase counter are picked, so that they are good
+ * wear-leveling targets as well. Note, @ubi->wl_lock has to be locked.
+ */
+void ubi_wl_refill_pool(struct ubi_device *ubi)
+{
+	int i, n = 0;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_wl_entry *e;
+
+	for (i = pool->used; i < pool->size; i++)
+		pool->pebs[n++] = pool->pebs[i];
+
+	while (n < pool->max_size && ubi->free.rb_node) {
+		e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		paranoid_check_in_wl_tree(ubi, e, &ubi->free);
+		rb_erase(&e->u.rb, &ubi->free);
+		pool->pebs[n++] = e->pnum;
+	}
+
+	pool->size = n;
+	pool->used = 0;
+	dbg_wl("pool has %d PEBs", n);
+}
+
 /**
  * tree_destroy - destroy an RB-tree.
  * @root: the root of the tree to destroy
@@ -1504,6 +1736,14 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 		}
 	}
 
+	/*
+	 * The PEBs of the fastmap we attached from are not in any tree, they
+	 * are returned when the next fastmap is written.
+	 */
+	if (ubi->fm)
+		for (i = 0; i < ubi->fm->used_blocks; i++)
+			ubi->lookuptbl[ubi->fm->e[i]->pnum] = ubi->fm->e[i];
+
 	if (ubi->avail_pebs < WL_RESERVED_PEBS) {
 		ubi_err("no enough physical eraseblocks (%d, need %d)",
 			ubi->avail_pebs, WL_RESERVED_PEBS);
@@ -1548,6 +1788,21 @@ static void protection_queue_destroy(struct ubi_device *ubi)
 	}
 }
 
+/**
+ * pool_destroy - destroy the fastmap pool.
+ * @ubi: UBI device description object
+ */
+static void pool_destroy(struct ubi_device *ubi)
+{
+	int i;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+
+	for (i = pool->used; i < pool->size; i++)
+		kmem_cache_free(ubi_wl_entry_slab,
+				ubi->lookuptbl[pool->pebs[i]]);
+	pool->used = pool->size = 0;
+}
+
 /**
  * ubi_wl_close - close the wear-leveling sub-system.
  * @ubi: UBI device description object
@@ -1556,6 +1811,7 @@ void ubi_wl_close(struct ubi_device *ubi)
 {
 	dbg_wl("close the WL sub-system");
 	cancel_pending(ubi);
+	pool_destroy(ubi);
 	protection_queue_destroy(ubi);
 	tree_destroy(&ubi->used);
 	tree_destroy(&ubi->erroneous);
@@ -36,6 +36,8 @@
 #include <linux/if_ether.h>
 #include <linux/list.h>
 #include <linux/io.h>
+#include <linux/rtnetlink.h>
+#include <linux/string.h>
 
 #include <linux/platform_device.h>
 #include <linux/can.h>
@@ -159,6 +161,12 @@
 #define D_CAN_IF_CMD_ALL	(D_CAN_IF_CMD_MASK | D_CAN_IF_CMD_ARB | \
 				D_CAN_IF_CMD_CONTROL | D_CAN_IF_CMD_TXRQST | \
 				D_CAN_IF_CMD_DATAA | D_CAN_IF_CMD_DATAB)
+/* On reads, the TXRQST bit clears the NEWDAT bit of the message object */
+#define D_CAN_IF_CMD_CLR_NEWDAT	D_CAN_IF_CMD_TXRQST
+/* Read a received message object and clear its interrupt pending bit */
+#define D_CAN_IF_CMD_RX		(D_CAN_IF_CMD_MASK | D_CAN_IF_CMD_ARB | \
+				D_CAN_IF_CMD_CONTROL | D_CAN_IF_CMD_CIP | \
+				D_CAN_IF_CMD_DATAA | D_CAN_IF_CMD_DATAB)
 
 /* D_CAN IF mask reg bit fields */
 #define D_CAN_IF_MASK_MX	BIT(31)	/* Mask Extended Identifier */
@@ -230,7 +238,6 @@
 /* Message objects split */
 #define D_CAN_NUM_MSG_OBJECTS		64
 #define D_CAN_NUM_RX_MSG_OBJECTS	32
-#define D_CAN_NUM_TX_MSG_OBJECTS	32
 
 #define D_CAN_MSG_OBJ_RX_FIRST		1
 #define D_CAN_MSG_OBJ_RX_LAST		(D_CAN_MSG_OBJ_RX_FIRST + \
@@ -240,9 +247,6 @@
 #define D_CAN_MSG_OBJ_TX_LAST		(D_CAN_MSG_OBJ_TX_FIRST + \
 					D_CAN_NUM_TX_MSG_OBJECTS - 1)
 
-#define D_CAN_MSG_OBJ_RX_SPLIT		17
-#define D_CAN_MSG_OBJ_RX_LOW_LAST	(D_CAN_MSG_OBJ_RX_SPLIT - 1)
-
 #define D_CAN_NEXT_MSG_OBJ_MASK		(D_CAN_NUM_TX_MSG_OBJECTS - 1)
 
 /* status interrupt */
@@ -255,6 +259,9 @@
 /* minimum timeout for checking BUSY status */
 #define MIN_TIMEOUT_VALUE		6
 
+/* BUSY status polls without delay, an IF transfer takes 12 CAN-CLK periods */
+#define D_CAN_BUSY_SPIN_COUNT		20
+
 /* Wait for ~1 sec for INIT bit */
 #define D_CAN_WAIT_COUNT		1000
 
@@ -360,8 +367,13 @@ static void d_can_interrupts(struct d_can_priv *priv, int enable)
 
 static inline int d_can_msg_obj_is_busy(struct d_can_priv *priv, int iface)
 {
-	int count = MIN_TIMEOUT_VALUE;
+	int count;
 
+	for (count = D_CAN_BUSY_SPIN_COUNT; count; count--)
+		if (!(d_can_read(priv, D_CAN_IFCMD(iface)) & D_CAN_IF_CMD_BUSY))
+			return 0;
+
+	count = MIN_TIMEOUT_VALUE;
 	while (count && (d_can_read(priv, D_CAN_IFCMD(iface)) &
 				D_CAN_IF_CMD_BUSY)) {
 		count--;
@@ -374,23 +386,6 @@ static inline int d_can_msg_obj_is_busy(struct d_can_priv *priv, int iface)
 	return 0;
 }
 
-static inline void d_can_object_get(struct net_device *dev,
-					int iface, int objno, int mask)
-{
-	struct d_can_priv *priv = netdev_priv(dev);
-
-	d_can_write(priv, D_CAN_IFCMD(iface), IFX_CMD_BITS(mask) |
-					IFX_CMD_MSG_NUMBER(objno));
-
-	/*
-	 * As per specs, after writing the message object number in the
-	 * IF command register the transfer b/w interface register and
-	 * message RAM must be complete in 12 CAN-CLK period.
-	 */
-	if (d_can_msg_obj_is_busy(priv, iface))
-		netdev_err(dev, "timed out in object get\n");
-}
-
 static inline void d_can_object_put(struct net_device *dev,
 					int iface, int objno, int mask)
 {
@@ -460,48 +455,12 @@ static void d_can_write_msg_object(struct net_device *dev,
 }
 
 /*
- * Mark that this particular message object is received and clearing
- * the interrupt pending register value.
+ * Clear the message lost bit of the RX message object which was just read
+ * into the IF registers, and queue an overflow error frame on @rxq.
  */
-static inline void d_can_mark_rx_msg_obj(struct net_device *dev,
-				int iface, int ctrl_mask, int obj)
-{
-	struct d_can_priv *priv = netdev_priv(dev);
-
-	d_can_write(priv, D_CAN_IFMCTL(iface), ctrl_mask
-		& ~(D_CAN_IF_MCTL_MSGLST | D_CAN_IF_MCTL_INTPND));
-
-	d_can_object_put(dev, iface, obj, D_CAN_IF_CMD_CONTROL);
-}
-
-static inline void d_can_activate_all_lower_rx_msg_objs(struct net_device *dev,
-				int iface, int ctrl_mask)
-{
-	int i;
-	struct d_can_priv *priv = netdev_priv(dev);
-
-	for (i = D_CAN_MSG_OBJ_RX_FIRST; i <= D_CAN_MSG_OBJ_RX_LOW_LAST; i++) {
-		d_can_write(priv, D_CAN_IFMCTL(iface),
-				ctrl_mask & ~(D_CAN_IF_MCTL_MSGLST |
-				D_CAN_IF_MCTL_INTPND | D_CAN_IF_MCTL_NEWDAT));
-		d_can_object_put(dev, iface, i, D_CAN_IF_CMD_CONTROL);
-	}
-}
-
-static inline void d_can_activate_rx_msg_obj(struct net_device *dev,
-						int iface, int ctrl_mask,
-						int obj)
-{
-	struct d_can_priv *priv = netdev_priv(dev);
-
-	d_can_write(priv, D_CAN_IFMCTL(iface),
-			ctrl_mask & ~(D_CAN_IF_MCTL_MSGLST |
-			D_CAN_IF_MCTL_INTPND | D_CAN_IF_MCTL_NEWDAT));
-	d_can_object_put(dev, iface, obj, D_CAN_IF_CMD_CONTROL);
-}
-
 static void d_can_handle_lost_msg_obj(struct net_device *dev,
-					int iface, int objno)
+					int iface, int objno, int ctrl_mask,
+					struct sk_buff_head *rxq)
 {
 	struct d_can_priv *priv = netdev_priv(dev);
 	struct net_device_stats *stats = &dev->stats;
@@ -510,11 +469,11 @@ static void d_can_handle_lost_msg_obj(struct net_device *dev,
 
 	netdev_err(dev, "msg lost in buffer %d\n", objno);
 
-	d_can_object_get(dev, iface, objno, D_CAN_IF_CMD_ALL &
-					~D_CAN_IF_CMD_TXRQST);
-
-	d_can_write(priv, D_CAN_IFMCTL(iface), D_CAN_IF_MCTL_CLR_MSGLST);
-
+	/* the data registers are kept, only the control bits are written */
+	ctrl_mask &= ~(D_CAN_IF_MCTL_MSGLST | D_CAN_IF_MCTL_INTPND);
+	if (!(priv->rx_keep_newdat & BIT(objno - 1)))
+		ctrl_mask &= ~D_CAN_IF_MCTL_NEWDAT;
+	d_can_write(priv, D_CAN_IFMCTL(iface), ctrl_mask);
 	d_can_object_put(dev, iface, objno, D_CAN_IF_CMD_CONTROL);
 
 	/* create an error msg */
@@ -527,10 +486,12 @@ static void d_can_handle_lost_msg_obj(struct net_device *dev,
 	stats->rx_errors++;
 	stats->rx_over_errors++;
 
-	netif_receive_skb(skb);
+	__skb_queue_tail(rxq, skb);
 }
 
-static int d_can_read_msg_object(struct net_device *dev, int iface, int ctrl)
+/* Copy the message object in the IF registers to a new skb on @rxq */
+static int d_can_read_msg_object(struct net_device *dev, int iface, int ctrl,
+				struct sk_buff_head *rxq)
 {
 	int i;
 	u32 dataA = 0;
@@ -576,7 +537,7 @@ static int d_can_read_msg_object(struct net_device *dev, int iface, int ctrl)
 		}
 	}
 
-	netif_receive_skb(skb);
+	__skb_queue_tail(rxq, skb);
 
 	stats->rx_packets++;
 	stats->rx_bytes += frame->can_dlc;
@@ -584,15 +545,18 @@ static int d_can_read_msg_object(struct net_device *dev, int iface, int ctrl)
 	return 0;
 }
 
+/*
+ * Set up an RX message object. @mask and @id are the values of the IF mask
+ * and arbitration registers, see d_can_filter_regs().
+ */
 static void d_can_setup_receive_object(struct net_device *dev, int iface,
 					int objno, unsigned int mask,
 					unsigned int id, unsigned int mcont)
 {
 	struct d_can_priv *priv = netdev_priv(dev);
 
-	d_can_write(priv, D_CAN_IFMSK(iface), IFX_WRITE_IDR(mask));
-	d_can_write(priv, D_CAN_IFARB(iface), IFX_WRITE_IDR(id) |
-			D_CAN_IF_ARB_MSGVAL);
+	d_can_write(priv, D_CAN_IFMSK(iface), mask);
+	d_can_write(priv, D_CAN_IFARB(iface), id | D_CAN_IF_ARB_MSGVAL);
 	d_can_write(priv, D_CAN_IFMCTL(iface), mcont);
 
 	d_can_object_put(dev, iface, objno, D_CAN_IF_CMD_ALL &
@@ -644,7 +608,10 @@ static netdev_tx_t d_can_start_xmit(struct sk_buff *skb,
 	msg_obj_no = get_tx_next_msg_obj(priv);
 
 	/* prepare message object for transmission */
+	spin_lock(&priv->if_lock);
 	d_can_write_msg_object(dev, D_CAN_IF_TX_NUM, frame, msg_obj_no);
+	spin_unlock(&priv->if_lock);
+	priv->tx_dlc[msg_obj_no - D_CAN_MSG_OBJ_TX_FIRST] = frame->can_dlc;
 	can_put_echo_skb(skb, dev, msg_obj_no - D_CAN_MSG_OBJ_TX_FIRST);
 
 	/*
@@ -682,33 +649,83 @@ static int d_can_set_bittiming(struct net_device *dev)
 	return 0;
 }
 
+/*
+ * Convert a hardware acceptance filter to the values of the IF mask and
+ * arbitration registers. The frame format always has to match: standard
+ * frames are accepted if @can_id has no CAN_EFF_FLAG, extended frames
+ * otherwise. Frames are accepted if (id & @can_mask) == (@can_id & @can_mask).
+ */
+static void d_can_filter_regs(u32 can_id, u32 can_mask, u32 *id, u32 *mask)
+{
+	if (can_id & CAN_EFF_FLAG) {
+		*id = D_CAN_IF_ARB_MSGXTD | (can_id & CAN_EFF_MASK);
+		*mask = can_mask & CAN_EFF_MASK;
+	} else {
+		*id = (can_id & CAN_SFF_MASK) << 18;
+		*mask = (can_mask & CAN_SFF_MASK) << 18;
+	}
+	*mask |= D_CAN_IF_MASK_MX;
+}
+
 /*
  * Configure D_CAN message objects for Tx and Rx purposes:
  * D_CAN provides a total of 64 message objects that can be configured
  * either for Tx or Rx purposes. In this driver first 32 message objects
- * are used as a reception FIFO and the reception FIFO is signified by the
- * EoB bit being SET. The remaining 32 message objects are kept aside for
- * Tx purposes. See user guide document for further details on configuring
- * message objects.
+ * are used for reception, the remaining 32 message objects are kept aside
+ * for Tx purposes. See user guide document for further details on
+ * configuring message objects.
+ *
+ * The RX message objects are split evenly between the hardware acceptance
+ * filters (one filter accepting all frames if none is set). The objects of
+ * each filter have the same ID and mask and are chained to a reception FIFO,
+ * which is signified by the EoB bit being SET in its last object.
  */
 static void d_can_configure_msg_objects(struct net_device *dev)
 {
-	unsigned int i;
+	struct d_can_priv *priv = netdev_priv(dev);
+	unsigned int i, j, len, obj, cnt;
+	u32 id = 0, mask = 0;
+	struct d_can_rx_fifo *fifo;
 
 	/* first invalidate all message objects */
 	for (i = D_CAN_MSG_OBJ_RX_FIRST; i <= D_CAN_NUM_MSG_OBJECTS; i++)
 		d_can_inval_msg_object(dev, D_CAN_IF_RX_NUM, i);
 
-	/* setup receive message objects */
-	for (i = D_CAN_MSG_OBJ_RX_FIRST; i < D_CAN_MSG_OBJ_RX_LAST; i++)
-		d_can_setup_receive_object(dev, D_CAN_IF_RX_NUM, i, 0, 0,
-			(D_CAN_IF_MCTL_RXIE | D_CAN_IF_MCTL_UMASK) &
-			~D_CAN_IF_MCTL_EOB);
-
-	/* Last object EoB bit should be 1 for terminate */
-	d_can_setup_receive_object(dev, D_CAN_IF_RX_NUM, D_CAN_MSG_OBJ_RX_LAST,
-			0, 0, D_CAN_IF_MCTL_RXIE | D_CAN_IF_MCTL_UMASK |
+	cnt = priv->rx_filter_cnt ? priv->rx_filter_cnt : 1;
+	priv->rx_keep_newdat = priv->rx_recycle = 0;
+	obj = D_CAN_MSG_OBJ_RX_FIRST;
+
+	for (i = 0; i < cnt; i++) {
+		len = D_CAN_NUM_RX_MSG_OBJECTS / cnt;
+		if (i < D_CAN_NUM_RX_MSG_OBJECTS % cnt)
+			len++;
+
+		fifo = &priv->rx_fifo[i];
+		fifo->first = obj;
+		fifo->last = obj + len - 1;
+		fifo->split = obj + len / 2;
+
+		if (priv->rx_filter_cnt)
+			d_can_filter_regs(priv->rx_filter_id[i],
+					priv->rx_filter_mask[i], &id, &mask);
+
+		/* setup receive message objects */
+		for (j = fifo->first; j < fifo->last; j++)
+			d_can_setup_receive_object(dev, D_CAN_IF_RX_NUM, j,
+				mask, id, D_CAN_IF_MCTL_RXIE |
+				D_CAN_IF_MCTL_UMASK);
+
+		/* Last object EoB bit should be 1 for terminate */
+		d_can_setup_receive_object(dev, D_CAN_IF_RX_NUM, fifo->last,
+			mask, id, D_CAN_IF_MCTL_RXIE | D_CAN_IF_MCTL_UMASK |
 			D_CAN_IF_MCTL_EOB);
+
+		for (j = fifo->first; j < fifo->split - 1; j++)
+			priv->rx_keep_newdat |= BIT(j - 1);
+		priv->rx_recycle |= BIT(fifo->split - 2);
+
+		obj += len;
+	}
 }
 
 static void d_can_test_mode(struct net_device *dev)
@@ -867,6 +884,7 @@ static void d_can_do_tx(struct net_device *dev)
 	struct net_device_stats *stats = &dev->stats;
 	u32 txrq_x_reg_val;
 	u32 txrq_reg_val;
+	unsigned int idx;
 
 	for (/* nix */; (priv->tx_next - priv->tx_echo) > 0; priv->tx_echo++) {
 		msg_obj_no = get_tx_echo_msg_obj(priv);
@@ -874,14 +892,14 @@ static void d_can_do_tx(struct net_device *dev)
 		txrq_reg_val = d_can_read(priv, D_CAN_TXRQ(txrq_x_reg_val));
 		if (!(txrq_reg_val & (1 << (msg_obj_no -
 						D_CAN_MSG_OBJ_TX_FIRST)))) {
-			can_get_echo_skb(dev,
-					msg_obj_no - D_CAN_MSG_OBJ_TX_FIRST);
-			stats->tx_bytes += d_can_read(priv,
-					D_CAN_IFMCTL(D_CAN_IF_TX_NUM))
-					& D_CAN_IF_MCTL_DLC_MASK;
+			idx = msg_obj_no - D_CAN_MSG_OBJ_TX_FIRST;
+			stats->tx_bytes += priv->tx_dlc[idx];
 			stats->tx_packets++;
+			can_get_echo_skb(dev, idx);
+			spin_lock(&priv->if_lock);
 			d_can_inval_msg_object(dev, D_CAN_IF_TX_NUM,
 					msg_obj_no);
+			spin_unlock(&priv->if_lock);
 		} else
 			break;
 	}
@@ -892,92 +910,153 @@ static void d_can_do_tx(struct net_device *dev)
 		netif_wake_queue(dev);
 }
 
+/*
+ * Clear the NEWDAT bit of the lower objects of the low group whose last
+ * object @objno has just been read, so that they receive frames again.
+ */
+static void d_can_rx_recycle_low_group(struct net_device *dev, int iface,
+					unsigned int objno)
+{
+	struct d_can_priv *priv = netdev_priv(dev);
+	struct d_can_rx_fifo *fifo = priv->rx_fifo;
+	unsigned int i;
+
+	while (fifo->split - 1 != objno)
+		fifo++;
+
+	for (i = fifo->first; i < objno; i++) {
+		d_can_write(priv, D_CAN_IFMCTL(iface),
+				D_CAN_IF_MCTL_RXIE | D_CAN_IF_MCTL_UMASK);
+		d_can_object_put(dev, iface, i, D_CAN_IF_CMD_CONTROL);
+	}
+}
+
+static inline int d_can_other_iface(int iface)
+{
+	return iface == D_CAN_IF_RX_NUM ? D_CAN_IF_TX_NUM : D_CAN_IF_RX_NUM;
+}
+
+/* Start transferring a received message object to the IF registers */
+static inline void d_can_rx_get_start(struct d_can_priv *priv, int iface,
+					unsigned int objno)
+{
+	u32 cmd = D_CAN_IF_CMD_RX;
+
+	if (!(priv->rx_keep_newdat & BIT(objno - 1)))
+		cmd |= D_CAN_IF_CMD_CLR_NEWDAT;
+
+	d_can_write(priv, D_CAN_IFCMD(iface), cmd | IFX_CMD_MSG_NUMBER(objno));
+}
+
+/* Handle a received message object once it is in the IF registers */
+static void d_can_rx_msg_obj(struct net_device *dev, int iface,
+				unsigned int objno, struct sk_buff_head *rxq)
+{
+	struct d_can_priv *priv = netdev_priv(dev);
+	unsigned int mctrl_reg_val;
+
+	if (d_can_msg_obj_is_busy(priv, iface))
+		netdev_err(dev, "timed out in object get\n");
+
+	mctrl_reg_val = d_can_read(priv, D_CAN_IFMCTL(iface));
+	if (!(mctrl_reg_val & D_CAN_IF_MCTL_NEWDAT))
+		return;
+
+	if (mctrl_reg_val & D_CAN_IF_MCTL_MSGLST)
+		d_can_handle_lost_msg_obj(dev, iface, objno, mctrl_reg_val,
+					rxq);
+
+	/* read the data from the message object */
+	d_can_read_msg_object(dev, iface, mctrl_reg_val, rxq);
+
+	if (priv->rx_recycle & BIT(objno - 1))
+		d_can_rx_recycle_low_group(dev, iface, objno);
+}
+
 /*
  * theory of operation:
  *
  * d_can core saves a received CAN message into the first free message
- * object it finds free (starting with the lowest). Bits NEWDAT and
- * INTPND are set for this message object indicating that a new message
- * has arrived. To work-around this issue, we keep two groups of message
- * objects whose partitioning is defined by D_CAN_MSG_OBJ_RX_SPLIT.
+ * object of the reception FIFO whose filter accepts it (starting with
+ * the lowest). Bits NEWDAT and INTPND are set for this message object
+ * indicating that a new message has arrived. To ensure in-order frame
+ * reception, each FIFO is split into two groups of message objects:
+ * - objects of the low group but the last one are read without clearing
+ *   the NEWDAT bit, only the INTPND bit is cleared, so that new frames
+ *   go to the following objects;
+ * - when the last object of the low group is read, the NEWDAT bit of all
+ *   the lower objects is cleared;
+ * - objects of the high group are read and their NEWDAT bit is cleared
+ *   at once.
  *
- * To ensure in-order frame reception we use the following
- * approach while re-activating a message object to receive further
- * frames:
- * - if the current message object number is lower than
- *   D_CAN_MSG_RX_LOW_LAST, do not clear the NEWDAT bit while clearing
- *   the INTPND bit.
- * - if the current message object number is equal to
- *   D_CAN_MSG_RX_LOW_LAST then clear the NEWDAT bit of all lower
- *   receive message objects.
- * - if the current message object number is greater than
- *   D_CAN_MSG_RX_LOW_LAST then clear the NEWDAT bit of
- *   only this message object.
+ * All pending objects are found from the NEWDAT and INTPND registers,
+ * which are read once per batch rather than once per object. Objects are
+ * transferred to the IF registers with a single command which also clears
+ * INTPND (and NEWDAT). If the TX interface is idle, it is used to fetch the
+ * next object while the current one is being handled.
+ *
+ * The frames of a batch are only copied out while the IF registers are in
+ * use. They are handed to the stack once the TX interface is released, as
+ * a transmission triggered from netif_receive_skb() needs it.
  */
 static int d_can_do_rx_poll(struct net_device *dev, int quota)
 {
 	struct d_can_priv *priv = netdev_priv(dev);
-	unsigned int msg_obj, mctrl_reg_val;
+	unsigned int msg_obj, next_obj;
+	int iface, next_iface, pipeline;
 	u32 num_rx_pkts = 0;
-	u32 intpnd_x_reg_val;
-	u32 intpnd_reg_val;
-
-	for (msg_obj = D_CAN_MSG_OBJ_RX_FIRST; msg_obj <= D_CAN_MSG_OBJ_RX_LAST
-				&& quota > 0; msg_obj++) {
+	u32 pending;
+	struct sk_buff_head rxq;
+	struct sk_buff *skb;
 
-		intpnd_x_reg_val = D_CAN_GET_XREG_NUM(priv, D_CAN_INTPND_X);
-		intpnd_reg_val = d_can_read(priv,
-					D_CAN_INTPND(intpnd_x_reg_val));
+	__skb_queue_head_init(&rxq);
 
+	while (quota > 0) {
 		/*
-		 * as interrupt pending register's bit n-1 corresponds to
+		 * as NEWDAT/INTPND register's bit n-1 corresponds to RX
 		 * message object n, we need to handle the same properly.
 		 */
-		if (intpnd_reg_val & (1 << (msg_obj - 1))) {
-
-			d_can_object_get(dev, D_CAN_IF_RX_NUM, msg_obj,
-					D_CAN_IF_CMD_ALL &
-					~D_CAN_IF_CMD_TXRQST);
-
-			mctrl_reg_val = d_can_read(priv,
-					D_CAN_IFMCTL(D_CAN_IF_RX_NUM));
-
-			if (!(mctrl_reg_val & D_CAN_IF_MCTL_NEWDAT))
-				continue;
-
-			/* read the data from the message object */
-			d_can_read_msg_object(dev, D_CAN_IF_RX_NUM,
-						mctrl_reg_val);
-
-			if (mctrl_reg_val & D_CAN_IF_MCTL_EOB)
-				d_can_setup_receive_object(dev, D_CAN_IF_RX_NUM,
-					D_CAN_MSG_OBJ_RX_LAST, 0, 0,
-					D_CAN_IF_MCTL_RXIE | D_CAN_IF_MCTL_UMASK
-					| D_CAN_IF_MCTL_EOB);
+		pending = d_can_read(priv, D_CAN_NWDAT(0)) &
+			d_can_read(priv, D_CAN_INTPND(0));
+		if (!pending)
+			break;
 
-			if (mctrl_reg_val & D_CAN_IF_MCTL_MSGLST) {
-				d_can_handle_lost_msg_obj(dev, D_CAN_IF_RX_NUM,
-					msg_obj);
-				num_rx_pkts++;
-				quota--;
-				continue;
+		pipeline = spin_trylock(&priv->if_lock);
+		msg_obj = __ffs(pending) + 1;
+		pending &= pending - 1;
+		iface = D_CAN_IF_RX_NUM;
+		d_can_rx_get_start(priv, iface, msg_obj);
+
+		while (1) {
+			next_obj = 0;
+			next_iface = iface;
+			if (pending && quota > 1) {
+				next_obj = __ffs(pending) + 1;
+				pending &= pending - 1;
+				if (pipeline) {
+					next_iface = d_can_other_iface(iface);
+					d_can_rx_get_start(priv, next_iface,
+							next_obj);
+				}
 			}
 
-			if (msg_obj < D_CAN_MSG_OBJ_RX_LOW_LAST)
-				d_can_mark_rx_msg_obj(dev, D_CAN_IF_RX_NUM,
-						mctrl_reg_val, msg_obj);
-			else if (msg_obj > D_CAN_MSG_OBJ_RX_LOW_LAST)
-				/* activate this msg obj */
-				d_can_activate_rx_msg_obj(dev, D_CAN_IF_RX_NUM,
-						mctrl_reg_val, msg_obj);
-			else if (msg_obj == D_CAN_MSG_OBJ_RX_LOW_LAST)
-				/* activate all lower message objects */
-				d_can_activate_all_lower_rx_msg_objs(dev,
-						D_CAN_IF_RX_NUM, mctrl_reg_val);
-
+			d_can_rx_msg_obj(dev, iface, msg_obj, &rxq);
 			num_rx_pkts++;
 			quota--;
+
+			if (!next_obj)
+				break;
+			if (!pipeline)
+				d_can_rx_get_start(priv, next_iface, next_obj);
+			msg_obj = next_obj;
+			iface = next_iface;
 		}
+
+		if (pipeline)
+			spin_unlock(&priv->if_lock);
+
+		while ((skb = __skb_dequeue(&rxq)))
+			netif_receive_skb(skb);
 	}
 
 	return num_rx_pkts;
@@ -1312,6 +1391,7 @@ struct net_device *alloc_d_can_dev(int num_objs)
 	netif_napi_add(dev, &priv->napi, d_can_poll, num_objs/2);
 
 	priv->dev = dev;
+	spin_lock_init(&priv->if_lock);
 	priv->can.bittiming_const = &d_can_bittiming_const;
 	priv->can.do_set_mode = d_can_set_mode;
 	priv->can.do_get_berr_counter = d_can_get_berr_counter;
@@ -1388,11 +1468,85 @@ static const struct net_device_ops d_can_netdev_ops = {
 	.ndo_start_xmit = d_can_start_xmit,
 };
 
+/*
+ * Hardware acceptance filters, one "id:mask" pair (hexadecimal, as for
+ * CAN_RAW filters) per filter. Frames which match none of the filters are
+ * dropped by the controller and never reach any socket. Writing an empty
+ * string accepts all frames again. See d_can_filter_regs() for the matching
+ * rules.
+ */
+static ssize_t d_can_sysfs_show_rx_filters(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct d_can_priv *priv = netdev_priv(to_net_dev(dev));
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < priv->rx_filter_cnt; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "%08x:%08x\n",
+				priv->rx_filter_id[i], priv->rx_filter_mask[i]);
+
+	return len;
+}
+
+static ssize_t d_can_sysfs_set_rx_filters(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct net_device *ndev = to_net_dev(dev);
+	struct d_can_priv *priv = netdev_priv(ndev);
+	u32 id[D_CAN_MAX_RX_FILTERS], mask[D_CAN_MAX_RX_FILTERS];
+	unsigned int cnt = 0;
+	const char *p = buf;
+	ssize_t ret;
+	int n;
+
+	while (1) {
+		p = skip_spaces(p);
+		if (!*p)
+			break;
+		if (cnt == D_CAN_MAX_RX_FILTERS)
+			return -ENOSPC;
+		if (sscanf(p, "%x:%x%n", &id[cnt], &mask[cnt], &n) != 2)
+			return -EINVAL;
+		p += n;
+		cnt++;
+	}
+
+	rtnl_lock();
+
+	if (ndev->flags & IFF_UP) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	memcpy(priv->rx_filter_id, id, cnt * sizeof(u32));
+	memcpy(priv->rx_filter_mask, mask, cnt * sizeof(u32));
+	priv->rx_filter_cnt = cnt;
+	ret = count;
+
+ out:
+	rtnl_unlock();
+	return ret;
+}
+
+static DEVICE_ATTR(rx_filters, S_IWUSR | S_IRUGO,
+	d_can_sysfs_show_rx_filters, d_can_sysfs_set_rx_filters);
+
+static struct attribute *d_can_sysfs_attrs[] = {
+	&dev_attr_rx_filters.attr,
+	NULL,
+};
+
+static struct attribute_group d_can_sysfs_attr_group = {
+	.attrs = d_can_sysfs_attrs,
+};
+
 int register_d_can_dev(struct net_device *dev)
 {
 	/* we support local echo */
 	dev->flags |= IFF_ECHO;
 	dev->netdev_ops = &d_can_netdev_ops;
+	dev->sysfs_groups[0] = &d_can_sysfs_attr_group;
 
 	return register_candev(dev);
 }
@@ -35,6 +35,22 @@
 #define D_CAN_DRV_DESC	"CAN bus driver for Bosch D_CAN controller " \
 			D_CAN_VERSION
 
+/* Maximum number of hardware acceptance filters */
+#define D_CAN_MAX_RX_FILTERS	8
+
+/* Number of TX message objects */
+#define D_CAN_NUM_TX_MSG_OBJECTS	32
+
+/*
+ * Receive FIFO: message objects @first to @last have the same acceptance
+ * filter, objects below @split form the low group (see d_can_do_rx_poll())
+ */
+struct d_can_rx_fifo {
+	unsigned int first;
+	unsigned int split;
+	unsigned int last;
+};
+
 /* d_can private data structure */
 struct d_can_priv {
 	struct can_priv can;	/* must be the first member */
@@ -54,7 +70,15 @@ struct d_can_priv {
 	unsigned long irq_flags; /* for request_irq() */
 	unsigned int tx_next;
 	unsigned int tx_echo;
+	u8 tx_dlc[D_CAN_NUM_TX_MSG_OBJECTS];	/* DLC of the TX frames */
 	unsigned int rx_next;
+	spinlock_t if_lock;	/* protects the TX interface registers */
+	unsigned int rx_filter_cnt;
+	u32 rx_filter_id[D_CAN_MAX_RX_FILTERS];
+	u32 rx_filter_mask[D_CAN_MAX_RX_FILTERS];
+	struct d_can_rx_fifo rx_fifo[D_CAN_MAX_RX_FILTERS];
+	u32 rx_keep_newdat;	/* low group RX objects but the last ones */
+	u32 rx_recycle;		/* last RX objects of the low groups */
 	bool opened;
 	void *priv;		/* for board-specific data */
 	void (*ram_init) (unsigned int, unsigned int);
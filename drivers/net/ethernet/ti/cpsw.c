@@ -27,12 +27,17 @@
 #include <linux/delay.h>
 #include <linux/interrupt.h>
 #include <linux/pm_runtime.h>
+#include <linux/pm_qos.h>
 #include <linux/if_vlan.h>
+#include <linux/math64.h>
+#include <linux/net_tstamp.h>
+#include <linux/pkt_sched.h>
 #include <linux/net_switch_config.h>
 
 #include <linux/cpsw.h>
 #include <plat/dmtimer.h>
 #include "cpsw_ale.h"
+#include "cpts.h"
 #include "davinci_cpdma.h"
 
 
@@ -63,8 +68,15 @@ do {								\
 #define CPDMA_RXCP_VER2		0x260
 
 #define CPSW_POLL_WEIGHT	64
+#define CPSW_MAX_QUEUES		8
 #define CPSW_MIN_PACKET_SIZE	60
 #define CPSW_MAX_PACKET_SIZE	(1500 + 14 + 4 + 4)
+#define CPSW_RX_BUF_MAX		(PAGE_SIZE - NET_IP_ALIGN)
+#define CPSW_RX_COPYBREAK	256
+#define CPSW_RX_HDR_LEN		128
+#define CPSW_RX_POOL_FACTOR	2
+#define CPSW_TSO_SEG_DESCS	3	/* header plus two page fragments */
+#define CPSW_TSO_SEG_SIZE	1448
 #define CPSW_PHY_SPEED		1000
 
 #define CPSW_PRIMAP(shift, priority)	(priority << (shift * 4))
@@ -82,19 +94,6 @@ do {								\
 #define CPSW_CMINTMAX_INTVL	(1000 / CPSW_CMINTMIN_CNT)
 #define CPSW_CMINTMIN_INTVL	((1000 / CPSW_CMINTMAX_CNT) + 1)
 
-#define cpsw_enable_irq(priv)	\
-	do {			\
-		u32 i;		\
-		for (i = 0; i < priv->num_irqs; i++) \
-			enable_irq(priv->irqs_table[i]); \
-	} while (0);
-#define cpsw_disable_irq(priv)	\
-	do {			\
-		u32 i;		\
-		for (i = 0; i < priv->num_irqs; i++) \
-			disable_irq_nosync(priv->irqs_table[i]); \
-	} while (0);
-
 #define ALE_ALL_PORTS		0x7
 
 #define CPSW_CPDMA_EOI_REG	0x894
@@ -103,6 +102,31 @@ do {								\
 #define CPSW_RX_TIMER_REQ	5
 #define CPSW_TX_TIMER_REQ	6
 
+/* Bit definitions for the CPSW2 port control register */
+#define TS_320			BIT(14)	/* Time Sync Dest Port 320 enable */
+#define TS_319			BIT(13)	/* Time Sync Dest Port 319 enable */
+#define TS_132			BIT(12)	/* Time Sync Dest IP Addr 132 enable */
+#define TS_131			BIT(11)	/* Time Sync Dest IP Addr 131 enable */
+#define TS_130			BIT(10)	/* Time Sync Dest IP Addr 130 enable */
+#define TS_129			BIT(9)	/* Time Sync Dest IP Addr 129 enable */
+#define TS_TTL_NONZERO		BIT(8)	/* Time Sync TTL Non-zero enable */
+#define TS_ANNEX_D_EN		BIT(4)	/* Time Sync Annex D enable */
+#define TS_LTYPE1_EN		BIT(2)	/* Time Sync LTYPE 1 enable */
+#define TS_TX_EN		BIT(1)	/* Time Sync Transmit Enable */
+#define TS_RX_EN		BIT(0)	/* Time Sync Receive Enable */
+
+#define CTRL_TS_BITS		(TS_320 | TS_319 | TS_132 | TS_131 | TS_130 | \
+				 TS_129 | TS_TTL_NONZERO | TS_ANNEX_D_EN | \
+				 TS_LTYPE1_EN)
+#define CTRL_ALL_TS_MASK	(CTRL_TS_BITS | TS_TX_EN | TS_RX_EN)
+
+#define TS_SEQ_ID_OFFSET_SHIFT	16	/* Time Sync Sequence ID Offset */
+#define TS_SEQ_ID_OFFSET	30	/* sequenceId offset in a PTP header */
+#define EVENT_MSG_BITS		(BIT(0) | BIT(1) | BIT(2) | BIT(3))
+
+/* the v2 port control register sits two words below the slave registers */
+#define cpsw2_port_control(slave)	((u32 __iomem *)(slave)->regs - 2)
+
 #ifdef CONFIG_TI_CPSW_DUAL_EMAC
 
 /* Enable VLAN aware mode to add VLAN for induvudual interface */
@@ -116,16 +140,14 @@ do {								\
 	do {							\
 		(func)((priv)->slaves + priv->emac_port, ##arg);\
 	} while (0)
-#define cpsw_dual_emac_source_port_detect(status, priv, ndev, skb)	\
+#define cpsw_dual_emac_source_port_detect(status, priv, ndev)		\
 	do {								\
 		if (CPDMA_RX_SOURCE_PORT(status) == 1) {		\
 			ndev = cpsw_get_slave_ndev(priv, 0);		\
 			priv = netdev_priv(ndev);			\
-			skb->dev = ndev;				\
 		} else if (CPDMA_RX_SOURCE_PORT(status) == 2) {		\
 			ndev = cpsw_get_slave_ndev(priv, 1);		\
 			priv = netdev_priv(ndev);			\
-			skb->dev = ndev;				\
 		}							\
 	} while (0)
 #define cpsw_add_switch_mode_bcast_ale_entries(priv, slave_port)
@@ -148,7 +170,7 @@ do {								\
 		for (idx = 0; idx < (priv)->data.slaves; idx++)	\
 			(func)((priv)->slaves + idx, ##arg);	\
 	} while (0)
-#define cpsw_dual_emac_source_port_detect(status, priv, ndev, skb)
+#define cpsw_dual_emac_source_port_detect(status, priv, ndev)
 #define cpsw_add_switch_mode_bcast_ale_entries(priv, slave_port)	\
 	cpsw_ale_add_mcast(priv->ale, priv->ndev->broadcast,		\
 			   1 << slave_port, 0, 0)
@@ -168,6 +190,9 @@ do {								\
 struct omap_dm_timer *dmtimer_rx;
 struct omap_dm_timer *dmtimer_tx;
 
+/* serializes read-modify-write of the wrapper interrupt enable registers */
+static DEFINE_SPINLOCK(cpsw_wr_lock);
+
 extern u32 omap_ctrl_readl(u16 offset);
 extern void omap_ctrl_writel(u32 val, u16 offset);
 
@@ -183,6 +208,26 @@ static int rx_packet_max = CPSW_MAX_PACKET_SIZE;
 module_param(rx_packet_max, int, 0);
 MODULE_PARM_DESC(rx_packet_max, "maximum receive packet size (bytes)");
 
+/*
+ * The descriptor pool is shared out between the channels, so a single
+ * queue, which keeps every descriptor for ordinary traffic, is the default.
+ */
+static int tx_queues = 1;
+module_param(tx_queues, int, 0);
+MODULE_PARM_DESC(tx_queues, "tx queues (default 1, 0 = all cpdma channels)");
+
+static int rx_queues = 1;
+module_param(rx_queues, int, 0);
+MODULE_PARM_DESC(rx_queues, "rx queues (default 1, 0 = all cpdma channels)");
+
+static int tx_weight[CPSW_MAX_QUEUES] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+module_param_array(tx_weight, int, NULL, 0);
+MODULE_PARM_DESC(tx_weight, "per tx queue descriptor and completion weight");
+
+static int rx_weight[CPSW_MAX_QUEUES] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+module_param_array(rx_weight, int, NULL, 0);
+MODULE_PARM_DESC(rx_weight, "per rx queue descriptor and napi budget weight");
+
 struct cpsw_ss_regs {
 	u32	id_ver;
 	u32	soft_reset;
@@ -213,6 +258,9 @@ struct cpsw_regs {
 	u32	gap_thresh;
 	u32	tx_start_wds;
 	u32	flow_control;
+	u32	vlan_ltype;
+	u32	ts_ltype;
+	u32	dlr_ltype;
 };
 
 struct cpsw_slave_regs {
@@ -304,14 +352,53 @@ struct cpsw_slave {
 	u32				open_stat;
 };
 
+struct cpsw_rx_napi {
+	struct napi_struct		napi;
+	struct cpsw_priv		*priv;
+	int				ch;
+};
+
+/*
+ * Receive buffers are whole pages that stay mapped for as long as they sit
+ * in the pool of their rx queue.  A page handed to the stack as an skb
+ * fragment is queued again once the stack has dropped its reference, and
+ * short frames are copied out so that their page goes straight back to
+ * the channel.  Only the bytes actually received are synced.
+ */
+struct cpsw_rx_page {
+	struct cpsw_rx_pool		*pool;
+	struct page			*page;
+	dma_addr_t			dma;
+	int				sync_len;	/* bytes touched by cpu */
+	bool				queued;		/* owned by the channel */
+};
+
+struct cpsw_rx_pool_stats {
+	u32				recycled;
+	u32				page_alloc;
+	u32				alloc_fail;
+	u32				copybreak;
+	u32				exhausted;
+};
+
+struct cpsw_rx_pool {
+	struct cpsw_priv		*priv;
+	int				ch;
+	int				next;
+	int				num_pages;
+	struct cpsw_rx_pool_stats	stats;
+	struct cpsw_rx_page		pages[0];
+};
+
 struct cpsw_priv {
 	spinlock_t			lock;
 	struct platform_device		*pdev;
 	struct net_device		*ndev;
 	struct resource			*cpsw_res;
 	struct resource			*cpsw_ss_res;
-	struct napi_struct		napi;
-#define napi_to_priv(napi)	container_of(napi, struct cpsw_priv, napi)
+	struct napi_struct		napi_tx;
+#define napi_tx_to_priv(napi)	container_of(napi, struct cpsw_priv, napi_tx)
+	struct cpsw_rx_napi		napi_rx[CPSW_MAX_QUEUES];
 	struct device			*dev;
 	struct cpsw_platform_data	data;
 	struct cpsw_regs __iomem	*regs;
@@ -328,15 +415,80 @@ struct cpsw_priv {
 	u8				mac_addr[ETH_ALEN];
 	struct cpsw_slave		*slaves;
 	struct cpdma_ctlr		*dma;
-	struct cpdma_chan		*txch, *rxch;
+	struct cpdma_chan		*txch[CPSW_MAX_QUEUES];
+	struct cpdma_chan		*rxch[CPSW_MAX_QUEUES];
+	struct cpsw_rx_pool		*rx_pool[CPSW_MAX_QUEUES];
+	int				num_tx_queues;
+	int				num_rx_queues;
+	int				tx_quota[CPSW_MAX_QUEUES];
+	int				tx_desc_num[CPSW_MAX_QUEUES];
+	struct sk_buff_head		tx_pending[CPSW_MAX_QUEUES];
+	u16				tx_prio_map[TC_PRIO_MAX + 1];
 	struct cpsw_ale			*ale;
+	struct cpts			*cpts;
 	u32				emac_port;
 	u8				port_state[3];
 	/* snapshot of IRQ numbers */
 	u32 irqs_table[4];
 	u32 num_irqs;
+	struct pm_qos_request		pm_qos_req;
 };
 
+/* number of descriptors the skb takes up on a tx channel */
+static inline int cpsw_tx_desc_num(struct sk_buff *skb)
+{
+	return !!skb_headlen(skb) + skb_shinfo(skb)->nr_frags;
+}
+
+/*
+ * The switch cannot checksum on transmit, so partial checksums are filled
+ * in here.  That is still cheaper than having the stack copy every page it
+ * sends, and paged skbs then go out as one descriptor per fragment.
+ */
+static int cpsw_tx_submit_skb(struct cpdma_chan *txch, struct sk_buff *skb,
+			      int directed)
+{
+	struct cpdma_buf bufs[MAX_SKB_FRAGS + 1];
+	int i, num_bufs = 0, ret;
+
+	if (skb->ip_summed == CHECKSUM_PARTIAL) {
+		ret = skb_checksum_help(skb);
+		if (ret)
+			return ret;
+	}
+
+	if (!skb_is_nonlinear(skb))
+		return cpdma_chan_submit(txch, skb, skb->data, skb->len,
+					 directed, GFP_KERNEL);
+
+	if (skb_headlen(skb)) {
+		bufs[0].data = skb->data;
+		bufs[0].page = NULL;
+		bufs[0].offset = 0;
+		bufs[0].len = skb_headlen(skb);
+		num_bufs++;
+	}
+
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++, num_bufs++) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		bufs[num_bufs].data = NULL;
+		bufs[num_bufs].page = skb_frag_page(frag);
+		bufs[num_bufs].offset = frag->page_offset;
+		bufs[num_bufs].len = skb_frag_size(frag);
+	}
+
+	ret = cpdma_chan_submit_sg(txch, skb, bufs, num_bufs, directed);
+	if (ret != -ENOSPC)
+		return ret;
+
+	/* more fragments than the channel has descriptors */
+	if (skb_linearize(skb))
+		return -ENOBUFS;
+	return cpdma_chan_submit(txch, skb, skb->data, skb->len, directed,
+				 GFP_KERNEL);
+}
+
 #ifdef CONFIG_TI_CPSW_DUAL_EMAC
 
 static inline void cpsw_p0_fifo_type_select(struct cpsw_priv *priv)
@@ -381,14 +533,13 @@ static int cpsw_common_res_usage_state(struct cpsw_priv *priv)
 }
 
 static inline int cpsw_tx_packet_submit(struct net_device *ndev,
-			struct cpsw_priv *priv, struct sk_buff *skb)
+			struct cpsw_priv *priv, struct cpdma_chan *txch,
+			struct sk_buff *skb)
 {
 	if (ndev == cpsw_get_slave_ndev(priv, 0))
-		return cpdma_chan_submit(priv->txch, skb, skb->data,
-				  skb->len, 1, GFP_KERNEL);
+		return cpsw_tx_submit_skb(txch, skb, 1);
 	else
-		return cpdma_chan_submit(priv->txch, skb, skb->data,
-				  skb->len, 2, GFP_KERNEL);
+		return cpsw_tx_submit_skb(txch, skb, 2);
 }
 
 #define cpsw_add_switch_mode_default_ale_entries(priv)
@@ -399,9 +550,8 @@ static inline int cpsw_tx_packet_submit(struct net_device *ndev,
 #define cpsw_add_dual_emac_mode_default_ale_entries(priv, slave, slave_port)
 #define cpsw_update_slave_open_state(priv, state)
 #define cpsw_common_res_usage_state(priv)	0
-#define cpsw_tx_packet_submit(ndev, priv, skb)		\
-	cpdma_chan_submit(priv->txch, skb, skb->data,	\
-			  skb->len, 0, GFP_KERNEL)
+#define cpsw_tx_packet_submit(ndev, priv, txch, skb)	\
+	cpsw_tx_submit_skb(txch, skb, 0)
 
 static inline void cpsw_add_switch_mode_default_ale_entries(
 			struct cpsw_priv *priv)
@@ -435,14 +585,170 @@ static void cpsw_intr_disable(struct cpsw_priv *priv)
 	return;
 }
 
+static void cpsw_wr_intr_ctrl(u32 __iomem *reg, u32 mask, bool enable)
+{
+	unsigned long flags;
+	u32 val;
+
+	spin_lock_irqsave(&cpsw_wr_lock, flags);
+	val = __raw_readl(reg);
+	if (enable)
+		val |= mask;
+	else
+		val &= ~mask;
+	__raw_writel(val, reg);
+	spin_unlock_irqrestore(&cpsw_wr_lock, flags);
+}
+
+static void cpsw_napi_enable(struct cpsw_priv *priv)
+{
+	int ch;
+
+	napi_enable(&priv->napi_tx);
+	for (ch = 0; ch < priv->num_rx_queues; ch++)
+		napi_enable(&priv->napi_rx[ch].napi);
+}
+
+static void cpsw_napi_disable(struct cpsw_priv *priv)
+{
+	int ch;
+
+	napi_disable(&priv->napi_tx);
+	for (ch = 0; ch < priv->num_rx_queues; ch++)
+		napi_disable(&priv->napi_rx[ch].napi);
+}
+
+static struct cpsw_rx_pool *cpsw_rx_pool_create(struct cpsw_priv *priv,
+						int ch)
+{
+	struct cpsw_rx_pool *pool;
+	int i, num_pages;
+
+	num_pages = CPSW_RX_POOL_FACTOR *
+		    cpdma_chan_get_rx_buf_num(priv->rxch[ch]);
+	pool = kzalloc(sizeof(*pool) + num_pages * sizeof(pool->pages[0]),
+		       GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->priv = priv;
+	pool->ch = ch;
+	pool->num_pages = num_pages;
+	for (i = 0; i < num_pages; i++)
+		pool->pages[i].pool = pool;
+	return pool;
+}
+
+/* release all pages, the channel must have been torn down already */
+static void cpsw_rx_pool_drain(struct cpsw_rx_pool *pool)
+{
+	struct device *dev = &pool->priv->pdev->dev;
+	struct cpsw_rx_page *rxp;
+	int i;
+
+	for (i = 0; i < pool->num_pages; i++) {
+		rxp = &pool->pages[i];
+		if (!rxp->page)
+			continue;
+		WARN_ON(rxp->queued);
+		dma_unmap_page(dev, rxp->dma, PAGE_SIZE, DMA_FROM_DEVICE);
+		put_page(rxp->page);
+		rxp->page = NULL;
+		rxp->sync_len = 0;
+		rxp->queued = false;
+	}
+	pool->next = 0;
+}
+
+/*
+ * Find a page that is neither queued nor referenced by the stack, starting
+ * after the last page handed out so the oldest fragments are tried first.
+ * A new page is only mapped when every pooled page is still in use.
+ */
+static struct cpsw_rx_page *cpsw_rx_pool_get(struct cpsw_rx_pool *pool)
+{
+	struct device *dev = &pool->priv->pdev->dev;
+	struct cpsw_rx_page *rxp;
+	int i, idx, empty = -1;
+
+	for (i = 0, idx = pool->next; i < pool->num_pages; i++) {
+		rxp = &pool->pages[idx];
+		if (++idx == pool->num_pages)
+			idx = 0;
+
+		if (!rxp->page) {
+			if (empty < 0)
+				empty = rxp - pool->pages;
+			continue;
+		}
+		if (rxp->queued || page_count(rxp->page) != 1)
+			continue;
+
+		if (rxp->sync_len)
+			dma_sync_single_range_for_device(dev, rxp->dma,
+					NET_IP_ALIGN, rxp->sync_len,
+					DMA_FROM_DEVICE);
+		rxp->sync_len = 0;
+		pool->next = idx;
+		pool->stats.recycled++;
+		return rxp;
+	}
+
+	if (empty < 0) {
+		pool->stats.exhausted++;
+		return NULL;
+	}
+
+	rxp = &pool->pages[empty];
+	rxp->page = alloc_page(GFP_ATOMIC);
+	if (!rxp->page) {
+		pool->stats.alloc_fail++;
+		return NULL;
+	}
+	rxp->dma = dma_map_page(dev, rxp->page, 0, PAGE_SIZE,
+				DMA_FROM_DEVICE);
+	rxp->sync_len = 0;
+	pool->next = (empty + 1) % pool->num_pages;
+	pool->stats.page_alloc++;
+	return rxp;
+}
+
+static int cpsw_rx_page_submit(struct cpsw_rx_page *rxp)
+{
+	struct cpsw_rx_pool *pool = rxp->pool;
+	struct cpsw_priv *priv = pool->priv;
+	int ret;
+
+	rxp->queued = true;
+	ret = cpdma_chan_submit_mapped(priv->rxch[pool->ch], rxp,
+				       rxp->dma + NET_IP_ALIGN,
+				       priv->rx_packet_max, 0);
+	if (ret < 0)
+		rxp->queued = false;
+	return ret;
+}
+
+static int cpsw_rx_submit(struct cpsw_priv *priv, int ch)
+{
+	struct cpsw_rx_page *rxp;
+
+	rxp = cpsw_rx_pool_get(priv->rx_pool[ch]);
+	if (!rxp)
+		return -ENOMEM;
+	return cpsw_rx_page_submit(rxp);
+}
+
 void cpsw_tx_handler(void *token, int len, int status)
 {
 	struct sk_buff		*skb = token;
 	struct net_device	*ndev = skb->dev;
 	struct cpsw_priv	*priv = netdev_priv(ndev);
+	struct netdev_queue	*txq;
 
-	if (unlikely(netif_queue_stopped(ndev)))
-		netif_start_queue(ndev);
+	txq = netdev_get_tx_queue(ndev, skb_get_queue_mapping(skb));
+	if (unlikely(netif_tx_queue_stopped(txq)))
+		netif_tx_wake_queue(txq);
+	cpts_tx_timestamp(priv->cpts, skb);
 	priv->stats.tx_packets++;
 	priv->stats.tx_bytes += len;
 	dev_kfree_skb_any(skb);
@@ -450,46 +756,79 @@ void cpsw_tx_handler(void *token, int len, int status)
 
 void cpsw_rx_handler(void *token, int len, int status)
 {
-	struct sk_buff		*skb = token;
-	struct net_device	*ndev = skb->dev;
-	struct cpsw_priv	*priv = netdev_priv(ndev);
-	int			ret = 0;
-
-	cpsw_dual_emac_source_port_detect(status, priv, ndev, skb);
-
-	if (unlikely(!netif_running(ndev)) ||
-			unlikely(!netif_carrier_ok(ndev))) {
-		dev_kfree_skb_any(skb);
+	struct cpsw_rx_page	*rxp = token;
+	struct cpsw_rx_page	*next = rxp;
+	struct cpsw_rx_pool	*pool = rxp->pool;
+	struct cpsw_priv	*priv = pool->priv;
+	struct net_device	*ndev = priv->ndev;
+	struct device		*dev = &priv->pdev->dev;
+	struct sk_buff		*skb;
+	void			*data;
+	int			hlen = len;
+	int			ret;
+
+	rxp->queued = false;
+
+	/* channel teardown, the page stays in the pool until it is drained */
+	if (unlikely(status < 0))
 		return;
-	}
 
-	if (likely(status >= 0)) {
-		skb_put(skb, len);
-		skb->protocol = eth_type_trans(skb, ndev);
-		netif_receive_skb(skb);
-		priv->stats.rx_bytes += len;
-		priv->stats.rx_packets++;
-		skb = NULL;
-	}
+	cpsw_dual_emac_source_port_detect(status, priv, ndev);
 
+	/* the other port may still be up, keep the channel fed */
+	if (unlikely(!netif_running(ndev) || !netif_carrier_ok(ndev)))
+		goto requeue;
 
-	if (unlikely(!netif_running(ndev))) {
-		if (skb)
-			dev_kfree_skb_any(skb);
-		return;
+	dma_sync_single_range_for_cpu(dev, rxp->dma, NET_IP_ALIGN, len,
+				      DMA_FROM_DEVICE);
+	rxp->sync_len = len;
+	data = page_address(rxp->page) + NET_IP_ALIGN;
+
+	/*
+	 * Large frames are passed up as a page fragment if another page is
+	 * available to refill the channel, otherwise they are copied.
+	 */
+	if (len > CPSW_RX_COPYBREAK) {
+		next = cpsw_rx_pool_get(pool);
+		if (next)
+			hlen = CPSW_RX_HDR_LEN;
+		else
+			next = rxp;
+	} else {
+		pool->stats.copybreak++;
 	}
 
-	if (likely(!skb)) {
-		skb = netdev_alloc_skb_ip_align(ndev, priv->rx_packet_max);
-		if (WARN_ON(!skb))
-			return;
+	skb = netdev_alloc_skb_ip_align(ndev, hlen);
+	if (unlikely(!skb)) {
+		priv->stats.rx_dropped++;
+		goto requeue;
+	}
 
-		ret = cpdma_chan_submit(priv->rxch, skb, skb->data,
-				skb_tailroom(skb), 0, GFP_KERNEL);
+	memcpy(skb_put(skb, hlen), data, hlen);
+	if (next != rxp) {
+		get_page(rxp->page);
+		skb_add_rx_frag(skb, 0, rxp->page, NET_IP_ALIGN + hlen,
+				len - hlen);
+		skb->truesize += PAGE_SIZE - (len - hlen);
 	}
 
-	WARN_ON(ret < 0);
+	skb_record_rx_queue(skb, pool->ch);
+	cpts_rx_timestamp(priv->cpts, skb);
+	skb->protocol = eth_type_trans(skb, ndev);
+	netif_receive_skb(skb);
+	priv->stats.rx_bytes += len;
+	priv->stats.rx_packets++;
+
+requeue:
+	if (next == rxp && rxp->sync_len) {
+		dma_sync_single_range_for_device(dev, rxp->dma,
+				NET_IP_ALIGN, rxp->sync_len, DMA_FROM_DEVICE);
+		rxp->sync_len = 0;
+	}
 
+	/* -EINVAL: the channel is stopped, the page stays in the pool */
+	ret = cpsw_rx_page_submit(next);
+	WARN_ON(ret < 0 && ret != -EINVAL);
 }
 
 static void set_cpsw_dmtimer_clear(void)
@@ -500,43 +839,133 @@ static void set_cpsw_dmtimer_clear(void)
 	return;
 }
 
+/*
+ * Each rx channel has its own napi context and all tx channels share one.
+ * The interrupt only masks the wrapper enables of the channels that are
+ * pending, so a busy bulk channel never holds off the others; the napi
+ * handlers unmask their channel again once they run out of work.
+ */
 static irqreturn_t cpsw_interrupt(int irq, void *dev_id)
 {
 	struct cpsw_priv *priv = dev_id;
+	u32 rx_stat, tx_stat;
+	int ch;
 
-	if (likely(netif_running(priv->ndev))) {
-		cpsw_intr_disable(priv);
-		cpsw_disable_irq(priv);
-		napi_schedule(&priv->napi);
-	} else {
+	if (unlikely(!netif_running(priv->ndev))) {
 		priv = cpsw_get_slave_priv(priv, 1);
-		if (likely(priv) && likely(netif_running(priv->ndev))) {
-			cpsw_intr_disable(priv);
-			cpsw_disable_irq(priv);
-			napi_schedule(&priv->napi);
-		}
+		if (!priv || unlikely(!netif_running(priv->ndev)))
+			return IRQ_HANDLED;
+	}
+
+	rx_stat = __raw_readl(&priv->ss_regs->rx_stat);
+	tx_stat = __raw_readl(&priv->ss_regs->tx_stat);
+
+	if (rx_stat)
+		cpsw_wr_intr_ctrl(&priv->ss_regs->rx_en, rx_stat, false);
+	if (tx_stat)
+		cpsw_wr_intr_ctrl(&priv->ss_regs->tx_en, tx_stat, false);
+	set_cpsw_dmtimer_clear();
+
+	for (ch = 0; ch < priv->num_rx_queues; ch++) {
+		if (rx_stat & BIT(ch))
+			napi_schedule(&priv->napi_rx[ch].napi);
 	}
+	if (tx_stat)
+		napi_schedule(&priv->napi_tx);
 
+	cpdma_ctlr_eoi(priv->dma);
 	return IRQ_HANDLED;
 }
 
-static int cpsw_poll(struct napi_struct *napi, int budget)
+/*
+ * Queue the segments parked by cpsw_tso_xmit() for as long as the channel
+ * has room for them.  Called with the tx queue lock held; returns true
+ * once none are left.
+ */
+static bool cpsw_tx_flush_pending(struct cpsw_priv *priv, int q)
+{
+	struct sk_buff_head *pending = &priv->tx_pending[q];
+	struct cpdma_chan *txch = priv->txch[q];
+	struct sk_buff *seg;
+
+	if (likely(skb_queue_empty(pending)))
+		return true;
+
+	cpdma_chan_hold(txch);
+	while ((seg = skb_peek(pending)) &&
+	       cpsw_tx_desc_num(seg) <= cpdma_chan_get_free_desc_num(txch)) {
+		__skb_unlink(seg, pending);
+		if (unlikely(cpsw_tx_packet_submit(seg->dev, priv, txch, seg))) {
+			priv->stats.tx_dropped++;
+			dev_kfree_skb_any(seg);
+		}
+	}
+	cpdma_chan_kick(txch);
+
+	return skb_queue_empty(pending);
+}
+
+static int cpsw_tx_poll(struct napi_struct *napi, int budget)
+{
+	struct cpsw_priv	*priv = napi_tx_to_priv(napi);
+	int			ch, ret, num_tx = 0;
+	bool			more = false;
+
+	/* reclaim the highest priority channel first, each up to its quota */
+	for (ch = priv->num_tx_queues - 1; ch >= 0; ch--) {
+		ret = cpdma_chan_process(priv->txch[ch], priv->tx_quota[ch]);
+		if (ret <= 0)
+			continue;
+		num_tx += ret;
+		if (ret >= priv->tx_quota[ch])
+			more = true;
+	}
+
+	/* segments parked by cpsw_tso_xmit() go out as descriptors free up */
+	for (ch = 0; ch < priv->num_tx_queues; ch++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(priv->ndev, ch);
+
+		if (skb_queue_empty(&priv->tx_pending[ch]))
+			continue;
+		__netif_tx_lock(txq, smp_processor_id());
+		cpsw_tx_flush_pending(priv, ch);
+		__netif_tx_unlock(txq);
+	}
+
+	if (num_tx)
+		msg(dbg, intr, "poll %d tx pkts\n", num_tx);
+
+	if (more)
+		return budget;
+
+	napi_complete(napi);
+	cpsw_wr_intr_ctrl(&priv->ss_regs->tx_en,
+			  BIT(priv->num_tx_queues) - 1, true);
+	cpdma_ctlr_eoi(priv->dma);
+
+	return min(num_tx, budget - 1);
+}
+
+static int cpsw_rx_poll(struct napi_struct *napi, int budget)
 {
-	struct cpsw_priv	*priv = napi_to_priv(napi);
-	int			num_tx, num_rx;
+	struct cpsw_rx_napi	*rx_napi = container_of(napi,
+					struct cpsw_rx_napi, napi);
+	struct cpsw_priv	*priv = rx_napi->priv;
+	int			num_rx;
 
-	num_tx = cpdma_chan_process(priv->txch, 128);
-	num_rx = cpdma_chan_process(priv->rxch, budget);
+	num_rx = cpdma_chan_process(priv->rxch[rx_napi->ch], budget);
+	if (num_rx < 0)
+		num_rx = 0;
 
-	if (num_rx || num_tx)
-		msg(dbg, intr, "poll %d rx, %d tx pkts\n", num_rx, num_tx);
+	if (num_rx)
+		msg(dbg, intr, "poll %d rx pkts on queue %d\n", num_rx,
+		    rx_napi->ch);
 
 	if (num_rx < budget) {
 		napi_complete(napi);
+		cpsw_wr_intr_ctrl(&priv->ss_regs->rx_en, BIT(rx_napi->ch),
+				  true);
 		cpdma_ctlr_eoi(priv->dma);
-		set_cpsw_dmtimer_clear();
-		cpsw_intr_enable(priv);
-		cpsw_enable_irq(priv);
 	}
 
 	return num_rx;
@@ -617,20 +1046,49 @@ static void _cpsw_adjust_link(struct cpsw_slave *slave,
 	slave->mac_control = mac_control;
 }
 
+/*
+ * Frames received while DDR wakes up wait in the RX FIFO of the port, 16
+ * blocks of 1KB by default.  Bits over Mbit/s gives the microseconds the
+ * FIFO takes to fill at line rate, which is what cpuidle may spend on DDR
+ * low power exits.
+ */
+#define CPSW_RX_FIFO_BITS	(16 * 1024 * 8)
+
+static void cpsw_slave_speed(struct cpsw_slave *slave, int *speed)
+{
+	if (slave->phy && slave->phy->link)
+		*speed = max(*speed, slave->phy->speed);
+}
+
+static void cpsw_update_qos(struct cpsw_priv *priv)
+{
+	s32 latency = PM_QOS_DEFAULT_VALUE;
+	int speed = 0;
+
+	if (!pm_qos_request_active(&priv->pm_qos_req))
+		return;
+
+	for_each_slave(priv, cpsw_slave_speed, &speed);
+	if (speed > 0)
+		latency = CPSW_RX_FIFO_BITS / speed;
+	pm_qos_update_request(&priv->pm_qos_req, latency);
+}
+
 static void cpsw_adjust_link(struct net_device *ndev)
 {
 	struct cpsw_priv	*priv = netdev_priv(ndev);
 	bool			link = false;
 
 	for_each_slave(priv, _cpsw_adjust_link, priv, &link);
+	cpsw_update_qos(priv);
 
 	if (link) {
 		netif_carrier_on(ndev);
 		if (netif_running(ndev))
-			netif_wake_queue(ndev);
+			netif_tx_wake_all_queues(ndev);
 	} else {
 		netif_carrier_off(ndev);
-		netif_stop_queue(ndev);
+		netif_tx_stop_all_queues(ndev);
 	}
 }
 
@@ -645,14 +1103,48 @@ static inline int __show_stat(char *buf, int maxlen, const char* name, u32 val)
 				leader + strlen(name), val);
 }
 
+static void cpsw_get_dma_stats(struct cpdma_chan **chans, int num_chans,
+			       struct cpdma_chan_stats *stats)
+{
+	struct cpdma_chan_stats	chan_stats;
+	u32			*sum = (u32 *)stats;
+	u32			*val = (u32 *)&chan_stats;
+	int			i, j;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < num_chans; i++) {
+		cpdma_chan_get_stats(chans[i], &chan_stats);
+		for (j = 0; j < sizeof(*stats) / sizeof(u32); j++)
+			sum[j] += val[j];
+	}
+}
+
+static void cpsw_get_rx_pool_stats(struct cpsw_priv *priv,
+				   struct cpsw_rx_pool_stats *stats)
+{
+	u32	*sum = (u32 *)stats;
+	u32	*val;
+	int	i, j;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < priv->num_rx_queues; i++) {
+		val = (u32 *)&priv->rx_pool[i]->stats;
+		for (j = 0; j < sizeof(*stats) / sizeof(u32); j++)
+			sum[j] += val[j];
+	}
+}
+
 static ssize_t cpsw_hw_stats_show(struct device *dev,
 				     struct device_attribute *attr,
 				     char *buf)
 {
 	struct net_device	*ndev = to_net_dev(dev);
 	struct cpsw_priv	*priv = netdev_priv(ndev);
-	int			len = 0;
+	int			len = 0, ch;
 	struct cpdma_chan_stats	dma_stats;
+	struct cpsw_rx_pool_stats pool_stats;
+	u64			hits, total;
+	char			name[32];
 
 #define show_stat(x) do {						\
 	len += __show_stat(buf + len, SZ_4K - len, #x,			\
@@ -663,6 +1155,10 @@ static ssize_t cpsw_hw_stats_show(struct device *dev,
 	len += __show_stat(buf + len, SZ_4K - len, #x, dma_stats.x);	\
 } while (0)
 
+#define show_pool_stat(x) do {						\
+	len += __show_stat(buf + len, SZ_4K - len, #x, pool_stats.x);	\
+} while (0)
+
 	len += snprintf(buf + len, SZ_4K - len, "CPSW Statistics:\n");
 	show_stat(rxgoodframes);	show_stat(rxbroadcastframes);
 	show_stat(rxmulticastframes);	show_stat(rxpauseframes);
@@ -682,7 +1178,7 @@ static ssize_t cpsw_hw_stats_show(struct device *dev,
 	show_stat(netoctets);		show_stat(rxsofoverruns);
 	show_stat(rxmofoverruns);	show_stat(rxdmaoverruns);
 
-	cpdma_chan_get_stats(priv->rxch, &dma_stats);
+	cpsw_get_dma_stats(priv->rxch, priv->num_rx_queues, &dma_stats);
 	len += snprintf(buf + len, SZ_4K - len, "\nRX DMA Statistics:\n");
 	show_dma_stat(head_enqueue);	show_dma_stat(tail_enqueue);
 	show_dma_stat(pad_enqueue);	show_dma_stat(misqueued);
@@ -690,8 +1186,10 @@ static ssize_t cpsw_hw_stats_show(struct device *dev,
 	show_dma_stat(runt_receive_buff); show_dma_stat(runt_transmit_buff);
 	show_dma_stat(empty_dequeue);	show_dma_stat(busy_dequeue);
 	show_dma_stat(good_dequeue);	show_dma_stat(teardown_dequeue);
+	show_dma_stat(batch_dequeue);	show_dma_stat(cp_write);
+	show_dma_stat(hdp_write);	show_dma_stat(hdp_deferred);
 
-	cpdma_chan_get_stats(priv->txch, &dma_stats);
+	cpsw_get_dma_stats(priv->txch, priv->num_tx_queues, &dma_stats);
 	len += snprintf(buf + len, SZ_4K - len, "\nTX DMA Statistics:\n");
 	show_dma_stat(head_enqueue);	show_dma_stat(tail_enqueue);
 	show_dma_stat(pad_enqueue);	show_dma_stat(misqueued);
@@ -699,6 +1197,43 @@ static ssize_t cpsw_hw_stats_show(struct device *dev,
 	show_dma_stat(runt_receive_buff); show_dma_stat(runt_transmit_buff);
 	show_dma_stat(empty_dequeue);	show_dma_stat(busy_dequeue);
 	show_dma_stat(good_dequeue);	show_dma_stat(teardown_dequeue);
+	show_dma_stat(sg_enqueue);	show_dma_stat(batch_dequeue);
+	show_dma_stat(cp_write);	show_dma_stat(hdp_write);
+	show_dma_stat(hdp_deferred);
+
+	/*
+	 * A frame is a recycle hit when its buffer went back to the channel
+	 * without a new page being allocated and mapped.
+	 */
+	cpsw_get_rx_pool_stats(priv, &pool_stats);
+	len += snprintf(buf + len, SZ_4K - len, "\nRX Buffer Pool Statistics:\n");
+	show_pool_stat(recycled);	show_pool_stat(copybreak);
+	show_pool_stat(page_alloc);	show_pool_stat(alloc_fail);
+	show_pool_stat(exhausted);
+	hits = (u64)pool_stats.recycled + pool_stats.copybreak;
+	total = hits + pool_stats.page_alloc + pool_stats.exhausted;
+	len += __show_stat(buf + len, SZ_4K - len, "recycle_hit_percent",
+			   total ? (u32)div64_u64(hits * 100, total) : 0);
+
+	len += snprintf(buf + len, SZ_4K - len, "\nQueue Statistics:\n");
+	for (ch = 0; ch < priv->num_rx_queues; ch++) {
+		cpdma_chan_get_stats(priv->rxch[ch], &dma_stats);
+		snprintf(name, sizeof(name), "rx_queue_%d", ch);
+		len += __show_stat(buf + len, SZ_4K - len, name,
+				   dma_stats.good_dequeue);
+		snprintf(name, sizeof(name), "rx_queue_%d_batch_max", ch);
+		len += __show_stat(buf + len, SZ_4K - len, name,
+				   dma_stats.batch_max);
+	}
+	for (ch = 0; ch < priv->num_tx_queues; ch++) {
+		cpdma_chan_get_stats(priv->txch[ch], &dma_stats);
+		snprintf(name, sizeof(name), "tx_queue_%d", ch);
+		len += __show_stat(buf + len, SZ_4K - len, name,
+				   dma_stats.good_dequeue);
+		snprintf(name, sizeof(name), "tx_queue_%d_batch_max", ch);
+		len += __show_stat(buf + len, SZ_4K - len, name,
+				   dma_stats.batch_max);
+	}
 
 	return len;
 }
@@ -822,6 +1357,21 @@ static inline void cpsw_add_default_vlan(struct cpsw_priv *priv)
 #define cpsw_add_default_vlan(priv)
 #endif
 
+/*
+ * Spread the eight packet priorities evenly over the rx channels, so that
+ * priority 7 traffic always lands on the highest numbered rx queue.
+ */
+static u32 cpsw_rx_chan_map(struct cpsw_priv *priv)
+{
+	u32 map = 0;
+	int prio;
+
+	for (prio = 0; prio < CPSW_MAX_QUEUES; prio++)
+		map |= CPSW_PRIMAP(prio, prio * priv->num_rx_queues /
+				   CPSW_MAX_QUEUES);
+	return map;
+}
+
 static void cpsw_init_host_port(struct cpsw_priv *priv)
 {
 	u32 control_reg;
@@ -840,7 +1390,8 @@ static void cpsw_init_host_port(struct cpsw_priv *priv)
 
 	/* setup host port priority mapping */
 	__raw_writel(0x76543210, &priv->host_port_regs->cpdma_tx_pri_map);
-	__raw_writel(0, &priv->host_port_regs->cpdma_rx_chan_map);
+	__raw_writel(cpsw_rx_chan_map(priv),
+		     &priv->host_port_regs->cpdma_rx_chan_map);
 
 	cpsw_ale_control_set(priv->ale, priv->host_port,
 			     ALE_PORT_STATE, ALE_PORT_STATE_FORWARD);
@@ -851,7 +1402,7 @@ static void cpsw_init_host_port(struct cpsw_priv *priv)
 static int cpsw_ndo_open(struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
-	int i, ret;
+	int i, ch, ret;
 	u32 reg;
 
 	if (!cpsw_common_res_usage_state(priv))
@@ -861,6 +1412,9 @@ static int cpsw_ndo_open(struct net_device *ndev)
 	if (priv->data.phy_control)
 		(*priv->data.phy_control)(true);
 
+	pm_qos_add_request(&priv->pm_qos_req, PM_QOS_CPU_DMA_LATENCY,
+			   PM_QOS_DEFAULT_VALUE);
+
 	reg = __raw_readl(&priv->regs->id_ver);
 
 	msg(info, ifup, "initializing cpsw version %d.%d (%d)\n",
@@ -878,6 +1432,7 @@ static int cpsw_ndo_open(struct net_device *ndev)
 		ret = device_create_file(&ndev->dev, &dev_attr_hw_stats);
 		if (ret < 0) {
 			dev_err(priv->dev, "unable to add device attr\n");
+			pm_qos_remove_request(&priv->pm_qos_req);
 			return ret;
 		}
 
@@ -893,26 +1448,23 @@ static int cpsw_ndo_open(struct net_device *ndev)
 		if (WARN_ON(!priv->data.rx_descs))
 			priv->data.rx_descs = 128;
 
-		for (i = 0; i < priv->data.rx_descs; i++) {
-			struct sk_buff *skb;
+		for (ch = 0; ch < priv->num_rx_queues; ch++) {
+			int num_descs;
 
-			ret = -ENOMEM;
-			skb = netdev_alloc_skb_ip_align(priv->ndev,
-							priv->rx_packet_max);
-			if (!skb)
-				break;
-			ret = cpdma_chan_submit(priv->rxch, skb, skb->data,
-					skb_tailroom(skb), 0, GFP_KERNEL);
-			if (WARN_ON(ret < 0)) {
-				dev_kfree_skb_any(skb);
-				break;
+			num_descs = min(priv->data.rx_descs,
+					cpdma_chan_get_rx_buf_num(priv->rxch[ch]));
+			for (i = 0; i < num_descs; i++) {
+				ret = cpsw_rx_submit(priv, ch);
+				if (WARN_ON(ret < 0))
+					break;
 			}
+			/*
+			 * continue even if we didn't manage to submit all
+			 * receive descs
+			 */
+			msg(info, ifup, "submitted %d rx descriptors on queue %d\n",
+			    i, ch);
 		}
-		/*
-		 * continue even if we didn't manage to submit all
-		 * receive descs
-		 */
-		msg(info, ifup, "submitted %d rx descriptors\n", i);
 	}
 
 	/* Enable Interrupt pacing if configured */
@@ -935,7 +1487,7 @@ static int cpsw_ndo_open(struct net_device *ndev)
 
 	cpdma_ctlr_start(priv->dma);
 	cpsw_intr_enable(priv);
-	napi_enable(&priv->napi);
+	cpsw_napi_enable(priv);
 	cpdma_ctlr_eoi(priv->dma);
 
 	cpsw_update_slave_open_state(priv, true)
@@ -955,12 +1507,15 @@ static void cpsw_slave_stop(struct cpsw_slave *slave, struct cpsw_priv *priv)
 static int cpsw_ndo_stop(struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
+	int ch;
 
 	msg(info, ifdown, "shutting down cpsw device\n");
 
-	netif_stop_queue(priv->ndev);
-	napi_disable(&priv->napi);
+	netif_tx_stop_all_queues(priv->ndev);
+	cpsw_napi_disable(priv);
 	netif_carrier_off(priv->ndev);
+	for (ch = 0; ch < priv->num_tx_queues; ch++)
+		__skb_queue_purge(&priv->tx_pending[ch]);
 
 	if (cpsw_common_res_usage_state(priv) <= 1) {
 		cpsw_intr_disable(priv);
@@ -971,10 +1526,14 @@ static int cpsw_ndo_stop(struct net_device *ndev)
 
 		cpdma_ctlr_stop(priv->dma);
 		cpsw_ale_stop(priv->ale);
+
+		for (ch = 0; ch < priv->num_rx_queues; ch++)
+			cpsw_rx_pool_drain(priv->rx_pool[ch]);
 	}
 
 	device_remove_file(&ndev->dev, &dev_attr_hw_stats);
 	for_each_slave(priv, cpsw_slave_stop, priv);
+	pm_qos_remove_request(&priv->pm_qos_req);
 	if (priv->data.phy_control)
 		(*priv->data.phy_control)(false);
 
@@ -983,33 +1542,173 @@ static int cpsw_ndo_stop(struct net_device *ndev)
 	return 0;
 }
 
+/*
+ * Software TSO: the skb is cut up here rather than by the stack, so that
+ * every segment is queued in one go once the channel is known to have
+ * room for all of them, and the channel is started once for the burst.
+ * A burst that could never fit the channel share goes out one linear
+ * segment at a time instead, from tx_pending as descriptors free up.
+ */
+static netdev_tx_t cpsw_tso_xmit(struct sk_buff *skb, struct net_device *ndev,
+				 int q)
+{
+	struct cpsw_priv *priv = netdev_priv(ndev);
+	struct netdev_queue *txq = netdev_get_tx_queue(ndev, q);
+	struct cpdma_chan *txch = priv->txch[q];
+	struct sk_buff *segs, *seg;
+	int num_desc = 0;
+	bool park;
+
+	segs = skb_gso_segment(skb, ndev->features & ~NETIF_F_ALL_TSO);
+	if (IS_ERR_OR_NULL(segs)) {
+		msg(err, tx_err, "tso segmentation failed");
+		priv->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		return NETDEV_TX_OK;
+	}
+
+	for (seg = segs; seg; seg = seg->next)
+		num_desc += cpsw_tx_desc_num(seg);
+
+	park = num_desc > priv->tx_desc_num[q];
+	if (!park && num_desc > cpdma_chan_get_free_desc_num(txch)) {
+		while (segs) {
+			seg = segs;
+			segs = seg->next;
+			dev_kfree_skb_any(seg);
+		}
+		netif_tx_stop_queue(txq);
+		if (cpdma_chan_get_free_desc_num(txch) >= num_desc)
+			netif_tx_wake_queue(txq);
+		return NETDEV_TX_BUSY;
+	}
+
+	cpdma_chan_hold(txch);
+	while (segs) {
+		seg = segs;
+		segs = seg->next;
+		seg->next = NULL;
+
+		if (unlikely(skb_padto(seg, CPSW_MIN_PACKET_SIZE) < 0)) {
+			priv->stats.tx_dropped++;
+			continue;
+		}
+		if (unlikely(park)) {
+			if (unlikely(skb_linearize(seg))) {
+				priv->stats.tx_dropped++;
+				dev_kfree_skb_any(seg);
+				continue;
+			}
+			__skb_queue_tail(&priv->tx_pending[q], seg);
+			continue;
+		}
+		if (unlikely(cpsw_tx_packet_submit(ndev, priv, txch, seg))) {
+			priv->stats.tx_dropped++;
+			dev_kfree_skb_any(seg);
+		}
+	}
+	cpdma_chan_kick(txch);
+
+	skb_tx_timestamp(skb);
+	dev_kfree_skb_any(skb);
+
+	if (unlikely(!cpsw_tx_flush_pending(priv, q) ||
+		     !cpdma_check_free_tx_desc(txch))) {
+		netif_tx_stop_queue(txq);
+		if (skb_queue_empty(&priv->tx_pending[q]) &&
+		    cpdma_check_free_tx_desc(txch))
+			netif_tx_wake_queue(txq);
+	}
+
+	return NETDEV_TX_OK;
+}
+
 static netdev_tx_t cpsw_ndo_start_xmit(struct sk_buff *skb,
 				       struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
-	int ret;
+	struct netdev_queue *txq;
+	struct cpdma_chan *txch;
+	int ret, q, num_desc;
 
 	ndev->trans_start = jiffies;
 
+	q = skb_get_queue_mapping(skb);
+	txq = netdev_get_tx_queue(ndev, q);
+	txch = priv->txch[q];
+
+	if (unlikely(!cpsw_tx_flush_pending(priv, q))) {
+		netif_tx_stop_queue(txq);
+		return NETDEV_TX_BUSY;
+	}
+
+	if (skb_is_gso(skb))
+		return cpsw_tso_xmit(skb, ndev, q);
+
 	ret = skb_padto(skb, CPSW_MIN_PACKET_SIZE);
 	if (unlikely(ret < 0)) {
 		msg(err, tx_err, "packet pad failed");
 		goto fail;
 	}
 
-	ret = cpsw_tx_packet_submit(ndev, priv, skb);
+	/*
+	 * Bounce the skb before it is timestamped, not after, so that a
+	 * retried skb is stamped once.  A packet with more fragments than
+	 * the whole share is linearized on submit and takes one descriptor.
+	 */
+	num_desc = cpsw_tx_desc_num(skb);
+	if (num_desc > priv->tx_desc_num[q])
+		num_desc = 1;
+	if (unlikely(num_desc > cpdma_chan_get_free_desc_num(txch)))
+		goto busy;
+
+	if (unlikely(skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP &&
+		     priv->cpts->tx_enable))
+		skb_shinfo(skb)->tx_flags |= SKBTX_IN_PROGRESS;
+
+	skb_tx_timestamp(skb);
+
+	ret = cpsw_tx_packet_submit(ndev, priv, txch, skb);
 	if (unlikely(ret != 0)) {
 		msg(err, tx_err, "desc submit failed");
-		goto fail;
+		priv->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		return NETDEV_TX_OK;
+	}
+
+	/* stop the queue once its channel has used up its descriptor share */
+	if (unlikely(!cpdma_check_free_tx_desc(txch))) {
+		netif_tx_stop_queue(txq);
+		if (cpdma_check_free_tx_desc(txch))
+			netif_tx_wake_queue(txq);
 	}
 
 	return NETDEV_TX_OK;
+busy:
+	/* not enough descriptors left for every fragment, retry later */
+	netif_tx_stop_queue(txq);
+	if (cpdma_chan_get_free_desc_num(txch) >= num_desc)
+		netif_tx_wake_queue(txq);
+	return NETDEV_TX_BUSY;
 fail:
 	priv->stats.tx_dropped++;
-	netif_stop_queue(ndev);
+	netif_tx_stop_queue(txq);
 	return NETDEV_TX_BUSY;
 }
 
+/*
+ * The cpdma transmits in fixed priority order, so the highest channel is
+ * the highest priority one.  skb->priority selects the channel through
+ * tx_prio_map; the per channel weights decide how much of the descriptor
+ * pool each channel may hold.
+ */
+static u16 cpsw_ndo_select_queue(struct net_device *ndev, struct sk_buff *skb)
+{
+	struct cpsw_priv *priv = netdev_priv(ndev);
+
+	return priv->tx_prio_map[skb->priority & TC_PRIO_MAX];
+}
+
 #ifndef CONFIG_TI_CPSW_DUAL_EMAC
 /*
  *  cpsw_set_priority_mapping
@@ -1721,6 +2420,81 @@ static int cpsw_switch_config_ioctl(struct net_device *ndev,
 #define cpsw_switch_config_ioctl(ndev, ifrq, cmd) (-EOPNOTSUPP)
 #endif /* CONFIG_TI_CPSW_DUAL_EMAC */
 
+static void cpsw_slave_hwtstamp(struct cpsw_slave *slave,
+				struct cpsw_priv *priv)
+{
+	u32 __iomem *port_control = cpsw2_port_control(slave);
+	u32 ctrl, mtype;
+
+	ctrl = __raw_readl(port_control);
+	ctrl &= ~CTRL_ALL_TS_MASK;
+
+	if (priv->cpts->tx_enable)
+		ctrl |= CTRL_TS_BITS | TS_TX_EN;
+
+	if (priv->cpts->rx_enable)
+		ctrl |= CTRL_TS_BITS | TS_RX_EN;
+
+	mtype = (TS_SEQ_ID_OFFSET << TS_SEQ_ID_OFFSET_SHIFT) | EVENT_MSG_BITS;
+
+	__raw_writel(mtype, &slave->regs->ts_seq_mtype);
+	__raw_writel(ctrl, port_control);
+}
+
+static int cpsw_hwtstamp_ioctl(struct net_device *ndev, struct ifreq *ifrq)
+{
+	struct cpsw_priv *priv = netdev_priv(ndev);
+	struct cpts *cpts = priv->cpts;
+	struct hwtstamp_config cfg;
+
+	if (!cpts->reg || priv->data.version != CPSW_VERSION_2)
+		return -EOPNOTSUPP;
+
+	if (copy_from_user(&cfg, ifrq->ifr_data, sizeof(cfg)))
+		return -EFAULT;
+
+	/* reserved for future extensions */
+	if (cfg.flags)
+		return -EINVAL;
+
+	switch (cfg.tx_type) {
+	case HWTSTAMP_TX_OFF:
+		cpts->tx_enable = 0;
+		break;
+	case HWTSTAMP_TX_ON:
+		cpts->tx_enable = 1;
+		break;
+	default:
+		return -ERANGE;
+	}
+
+	/* the cpts only time stamps PTPv2 event messages */
+	switch (cfg.rx_filter) {
+	case HWTSTAMP_FILTER_NONE:
+		cpts->rx_enable = 0;
+		break;
+	case HWTSTAMP_FILTER_PTP_V2_L4_EVENT:
+	case HWTSTAMP_FILTER_PTP_V2_L4_SYNC:
+	case HWTSTAMP_FILTER_PTP_V2_L4_DELAY_REQ:
+	case HWTSTAMP_FILTER_PTP_V2_L2_EVENT:
+	case HWTSTAMP_FILTER_PTP_V2_L2_SYNC:
+	case HWTSTAMP_FILTER_PTP_V2_L2_DELAY_REQ:
+	case HWTSTAMP_FILTER_PTP_V2_EVENT:
+	case HWTSTAMP_FILTER_PTP_V2_SYNC:
+	case HWTSTAMP_FILTER_PTP_V2_DELAY_REQ:
+		cpts->rx_enable = 1;
+		cfg.rx_filter = HWTSTAMP_FILTER_PTP_V2_EVENT;
+		break;
+	default:
+		return -ERANGE;
+	}
+
+	for_each_slave(priv, cpsw_slave_hwtstamp, priv);
+	__raw_writel(ETH_P_1588, &priv->regs->ts_ltype);
+
+	return copy_to_user(ifrq->ifr_data, &cfg, sizeof(cfg)) ? -EFAULT : 0;
+}
+
 static int cpsw_ndo_do_ioctl(struct net_device *ndev, struct ifreq *ifrq,
 		int cmd)
 {
@@ -1732,6 +2506,9 @@ static int cpsw_ndo_do_ioctl(struct net_device *ndev, struct ifreq *ifrq,
 	case SIOCSWITCHCONFIG:
 		return cpsw_switch_config_ioctl(ndev, ifrq, cmd);
 
+	case SIOCSHWTSTAMP:
+		return cpsw_hwtstamp_ioctl(ndev, ifrq);
+
 	default:
 		return -EOPNOTSUPP;
 	}
@@ -1783,13 +2560,16 @@ static int cpsw_ndo_set_mac_address(struct net_device *ndev, void *p)
 static void cpsw_ndo_tx_timeout(struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
+	int ch;
 
 	msg(err, tx_err, "transmit timeout, restarting dma");
 	priv->stats.tx_errors++;
 	cpsw_intr_disable(priv);
 	cpdma_ctlr_int_ctrl(priv->dma, false);
-	cpdma_chan_stop(priv->txch);
-	cpdma_chan_start(priv->txch);
+	for (ch = 0; ch < priv->num_tx_queues; ch++) {
+		cpdma_chan_stop(priv->txch[ch]);
+		cpdma_chan_start(priv->txch[ch]);
+	}
 	cpdma_ctlr_int_ctrl(priv->dma, true);
 	cpsw_intr_enable(priv);
 	cpdma_ctlr_eoi(priv->dma);
@@ -1971,6 +2751,7 @@ static const struct net_device_ops cpsw_netdev_ops = {
 	.ndo_open		= cpsw_ndo_open,
 	.ndo_stop		= cpsw_ndo_stop,
 	.ndo_start_xmit		= cpsw_ndo_start_xmit,
+	.ndo_select_queue	= cpsw_ndo_select_queue,
 	.ndo_change_rx_flags	= cpsw_ndo_change_rx_flags,
 	.ndo_set_mac_address	= cpsw_ndo_set_mac_address,
 	.ndo_do_ioctl		= cpsw_ndo_do_ioctl,
@@ -2057,6 +2838,110 @@ static const struct ethtool_ops cpsw_ethtool_ops = {
 	.set_coalesce	= cpsw_set_coalesce,
 };
 
+static int cpsw_num_queues(int queues, int channels)
+{
+	if (queues <= 0 || queues > channels)
+		queues = channels;
+	return clamp(queues, 1, CPSW_MAX_QUEUES);
+}
+
+static void cpsw_init_queues(struct cpsw_priv *priv)
+{
+	struct net_device *ndev = priv->ndev;
+	int ch, prio, weight, total = 0, max_weight = 1;
+	int tso_segs = INT_MAX;
+
+	for (ch = 0; ch < priv->num_tx_queues; ch++)
+		total += max(tx_weight[ch], 1);
+	for (ch = 0; ch < priv->num_tx_queues; ch++)
+		priv->tx_quota[ch] = max(CPSW_POLL_WEIGHT *
+					 max(tx_weight[ch], 1) / total, 1);
+
+	for (prio = 0; prio <= TC_PRIO_MAX; prio++)
+		priv->tx_prio_map[prio] = min(prio, CPSW_MAX_QUEUES - 1) *
+					  priv->num_tx_queues / CPSW_MAX_QUEUES;
+
+	netif_napi_add(priv->ndev, &priv->napi_tx, cpsw_tx_poll,
+		       CPSW_POLL_WEIGHT);
+
+	for (ch = 0; ch < priv->num_rx_queues; ch++)
+		max_weight = max(max_weight, rx_weight[ch]);
+	for (ch = 0; ch < priv->num_rx_queues; ch++) {
+		weight = max(CPSW_POLL_WEIGHT * rx_weight[ch] / max_weight, 1);
+		priv->napi_rx[ch].priv = priv;
+		priv->napi_rx[ch].ch = ch;
+		netif_napi_add(priv->ndev, &priv->napi_rx[ch].napi,
+			       cpsw_rx_poll, weight);
+	}
+
+	/*
+	 * Nothing has been queued yet, so every descriptor is free.  TSO
+	 * bursts are kept small enough to fit the smallest channel share.
+	 */
+	for (ch = 0; ch < priv->num_tx_queues; ch++) {
+		skb_queue_head_init(&priv->tx_pending[ch]);
+		priv->tx_desc_num[ch] =
+			cpdma_chan_get_free_desc_num(priv->txch[ch]);
+		tso_segs = min(tso_segs,
+			       priv->tx_desc_num[ch] / CPSW_TSO_SEG_DESCS);
+	}
+
+	ndev->hw_features |= NETIF_F_SG | NETIF_F_HW_CSUM;
+	if (tso_segs >= 2) {
+		ndev->hw_features |= NETIF_F_TSO;
+		netif_set_gso_max_size(ndev, min(tso_segs * CPSW_TSO_SEG_SIZE,
+						 GSO_MAX_SIZE));
+	}
+	ndev->features |= ndev->hw_features;
+}
+
+static int cpsw_create_chans(struct cpsw_priv *priv)
+{
+	int ch;
+
+	for (ch = 0; ch < priv->num_tx_queues; ch++) {
+		priv->txch[ch] = cpdma_chan_create(priv->dma, tx_chan_num(ch),
+						   cpsw_tx_handler);
+		if (IS_ERR_OR_NULL(priv->txch[ch])) {
+			priv->txch[ch] = NULL;
+			return -ENOMEM;
+		}
+		cpdma_chan_set_weight(priv->txch[ch], max(tx_weight[ch], 1));
+	}
+
+	for (ch = 0; ch < priv->num_rx_queues; ch++) {
+		priv->rxch[ch] = cpdma_chan_create(priv->dma, rx_chan_num(ch),
+						   cpsw_rx_handler);
+		if (IS_ERR_OR_NULL(priv->rxch[ch])) {
+			priv->rxch[ch] = NULL;
+			return -ENOMEM;
+		}
+		cpdma_chan_set_weight(priv->rxch[ch], max(rx_weight[ch], 1));
+	}
+
+	/* pools are sized once every channel has its share of descriptors */
+	for (ch = 0; ch < priv->num_rx_queues; ch++) {
+		priv->rx_pool[ch] = cpsw_rx_pool_create(priv, ch);
+		if (!priv->rx_pool[ch])
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void cpsw_destroy_chans(struct cpsw_priv *priv)
+{
+	int ch;
+
+	for (ch = 0; ch < CPSW_MAX_QUEUES; ch++) {
+		if (priv->txch[ch])
+			cpdma_chan_destroy(priv->txch[ch]);
+		if (priv->rxch[ch])
+			cpdma_chan_destroy(priv->rxch[ch]);
+		kfree(priv->rx_pool[ch]);
+	}
+}
+
 static void cpsw_slave_init(struct cpsw_slave *slave, struct cpsw_priv *priv)
 {
 	void __iomem		*regs = priv->regs;
@@ -2079,7 +2964,8 @@ static int cpsw_init_slave_emac(struct platform_device *pdev,
 	struct cpsw_priv		*priv_sl2;
 	int ret = 0, i;
 
-	ndev = alloc_etherdev(sizeof(struct cpsw_priv));
+	ndev = alloc_etherdev_mqs(sizeof(struct cpsw_priv),
+				  priv->num_tx_queues, priv->num_rx_queues);
 	if (!ndev) {
 		pr_err("cpsw: error allocating net_device\n");
 		return -ENOMEM;
@@ -2092,7 +2978,8 @@ static int cpsw_init_slave_emac(struct platform_device *pdev,
 	priv_sl2->ndev = ndev;
 	priv_sl2->dev  = &ndev->dev;
 	priv_sl2->msg_enable = netif_msg_init(debug_level, CPSW_DEBUG);
-	priv_sl2->rx_packet_max = max(rx_packet_max, 128);
+	priv_sl2->rx_packet_max = min_t(int, max(rx_packet_max, 128),
+					CPSW_RX_BUF_MAX);
 
 	if (is_valid_ether_addr(data->slave_data[1].mac_addr)) {
 		memcpy(priv_sl2->mac_addr, data->slave_data[1].mac_addr,
@@ -2118,9 +3005,13 @@ static int cpsw_init_slave_emac(struct platform_device *pdev,
 	priv_sl2->cpsw_ss_res = priv->cpsw_ss_res;
 	priv_sl2->ss_regs = priv->ss_regs;
 	priv_sl2->dma = priv->dma;
-	priv_sl2->txch = priv->txch;
-	priv_sl2->rxch = priv->rxch;
+	memcpy(priv_sl2->txch, priv->txch, sizeof(priv->txch));
+	memcpy(priv_sl2->rxch, priv->rxch, sizeof(priv->rxch));
+	memcpy(priv_sl2->rx_pool, priv->rx_pool, sizeof(priv->rx_pool));
+	priv_sl2->num_tx_queues = priv->num_tx_queues;
+	priv_sl2->num_rx_queues = priv->num_rx_queues;
 	priv_sl2->ale = priv->ale;
+	priv_sl2->cpts = priv->cpts;
 	priv_sl2->emac_port = 1;
 	priv->slaves[1].ndev = ndev;
 	for_each_slave(priv_sl2, cpsw_slave_init, priv_sl2);
@@ -2138,7 +3029,7 @@ static int cpsw_init_slave_emac(struct platform_device *pdev,
 
 	ndev->netdev_ops = &cpsw_netdev_ops;
 	SET_ETHTOOL_OPS(ndev, &cpsw_ethtool_ops);
-	netif_napi_add(ndev, &priv_sl2->napi, cpsw_poll, CPSW_POLL_WEIGHT);
+	cpsw_init_queues(priv_sl2);
 
 	/* register the network device */
 	SET_NETDEV_DEV(ndev, &pdev->dev);
@@ -2173,13 +3064,17 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 	struct cpsw_ale_params		ale_params;
 	void __iomem			*regs;
 	int ret = 0, i, k = 0;
+	int num_tx, num_rx;
 
 	if (!data) {
 		pr_err("cpsw: platform data missing\n");
 		return -ENODEV;
 	}
 
-	ndev = alloc_etherdev(sizeof(struct cpsw_priv));
+	num_tx = cpsw_num_queues(tx_queues, data->channels);
+	num_rx = cpsw_num_queues(rx_queues, data->channels);
+
+	ndev = alloc_etherdev_mqs(sizeof(struct cpsw_priv), num_tx, num_rx);
 	if (!ndev) {
 		pr_err("cpsw: error allocating net_device\n");
 		return -ENOMEM;
@@ -2187,13 +3082,16 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, ndev);
 	priv = netdev_priv(ndev);
+	priv->num_tx_queues = num_tx;
+	priv->num_rx_queues = num_rx;
 	spin_lock_init(&priv->lock);
 	priv->data = *data;
 	priv->pdev = pdev;
 	priv->ndev = ndev;
 	priv->dev  = &ndev->dev;
 	priv->msg_enable = netif_msg_init(debug_level, CPSW_DEBUG);
-	priv->rx_packet_max = max(rx_packet_max, 128);
+	priv->rx_packet_max = min_t(int, max(rx_packet_max, 128),
+				    CPSW_RX_BUF_MAX);
 
 	if (is_valid_ether_addr(data->mac_addr)) {
 		memcpy(priv->mac_addr, data->mac_addr, ETH_ALEN);
@@ -2346,14 +3244,9 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 		goto clean_timer_ret;
 	}
 
-	priv->txch = cpdma_chan_create(priv->dma, tx_chan_num(0),
-				       cpsw_tx_handler);
-	priv->rxch = cpdma_chan_create(priv->dma, rx_chan_num(0),
-				       cpsw_rx_handler);
-
-	if (WARN_ON(!priv->txch || !priv->rxch)) {
+	ret = cpsw_create_chans(priv);
+	if (WARN_ON(ret < 0)) {
 		dev_err(priv->dev, "error initializing dma channels\n");
-		ret = -ENOMEM;
 		goto clean_dma_ret;
 	}
 
@@ -2372,11 +3265,27 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 		goto clean_dma_ret;
 	}
 
+	priv->cpts = kzalloc(sizeof(struct cpts), GFP_KERNEL);
+	if (!priv->cpts) {
+		dev_err(priv->dev, "error allocating cpts\n");
+		ret = -ENOMEM;
+		goto clean_ale_ret;
+	}
+
+	if (IS_ENABLED(CONFIG_TI_CPTS) && data->cpts_reg_ofs) {
+		priv->cpts->reg = (void __iomem *)priv->regs +
+				  data->cpts_reg_ofs;
+		if (cpts_register(&pdev->dev, priv->cpts)) {
+			dev_err(priv->dev, "error registering cpts device\n");
+			priv->cpts->reg = NULL;
+		}
+	}
+
 	while ((i = platform_get_irq(pdev, k)) >= 0) {
 		if (request_irq(i, cpsw_interrupt, IRQF_DISABLED,
 				dev_name(&pdev->dev), priv)) {
 			dev_err(priv->dev, "error attaching irq\n");
-			goto clean_ale_ret;
+			goto clean_cpts_ret;
 		}
 		priv->irqs_table[k] = i;
 		priv->num_irqs = ++k;
@@ -2390,7 +3299,7 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 
 	ndev->netdev_ops = &cpsw_netdev_ops;
 	SET_ETHTOOL_OPS(ndev, &cpsw_ethtool_ops);
-	netif_napi_add(ndev, &priv->napi, cpsw_poll, CPSW_POLL_WEIGHT);
+	cpsw_init_queues(priv);
 
 	/* register the network device */
 	SET_NETDEV_DEV(ndev, &pdev->dev);
@@ -2414,11 +3323,13 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 
 clean_irq_ret:
 	free_irq(ndev->irq, priv);
+clean_cpts_ret:
+	cpts_unregister(priv->cpts);
+	kfree(priv->cpts);
 clean_ale_ret:
 	cpsw_ale_destroy(priv->ale);
 clean_dma_ret:
-	cpdma_chan_destroy(priv->txch);
-	cpdma_chan_destroy(priv->rxch);
+	cpsw_destroy_chans(priv);
 	cpdma_ctlr_destroy(priv->dma);
 clean_timer_ret:
 	omap_dm_timer_free(dmtimer_tx);
@@ -2457,9 +3368,10 @@ static int __devexit cpsw_remove(struct platform_device *pdev)
 	omap_dm_timer_free(dmtimer_tx);
 	for (i = 0; i < priv->num_irqs; i++)
 		free_irq(priv->irqs_table[i], priv);
+	cpts_unregister(priv->cpts);
+	kfree(priv->cpts);
 	cpsw_ale_destroy(priv->ale);
-	cpdma_chan_destroy(priv->txch);
-	cpdma_chan_destroy(priv->rxch);
+	cpsw_destroy_chans(priv);
 	cpdma_ctlr_destroy(priv->dma);
 	iounmap(priv->regs);
 	release_mem_region(priv->cpsw_res->start,
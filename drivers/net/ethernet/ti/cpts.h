@@ -0,0 +1,129 @@
+/*
+ * TI Common Platform Time Sync
+ *
+ * Copyright (C) 2012 Texas Instruments
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __CPTS_H__
+#define __CPTS_H__
+
+#include <linux/clk.h>
+#include <linux/clocksource.h>
+#include <linux/device.h>
+#include <linux/list.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/skbuff.h>
+#include <linux/workqueue.h>
+
+struct cpsw_cpts {
+	u32 idver;		/* Identification and version */
+	u32 control;		/* Time sync control */
+	u32 res1;
+	u32 ts_push;		/* Time stamp event push */
+	u32 ts_load_val;	/* Time stamp load value */
+	u32 ts_load_en;		/* Time stamp load enable */
+	u32 res2[2];
+	u32 intstat_raw;	/* Time sync interrupt status raw */
+	u32 intstat_masked;	/* Time sync interrupt status masked */
+	u32 int_enable;		/* Time sync interrupt enable */
+	u32 res3;
+	u32 event_pop;		/* Event interrupt pop */
+	u32 event_low;		/* 32 Bit Event Time Stamp */
+	u32 event_high;		/* Event Type Fields */
+};
+
+/* Bit definitions for the CONTROL register */
+#define HW4_TS_PUSH_EN		BIT(11)	/* Hardware push 4 enable */
+#define HW3_TS_PUSH_EN		BIT(10)	/* Hardware push 3 enable */
+#define HW2_TS_PUSH_EN		BIT(9)	/* Hardware push 2 enable */
+#define HW1_TS_PUSH_EN		BIT(8)	/* Hardware push 1 enable */
+#define INT_TEST		BIT(1)	/* Interrupt Test */
+#define CPTS_EN			BIT(0)	/* Time Sync Enable */
+
+/* Bit definitions for the TS_PUSH, INTSTAT_RAW, INT_ENABLE, EVENT_POP regs */
+#define TS_PUSH			BIT(0)	/* Time stamp event push */
+#define TS_PEND_RAW		BIT(0)	/* int read (before enable) */
+#define TS_PEND_EN		BIT(0)	/* masked interrupt enable */
+#define EVENT_POP		BIT(0)	/* writing discards one event */
+
+/* Bit definitions for the EVENT_HIGH register */
+#define PORT_NUMBER_SHIFT	24	/* Indicates Ethernet port or HW pin */
+#define PORT_NUMBER_MASK	0x1f
+#define EVENT_TYPE_SHIFT	20	/* Time sync event type */
+#define EVENT_TYPE_MASK		0xf
+#define MESSAGE_TYPE_SHIFT	16	/* PTP message type */
+#define MESSAGE_TYPE_MASK	0xf
+#define SEQUENCE_ID_SHIFT	0	/* PTP message sequence ID */
+#define SEQUENCE_ID_MASK	0xffff
+
+enum {
+	CPTS_EV_PUSH,	/* Time Stamp Push Event */
+	CPTS_EV_ROLL,	/* Time Stamp Rollover Event */
+	CPTS_EV_HALF,	/* Time Stamp Half Rollover Event */
+	CPTS_EV_HW,	/* Hardware Time Stamp Push Event */
+	CPTS_EV_RX,	/* Ethernet Receive Event */
+	CPTS_EV_TX,	/* Ethernet Transmit Event */
+};
+
+/* The 32 bit counter wraps after ~17s at 250MHz, check well before that */
+#define CPTS_OVERFLOW_PERIOD	(HZ * 8)
+
+#define CPTS_FIFO_DEPTH		16
+#define CPTS_MAX_EVENTS		32
+
+struct cpts_event {
+	struct list_head	list;
+	unsigned long		tmo;
+	u32			high;
+	u32			low;
+};
+
+struct cpts {
+	struct cpsw_cpts __iomem	*reg;
+	int				tx_enable;
+	int				rx_enable;
+#ifdef CONFIG_TI_CPTS
+	struct ptp_clock_info		info;
+	struct ptp_clock		*clock;
+	spinlock_t			lock;	/* protects time registers */
+	u32				cc_mult;	/* for the nominal frequency */
+	struct cyclecounter		cc;
+	struct timecounter		tc;
+	struct delayed_work		overflow_work;
+	struct clk			*refclk;
+	struct list_head		events;
+	struct list_head		pool;
+	struct cpts_event		pool_data[CPTS_MAX_EVENTS];
+#endif
+};
+
+#ifdef CONFIG_TI_CPTS
+void cpts_rx_timestamp(struct cpts *cpts, struct sk_buff *skb);
+void cpts_tx_timestamp(struct cpts *cpts, struct sk_buff *skb);
+int cpts_register(struct device *dev, struct cpts *cpts);
+void cpts_unregister(struct cpts *cpts);
+#else
+static inline void cpts_rx_timestamp(struct cpts *cpts, struct sk_buff *skb)
+{
+}
+static inline void cpts_tx_timestamp(struct cpts *cpts, struct sk_buff *skb)
+{
+}
+static inline int cpts_register(struct device *dev, struct cpts *cpts)
+{
+	return -EOPNOTSUPP;
+}
+static inline void cpts_unregister(struct cpts *cpts)
+{
+}
+#endif
+
+#endif
@@ -73,10 +73,14 @@ struct cpdma_desc {
 	u32			hw_mode;
 	/* software fields */
 	void			*sw_token;
-	u32			sw_buffer;
+	u32			sw_buffer;	/* 0 if mapped by the submitter */
 	u32			sw_len;
+	u32			sw_flags;
 };
 
+/* software flags, sw_flags field */
+#define CPDMA_DESC_SW_PAGE	BIT(0)	/* buffer mapped with dma_map_page */
+
 struct cpdma_desc_pool {
 	u32			phys;
 	u32			hw_addr;
@@ -114,6 +118,10 @@ struct cpdma_chan {
 	int				chan_num;
 	spinlock_t			lock;
 	int				count;
+	int				desc_num;
+	int				weight;
+	bool				held;
+	struct cpdma_desc __iomem	*kick;	/* first unstarted desc */
 	u32				mask;
 	cpdma_handler_fn		handler;
 	enum dma_data_direction		dir;
@@ -258,6 +266,37 @@ static void cpdma_desc_free(struct cpdma_desc_pool *pool,
 	spin_unlock_irqrestore(&pool->lock, flags);
 }
 
+/*
+ * The descriptor pool is split in two halves, one for rx and one for tx.
+ * Each half is shared between the channels of that direction in proportion
+ * to their weight, so that a busy low priority channel cannot starve the
+ * others of descriptors.  Must be called with ctlr->lock held.
+ */
+static void cpdma_chan_split_pool(struct cpdma_ctlr *ctlr)
+{
+	struct cpdma_chan *chan;
+	int i, half = ctlr->pool->num_desc / 2;
+	int tx_weight = 0, rx_weight = 0, weight;
+
+	for (i = 0; i < ARRAY_SIZE(ctlr->channels); i++) {
+		chan = ctlr->channels[i];
+		if (!chan)
+			continue;
+		if (is_rx_chan(chan))
+			rx_weight += chan->weight;
+		else
+			tx_weight += chan->weight;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ctlr->channels); i++) {
+		chan = ctlr->channels[i];
+		if (!chan)
+			continue;
+		weight = is_rx_chan(chan) ? rx_weight : tx_weight;
+		chan->desc_num = max(half * chan->weight / weight, 1);
+	}
+}
+
 struct cpdma_ctlr *cpdma_ctlr_create(struct cpdma_params *params)
 {
 	struct cpdma_ctlr *ctlr;
@@ -532,10 +571,12 @@ struct cpdma_chan *cpdma_chan_create(struct cpdma_ctlr *ctlr, int chan_num,
 		chan->dir	= DMA_TO_DEVICE;
 	}
 	chan->mask = BIT(chan_linear(chan));
+	chan->weight = 1;
 
 	spin_lock_init(&chan->lock);
 
 	ctlr->channels[chan_num] = chan;
+	cpdma_chan_split_pool(ctlr);
 	spin_unlock_irqrestore(&ctlr->lock, flags);
 	return chan;
 
@@ -559,12 +600,47 @@ int cpdma_chan_destroy(struct cpdma_chan *chan)
 	if (chan->state != CPDMA_STATE_IDLE)
 		cpdma_chan_stop(chan);
 	ctlr->channels[chan->chan_num] = NULL;
+	cpdma_chan_split_pool(ctlr);
 	spin_unlock_irqrestore(&ctlr->lock, flags);
 	kfree(chan);
 	return 0;
 }
 EXPORT_SYMBOL_GPL(cpdma_chan_destroy);
 
+int cpdma_chan_set_weight(struct cpdma_chan *chan, int weight)
+{
+	struct cpdma_ctlr *ctlr = chan->ctlr;
+	unsigned long flags;
+
+	if (weight < 1)
+		return -EINVAL;
+
+	spin_lock_irqsave(&ctlr->lock, flags);
+	chan->weight = weight;
+	cpdma_chan_split_pool(ctlr);
+	spin_unlock_irqrestore(&ctlr->lock, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(cpdma_chan_set_weight);
+
+int cpdma_chan_get_rx_buf_num(struct cpdma_chan *chan)
+{
+	return chan->desc_num;
+}
+EXPORT_SYMBOL_GPL(cpdma_chan_get_rx_buf_num);
+
+bool cpdma_check_free_tx_desc(struct cpdma_chan *chan)
+{
+	return chan->count < chan->desc_num;
+}
+EXPORT_SYMBOL_GPL(cpdma_check_free_tx_desc);
+
+int cpdma_chan_get_free_desc_num(struct cpdma_chan *chan)
+{
+	return max(chan->desc_num - chan->count, 0);
+}
+EXPORT_SYMBOL_GPL(cpdma_chan_get_free_desc_num);
+
 int cpdma_chan_get_stats(struct cpdma_chan *chan,
 			 struct cpdma_chan_stats *stats)
 {
@@ -595,6 +671,9 @@ int cpdma_chan_dump(struct cpdma_chan *chan)
 			 chan_read(chan, rxfree));
 	}
 
+	dev_info(dev, "\tdescs: %d/%d (weight %d)\n",
+		 chan->count, chan->desc_num, chan->weight);
+
 	dev_info(dev, "\tstats head_enqueue: %d\n",
 		 chan->stats.head_enqueue);
 	dev_info(dev, "\tstats tail_enqueue: %d\n",
@@ -621,13 +700,42 @@ int cpdma_chan_dump(struct cpdma_chan *chan)
 		 chan->stats.requeue);
 	dev_info(dev, "\tstats teardown_dequeue: %d\n",
 		 chan->stats.teardown_dequeue);
+	dev_info(dev, "\tstats sg_enqueue: %d\n",
+		 chan->stats.sg_enqueue);
+	dev_info(dev, "\tstats batch_dequeue: %d\n",
+		 chan->stats.batch_dequeue);
+	dev_info(dev, "\tstats batch_max: %d\n",
+		 chan->stats.batch_max);
+	dev_info(dev, "\tstats cp_write: %d\n",
+		 chan->stats.cp_write);
+	dev_info(dev, "\tstats hdp_write: %d\n",
+		 chan->stats.hdp_write);
+	dev_info(dev, "\tstats hdp_deferred: %d\n",
+		 chan->stats.hdp_deferred);
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 	return 0;
 }
 
+/* find the end of the packet starting at desc, returns its descriptor count */
+static int cpdma_desc_eop(struct cpdma_desc_pool *pool,
+			  struct cpdma_desc __iomem *desc,
+			  struct cpdma_desc __iomem **eop)
+{
+	int num_desc = 1;
+
+	while (!(desc_read(desc, hw_mode) & CPDMA_DESC_EOP) &&
+	       desc_read(desc, hw_next)) {
+		desc = desc_from_phys(pool, desc_read(desc, hw_next));
+		num_desc++;
+	}
+	*eop = desc;
+	return num_desc;
+}
+
 static void __cpdma_chan_submit(struct cpdma_chan *chan,
-				struct cpdma_desc __iomem *desc)
+				struct cpdma_desc __iomem *desc,
+				struct cpdma_desc __iomem *eop)
 {
 	struct cpdma_ctlr		*ctlr = chan->ctlr;
 	struct cpdma_desc __iomem	*prev = chan->tail;
@@ -641,15 +749,22 @@ static void __cpdma_chan_submit(struct cpdma_chan *chan,
 	if (!chan->head) {
 		chan->stats.head_enqueue++;
 		chan->head = desc;
-		chan->tail = desc;
-		if (chan->state == CPDMA_STATE_ACTIVE)
-			chan_write(chan, hdp, desc_dma);
+		chan->tail = eop;
+		if (chan->state != CPDMA_STATE_ACTIVE)
+			return;
+		if (chan->held) {
+			chan->kick = desc;
+			chan->stats.hdp_deferred++;
+			return;
+		}
+		chan_write(chan, hdp, desc_dma);
+		chan->stats.hdp_write++;
 		return;
 	}
 
 	/* first chain the descriptor at the tail of the list */
 	desc_write(prev, hw_next, desc_dma);
-	chan->tail = desc;
+	chan->tail = eop;
 	chan->stats.tail_enqueue++;
 
 	/* next check if EOQ has been triggered already */
@@ -657,17 +772,24 @@ static void __cpdma_chan_submit(struct cpdma_chan *chan,
 	if (((mode & (CPDMA_DESC_EOQ | CPDMA_DESC_OWNER)) == CPDMA_DESC_EOQ) &&
 	    (chan->state == CPDMA_STATE_ACTIVE)) {
 		desc_write(prev, hw_mode, mode & ~CPDMA_DESC_EOQ);
-		chan_write(chan, hdp, desc_dma);
 		chan->stats.misqueued++;
+		if (chan->held) {
+			if (!chan->kick)
+				chan->kick = desc;
+			chan->stats.hdp_deferred++;
+			return;
+		}
+		chan_write(chan, hdp, desc_dma);
+		chan->stats.hdp_write++;
 	}
 }
 
-int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
-		      int len, int directed, gfp_t gfp_mask)
+static int __cpdma_chan_submit_buffer(struct cpdma_chan *chan, void *token,
+				      void *data, dma_addr_t buffer, int len,
+				      int directed)
 {
 	struct cpdma_ctlr		*ctlr = chan->ctlr;
 	struct cpdma_desc __iomem	*desc;
-	dma_addr_t			buffer;
 	unsigned long			flags;
 	u32				mode;
 	int				ret = 0;
@@ -680,6 +802,12 @@ int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
 		goto unlock_ret;
 	}
 
+	if (chan->count >= chan->desc_num) {
+		chan->stats.desc_alloc_fail++;
+		ret = -ENOMEM;
+		goto unlock_ret;
+	}
+
 	is_rx = (chan->rxfree != 0);
 	desc = cpdma_desc_alloc(ctlr->pool, 1, is_rx);
 	if (!desc) {
@@ -693,7 +821,8 @@ int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
 		chan->stats.runt_transmit_buff++;
 	}
 
-	buffer = dma_map_single(ctlr->dev, data, len, chan->dir);
+	if (data)
+		buffer = dma_map_single(ctlr->dev, data, len, chan->dir);
 	mode = CPDMA_DESC_OWNER | CPDMA_DESC_SOP | CPDMA_DESC_EOP;
 	if ((!is_rx) && ((directed == 1) || (directed == 2)))
 		mode |= (CPDMA_DESC_TO_PORT_EN | (directed << 16));
@@ -703,10 +832,11 @@ int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
 	desc_write(desc, hw_len,    len);
 	desc_write(desc, hw_mode,   mode | len);
 	desc_write(desc, sw_token,  token);
-	desc_write(desc, sw_buffer, buffer);
+	desc_write(desc, sw_buffer, data ? buffer : 0);
 	desc_write(desc, sw_len,    len);
+	desc_write(desc, sw_flags,  0);
 
-	__cpdma_chan_submit(chan, desc);
+	__cpdma_chan_submit(chan, desc, desc);
 
 	if (chan->state == CPDMA_STATE_ACTIVE && chan->rxfree)
 		chan_write(chan, rxfree, 1);
@@ -717,32 +847,181 @@ unlock_ret:
 	spin_unlock_irqrestore(&chan->lock, flags);
 	return ret;
 }
+
+int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
+		      int len, int directed, gfp_t gfp_mask)
+{
+	return __cpdma_chan_submit_buffer(chan, token, data, 0, len, directed);
+}
 EXPORT_SYMBOL_GPL(cpdma_chan_submit);
 
+/*
+ * Submit a buffer that the caller has already mapped for the channel's
+ * direction.  The mapping is left alone when the descriptor completes, so
+ * the caller is responsible for syncing the buffer before and after use.
+ */
+int cpdma_chan_submit_mapped(struct cpdma_chan *chan, void *token,
+			     dma_addr_t buffer, int len, int directed)
+{
+	return __cpdma_chan_submit_buffer(chan, token, NULL, buffer, len,
+					  directed);
+}
+EXPORT_SYMBOL_GPL(cpdma_chan_submit_mapped);
+
+static void cpdma_desc_unmap(struct cpdma_chan *chan,
+			     struct cpdma_desc __iomem *desc)
+{
+	struct device	*dev = chan->ctlr->dev;
+	dma_addr_t	buff_dma;
+	int		origlen;
+
+	buff_dma   = desc_read(desc, sw_buffer);
+	origlen    = desc_read(desc, sw_len);
+
+	if (!buff_dma)
+		return;
+	if (desc_read(desc, sw_flags) & CPDMA_DESC_SW_PAGE)
+		dma_unmap_page(dev, buff_dma, origlen, chan->dir);
+	else
+		dma_unmap_single(dev, buff_dma, origlen, chan->dir);
+}
+
+/*
+ * Queue one tx packet made up of several buffers, one descriptor per
+ * buffer.  Only the SOP descriptor carries the owner bit and the packet
+ * length; the hardware reports completion there and flags EOQ on the EOP
+ * descriptor.  Returns -ENOSPC if the packet needs more descriptors than
+ * the channel can ever have outstanding, and -ENOMEM if it does not fit
+ * right now.
+ */
+int cpdma_chan_submit_sg(struct cpdma_chan *chan, void *token,
+			 struct cpdma_buf *bufs, int num_bufs, int directed)
+{
+	struct cpdma_ctlr		*ctlr = chan->ctlr;
+	struct cpdma_desc_pool		*pool = ctlr->pool;
+	struct cpdma_desc __iomem	*desc, *sop = NULL, *prev = NULL;
+	dma_addr_t			buffer;
+	unsigned long			flags;
+	u32				mode;
+	int				i, pkt_len = 0, ret = 0;
+
+	if (WARN_ON(is_rx_chan(chan) || num_bufs < 1))
+		return -EINVAL;
+
+	spin_lock_irqsave(&chan->lock, flags);
+
+	if (chan->state == CPDMA_STATE_TEARDOWN) {
+		ret = -EINVAL;
+		goto unlock_ret;
+	}
+
+	if (num_bufs > chan->desc_num) {
+		ret = -ENOSPC;
+		goto unlock_ret;
+	}
+
+	if (chan->count + num_bufs > chan->desc_num) {
+		chan->stats.desc_alloc_fail++;
+		ret = -ENOMEM;
+		goto unlock_ret;
+	}
+
+	for (i = 0; i < num_bufs; i++) {
+		desc = cpdma_desc_alloc(pool, 1, false);
+		if (!desc) {
+			chan->stats.desc_alloc_fail++;
+			ret = -ENOMEM;
+			goto free_descs;
+		}
+
+		if (bufs[i].page) {
+			buffer = dma_map_page(ctlr->dev, bufs[i].page,
+					      bufs[i].offset, bufs[i].len,
+					      chan->dir);
+			desc_write(desc, sw_flags, CPDMA_DESC_SW_PAGE);
+		} else {
+			buffer = dma_map_single(ctlr->dev, bufs[i].data,
+						bufs[i].len, chan->dir);
+			desc_write(desc, sw_flags, 0);
+		}
+
+		desc_write(desc, hw_next,   0);
+		desc_write(desc, hw_buffer, buffer);
+		desc_write(desc, hw_len,    bufs[i].len);
+		desc_write(desc, hw_mode,   0);
+		desc_write(desc, sw_token,  NULL);
+		desc_write(desc, sw_buffer, buffer);
+		desc_write(desc, sw_len,    bufs[i].len);
+
+		if (prev)
+			desc_write(prev, hw_next, desc_phys(pool, desc));
+		else
+			sop = desc;
+		prev = desc;
+		pkt_len += bufs[i].len;
+	}
+
+	if (pkt_len < ctlr->params.min_packet_size) {
+		/* the caller pads short packets, they are never fragmented */
+		WARN_ON_ONCE(1);
+		chan->stats.runt_transmit_buff++;
+	}
+
+	mode = CPDMA_DESC_OWNER | CPDMA_DESC_SOP;
+	if ((directed == 1) || (directed == 2))
+		mode |= (CPDMA_DESC_TO_PORT_EN | (directed << 16));
+	desc_write(prev, hw_mode, desc_read(prev, hw_mode) | CPDMA_DESC_EOP);
+	desc_write(sop, sw_token, token);
+	desc_write(sop, hw_mode, desc_read(sop, hw_mode) | mode | pkt_len);
+
+	__cpdma_chan_submit(chan, sop, prev);
+	chan->count += num_bufs;
+	chan->stats.sg_enqueue++;
+	goto unlock_ret;
+
+free_descs:
+	while (sop) {
+		desc = sop;
+		sop = desc_from_phys(pool, desc_read(desc, hw_next));
+		cpdma_desc_unmap(chan, desc);
+		cpdma_desc_free(pool, desc, 1);
+	}
+
+unlock_ret:
+	spin_unlock_irqrestore(&chan->lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(cpdma_chan_submit_sg);
+
+/* unmap and free all descriptors of a packet, then complete it */
 static void __cpdma_chan_free(struct cpdma_chan *chan,
 			      struct cpdma_desc __iomem *desc,
 			      int outlen, int status)
 {
 	struct cpdma_ctlr		*ctlr = chan->ctlr;
 	struct cpdma_desc_pool		*pool = ctlr->pool;
-	dma_addr_t			buff_dma;
-	int				origlen;
+	struct cpdma_desc __iomem	*next;
 	void				*token;
+	bool				eop;
 
 	token      = (void *)desc_read(desc, sw_token);
-	buff_dma   = desc_read(desc, sw_buffer);
-	origlen    = desc_read(desc, sw_len);
 
-	dma_unmap_single(ctlr->dev, buff_dma, origlen, chan->dir);
-	cpdma_desc_free(pool, desc, 1);
+	do {
+		eop  = desc_read(desc, hw_mode) & CPDMA_DESC_EOP;
+		next = desc_from_phys(pool, desc_read(desc, hw_next));
+		cpdma_desc_unmap(chan, desc);
+		cpdma_desc_free(pool, desc, 1);
+		desc = next;
+	} while (!eop && desc);
+
 	(*chan->handler)(token, outlen, status);
 }
 
 static int __cpdma_chan_process(struct cpdma_chan *chan)
 {
 	struct cpdma_ctlr		*ctlr = chan->ctlr;
-	struct cpdma_desc __iomem	*desc;
-	int				status, outlen;
+	struct cpdma_desc __iomem	*desc, *eop;
+	int				status, outlen, num_desc;
 	struct cpdma_desc_pool		*pool = ctlr->pool;
 	dma_addr_t			desc_dma;
 
@@ -752,7 +1031,6 @@ static int __cpdma_chan_process(struct cpdma_chan *chan)
 		status = -ENOENT;
 		goto unlock_ret;
 	}
-	desc_dma = desc_phys(pool, desc);
 
 	status	= __raw_readl(&desc->hw_mode);
 	outlen	= status & 0x7ff;
@@ -761,18 +1039,25 @@ static int __cpdma_chan_process(struct cpdma_chan *chan)
 		status = -EBUSY;
 		goto unlock_ret;
 	}
-	status	= status & (CPDMA_DESC_EOQ | CPDMA_DESC_TD_COMPLETE |
-			    CPDMA_DESC_PORT_MASK);
+	status	= status & (CPDMA_DESC_TD_COMPLETE | CPDMA_DESC_PORT_MASK);
 
-	chan->head = desc_from_phys(pool, desc_read(desc, hw_next));
+	/* EOQ is reported in the last descriptor of the packet */
+	num_desc = cpdma_desc_eop(pool, desc, &eop);
+	status	|= desc_read(eop, hw_mode) & CPDMA_DESC_EOQ;
+	desc_dma = desc_phys(pool, eop);
+
+	chan->head = desc_from_phys(pool, desc_read(eop, hw_next));
 	chan_write(chan, cp, desc_dma);
-	chan->count--;
+	chan->count -= num_desc;
 	chan->stats.good_dequeue++;
+	chan->stats.cp_write++;
 
 	if ((status & CPDMA_DESC_EOQ) && (chan->head) &&
 			(!(status & CPDMA_DESC_TD_COMPLETE))) {
 		chan->stats.requeue++;
+		chan->stats.hdp_write++;
 		chan_write(chan, hdp, desc_phys(pool, chan->head));
+		chan->kick = NULL;
 	}
 
 	__cpdma_chan_free(chan, desc, outlen, status);
@@ -782,23 +1067,115 @@ unlock_ret:
 	return status;
 }
 
+/*
+ * Reclaim up to quota completed packets as one batch: the run of
+ * completed descriptors is unlinked under a single lock with a single
+ * completion pointer write for its last descriptor, and the handlers are
+ * then called without the lock held.  EOQ can only be pending on the last
+ * packet of the batch, since the hardware does not complete anything
+ * queued after an EOQ until it is restarted.
+ */
 int cpdma_chan_process(struct cpdma_chan *chan, int quota)
 {
-	int used = 0, ret = 0;
+	struct cpdma_ctlr		*ctlr = chan->ctlr;
+	struct cpdma_desc_pool		*pool = ctlr->pool;
+	struct cpdma_desc __iomem	*desc, *first, *last = NULL, *eop = NULL;
+	struct cpdma_desc __iomem	*next;
+	unsigned long			flags;
+	int				used = 0, num_desc = 0, status, i;
+	u32				mode;
 
-	if (chan->state != CPDMA_STATE_ACTIVE)
+	spin_lock_irqsave(&chan->lock, flags);
+
+	if (chan->state != CPDMA_STATE_ACTIVE) {
+		spin_unlock_irqrestore(&chan->lock, flags);
 		return -EINVAL;
+	}
 
-	while (used < quota) {
-		ret = __cpdma_chan_process(chan);
-		if (ret < 0)
+	first = desc = chan->head;
+	if (!desc)
+		chan->stats.empty_dequeue++;
+
+	while (desc && used < quota) {
+		if (desc_read(desc, hw_mode) & CPDMA_DESC_OWNER) {
+			chan->stats.busy_dequeue++;
 			break;
+		}
+		num_desc += cpdma_desc_eop(pool, desc, &eop);
+		last = desc;
+		desc = desc_from_phys(pool, desc_read(eop, hw_next));
 		used++;
 	}
+
+	if (!used) {
+		spin_unlock_irqrestore(&chan->lock, flags);
+		return 0;
+	}
+
+	chan->head = desc;
+	chan_write(chan, cp, desc_phys(pool, eop));
+	chan->count -= num_desc;
+	chan->stats.good_dequeue += used;
+	chan->stats.cp_write++;
+	chan->stats.batch_dequeue++;
+	if (used > chan->stats.batch_max)
+		chan->stats.batch_max = used;
+
+	if ((desc_read(eop, hw_mode) & CPDMA_DESC_EOQ) && chan->head &&
+	    !(desc_read(last, hw_mode) & CPDMA_DESC_TD_COMPLETE)) {
+		chan->stats.requeue++;
+		chan->stats.hdp_write++;
+		chan_write(chan, hdp, desc_phys(pool, chan->head));
+		chan->kick = NULL;
+	}
+
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	for (i = 0, desc = first; i < used; i++, desc = next) {
+		mode	= desc_read(desc, hw_mode);
+		cpdma_desc_eop(pool, desc, &eop);
+		status	= mode & (CPDMA_DESC_TD_COMPLETE | CPDMA_DESC_PORT_MASK);
+		status	|= desc_read(eop, hw_mode) & CPDMA_DESC_EOQ;
+		next	= desc_from_phys(pool, desc_read(eop, hw_next));
+		__cpdma_chan_free(chan, desc, mode & 0x7ff, status);
+	}
+
 	return used;
 }
 EXPORT_SYMBOL_GPL(cpdma_chan_process);
 
+/*
+ * Hold back the head descriptor pointer writes of a channel while a burst
+ * of packets is queued, so that the hardware is started once for the
+ * whole chain instead of once for the first packet and again each time it
+ * runs dry in the middle of the burst.  cpdma_chan_kick() ends the burst.
+ */
+void cpdma_chan_hold(struct cpdma_chan *chan)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->held = true;
+	spin_unlock_irqrestore(&chan->lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpdma_chan_hold);
+
+void cpdma_chan_kick(struct cpdma_chan *chan)
+{
+	struct cpdma_desc_pool	*pool = chan->ctlr->pool;
+	unsigned long		flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->held = false;
+	if (chan->kick && chan->state == CPDMA_STATE_ACTIVE) {
+		chan_write(chan, hdp, desc_phys(pool, chan->kick));
+		chan->stats.hdp_write++;
+	}
+	chan->kick = NULL;
+	spin_unlock_irqrestore(&chan->lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpdma_chan_kick);
+
 int cpdma_chan_start(struct cpdma_chan *chan)
 {
 	struct cpdma_ctlr	*ctlr = chan->ctlr;
@@ -818,9 +1195,11 @@ int cpdma_chan_start(struct cpdma_chan *chan)
 	chan->state = CPDMA_STATE_ACTIVE;
 	if (chan->head) {
 		chan_write(chan, hdp, desc_phys(pool, chan->head));
+		chan->stats.hdp_write++;
 		if (chan->rxfree)
 			chan_write(chan, rxfree, chan->count);
 	}
+	chan->kick = NULL;
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 	return 0;
@@ -869,10 +1248,11 @@ int cpdma_chan_stop(struct cpdma_chan *chan)
 
 	/* remaining packets haven't been tx/rx'ed, clean them up */
 	while (chan->head) {
-		struct cpdma_desc __iomem *desc = chan->head;
+		struct cpdma_desc __iomem *desc = chan->head, *eop;
 		dma_addr_t next_dma;
 
-		next_dma = desc_read(desc, hw_next);
+		chan->count -= cpdma_desc_eop(pool, desc, &eop);
+		next_dma = desc_read(eop, hw_next);
 		chan->head = desc_from_phys(pool, next_dma);
 		chan->stats.teardown_dequeue++;
 
@@ -883,6 +1263,7 @@ int cpdma_chan_stop(struct cpdma_chan *chan)
 	}
 
 	chan->state = CPDMA_STATE_IDLE;
+	chan->kick = NULL;
 	spin_unlock_irqrestore(&chan->lock, flags);
 	return 0;
 }
@@ -61,6 +61,20 @@ struct cpdma_chan_stats {
 	u32			good_dequeue;
 	u32			requeue;
 	u32			teardown_dequeue;
+	u32			sg_enqueue;
+	u32			batch_dequeue;	/* reclaim runs that found work */
+	u32			batch_max;	/* most packets in one run */
+	u32			cp_write;
+	u32			hdp_write;
+	u32			hdp_deferred;	/* kicks folded into a later one */
+};
+
+/* one buffer of a multi-descriptor tx packet, see cpdma_chan_submit_sg() */
+struct cpdma_buf {
+	void			*data;		/* used if page is NULL */
+	struct page		*page;
+	unsigned int		offset;
+	int			len;
 };
 
 struct cpdma_ctlr;
@@ -80,12 +94,22 @@ int cpdma_chan_destroy(struct cpdma_chan *chan);
 int cpdma_chan_start(struct cpdma_chan *chan);
 int cpdma_chan_stop(struct cpdma_chan *chan);
 int cpdma_chan_dump(struct cpdma_chan *chan);
+int cpdma_chan_set_weight(struct cpdma_chan *chan, int weight);
+int cpdma_chan_get_rx_buf_num(struct cpdma_chan *chan);
+bool cpdma_check_free_tx_desc(struct cpdma_chan *chan);
+int cpdma_chan_get_free_desc_num(struct cpdma_chan *chan);
 
 int cpdma_chan_get_stats(struct cpdma_chan *chan,
 			 struct cpdma_chan_stats *stats);
 int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
 		      int len, int directed, gfp_t gfp_mask);
+int cpdma_chan_submit_mapped(struct cpdma_chan *chan, void *token,
+			     dma_addr_t buffer, int len, int directed);
+int cpdma_chan_submit_sg(struct cpdma_chan *chan, void *token,
+			 struct cpdma_buf *bufs, int num_bufs, int directed);
 int cpdma_chan_process(struct cpdma_chan *chan, int quota);
+void cpdma_chan_hold(struct cpdma_chan *chan);
+void cpdma_chan_kick(struct cpdma_chan *chan);
 
 int cpdma_ctlr_int_ctrl(struct cpdma_ctlr *ctlr, bool enable);
 void cpdma_ctlr_eoi(struct cpdma_ctlr *ctlr);
@@ -34,6 +34,10 @@
 #include <linux/io.h>
 #include <linux/slab.h>
 #include <linux/pm_runtime.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <linux/spi/spi.h>
 
@@ -92,6 +96,11 @@
 
 #define OMAP2_MCSPI_WAKEUPENABLE_WKEN	BIT(0)
 
+/* PaRAM slots linked behind each channel, so that up to this many
+ * consecutive transfers of one message run as a single DMA chain.
+ */
+#define OMAP2_MCSPI_DMA_CHAIN		4
+
 /* We have 2 DMA channels per CS, one for RX and one for TX */
 struct omap2_mcspi_dma {
 	int dma_tx_channel;
@@ -103,18 +112,41 @@ struct omap2_mcspi_dma {
 	struct completion dma_tx_completion;
 	struct completion dma_rx_completion;
 	int dummy_param_slot;
+
+	int tx_chain_slot[OMAP2_MCSPI_DMA_CHAIN];
+	int rx_chain_slot[OMAP2_MCSPI_DMA_CHAIN];
+	int chain_slots;
 };
 
 /* use PIO for small transfers, avoiding DMA setup/teardown overhead and
  * cache operations; better heuristics consider wordsize and bitrate.
+ * This is the default, each controller can be tuned through sysfs.
  */
 #define DMA_MIN_BYTES			160
 
+struct omap2_mcspi_stats {
+	u64			messages;
+	u64			transfers;
+	u64			bytes;
+	u64			dma_transfers;
+	u64			dma_chained;
+	u64			pio_transfers;
+	u64			errors;
+	/* time spent running messages since the counters were reset */
+	u64			busy_ns;
+	ktime_t			since;
+};
+
 struct omap2_mcspi {
-	struct work_struct	work;
-	/* lock protects queue and registers */
+	/* messages are pumped by a real-time thread per controller */
+	struct kthread_worker	kworker;
+	struct task_struct	*kworker_task;
+	struct kthread_work	work;
+	/* lock protects queue, stats and registers */
 	spinlock_t		lock;
 	struct list_head	msg_queue;
+	unsigned		dma_min_bytes;
+	struct omap2_mcspi_stats stats;
 	struct spi_master	*master;
 	/* Virtual base address of the controller */
 	void __iomem		*base;
@@ -144,8 +176,6 @@ struct omap2_mcspi_regs {
 
 static struct omap2_mcspi_regs omap2_mcspi_ctx[OMAP2_MCSPI_MAX_CTRL];
 
-static struct workqueue_struct *omap2_mcspi_wq;
-
 #define MOD_REG_BIT(val, mask, set) do { \
 	if (set) \
 		val |= mask; \
@@ -290,15 +320,86 @@ static int mcspi_wait_for_reg_bit(void __iomem *reg, unsigned long bit)
 	return 0;
 }
 
+static int mcspi_dma_elements(int word_len, unsigned count)
+{
+	if (word_len <= 8)
+		return count;
+	else if (word_len <= 16)
+		return count >> 1;
+	else /* word_len <= 32 */
+		return count >> 2;
+}
+
+static void omap2_mcspi_tx_param(struct omap2_mcspi_dma *mcspi_dma,
+		struct spi_transfer *xfer, unsigned long tx_reg,
+		int element_count, int last, struct edmacc_param *param)
+{
+	int a_cnt, b_cnt, b_cntrld;
+
+	a_cnt    = 1;
+	b_cnt    = 1;
+	b_cntrld = SZ_64K - 1;
+
+	/* only the last set of a chain raises the completion */
+	param->opt          = EDMA_TCC(mcspi_dma->dma_tx_channel) | SYNCDIM;
+	if (last)
+		param->opt |= TCINTEN;
+	param->src          = xfer->tx_dma;
+	param->a_b_cnt      = a_cnt | b_cnt << 16;
+	param->dst          = tx_reg;
+	param->src_dst_bidx = a_cnt;
+	param->link_bcntrld = b_cntrld << 16;
+	param->src_dst_cidx = b_cnt;
+	param->ccnt         = element_count;
+}
+
+static void omap2_mcspi_rx_param(struct omap2_mcspi_dma *mcspi_dma,
+		struct spi_transfer *xfer, unsigned long rx_reg,
+		int element_count, int last, struct edmacc_param *param)
+{
+	int a_cnt, b_cnt, c_cnt, b_cntrld;
+
+	a_cnt    = 1;
+	c_cnt    = (element_count / a_cnt) / (SZ_64K - 1);
+	b_cnt    = element_count - c_cnt * (SZ_64K - 1);
+	b_cntrld = SZ_64K - 1;
+
+	if (b_cnt)
+		c_cnt++;
+	else
+		b_cnt = SZ_64K - 1;
+
+	param->opt          = EDMA_TCC(mcspi_dma->dma_rx_channel);
+	if (last)
+		param->opt |= TCINTEN;
+	param->src          = rx_reg;
+	param->a_b_cnt      = a_cnt | b_cnt << 16;
+	param->dst          = xfer->rx_dma;
+	param->src_dst_bidx = a_cnt << 16;
+	param->link_bcntrld = b_cntrld << 16;
+	param->src_dst_cidx = 1 << 16;
+	param->ccnt         = c_cnt;
+}
+
+/*
+ * Run xfer and the @chained transfers following it in its message as one
+ * DMA: each transfer gets its own PaRAM set, linked in list order behind
+ * the channel, so the controller never idles between them waiting for
+ * the CPU.  The caller guarantees the chained transfers share direction
+ * and channel configuration with xfer.
+ */
 static unsigned
-omap2_mcspi_txrx_dma(struct spi_device *spi, struct spi_transfer *xfer)
+omap2_mcspi_txrx_dma(struct spi_device *spi, struct spi_transfer *xfer,
+		unsigned chained)
 {
 	struct omap2_mcspi	*mcspi;
 	struct omap2_mcspi_cs	*cs = spi->controller_state;
 	struct omap2_mcspi_dma  *mcspi_dma;
-	unsigned int		count, c;
+	struct spi_transfer	*t;
+	unsigned int		count, i;
 	unsigned long		base, tx_reg, rx_reg;
-	int			word_len, data_type, element_count;
+	int			word_len, element_count;
+	int			tx_slot, rx_slot, next;
 	int			elements = 0;
 	u32			l;
 	u8			* rx;
@@ -312,8 +413,6 @@ omap2_mcspi_txrx_dma(struct spi_device *spi, struct spi_transfer *xfer)
 
 	chstat_reg = cs->base + OMAP2_MCSPI_CHSTAT0;
 
-	count = xfer->len;
-	c = count;
 	word_len = cs->word_len;
 
 	base = cs->phys;
@@ -322,69 +421,45 @@ omap2_mcspi_txrx_dma(struct spi_device *spi, struct spi_transfer *xfer)
 	rx = xfer->rx_buf;
 	tx = xfer->tx_buf;
 
-	if (word_len <= 8) {
-		data_type = OMAP_DMA_DATA_TYPE_S8;
-		element_count = count;
-	} else if (word_len <= 16) {
-		data_type = OMAP_DMA_DATA_TYPE_S16;
-		element_count = count >> 1;
-	} else /* word_len <= 32 */ {
-		data_type = OMAP_DMA_DATA_TYPE_S32;
-		element_count = count >> 2;
-	}
+	count = 0;
+	tx_slot = mcspi_dma->dma_tx_channel;
+	rx_slot = mcspi_dma->dma_rx_channel;
+	t = xfer;
+	for (i = 0; i <= chained; i++) {
+		int last = (i == chained);
+
+		element_count = mcspi_dma_elements(word_len, t->len);
+
+		if (tx != NULL) {
+			omap2_mcspi_tx_param(mcspi_dma, t, tx_reg,
+					element_count, last, &param);
+			edma_write_slot(tx_slot, &param);
+			next = last ? mcspi_dma->dummy_param_slot :
+				mcspi_dma->tx_chain_slot[i];
+			edma_link(tx_slot, next);
+			tx_slot = next;
+		}
 
-	if (tx != NULL) {
-		int a_cnt, b_cnt, c_cnt, b_cntrld;
-
-		a_cnt    = 1;
-		b_cnt    = 1;
-		c_cnt    = (element_count / a_cnt) / 256;
-		b_cntrld = SZ_64K - 1;
-
-		param.opt          = TCINTEN |
-			EDMA_TCC(mcspi_dma->dma_tx_channel) | SYNCDIM ;
-		param.src          = xfer->tx_dma;
-		param.a_b_cnt      = a_cnt | b_cnt << 16;
-		param.dst          = tx_reg;
-		param.src_dst_bidx = a_cnt;
-		param.link_bcntrld = b_cntrld << 16;
-		param.src_dst_cidx = b_cnt;
-		param.ccnt         = element_count;
-		edma_write_slot(mcspi_dma->dma_tx_channel, &param);
-		edma_link(mcspi_dma->dma_tx_channel,
-				mcspi_dma->dummy_param_slot);
+		if (rx != NULL) {
+			omap2_mcspi_rx_param(mcspi_dma, t, rx_reg,
+					element_count, last, &param);
+			edma_write_slot(rx_slot, &param);
+			next = last ? mcspi_dma->dummy_param_slot :
+				mcspi_dma->rx_chain_slot[i];
+			edma_link(rx_slot, next);
+			rx_slot = next;
+		}
+
+		count += t->len;
+		t = list_entry(t->transfer_list.next, struct spi_transfer,
+				transfer_list);
 	}
 
+	/* turbo mode is never chained, element_count is that of xfer */
 	if (rx != NULL) {
-		int a_cnt, b_cnt, c_cnt, b_cntrld;
-
-		a_cnt    = 1;
-		c_cnt    = (element_count / a_cnt) / (SZ_64K - 1);
-		b_cnt    = element_count - c_cnt * (SZ_64K - 1);
-		b_cntrld = SZ_64K - 1;
-
-		if (b_cnt)
-			c_cnt++;
-		else
-			b_cnt = SZ_64K - 1;
-
 		elements = element_count - 1;
 		if (l & OMAP2_MCSPI_CHCONF_TURBO)
 			elements--;
-
-		param.opt          = TCINTEN |
-			EDMA_TCC(mcspi_dma->dma_rx_channel);
-		param.src          = rx_reg;
-		param.a_b_cnt      = a_cnt | b_cnt << 16;
-		param.dst          = xfer->rx_dma;
-		param.src_dst_bidx = a_cnt << 16;
-		param.link_bcntrld = b_cntrld << 16;
-		param.src_dst_cidx = 1 << 16;
-		param.ccnt         = c_cnt;
-		edma_write_slot(mcspi_dma->dma_rx_channel, &param);
-		edma_link(mcspi_dma->dma_rx_channel,
-				mcspi_dma->dummy_param_slot);
-
 	}
 
 	if (tx != NULL) {
@@ -399,7 +474,12 @@ omap2_mcspi_txrx_dma(struct spi_device *spi, struct spi_transfer *xfer)
 
 	if (tx != NULL) {
 		wait_for_completion(&mcspi_dma->dma_tx_completion);
-		dma_unmap_single(&spi->dev, xfer->tx_dma, count, DMA_TO_DEVICE);
+		for (i = 0, t = xfer; i <= chained; i++) {
+			dma_unmap_single(&spi->dev, t->tx_dma, t->len,
+					DMA_TO_DEVICE);
+			t = list_entry(t->transfer_list.next,
+					struct spi_transfer, transfer_list);
+		}
 
 		/* for TX_ONLY mode, be sure all words have shifted out */
 		if (rx == NULL) {
@@ -414,7 +494,12 @@ omap2_mcspi_txrx_dma(struct spi_device *spi, struct spi_transfer *xfer)
 
 	if (rx != NULL) {
 		wait_for_completion(&mcspi_dma->dma_rx_completion);
-		dma_unmap_single(&spi->dev, xfer->rx_dma, count, DMA_FROM_DEVICE);
+		for (i = 0, t = xfer; i <= chained; i++) {
+			dma_unmap_single(&spi->dev, t->rx_dma, t->len,
+					DMA_FROM_DEVICE);
+			t = list_entry(t->transfer_list.next,
+					struct spi_transfer, transfer_list);
+		}
 		omap2_mcspi_set_enable(spi, 0);
 
 		if (l & OMAP2_MCSPI_CHCONF_TURBO) {
@@ -752,7 +837,7 @@ static int omap2_mcspi_request_dma(struct spi_device *spi)
 	struct spi_master	*master = spi->master;
 	struct omap2_mcspi	*mcspi;
 	struct omap2_mcspi_dma	*mcspi_dma;
-	int			ret = 0;
+	int			ret = 0, i;
 
 	mcspi = spi_master_get_devdata(master);
 	mcspi_dma = mcspi->dma_channels + spi->chip_select;
@@ -785,6 +870,24 @@ static int omap2_mcspi_request_dma(struct spi_device *spi)
 	edma_link(mcspi_dma->dummy_param_slot,
 			mcspi_dma->dummy_param_slot);
 
+	/* chaining is an optimization, run unchained if slots are short */
+	for (i = 0; i < OMAP2_MCSPI_DMA_CHAIN; i++) {
+		ret = edma_alloc_slot(EDMA_CTLR(mcspi_dma->dma_tx_channel),
+				EDMA_SLOT_ANY);
+		if (ret < 0)
+			break;
+		mcspi_dma->tx_chain_slot[i] = ret;
+
+		ret = edma_alloc_slot(EDMA_CTLR(mcspi_dma->dma_rx_channel),
+				EDMA_SLOT_ANY);
+		if (ret < 0) {
+			edma_free_slot(mcspi_dma->tx_chain_slot[i]);
+			break;
+		}
+		mcspi_dma->rx_chain_slot[i] = ret;
+	}
+	mcspi_dma->chain_slots = i;
+
 	init_completion(&mcspi_dma->dma_rx_completion);
 	init_completion(&mcspi_dma->dma_tx_completion);
 
@@ -842,6 +945,7 @@ static void omap2_mcspi_cleanup(struct spi_device *spi)
 	struct omap2_mcspi	*mcspi;
 	struct omap2_mcspi_dma	*mcspi_dma;
 	struct omap2_mcspi_cs	*cs;
+	int			i;
 
 	mcspi = spi_master_get_devdata(spi->master);
 
@@ -864,10 +968,51 @@ static void omap2_mcspi_cleanup(struct spi_device *spi)
 			omap_free_dma(mcspi_dma->dma_tx_channel);
 			mcspi_dma->dma_tx_channel = -1;
 		}
+		for (i = 0; i < mcspi_dma->chain_slots; i++) {
+			edma_free_slot(mcspi_dma->tx_chain_slot[i]);
+			edma_free_slot(mcspi_dma->rx_chain_slot[i]);
+		}
+		mcspi_dma->chain_slots = 0;
 	}
 }
 
-static void omap2_mcspi_work(struct work_struct *work)
+/*
+ * Count the transfers after @t that can be linked behind it into a single
+ * DMA: they must not need any CPU work in between (chipselect toggles,
+ * delays, channel reconfiguration or the turbo mode last word fixup) and
+ * must themselves go through DMA.
+ */
+static unsigned omap2_mcspi_dma_chain(struct spi_message *m,
+		struct spi_transfer *t, u32 chconf, unsigned dma_min_bytes,
+		unsigned max)
+{
+	struct spi_transfer	*next;
+	unsigned		chained = 0;
+
+	if (chconf & OMAP2_MCSPI_CHCONF_TURBO)
+		return 0;
+
+	while (chained < max && !t->cs_change && !t->delay_usecs
+			&& t->transfer_list.next != &m->transfers) {
+		next = list_entry(t->transfer_list.next, struct spi_transfer,
+				transfer_list);
+
+		if (!next->len
+				|| (!m->is_dma_mapped && next->len < dma_min_bytes)
+				|| !next->tx_buf != !t->tx_buf
+				|| !next->rx_buf != !t->rx_buf
+				|| next->speed_hz != t->speed_hz
+				|| next->bits_per_word != t->bits_per_word)
+			break;
+
+		chained++;
+		t = next;
+	}
+
+	return chained;
+}
+
+static void omap2_mcspi_work(struct kthread_work *work)
 {
 	struct omap2_mcspi	*mcspi;
 
@@ -891,9 +1036,13 @@ static void omap2_mcspi_work(struct work_struct *work)
 		int				cs_active = 0;
 		struct omap2_mcspi_cs		*cs;
 		struct omap2_mcspi_device_config *cd;
+		struct omap2_mcspi_dma		*mcspi_dma;
 		int				par_override = 0;
 		int				status = 0;
 		u32				chconf;
+		unsigned			dma_min_bytes;
+		unsigned			transfers = 0, dma = 0, chained = 0;
+		ktime_t				start;
 
 		m = container_of(mcspi->msg_queue.next, struct spi_message,
 				 queue);
@@ -901,9 +1050,13 @@ static void omap2_mcspi_work(struct work_struct *work)
 		list_del_init(&m->queue);
 		spin_unlock_irq(&mcspi->lock);
 
+		start = ktime_get();
 		spi = m->spi;
 		cs = spi->controller_state;
 		cd = spi->controller_data;
+		mcspi_dma = &mcspi->dma_channels[spi->chip_select];
+		/* threshold the buffers were mapped with in transfer() */
+		dma_min_bytes = (unsigned long)m->state;
 
 		omap2_mcspi_set_enable(spi, 1);
 		list_for_each_entry(t, &m->transfers, transfer_list) {
@@ -943,20 +1096,39 @@ static void omap2_mcspi_work(struct work_struct *work)
 			mcspi_write_chconf0(spi, chconf);
 
 			if (t->len) {
-				unsigned	count;
+				unsigned	count, len = t->len;
 
 				/* RX_ONLY mode needs dummy data in TX reg */
 				if (t->tx_buf == NULL)
 					__raw_writel(0, cs->base
 							+ OMAP2_MCSPI_TX0);
 
-				if (m->is_dma_mapped || t->len >= DMA_MIN_BYTES)
-					count = omap2_mcspi_txrx_dma(spi, t);
-				else
+				if (m->is_dma_mapped
+						|| t->len >= dma_min_bytes) {
+					unsigned n;
+
+					n = omap2_mcspi_dma_chain(m, t, chconf,
+						dma_min_bytes,
+						mcspi_dma->chain_slots);
+					count = omap2_mcspi_txrx_dma(spi, t, n);
+					/* carry on behind the chain */
+					while (n--) {
+						t = list_entry(
+							t->transfer_list.next,
+							struct spi_transfer,
+							transfer_list);
+						len += t->len;
+						transfers++;
+						dma++;
+						chained++;
+					}
+					dma++;
+				} else
 					count = omap2_mcspi_txrx_pio(spi, t);
 				m->actual_length += count;
+				transfers++;
 
-				if (count != t->len) {
+				if (count != len) {
 					status = -EIO;
 					break;
 				}
@@ -983,6 +1155,19 @@ static void omap2_mcspi_work(struct work_struct *work)
 
 		omap2_mcspi_set_enable(spi, 0);
 
+		spin_lock_irq(&mcspi->lock);
+		mcspi->stats.messages++;
+		mcspi->stats.transfers += transfers;
+		mcspi->stats.bytes += m->actual_length;
+		mcspi->stats.dma_transfers += dma;
+		mcspi->stats.dma_chained += chained;
+		mcspi->stats.pio_transfers += transfers - dma;
+		if (status < 0)
+			mcspi->stats.errors++;
+		mcspi->stats.busy_ns += ktime_to_ns(ktime_sub(ktime_get(),
+								start));
+		spin_unlock_irq(&mcspi->lock);
+
 		m->status = status;
 		m->complete(m->context);
 
@@ -999,9 +1184,15 @@ static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
 	struct omap2_mcspi	*mcspi;
 	unsigned long		flags;
 	struct spi_transfer	*t;
+	unsigned		dma_min_bytes;
+
+	mcspi = spi_master_get_devdata(spi->master);
+	dma_min_bytes = ACCESS_ONCE(mcspi->dma_min_bytes);
 
 	m->actual_length = 0;
 	m->status = 0;
+	/* the threshold may be retuned before the message is pumped */
+	m->state = (void *)(unsigned long)dma_min_bytes;
 
 	/* reject invalid messages and transfers */
 	if (list_empty(&m->transfers) || !m->complete)
@@ -1031,7 +1222,7 @@ static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
 			return -EINVAL;
 		}
 
-		if (m->is_dma_mapped || len < DMA_MIN_BYTES)
+		if (m->is_dma_mapped || !len || len < dma_min_bytes)
 			continue;
 
 		if (tx_buf != NULL) {
@@ -1057,16 +1248,105 @@ static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
 		}
 	}
 
-	mcspi = spi_master_get_devdata(spi->master);
-
 	spin_lock_irqsave(&mcspi->lock, flags);
 	list_add_tail(&m->queue, &mcspi->msg_queue);
-	queue_work(omap2_mcspi_wq, &mcspi->work);
+	queue_kthread_work(&mcspi->kworker, &mcspi->work);
 	spin_unlock_irqrestore(&mcspi->lock, flags);
 
 	return 0;
 }
 
+static ssize_t omap2_mcspi_show_dma_min_bytes(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_master	*master = dev_get_drvdata(dev);
+	struct omap2_mcspi	*mcspi = spi_master_get_devdata(master);
+
+	return sprintf(buf, "%u\n", mcspi->dma_min_bytes);
+}
+
+static ssize_t omap2_mcspi_store_dma_min_bytes(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct spi_master	*master = dev_get_drvdata(dev);
+	struct omap2_mcspi	*mcspi = spi_master_get_devdata(master);
+	unsigned long		val;
+
+	if (strict_strtoul(buf, 0, &val) || val > UINT_MAX)
+		return -EINVAL;
+
+	mcspi->dma_min_bytes = val;
+
+	return count;
+}
+
+static DEVICE_ATTR(dma_min_bytes, S_IWUSR | S_IRUGO,
+		omap2_mcspi_show_dma_min_bytes,
+		omap2_mcspi_store_dma_min_bytes);
+
+static ssize_t omap2_mcspi_show_statistics(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_master	*master = dev_get_drvdata(dev);
+	struct omap2_mcspi	*mcspi = spi_master_get_devdata(master);
+	struct omap2_mcspi_stats stats;
+	u64			elapsed_ns;
+	unsigned		util = 0;
+
+	spin_lock_irq(&mcspi->lock);
+	stats = mcspi->stats;
+	spin_unlock_irq(&mcspi->lock);
+
+	elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), stats.since));
+	if (elapsed_ns)
+		util = div64_u64(min(stats.busy_ns, elapsed_ns) * 1000,
+				elapsed_ns);
+
+	return sprintf(buf, "messages:      %llu\n"
+			"transfers:     %llu\n"
+			"bytes:         %llu\n"
+			"dma transfers: %llu\n"
+			"dma chained:   %llu\n"
+			"pio transfers: %llu\n"
+			"errors:        %llu\n"
+			"busy us:       %llu\n"
+			"utilization:   %u.%u%%\n",
+			stats.messages, stats.transfers, stats.bytes,
+			stats.dma_transfers, stats.dma_chained,
+			stats.pio_transfers, stats.errors,
+			div_u64(stats.busy_ns, NSEC_PER_USEC),
+			util / 10, util % 10);
+}
+
+/* any write restarts the counters and the utilization window */
+static ssize_t omap2_mcspi_store_statistics(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct spi_master	*master = dev_get_drvdata(dev);
+	struct omap2_mcspi	*mcspi = spi_master_get_devdata(master);
+
+	spin_lock_irq(&mcspi->lock);
+	memset(&mcspi->stats, 0, sizeof(mcspi->stats));
+	mcspi->stats.since = ktime_get();
+	spin_unlock_irq(&mcspi->lock);
+
+	return count;
+}
+
+static DEVICE_ATTR(statistics, S_IWUSR | S_IRUGO,
+		omap2_mcspi_show_statistics,
+		omap2_mcspi_store_statistics);
+
+static struct attribute *omap2_mcspi_attributes[] = {
+	&dev_attr_dma_min_bytes.attr,
+	&dev_attr_statistics.attr,
+	NULL,
+};
+
+static const struct attribute_group omap2_mcspi_attr_group = {
+	.attrs = omap2_mcspi_attributes,
+};
+
 static int __init omap2_mcspi_master_setup(struct omap2_mcspi *mcspi)
 {
 	struct spi_master	*master = mcspi->master;
@@ -1105,6 +1385,7 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 	struct omap2_mcspi_platform_config *pdata = pdev->dev.platform_data;
 	struct omap2_mcspi	*mcspi;
 	struct resource		*r;
+	struct sched_param	param = { .sched_priority = MAX_RT_PRIO - 1 };
 	int			status = 0, i;
 
 	master = spi_alloc_master(&pdev->dev, sizeof *mcspi);
@@ -1152,10 +1433,13 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 	}
 
 	mcspi->dev = &pdev->dev;
-	INIT_WORK(&mcspi->work, omap2_mcspi_work);
+	init_kthread_worker(&mcspi->kworker);
+	init_kthread_work(&mcspi->work, omap2_mcspi_work);
 
 	spin_lock_init(&mcspi->lock);
 	INIT_LIST_HEAD(&mcspi->msg_queue);
+	mcspi->dma_min_bytes = DMA_MIN_BYTES;
+	mcspi->stats.since = ktime_get();
 	INIT_LIST_HEAD(&omap2_mcspi_ctx[master->bus_num - 1].cs);
 
 	mcspi->dma_channels = kcalloc(master->num_chipselect,
@@ -1201,6 +1485,20 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 	if (status || omap2_mcspi_master_setup(mcspi) < 0)
 		goto diable_pm;
 
+	mcspi->kworker_task = kthread_run(kthread_worker_fn, &mcspi->kworker,
+					  "%s", dev_name(&pdev->dev));
+	if (IS_ERR(mcspi->kworker_task)) {
+		dev_err(&pdev->dev, "failed to create message pump\n");
+		status = PTR_ERR(mcspi->kworker_task);
+		goto diable_pm;
+	}
+	/* latency sensitive: the pump runs whole messages back to back */
+	sched_setscheduler(mcspi->kworker_task, SCHED_FIFO, &param);
+
+	status = sysfs_create_group(&pdev->dev.kobj, &omap2_mcspi_attr_group);
+	if (status < 0)
+		goto stop_pump;
+
 	status = spi_register_master(master);
 	if (status < 0)
 		goto err_spi_register;
@@ -1208,7 +1506,9 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 	return status;
 
 err_spi_register:
-	spi_master_put(master);
+	sysfs_remove_group(&pdev->dev.kobj, &omap2_mcspi_attr_group);
+stop_pump:
+	kthread_stop(mcspi->kworker_task);
 diable_pm:
 	pm_runtime_put_sync(&pdev->dev);
 	pm_runtime_disable(&pdev->dev);
@@ -1236,6 +1536,17 @@ static int __exit omap2_mcspi_remove(struct platform_device *pdev)
 	mcspi = spi_master_get_devdata(master);
 	dma_channels = mcspi->dma_channels;
 
+	sysfs_remove_group(&pdev->dev.kobj, &omap2_mcspi_attr_group);
+
+	/*
+	 * Remove the child devices while the pump still runs, they may
+	 * transfer on their way out.  Keep mcspi around until we are done.
+	 */
+	spi_master_get(master);
+	spi_unregister_master(master);
+	flush_kthread_worker(&mcspi->kworker);
+	kthread_stop(mcspi->kworker_task);
+
 	omap2_mcspi_disable_clocks(mcspi);
 	pm_runtime_disable(&pdev->dev);
 	kfree(dma_channels);
@@ -1245,8 +1556,8 @@ static int __exit omap2_mcspi_remove(struct platform_device *pdev)
 	r = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	release_mem_region(r->start, resource_size(r));
 
-	spi_unregister_master(master);
 	platform_set_drvdata(pdev, NULL);
+	spi_master_put(master);
 
 	return 0;
 }
@@ -1305,10 +1616,6 @@ static struct platform_driver omap2_mcspi_driver = {
 
 static int __init omap2_mcspi_init(void)
 {
-	omap2_mcspi_wq = create_singlethread_workqueue(
-				omap2_mcspi_driver.driver.name);
-	if (omap2_mcspi_wq == NULL)
-		return -1;
 	return platform_driver_probe(&omap2_mcspi_driver, omap2_mcspi_probe);
 }
 subsys_initcall(omap2_mcspi_init);
@@ -1316,8 +1623,6 @@ subsys_initcall(omap2_mcspi_init);
 static void __exit omap2_mcspi_exit(void)
 {
 	platform_driver_unregister(&omap2_mcspi_driver);
-
-	destroy_workqueue(omap2_mcspi_wq);
 }
 module_exit(omap2_mcspi_exit);
 
@@ -21,14 +21,30 @@
 #include <linux/interrupt.h>
 #include <linux/platform_device.h>
 #include <linux/io.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
 #include "../iio.h"
+#include "../buffer_generic.h"
+#include "../ring_sw.h"
 #include <linux/mfd/ti_tscadc.h>
 #include <linux/platform_data/ti_adc.h>
 
+/* Single conversions with 16x averaging take well under a millisecond */
+#define TIADC_READ_TIMEOUT_MS	10
+
 struct adc_device {
 	struct ti_tscadc_dev	*mfd_tscadc;
 	struct iio_dev	*idev;
+	struct iio_chan_spec *chan_array;
 	int channels;
+	int irq;
+
+	/* buffered capture state, set up in preenable, then irq owned */
+	u32 buffer_step_mask;
+	s8 step_slot[TOTAL_STEPS];
+	int scan_len;
+	int scan_pos;
+	u16 scan[TOTAL_CHANNELS];
 };
 
 static unsigned int adc_readl(struct adc_device *adc, unsigned int reg)
@@ -42,34 +58,213 @@ static void adc_writel(struct adc_device *adc, unsigned int reg,
 	writel(val, adc->mfd_tscadc->tscadc_base + reg);
 }
 
-static void adc_step_config(struct adc_device *adc_dev)
+/*
+ * There are 16 configurable steps and 8 analog input
+ * lines available which are shared between Touchscreen and ADC.
+ *
+ * Steps backwards i.e. from 16 towards 0 are used by ADC
+ * depending on number of input lines needed.
+ * Channel would represent which analog input
+ * needs to be given to ADC to digitalize data.
+ */
+static int adc_chan_step(struct adc_device *adc_dev, int chan)
+{
+	return TOTAL_STEPS - adc_dev->channels + 1 + chan;
+}
+
+static int adc_chan_ain(struct adc_device *adc_dev, int chan)
+{
+	return TOTAL_CHANNELS - adc_dev->channels + chan;
+}
+
+static u32 adc_chan_step_mask(struct adc_device *adc_dev, int chan)
+{
+	return TSCADC_STPENB_STEP(adc_chan_step(adc_dev, chan));
+}
+
+/*
+ * One-shot steps with 16x averaging serve sysfs reads; buffered capture
+ * reprograms the same steps for continuous sampling without averaging
+ * or open delay so the converter runs at its full rate.
+ */
+static void adc_step_config(struct adc_device *adc_dev, bool continuous)
+{
+	unsigned int    stepconfig, delay;
+	int i, step;
+
+	if (continuous) {
+		stepconfig = TSCADC_STEPCONFIG_MODE_SWCNT |
+				TSCADC_STEPCONFIG_FIFO1;
+		delay = 0;
+	} else {
+		stepconfig = TSCADC_STEPCONFIG_AVG_16 | TSCADC_STEPCONFIG_FIFO1;
+		delay = TSCADC_STEPCONFIG_OPENDLY;
+	}
+
+	for (i = 0; i < adc_dev->channels; i++) {
+		step = adc_chan_step(adc_dev, i);
+		adc_writel(adc_dev, TSCADC_REG_STEPCONFIG(step), stepconfig |
+				TSCADC_STEPCONFIG_INP_AN(adc_chan_ain(adc_dev, i)));
+		adc_writel(adc_dev, TSCADC_REG_STEPDELAY(step), delay);
+	}
+}
+
+static void adc_fifo_flush(struct adc_device *adc_dev)
+{
+	unsigned int fifo1count;
+
+	fifo1count = adc_readl(adc_dev, TSCADC_REG_FIFO1CNT);
+	while (fifo1count--)
+		adc_readl(adc_dev, TSCADC_REG_FIFO1);
+}
+
+static irqreturn_t tiadc_irq(int irq, void *private)
+{
+	struct adc_device *adc_dev = private;
+	struct iio_buffer *buffer = adc_dev->idev->buffer;
+	unsigned int status, fifo1count, read;
+	int slot;
+
+	status = adc_readl(adc_dev, TSCADC_REG_IRQSTATUS);
+	status &= TSCADC_IRQENB_FIFO1THRES | TSCADC_IRQENB_FIFO1OVRRUN |
+			TSCADC_IRQENB_FIFO1UNDRFLW;
+	if (!status)
+		return IRQ_NONE;
+
+	if (status & (TSCADC_IRQENB_FIFO1OVRRUN | TSCADC_IRQENB_FIFO1UNDRFLW)) {
+		/* samples were lost, drop the partial scan and resync */
+		adc_fifo_flush(adc_dev);
+		adc_dev->scan_pos = 0;
+		goto out;
+	}
+
+	fifo1count = adc_readl(adc_dev, TSCADC_REG_FIFO1CNT);
+	while (fifo1count--) {
+		read = adc_readl(adc_dev, TSCADC_REG_FIFO1);
+		slot = adc_dev->step_slot[TSCADC_FIFO_STEPID(read)];
+
+		/* a scan only starts on its first channel */
+		if (slot != adc_dev->scan_pos) {
+			adc_dev->scan_pos = 0;
+			if (slot != 0)
+				continue;
+		}
+
+		adc_dev->scan[slot] = read & TSCADC_FIFO_DATA;
+		if (++adc_dev->scan_pos == adc_dev->scan_len) {
+			buffer->access->store_to(buffer, (u8 *)adc_dev->scan,
+					iio_get_time_ns());
+			adc_dev->scan_pos = 0;
+		}
+	}
+
+out:
+	adc_writel(adc_dev, TSCADC_REG_IRQSTATUS, status);
+
+	/* check pending interrupts */
+	adc_writel(adc_dev, TSCADC_REG_IRQEOI, 0x0);
+
+	return IRQ_HANDLED;
+}
+
+static int tiadc_buffer_preenable(struct iio_dev *idev)
+{
+	struct adc_device *adc_dev = iio_priv(idev);
+	struct iio_buffer *buffer = idev->buffer;
+	int i, slot = 0;
+
+	if (!buffer->scan_count)
+		return -EINVAL;
+
+	if (buffer->access->set_bytes_per_datum)
+		buffer->access->set_bytes_per_datum(buffer,
+				buffer->scan_count * sizeof(u16));
+
+	/* map each sequencer step to its position in the scan */
+	memset(adc_dev->step_slot, -1, sizeof(adc_dev->step_slot));
+	adc_dev->buffer_step_mask = 0;
+	for (i = 0; i < adc_dev->channels; i++) {
+		if (!test_bit(i, buffer->scan_mask))
+			continue;
+		adc_dev->step_slot[adc_chan_step(adc_dev, i) - 1] = slot++;
+		adc_dev->buffer_step_mask |= adc_chan_step_mask(adc_dev, i);
+	}
+	adc_dev->scan_len = slot;
+	adc_dev->scan_pos = 0;
+
+	return 0;
+}
+
+static int tiadc_buffer_postenable(struct iio_dev *idev)
 {
-	unsigned int    stepconfig;
-	int i, channels = 0, steps;
+	struct adc_device *adc_dev = iio_priv(idev);
+	unsigned int thr;
+
+	adc_step_config(adc_dev, true);
+	adc_fifo_flush(adc_dev);
 
 	/*
-	 * There are 16 configurable steps and 8 analog input
-	 * lines available which are shared between Touchscreen and ADC.
-	 *
-	 * Steps backwards i.e. from 16 towards 0 are used by ADC
-	 * depending on number of input lines needed.
-	 * Channel would represent which analog input
-	 * needs to be given to ADC to digitalize data.
+	 * Interrupt once half the FIFO holds whole scans; the other half
+	 * covers the interrupt latency at the full conversion rate.
 	 */
+	thr = max(TSCADC_FIFO_DEPTH / 2 / adc_dev->scan_len, 1) *
+			adc_dev->scan_len;
+	adc_writel(adc_dev, TSCADC_REG_FIFO1THR, thr - 1);
+	adc_writel(adc_dev, TSCADC_REG_IRQSTATUS, TSCADC_IRQENB_FIFO1THRES |
+			TSCADC_IRQENB_FIFO1OVRRUN | TSCADC_IRQENB_FIFO1UNDRFLW);
+	adc_writel(adc_dev, TSCADC_REG_IRQENABLE, TSCADC_IRQENB_FIFO1THRES |
+			TSCADC_IRQENB_FIFO1OVRRUN | TSCADC_IRQENB_FIFO1UNDRFLW);
 
-	steps = TOTAL_STEPS - adc_dev->channels;
-	channels = TOTAL_CHANNELS - adc_dev->channels;
+	ti_tscadc_se_set(adc_dev->mfd_tscadc, adc_dev->buffer_step_mask);
 
-	stepconfig = TSCADC_STEPCONFIG_AVG_16 | TSCADC_STEPCONFIG_FIFO1;
+	return 0;
+}
 
-	for (i = (steps + 1); i <= TOTAL_STEPS; i++) {
-		adc_writel(adc_dev, TSCADC_REG_STEPCONFIG(i),
-				stepconfig | TSCADC_STEPCONFIG_INP(channels));
-		adc_writel(adc_dev, TSCADC_REG_STEPDELAY(i),
-				TSCADC_STEPCONFIG_OPENDLY);
-		channels++;
-	}
-	adc_writel(adc_dev, TSCADC_REG_SE, TSCADC_STPENB_STEPENB);
+static int tiadc_buffer_predisable(struct iio_dev *idev)
+{
+	struct adc_device *adc_dev = iio_priv(idev);
+
+	ti_tscadc_se_clr(adc_dev->mfd_tscadc, adc_dev->buffer_step_mask);
+	adc_writel(adc_dev, TSCADC_REG_IRQCLR, TSCADC_IRQENB_FIFO1THRES |
+			TSCADC_IRQENB_FIFO1OVRRUN | TSCADC_IRQENB_FIFO1UNDRFLW);
+
+	return 0;
+}
+
+static int tiadc_buffer_postdisable(struct iio_dev *idev)
+{
+	struct adc_device *adc_dev = iio_priv(idev);
+
+	/* a continuous step may have completed after the disable */
+	adc_fifo_flush(adc_dev);
+	adc_step_config(adc_dev, false);
+	adc_dev->buffer_step_mask = 0;
+
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops tiadc_buffer_setup_ops = {
+	.preenable = &tiadc_buffer_preenable,
+	.postenable = &tiadc_buffer_postenable,
+	.predisable = &tiadc_buffer_predisable,
+	.postdisable = &tiadc_buffer_postdisable,
+};
+
+static int tiadc_register_ring_funcs_and_init(struct iio_dev *idev)
+{
+	idev->buffer = iio_sw_rb_allocate(idev);
+	if (!idev->buffer)
+		return -ENOMEM;
+
+	/* Effectively select the ring buffer implementation */
+	idev->buffer->access = &ring_sw_access_funcs;
+
+	/* Ring buffer functions - here FIFO related */
+	idev->buffer->setup_ops = &tiadc_buffer_setup_ops;
+
+	idev->modes |= INDIO_BUFFER_HARDWARE;
+
+	return 0;
 }
 
 static int tiadc_channel_init(struct iio_dev *idev, struct adc_device *adc_dev)
@@ -89,12 +284,14 @@ static int tiadc_channel_init(struct iio_dev *idev, struct adc_device *adc_dev)
 		chan->type = IIO_VOLTAGE;
 		chan->indexed = 1;
 		chan->channel = i;
+		chan->scan_index = i;
 		chan->scan_type.sign = 'u';
 		chan->scan_type.realbits = 12;
-		chan->scan_type.storagebits = 32;
+		chan->scan_type.storagebits = 16;
 		chan->scan_type.shift = 0;
 	}
 
+	adc_dev->chan_array = chan_array;
 	idev->channels = chan_array;
 	return idev->num_channels;
 }
@@ -109,30 +306,53 @@ static int tiadc_read_raw(struct iio_dev *idev,
 		int *val, int *val2, long mask)
 {
 	struct adc_device *adc_dev = iio_priv(idev);
-	int i;
-	unsigned int fifo1count, readx1;
+	unsigned long timeout;
+	unsigned int read;
+	int step_id, ret = -ETIMEDOUT;
+	u32 step_mask;
+
+	mutex_lock(&idev->mlock);
+	if (iio_buffer_enabled(idev)) {
+		mutex_unlock(&idev->mlock);
+		return -EBUSY;
+	}
 
-	fifo1count = adc_readl(adc_dev, TSCADC_REG_FIFO1CNT);
-	for (i = 0; i < fifo1count; i++) {
-		readx1 = adc_readl(adc_dev, TSCADC_REG_FIFO1);
-		if (i == chan->channel) {
-			readx1 = readx1 & 0xfff;
-			*val = readx1;
+	step_id = adc_chan_step(adc_dev, chan->channel) - 1;
+	step_mask = adc_chan_step_mask(adc_dev, chan->channel);
+
+	adc_fifo_flush(adc_dev);
+	ti_tscadc_se_set_once(adc_dev->mfd_tscadc, step_mask);
+
+	timeout = jiffies + msecs_to_jiffies(TIADC_READ_TIMEOUT_MS);
+	do {
+		if (!adc_readl(adc_dev, TSCADC_REG_FIFO1CNT)) {
+			udelay(10);
+			continue;
 		}
-	}
-	adc_writel(adc_dev, TSCADC_REG_SE, TSCADC_STPENB_STEPENB);
-	return IIO_VAL_INT;
+
+		read = adc_readl(adc_dev, TSCADC_REG_FIFO1);
+		if (TSCADC_FIFO_STEPID(read) == step_id) {
+			*val = read & TSCADC_FIFO_DATA;
+			ret = IIO_VAL_INT;
+			break;
+		}
+	} while (time_before(jiffies, timeout));
+	ti_tscadc_se_done(adc_dev->mfd_tscadc, step_mask);
+	mutex_unlock(&idev->mlock);
+
+	return ret;
 }
 
 static const struct iio_info tiadc_info = {
 	.read_raw = &tiadc_read_raw,
+	.driver_module = THIS_MODULE,
 };
 
 static int __devinit tiadc_probe(struct platform_device *pdev)
 {
 	struct iio_dev		*idev;
 	struct adc_device	*adc_dev = NULL;
-	struct ti_tscadc_dev	*tscadc_dev = pdev->dev.platform_data;
+	struct ti_tscadc_dev	*tscadc_dev = ti_tscadc_dev_get(pdev);
 	struct mfd_tscadc_board	*pdata;
 	int			err;
 
@@ -154,31 +374,52 @@ static int __devinit tiadc_probe(struct platform_device *pdev)
 	adc_dev->mfd_tscadc = tscadc_dev;
 	adc_dev->idev = idev;
 	adc_dev->channels = pdata->adc_init->adc_channels;
+	adc_dev->irq = tscadc_dev->irq;
 
 	idev->dev.parent = &pdev->dev;
 	idev->name = dev_name(&pdev->dev);
 	idev->modes = INDIO_DIRECT_MODE;
 	idev->info = &tiadc_info;
 
-	adc_step_config(adc_dev);
+	adc_step_config(adc_dev, false);
 
 	err = tiadc_channel_init(idev, adc_dev);
 	if (err < 0)
+		goto err_free_device;
+
+	err = request_irq(adc_dev->irq, tiadc_irq, IRQF_SHARED,
+				pdev->dev.driver->name, adc_dev);
+	if (err)
 		goto err_cleanup_channels;
 
+	err = tiadc_register_ring_funcs_and_init(idev);
+	if (err)
+		goto err_free_irq;
+
+	err = iio_buffer_register(idev, adc_dev->chan_array,
+			idev->num_channels);
+	if (err)
+		goto err_free_ring;
+
 	err = iio_device_register(idev);
 	if (err)
-		goto err_unregister;
+		goto err_unregister_buffer;
 
 	dev_info(&pdev->dev, "attached adc driver\n");
 	platform_set_drvdata(pdev, idev);
 
 	return 0;
 
-err_unregister:
-	tiadc_channel_remove(idev);
+err_unregister_buffer:
+	iio_buffer_unregister(idev);
+err_free_ring:
+	iio_sw_rb_free(idev->buffer);
+err_free_irq:
+	free_irq(adc_dev->irq, adc_dev);
 err_cleanup_channels:
-	iio_device_unregister(idev);
+	tiadc_channel_remove(idev);
+err_free_device:
+	tscadc_dev->adc = NULL;
 	iio_free_device(idev);
 err_allocate:
 	return err;
@@ -186,11 +427,14 @@ err_allocate:
 
 static int __devexit tiadc_remove(struct platform_device *pdev)
 {
-	struct ti_tscadc_dev	*tscadc_dev = pdev->dev.platform_data;
+	struct ti_tscadc_dev	*tscadc_dev = ti_tscadc_dev_get(pdev);
 	struct adc_device	*adc_dev = tscadc_dev->adc;
 	struct iio_dev		*idev = adc_dev->idev;
 
 	iio_device_unregister(idev);
+	iio_buffer_unregister(idev);
+	iio_sw_rb_free(idev->buffer);
+	free_irq(adc_dev->irq, adc_dev);
 	tiadc_channel_remove(idev);
 
 	tscadc_dev->adc = NULL;
@@ -200,6 +444,32 @@ static int __devexit tiadc_remove(struct platform_device *pdev)
 	return 0;
 }
 
+static int tiadc_suspend(struct platform_device *pdev, pm_message_t state)
+{
+	struct iio_dev *idev = platform_get_drvdata(pdev);
+	struct adc_device *adc_dev = iio_priv(idev);
+
+	if (iio_buffer_enabled(idev))
+		ti_tscadc_se_clr(adc_dev->mfd_tscadc,
+				adc_dev->buffer_step_mask);
+
+	return 0;
+}
+
+static int tiadc_resume(struct platform_device *pdev)
+{
+	struct iio_dev *idev = platform_get_drvdata(pdev);
+	struct adc_device *adc_dev = iio_priv(idev);
+
+	/* context restore; CTRL and CLKDIV are restored by the core */
+	if (iio_buffer_enabled(idev))
+		tiadc_buffer_postenable(idev);
+	else
+		adc_step_config(adc_dev, false);
+
+	return 0;
+}
+
 static struct platform_driver tiadc_driver = {
 	.driver = {
 		.name   = "tiadc",
@@ -207,6 +477,8 @@ static struct platform_driver tiadc_driver = {
 	},
 	.probe          = tiadc_probe,
 	.remove         = __devexit_p(tiadc_remove),
+	.suspend	= tiadc_suspend,
+	.resume		= tiadc_resume,
 };
 
 module_platform_driver(tiadc_driver);
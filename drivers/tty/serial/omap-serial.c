@@ -43,14 +43,29 @@
 #include <plat/dma.h>
 #include <plat/dmtimer.h>
 #include <plat/omap-serial.h>
+#ifdef CONFIG_OMAP3_EDMA
+#include <mach/edma.h>
+#endif
 
 #define DEFAULT_CLK_SPEED 48000000 /* 48Mhz*/
 
 static struct uart_omap_port *ui[OMAP_MAX_HSUART_PORTS];
 
+/*
+ * With RX_TRIG_GRANU1 set in SCR the RX trigger level is TLR[7:4]:FCR[7:6];
+ * the EDMA ring wants a request every OMAP_UART_RXDMA_TRIG bytes.
+ */
+#ifdef CONFIG_OMAP3_EDMA
+#define OMAP_UART_RXDMA_TLR	((OMAP_UART_RXDMA_TRIG >> 2) << 4)
+#else
+#define OMAP_UART_RXDMA_TLR	0
+#endif
+
 /* Forward declaration of functions */
 static void uart_tx_dma_callback(int lch, u16 ch_status, void *data);
+#ifndef CONFIG_OMAP3_EDMA
 static void serial_omap_rxdma_poll(unsigned long uart_no);
+#endif
 static int serial_omap_start_rxdma(struct uart_omap_port *up);
 static void serial_omap_mdr1_errataset(struct uart_omap_port *up, u8 mdr1);
 
@@ -101,6 +116,25 @@ serial_omap_get_divisor(struct uart_port *port, unsigned int baud)
 	return port->uartclk/(baud * divisor);
 }
 
+#ifdef CONFIG_OMAP3_EDMA
+static void serial_omap_stop_rxdma(struct uart_omap_port *up)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+	int i;
+
+	if (dma->rx_dma_used) {
+		del_timer(&dma->rx_timer);
+		edma_stop(dma->rx_dma_channel);
+		edma_free_channel(dma->rx_dma_channel);
+		for (i = 0; i < OMAP_UART_RXDMA_PERIODS; i++)
+			edma_free_slot(dma->rx_ring_slot[i]);
+		dma->rx_dma_channel = OMAP_UART_DMA_CH_FREE;
+		dma->rx_dma_used = false;
+		pm_runtime_mark_last_busy(&up->pdev->dev);
+		pm_runtime_put_autosuspend(&up->pdev->dev);
+	}
+}
+#else
 static void serial_omap_stop_rxdma(struct uart_omap_port *up)
 {
 	if (up->uart_dma.rx_dma_used) {
@@ -113,6 +147,7 @@ static void serial_omap_stop_rxdma(struct uart_omap_port *up)
 		pm_runtime_put_autosuspend(&up->pdev->dev);
 	}
 }
+#endif
 
 static void serial_omap_enable_ms(struct uart_port *port)
 {
@@ -170,12 +205,11 @@ static void serial_omap_stop_rx(struct uart_port *port)
 }
 
 static inline void receive_chars(struct uart_omap_port *up,
-		unsigned int *status)
+		unsigned int *status, int max_count)
 {
 	struct tty_struct *tty = up->port.state->port.tty;
 	unsigned int flag, lsr = *status;
 	unsigned char ch = 0;
-	int max_count = 256;
 
 	do {
 		if (likely(lsr & UART_LSR_DR))
@@ -231,7 +265,7 @@ static inline void receive_chars(struct uart_omap_port *up,
 		uart_insert_char(&up->port, lsr, UART_LSR_OE, ch, flag);
 ignore_char:
 		lsr = serial_in(up, UART_LSR);
-	} while ((lsr & (UART_LSR_DR | UART_LSR_BI)) && (max_count-- > 0));
+	} while ((lsr & (UART_LSR_DR | UART_LSR_BI)) && (--max_count > 0));
 	spin_unlock(&up->port.lock);
 	tty_flip_buffer_push(tty);
 	spin_lock(&up->port.lock);
@@ -369,6 +403,155 @@ static unsigned int check_modem_status(struct uart_omap_port *up)
 	return status;
 }
 
+#ifdef CONFIG_OMAP3_EDMA
+/*
+ * Hand everything between the ring tail and head to the tty in at most
+ * two chunks.  Called with the port lock held, which is dropped around
+ * the flip buffer push as in receive_chars().
+ */
+static void serial_omap_rxdma_push(struct uart_omap_port *up)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+	struct tty_struct *tty = up->port.state->port.tty;
+	unsigned int size = dma->rx_buf_size;
+	unsigned int off, len, copied;
+	u32 pending = dma->rx_head - dma->rx_tail;
+
+	if (!pending)
+		return;
+
+	if (pending > dma->rx_stats.ring_hwm)
+		dma->rx_stats.ring_hwm = min(pending, size);
+	if (pending > size) {
+		/* the DMA lapped us, the oldest data has been overwritten */
+		dma->rx_stats.ring_overruns++;
+		dma->rx_tail = dma->rx_head - size;
+		pending = size;
+	}
+
+	while (pending) {
+		off = dma->rx_tail & (size - 1);
+		len = min(pending, size - off);
+		copied = tty ? tty_insert_flip_string(tty,
+				dma->rx_buf + off, len) : 0;
+		if (copied < len)
+			up->port.icount.buf_overrun += len - copied;
+		up->port.icount.rx += len;
+		dma->rx_stats.dma_bytes += len;
+		dma->rx_tail += len;
+		pending -= len;
+	}
+
+	if (tty) {
+		spin_unlock(&up->port.lock);
+		tty_flip_buffer_push(tty);
+		spin_lock(&up->port.lock);
+	}
+}
+
+/*
+ * RX timeout: the line went quiet with a partial period in the ring and
+ * possibly fewer than OMAP_UART_RXDMA_TRIG bytes left in the FIFO.  DMA
+ * events are held off while the ring position is sampled and the FIFO
+ * tail is read, so the CPU and the DMA never pull the same bytes.
+ */
+static void serial_omap_rxdma_flush(struct uart_omap_port *up,
+		unsigned int *lsr)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+	unsigned int size = dma->rx_buf_size;
+	unsigned int off, level, rx;
+	dma_addr_t dst;
+
+	edma_pause(dma->rx_dma_channel);
+
+	edma_get_position(dma->rx_dma_channel, NULL, &dst);
+	off = dst - dma->rx_buf_dma_phys;
+	dma->rx_head += (off - dma->rx_head) & (size - 1);
+	dma->rx_stats.timeouts++;
+	serial_omap_rxdma_push(up);
+
+	if (*lsr & UART_LSR_OE)
+		up->port.icount.overrun++;
+
+	level = serial_in(up, UART_OMAP_RXFIFO_LVL);
+	if (level && level < OMAP_UART_RXDMA_TRIG) {
+		*lsr = serial_in(up, UART_LSR) & ~UART_LSR_OE;
+		rx = up->port.icount.rx;
+		receive_chars(up, lsr, level);
+		dma->rx_stats.pio_bytes += up->port.icount.rx - rx;
+
+		/* an event latched meanwhile would read an empty FIFO */
+		if (serial_in(up, UART_OMAP_RXFIFO_LVL) <
+				OMAP_UART_RXDMA_TRIG)
+			edma_clear_event(dma->rx_dma_channel);
+	}
+
+	edma_resume(dma->rx_dma_channel);
+}
+
+static void serial_omap_rxdma_irq(struct uart_omap_port *up,
+		unsigned int iir, unsigned int *lsr)
+{
+	unsigned int id = iir & OMAP_UART_IIR_ID_MASK;
+
+	if (!up->uart_dma.rx_dma_used) {
+		if (*lsr & UART_LSR_DR)
+			receive_chars(up, lsr, 256);
+		return;
+	}
+
+	/*
+	 * A trigger level interrupt means a burst started and the DMA owns
+	 * the FIFO.  RHR_IT also gates the RX timeout interrupt, so while it
+	 * is masked rx_timer flushes the tail and unmasks it once the line
+	 * goes quiet.
+	 */
+	if (id == UART_IIR_RDI) {
+		up->ier &= ~UART_IER_RDI;
+		serial_out(up, UART_IER, up->ier);
+		mod_timer(&up->uart_dma.rx_timer, jiffies +
+			usecs_to_jiffies(up->uart_dma.rx_poll_rate));
+	} else if (id == UART_IIR_RLSI || id == OMAP_UART_IIR_RX_TIMEOUT) {
+		serial_omap_rxdma_flush(up, lsr);
+	}
+}
+
+static void serial_omap_rxdma_timer(unsigned long data)
+{
+	struct uart_omap_port *up = (struct uart_omap_port *)data;
+	struct uart_omap_dma *dma = &up->uart_dma;
+	unsigned long flags;
+	unsigned int lsr;
+	u32 head;
+
+	spin_lock_irqsave(&up->port.lock, flags);
+	if (dma->rx_dma_used) {
+		head = dma->rx_head;
+		lsr = serial_in(up, UART_LSR);
+		serial_omap_rxdma_flush(up, &lsr);
+		if (dma->rx_head != head) {
+			mod_timer(&dma->rx_timer, jiffies +
+				usecs_to_jiffies(dma->rx_poll_rate));
+		} else {
+			up->ier |= UART_IER_RDI;
+			serial_out(up, UART_IER, up->ier);
+		}
+	}
+	spin_unlock_irqrestore(&up->port.lock, flags);
+}
+#else
+static void serial_omap_rxdma_irq(struct uart_omap_port *up,
+		unsigned int iir, unsigned int *lsr)
+{
+	up->ier &= ~(UART_IER_RDI | UART_IER_RLSI);
+	serial_out(up, UART_IER, up->ier);
+	if ((serial_omap_start_rxdma(up) != 0) &&
+			(*lsr & UART_LSR_DR))
+		receive_chars(up, lsr, 256);
+}
+#endif
+
 /**
  * serial_omap_irq() - This handles the interrupt from one port
  * @irq: uart port irq number
@@ -385,7 +568,8 @@ static inline irqreturn_t serial_omap_irq(int irq, void *dev_id)
 	if (iir & UART_IIR_NO_INT) {
 		pm_runtime_mark_last_busy(&up->pdev->dev);
 		pm_runtime_put_autosuspend(&up->pdev->dev);
-		return IRQ_NONE;
+		/* the RX DMA may have drained the FIFO since the trigger */
+		return up->uart_dma.rx_dma_used ? IRQ_HANDLED : IRQ_NONE;
 	}
 
 	spin_lock_irqsave(&up->port.lock, flags);
@@ -393,14 +577,9 @@ static inline irqreturn_t serial_omap_irq(int irq, void *dev_id)
 	if (iir & UART_IIR_RLSI) {
 		if (!up->use_dma) {
 			if (lsr & UART_LSR_DR)
-				receive_chars(up, &lsr);
-		} else {
-			up->ier &= ~(UART_IER_RDI | UART_IER_RLSI);
-			serial_out(up, UART_IER, up->ier);
-			if ((serial_omap_start_rxdma(up) != 0) &&
-					(lsr & UART_LSR_DR))
-				receive_chars(up, &lsr);
-		}
+				receive_chars(up, &lsr, 256);
+		} else
+			serial_omap_rxdma_irq(up, iir, &lsr);
 	}
 
 	check_modem_status(up);
@@ -547,13 +726,23 @@ static int serial_omap_startup(struct uart_port *port)
 			UART_XMIT_SIZE,
 			(dma_addr_t *)&(up->uart_dma.tx_buf_dma_phys),
 			0);
+#ifndef CONFIG_OMAP3_EDMA
 		init_timer(&(up->uart_dma.rx_timer));
 		up->uart_dma.rx_timer.function = serial_omap_rxdma_poll;
 		up->uart_dma.rx_timer.data = up->port.line;
+#else
+		setup_timer(&up->uart_dma.rx_timer, serial_omap_rxdma_timer,
+			    (unsigned long)up);
+#endif
 		/* Currently the buffer size is 4KB. Can increase it */
 		up->uart_dma.rx_buf = dma_alloc_coherent(NULL,
 			up->uart_dma.rx_buf_size,
 			(dma_addr_t *)&(up->uart_dma.rx_buf_dma_phys), 0);
+#ifdef CONFIG_OMAP3_EDMA
+		/* the ring runs for as long as the port is open */
+		if (serial_omap_start_rxdma(up))
+			dev_warn(up->port.dev, "no RX DMA, receiving by PIO\n");
+#endif
 	}
 	/*
 	 * Finally, enable interrupts. Note: Modem status interrupts
@@ -608,6 +797,7 @@ static void serial_omap_shutdown(struct uart_port *port)
 			up->uart_dma.tx_buf_dma_phys);
 		up->port.state->xmit.buf = NULL;
 		serial_omap_stop_rx(port);
+		del_timer_sync(&up->uart_dma.rx_timer);
 		dma_free_coherent(up->port.dev,
 			up->uart_dma.rx_buf_size, up->uart_dma.rx_buf,
 			up->uart_dma.rx_buf_dma_phys);
@@ -737,8 +927,13 @@ serial_omap_set_termios(struct uart_port *port, struct ktermios *termios,
 
 	up->fcr = UART_FCR_R_TRIG_01 | UART_FCR_T_TRIG_01 |
 			UART_FCR_ENABLE_FIFO;
-	if (up->use_dma)
+	if (up->use_dma) {
 		up->fcr |= UART_FCR_DMA_SELECT;
+#ifdef CONFIG_OMAP3_EDMA
+		/* RX trigger comes from TLR, see OMAP_UART_RXDMA_TLR */
+		up->fcr &= ~UART_FCR_R_TRIG_11;
+#endif
+	}
 
 	/*
 	 * Ok, we're now changing the port state. Do it with
@@ -815,7 +1010,7 @@ serial_omap_set_termios(struct uart_port *port, struct ktermios *termios,
 	serial_out(up, UART_LCR, UART_LCR_CONF_MODE_B);
 
 	if (up->use_dma) {
-		serial_out(up, UART_TI752_TLR, 0);
+		serial_out(up, UART_TI752_TLR, OMAP_UART_RXDMA_TLR);
 		up->scr |= (UART_FCR_TRIGGER_4 | UART_FCR_TRIGGER_8);
 	}
 
@@ -1183,6 +1378,98 @@ static int serial_omap_resume(struct device *dev)
 }
 #endif
 
+#ifdef CONFIG_OMAP3_EDMA
+static void serial_omap_rxdma_callback(unsigned lch, u16 ch_status,
+		void *data)
+{
+	struct uart_omap_port *up = data;
+	struct uart_omap_dma *dma = &up->uart_dma;
+	unsigned long flags;
+	u32 head;
+
+	if (ch_status != DMA_COMPLETE) {
+		dev_err(up->port.dev, "RX DMA error %d\n", ch_status);
+		return;
+	}
+
+	spin_lock_irqsave(&up->port.lock, flags);
+	if (dma->rx_dma_used) {
+		dma->rx_stats.periods++;
+		dma->rx_periods_done++;
+		head = dma->rx_periods_done * dma->rx_period_len;
+		/* a timeout flush may already have gone past this period */
+		if ((s32)(head - dma->rx_head) > 0)
+			dma->rx_head = head;
+		serial_omap_rxdma_push(up);
+	}
+	spin_unlock_irqrestore(&up->port.lock, flags);
+	up->port_activity = jiffies;
+}
+
+/*
+ * The RX buffer is a ring of OMAP_UART_RXDMA_PERIODS PaRAM sets linked in
+ * a circle, so the channel runs for as long as the port is open and the
+ * CPU is only involved on period completions and RX timeouts.  Each DMA
+ * event moves OMAP_UART_RXDMA_TRIG bytes (AB-synchronized).
+ */
+static int serial_omap_start_rxdma(struct uart_omap_port *up)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+	struct edmacc_param param;
+	int ch, slot, i;
+
+	if (dma->rx_dma_used)
+		return 0;
+	if (!dma->rx_buf)
+		return -ENOMEM;
+
+	ch = edma_alloc_channel(dma->uart_dma_rx, serial_omap_rxdma_callback,
+			up, EVENTQ_2);
+	if (ch < 0)
+		return ch;
+
+	for (i = 0; i < OMAP_UART_RXDMA_PERIODS; i++) {
+		slot = edma_alloc_slot(EDMA_CTLR(ch), EDMA_SLOT_ANY);
+		if (slot < 0) {
+			while (i--)
+				edma_free_slot(dma->rx_ring_slot[i]);
+			edma_free_channel(ch);
+			return slot;
+		}
+		dma->rx_ring_slot[i] = slot;
+	}
+
+	dma->rx_period_len = dma->rx_buf_size / OMAP_UART_RXDMA_PERIODS;
+	for (i = 0; i < OMAP_UART_RXDMA_PERIODS; i++) {
+		param.opt = TCINTEN | EDMA_TCC(EDMA_CHAN_SLOT(ch)) | SYNCDIM;
+		param.src = dma->uart_base;
+		param.a_b_cnt = 1 | OMAP_UART_RXDMA_TRIG << 16;
+		param.dst = dma->rx_buf_dma_phys + i * dma->rx_period_len;
+		param.src_dst_bidx = 1 << 16;
+		param.link_bcntrld = 0xffff;
+		param.src_dst_cidx = OMAP_UART_RXDMA_TRIG << 16;
+		param.ccnt = dma->rx_period_len / OMAP_UART_RXDMA_TRIG;
+		edma_write_slot(dma->rx_ring_slot[i], &param);
+	}
+	for (i = 0; i < OMAP_UART_RXDMA_PERIODS; i++)
+		edma_link(dma->rx_ring_slot[i], dma->rx_ring_slot[
+				(i + 1) % OMAP_UART_RXDMA_PERIODS]);
+
+	/* the channel starts on a copy of period 0 and then follows the ring */
+	edma_read_slot(dma->rx_ring_slot[0], &param);
+	edma_write_slot(ch, &param);
+
+	dma->rx_dma_channel = ch;
+	dma->rx_periods_done = 0;
+	dma->rx_head = 0;
+	dma->rx_tail = 0;
+
+	pm_runtime_get_sync(&up->pdev->dev);
+	dma->rx_dma_used = true;
+	edma_start(ch);
+	return 0;
+}
+#else
 static void serial_omap_rxdma_poll(unsigned long uart_no)
 {
 	struct uart_omap_port *up = ui[uart_no];
@@ -1267,6 +1554,7 @@ static int serial_omap_start_rxdma(struct uart_omap_port *up)
 	up->uart_dma.rx_dma_used = true;
 	return ret;
 }
+#endif
 
 static void serial_omap_continue_tx(struct uart_omap_port *up)
 {
@@ -1339,6 +1627,40 @@ static struct omap_uart_port_info *of_get_uart_port_info(struct device *dev)
 	return omap_up_info;
 }
 
+#ifdef CONFIG_OMAP3_EDMA
+static ssize_t serial_omap_show_rx_dma_stats(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct uart_omap_port *up = dev_get_drvdata(dev);
+	struct uart_omap_rxdma_stats stats;
+	unsigned long flags;
+	u32 pending;
+
+	spin_lock_irqsave(&up->port.lock, flags);
+	stats = up->uart_dma.rx_stats;
+	pending = up->uart_dma.rx_head - up->uart_dma.rx_tail;
+	spin_unlock_irqrestore(&up->port.lock, flags);
+
+	return sprintf(buf, "periods:       %lu\n"
+			"timeouts:      %lu\n"
+			"dma bytes:     %lu\n"
+			"pio bytes:     %lu\n"
+			"ring size:     %u\n"
+			"ring pending:  %u\n"
+			"ring hwm:      %u\n"
+			"ring overruns: %lu\n"
+			"uart overruns: %u\n"
+			"tty overruns:  %u\n",
+			stats.periods, stats.timeouts, stats.dma_bytes,
+			stats.pio_bytes, up->uart_dma.rx_buf_size, pending,
+			stats.ring_hwm, stats.ring_overruns,
+			up->port.icount.overrun, up->port.icount.buf_overrun);
+}
+
+static DEVICE_ATTR(rx_dma_stats, S_IRUGO, serial_omap_show_rx_dma_stats,
+		NULL);
+#endif
+
 static int serial_omap_probe(struct platform_device *pdev)
 {
 	struct uart_omap_port	*up;
@@ -1436,6 +1758,12 @@ static int serial_omap_probe(struct platform_device *pdev)
 		spin_lock_init(&(up->uart_dma.rx_lock));
 		up->uart_dma.tx_dma_channel = OMAP_UART_DMA_CH_FREE;
 		up->uart_dma.rx_dma_channel = OMAP_UART_DMA_CH_FREE;
+#ifdef CONFIG_OMAP3_EDMA
+		/* ring positions wrap with the free running byte counts */
+		up->uart_dma.rx_buf_size = rounddown_pow_of_two(
+			max_t(unsigned int, up->uart_dma.rx_buf_size,
+			      OMAP_UART_RXDMA_PERIODS * OMAP_UART_RXDMA_TRIG));
+#endif
 	}
 
 	up->latency = PM_QOS_CPU_DMA_LAT_DEFAULT_VALUE;
@@ -1462,6 +1790,12 @@ static int serial_omap_probe(struct platform_device *pdev)
 
 	pm_runtime_put(&pdev->dev);
 	platform_set_drvdata(pdev, up);
+
+#ifdef CONFIG_OMAP3_EDMA
+	if (up->use_dma && device_create_file(&pdev->dev,
+				&dev_attr_rx_dma_stats))
+		dev_warn(&pdev->dev, "failed to create rx_dma_stats\n");
+#endif
 	return 0;
 err:
 	dev_err(&pdev->dev, "[UART%d]: failure [%s]: %d\n",
@@ -1476,6 +1810,10 @@ static int serial_omap_remove(struct platform_device *dev)
 	struct uart_omap_port *up = platform_get_drvdata(dev);
 
 	if (up) {
+#ifdef CONFIG_OMAP3_EDMA
+		if (up->use_dma)
+			device_remove_file(&dev->dev, &dev_attr_rx_dma_stats);
+#endif
 		pm_runtime_disable(&up->pdev->dev);
 		uart_remove_one_port(&serial_omap_reg, &up->port);
 		pm_qos_remove_request(&up->pm_qos_request);
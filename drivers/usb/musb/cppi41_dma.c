@@ -22,6 +22,8 @@
 #include <linux/errno.h>
 #include <linux/dma-mapping.h>
 #include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "cppi41.h"
 
@@ -34,6 +36,8 @@
 #define USB_CPPI41_DESC_ALIGN	(1 << USB_CPPI41_DESC_SIZE_SHIFT)
 #define USB_CPPI41_CH_NUM_PD	128	/* 4K bulk data at full speed */
 #define USB_CPPI41_MAX_PD	(USB_CPPI41_CH_NUM_PD * (USB_CPPI41_NUM_CH+1))
+#define USB_CPPI41_RX_MAX_BATCH	8	/* max Rx PDs per channel */
+#define USB_CPPI41_GRNDIS_MAX_LEN 0x10000 /* max Generic RNDIS EP size */
 
 #undef DEBUG_CPPI_TD
 #undef USBDRV_DEBUG
@@ -99,11 +103,15 @@ struct cppi41_channel {
 	u8  transfer_mode;
 	u8  zlp_queued;
 	u8  inf_mode;
-	u8  tx_complete;
 	u8  hb_mult;
 	u8  txf_complete;
 	u8  txfifo_intr_enable;
-	u8  count;
+	u8  tx_complete;		/* Tx FIFO drain left to txdma_work */
+	u16 pd_queued;			/* Rx PDs not completed yet */
+
+	/* Statistics, see cppi41_stats_show() */
+	u32 nr_xfers;
+	u64 nr_bytes;
 };
 
 /**
@@ -118,9 +126,13 @@ struct cppi41 {
 
 	struct cppi41_channel tx_cppi_ch[USB_CPPI41_NUM_CH];
 	struct cppi41_channel rx_cppi_ch[USB_CPPI41_NUM_CH];
-	struct work_struct      txdma_work;
 
 	struct usb_pkt_desc *pd_pool_head; /* Free PD pool head */
+	u32 pd_free;			/* PDs in the free pool */
+	u32 pd_min_free;		/* low watermark of pd_free */
+	u32 pd_starved;			/* usb_get_free_pd() failures */
+	unsigned long stats_start;	/* jiffies at last statistics reset */
+	struct dentry *debugfs;
 	dma_addr_t pd_mem_phys;		/* PD memory physical address */
 	void *pd_mem;			/* PD memory pointer */
 	u8 pd_mem_rgn;			/* PD memory region number */
@@ -136,6 +148,7 @@ struct cppi41 {
 	u32 bd_size;
 	u8  inf_mode;
 	u8  txfifo_intr_enable;		/* txfifo empty interrupt logic */
+	struct work_struct txdma_work;	/* Tx FIFO drain, cppi41_tx_complete */
 };
 
 struct usb_cppi41_info usb_cppi41_info[2];
@@ -165,7 +178,10 @@ static struct usb_pkt_desc *usb_get_free_pd(struct cppi41 *cppi)
 	if (free_pd != NULL) {
 		cppi->pd_pool_head = free_pd->next_pd_ptr;
 		free_pd->next_pd_ptr = NULL;
-	}
+		if (--cppi->pd_free < cppi->pd_min_free)
+			cppi->pd_min_free = cppi->pd_free;
+	} else
+		cppi->pd_starved++;
 	return free_pd;
 }
 
@@ -173,6 +189,7 @@ static void usb_put_free_pd(struct cppi41 *cppi, struct usb_pkt_desc *free_pd)
 {
 	free_pd->next_pd_ptr = cppi->pd_pool_head;
 	cppi->pd_pool_head = free_pd;
+	cppi->pd_free++;
 }
 
 /**
@@ -263,6 +280,9 @@ static int __devinit cppi41_controller_start(struct dma_controller *controller)
 						  USB_CPPI41_DESC_ALIGN);
 		pd_addr += USB_CPPI41_DESC_ALIGN;
 	}
+	cppi->pd_min_free = cppi->pd_free;
+	cppi->pd_starved = 0;
+	cppi->stats_start = jiffies;
 
 	/* Configure the Tx channels */
 	for (i = 0, cppi_ch = cppi->tx_cppi_ch;
@@ -363,6 +383,7 @@ static int cppi41_controller_stop(struct dma_controller *controller)
 	cppi->pd_mem = 0;
 	cppi->pd_mem_phys = 0;
 	cppi->pd_pool_head = 0;
+	cppi->pd_free = 0;
 	cppi->bd_size = 0;
 
 	reg_base = cppi->musb->ctrl_base;
@@ -750,6 +771,17 @@ static void cppi41_set_ep_size(struct cppi41_channel *rx_ch, u32 pkt_size)
  * an IRQ per packet.  (The lack of I/O overlap can be slightly ameliorated by
  * enabling double buffering.)
  *
+ * In the peripheral mode the Generic RNDIS mode lets us do better: as long as
+ * every BD queued has the size programmed into the EP Size register, each of
+ * them is closed either by a short packet or by the EP size being reached, so
+ * a batch of 64KB BDs can be queued at once with a single IRQ per BD.  The
+ * tail of the transfer gets its own BD (and EP size) after the batch is done.
+ * When a short packet ends the transfer early, the BDs left over in the free
+ * descriptor/buffer queue are taken back by cppi41_rx_reclaim_pds().
+ * Batching only kicks in for transfers of 64KB and more.  The gadget network
+ * functions queue one MTU sized request at a time, and each request is a
+ * transfer of its own, so they still get a single BD and IRQ per request.
+ *
  * There seems to be no way to identify for sure the cases where the CDC mode
  * is appropriate...
  *
@@ -801,9 +833,23 @@ static unsigned cppi41_next_rx_segment(struct cppi41_channel *rx_ch)
 				max_rx_transfer_size = rx_ch->pkt_size;
 				mode = USB_TRANSPARENT_MODE;
 			}
+		} else if (pkt_size & 0x3f) {
+			max_rx_transfer_size = rx_ch->pkt_size;
+			mode = USB_TRANSPARENT_MODE;
+		} else if (length >= USB_CPPI41_GRNDIS_MAX_LEN) {
+			/* Batch as many full sized BDs as we may */
+			pkt_len = USB_CPPI41_GRNDIS_MAX_LEN;
+			i = 0;
+			if (rx_ch->pd_queued < USB_CPPI41_RX_MAX_BATCH)
+				i = min_t(u32, length / pkt_len,
+					  USB_CPPI41_RX_MAX_BATCH -
+					  rx_ch->pd_queued);
+			length = i * pkt_len;
+		} else if (rx_ch->pd_queued) {
+			/* Can't shrink the EP size under the queued BDs */
+			return 1;
 		} else
-			if (rx_ch->length < max_rx_transfer_size)
-				pkt_len = rx_ch->length;
+			pkt_len = length;
 
 		if (mode != USB_TRANSPARENT_MODE)
 			cppi41_set_ep_size(rx_ch, pkt_len);
@@ -867,8 +913,10 @@ static unsigned cppi41_next_rx_segment(struct cppi41_channel *rx_ch)
 		curr_pd->ch_num = rx_ch->ch_num;
 		curr_pd->ep_num = rx_ch->end_pt->epnum;
 
-		curr_pd->eop = (length -= pkt_len) ? 0 : 1;
+		length -= pkt_len;
 		rx_ch->curr_offset += pkt_len;
+		/* A batch may end short of the transfer, keep it scheduled */
+		curr_pd->eop = !length && rx_ch->curr_offset >= rx_ch->length;
 
 		if (en_bd_intr)
 			hw_desc->orig_buf_len |= CPPI41_PKT_INTR_FLAG;
@@ -882,6 +930,7 @@ static unsigned cppi41_next_rx_segment(struct cppi41_channel *rx_ch)
 		 */
 		cppi41_queue_push(&rx_ch->queue_obj, curr_pd->dma_addr,
 			USB_CPPI41_DESC_ALIGN, 0);
+		rx_ch->pd_queued++;
 	}
 
 sched:
@@ -1325,6 +1374,7 @@ static int cppi41_channel_abort(struct dma_channel *channel)
 		dprintk("Returning PD %p to the free PD list\n", curr_pd);
 		usb_put_free_pd(cppi, curr_pd);
 	}
+	cppi_ch->pd_queued = 0;
 
 #ifdef DEBUG_CPPI_TD
 	printk("After teardown:");
@@ -1339,71 +1389,6 @@ static int cppi41_channel_abort(struct dma_channel *channel)
 	return 0;
 }
 
-void txdma_completion_work(struct work_struct *data)
-{
-	struct cppi41 *cppi = container_of(data, struct cppi41, txdma_work);
-	struct cppi41_channel *tx_ch;
-	struct musb *musb = cppi->musb;
-	unsigned index;
-	u8 resched = 0;
-	unsigned long flags;
-
-	while (1) {
-		for (index = 0; index < USB_CPPI41_NUM_CH; index++) {
-			void __iomem *epio;
-			u16 csr;
-
-			tx_ch = &cppi->tx_cppi_ch[index];
-			if (tx_ch->tx_complete) {
-				/* Sometimes a EP can unregister from a DMA
-				 * channel while the data is still in the FIFO.
-				 * Probable reason a proper abort was not
-				 * called before taking such a step.
-				 * Protect against such cases.
-				 */
-				if (!tx_ch->end_pt) {
-					tx_ch->tx_complete = 0;
-					tx_ch->count = 0;
-					continue;
-				}
-
-				epio = tx_ch->end_pt->regs;
-				csr = musb_readw(epio, MUSB_TXCSR);
-
-				if (!tx_ch->txfifo_intr_enable &&
-					(csr & (MUSB_TXCSR_TXPKTRDY |
-					MUSB_TXCSR_FIFONOTEMPTY))) {
-					resched = 1;
-				} else {
-					if (tx_ch->count > 0) {
-						tx_ch->count--;
-						resched = 1;
-						continue;
-					}
-					tx_ch->channel.status =
-						MUSB_DMA_STATUS_FREE;
-					tx_ch->tx_complete = 0;
-					spin_lock_irqsave(&musb->lock, flags);
-					musb_dma_completion(musb, index+1, 1);
-					spin_unlock_irqrestore(&musb->lock,
-						flags);
-				}
-			}
-
-			if (!resched)
-				cond_resched();
-		}
-
-		if (resched) {
-			resched = 0;
-			cond_resched();
-		} else {
-			return ;
-		}
-	}
-
-}
-
 void cppi41_handle_txfifo_intr(struct musb *musb, u16 usbintr)
 {
 	struct cppi41 *cppi;
@@ -1436,6 +1421,163 @@ void cppi41_handle_txfifo_intr(struct musb *musb, u16 usbintr)
 }
 EXPORT_SYMBOL(cppi41_handle_txfifo_intr);
 
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *cppi41_debugfs_root;
+
+static void cppi41_ch_stats_show(struct seq_file *s, struct cppi41_channel *ch,
+				 unsigned msecs)
+{
+	u64 kbps = ch->nr_bytes * 8;
+
+	if (!ch->nr_xfers && !ch->nr_bytes)
+		return;
+
+	do_div(kbps, msecs ? msecs : 1);
+	seq_printf(s, "ep%u %cx: %u xfers, %llu bytes, %llu kbit/s\n",
+		   ch->ch_num + 1, ch->transmit ? 'T' : 'R', ch->nr_xfers,
+		   (unsigned long long)ch->nr_bytes, (unsigned long long)kbps);
+}
+
+/*
+ * Free PD pool usage and the throughput of each channel since the statistics
+ * were last reset (by writing anything to the file).  Reset, run iperf over
+ * the gadget Ethernet link, then read the file to see what the DMA did.
+ */
+static int cppi41_stats_show(struct seq_file *s, void *unused)
+{
+	struct cppi41 *cppi = s->private;
+	struct musb *musb = cppi->musb;
+	unsigned long flags;
+	unsigned msecs, i;
+
+	spin_lock_irqsave(&musb->lock, flags);
+
+	msecs = jiffies_to_msecs(jiffies - cppi->stats_start);
+	seq_printf(s, "free PDs: %u/%u, min %u, starved %u\n",
+		   cppi->pd_free, USB_CPPI41_MAX_PD, cppi->pd_min_free,
+		   cppi->pd_starved);
+	seq_printf(s, "elapsed: %u ms\n", msecs);
+
+	for (i = 0; i < USB_CPPI41_NUM_CH; i++)
+		cppi41_ch_stats_show(s, &cppi->tx_cppi_ch[i], msecs);
+	for (i = 0; i < USB_CPPI41_NUM_CH; i++)
+		cppi41_ch_stats_show(s, &cppi->rx_cppi_ch[i], msecs);
+
+	spin_unlock_irqrestore(&musb->lock, flags);
+	return 0;
+}
+
+static int cppi41_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cppi41_stats_show, inode->i_private);
+}
+
+static ssize_t cppi41_stats_write(struct file *file,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct cppi41 *cppi = s->private;
+	struct musb *musb = cppi->musb;
+	unsigned long flags;
+	unsigned i;
+
+	spin_lock_irqsave(&musb->lock, flags);
+
+	for (i = 0; i < USB_CPPI41_NUM_CH; i++) {
+		cppi->tx_cppi_ch[i].nr_xfers = 0;
+		cppi->tx_cppi_ch[i].nr_bytes = 0;
+		cppi->rx_cppi_ch[i].nr_xfers = 0;
+		cppi->rx_cppi_ch[i].nr_bytes = 0;
+	}
+	cppi->pd_min_free = cppi->pd_free;
+	cppi->pd_starved = 0;
+	cppi->stats_start = jiffies;
+
+	spin_unlock_irqrestore(&musb->lock, flags);
+	return count;
+}
+
+static const struct file_operations cppi41_stats_fops = {
+	.open			= cppi41_stats_open,
+	.write			= cppi41_stats_write,
+	.read			= seq_read,
+	.llseek			= seq_lseek,
+	.release		= single_release,
+};
+
+static void cppi41_init_debugfs(struct cppi41 *cppi)
+{
+	struct dentry *file;
+
+	file = debugfs_create_file(dev_name(cppi->musb->controller),
+				   S_IRUGO | S_IWUSR, cppi41_debugfs_root,
+				   cppi, &cppi41_stats_fops);
+	if (!IS_ERR(file))
+		cppi->debugfs = file;
+}
+
+static void cppi41_exit_debugfs(struct cppi41 *cppi)
+{
+	debugfs_remove(cppi->debugfs);
+}
+#else
+static inline void cppi41_init_debugfs(struct cppi41 *cppi)
+{
+}
+
+static inline void cppi41_exit_debugfs(struct cppi41 *cppi)
+{
+}
+#endif
+
+static int cppi41_txfifo_busy(struct cppi41_channel *tx_ch)
+{
+	u16 csr = musb_readw(tx_ch->end_pt->regs, MUSB_TXCSR);
+
+	return csr & (MUSB_TXCSR_TXPKTRDY | MUSB_TXCSR_FIFONOTEMPTY);
+}
+
+/*
+ * Give back the Tx requests whose FIFO had not drained yet when their last
+ * PD completed.  Only used when there is no Tx FIFO empty interrupt to wait
+ * for (txfifo_intr_enable is clear).
+ */
+static void cppi41_txdma_work(struct work_struct *work)
+{
+	struct cppi41 *cppi = container_of(work, struct cppi41, txdma_work);
+	struct musb *musb = cppi->musb;
+	struct cppi41_channel *tx_ch;
+	unsigned long flags;
+	unsigned index;
+	int busy;
+
+	do {
+		busy = 0;
+		spin_lock_irqsave(&musb->lock, flags);
+		for (index = 0; index < USB_CPPI41_NUM_CH; index++) {
+			tx_ch = &cppi->tx_cppi_ch[index];
+			if (!tx_ch->tx_complete)
+				continue;
+
+			/* The EP may have been released in the meantime */
+			if (tx_ch->end_pt && cppi41_txfifo_busy(tx_ch)) {
+				busy = 1;
+				continue;
+			}
+
+			tx_ch->tx_complete = 0;
+			if (!tx_ch->end_pt)
+				continue;
+			tx_ch->channel.status = MUSB_DMA_STATUS_FREE;
+			musb_dma_completion(musb, index + 1, 1);
+		}
+		spin_unlock_irqrestore(&musb->lock, flags);
+
+		if (busy)
+			cond_resched();
+	} while (busy);
+}
+
 /**
  * cppi41_dma_controller_create -
  * instantiate an object representing DMA controller.
@@ -1460,7 +1602,7 @@ cppi41_dma_controller_create(struct musb  *musb, void __iomem *mregs)
 	cppi->cppi_info = (struct usb_cppi41_info *)&usb_cppi41_info[musb->id];;
 	cppi->en_bd_intr = cppi->cppi_info->bd_intr_ctrl;
 	cppi->txfifo_intr_enable = musb->txfifo_intr_enable;
-	INIT_WORK(&cppi->txdma_work, txdma_completion_work);
+	INIT_WORK(&cppi->txdma_work, cppi41_txdma_work);
 
 	/*
 	 * Extra IN token has been seen when a file is transferred from one MSC
@@ -1482,6 +1624,8 @@ cppi41_dma_controller_create(struct musb  *musb, void __iomem *mregs)
 		cppi->inf_mode = 1;
 	}
 
+	cppi41_init_debugfs(cppi);
+
 	return &cppi->controller;
 }
 EXPORT_SYMBOL(cppi41_dma_controller_create);
@@ -1497,11 +1641,58 @@ void cppi41_dma_controller_destroy(struct dma_controller *controller)
 
 	cppi = container_of(controller, struct cppi41, controller);
 
+	cppi41_exit_debugfs(cppi);
+	cancel_work_sync(&cppi->txdma_work);
+
 	/* Free the CPPI object */
 	kfree(cppi);
 }
 EXPORT_SYMBOL(cppi41_dma_controller_destroy);
 
+/*
+ * We get Tx DMA completion interrupt even when data is still in FIFO and not
+ * moved out to USB bus.  As we program the next request we flush out any old
+ * data in FIFO, which affects USB functionality (so far, we have observed
+ * failures with iperf), so the request can only be given back once the FIFO
+ * is empty.  Unless it already is, let the Tx FIFO empty interrupt tell us,
+ * or leave it to txdma_work if there is no such thing.
+ *
+ * Context: controller IRQ-locked
+ */
+static void cppi41_tx_complete(struct cppi41 *cppi,
+			       struct cppi41_channel *tx_ch)
+{
+	struct musb *musb = cppi->musb;
+	u8 ep_num = tx_ch->ch_num + 1;
+
+	if (cppi->txfifo_intr_enable && cppi41_txfifo_busy(tx_ch)) {
+		tx_ch->txfifo_intr_enable = 1;
+		tx_ch->txf_complete = 1;
+		txfifoempty_int_enable(musb, ep_num);
+
+		/* The FIFO may have drained before the IRQ got unmasked */
+		if (cppi41_txfifo_busy(tx_ch)) {
+			dev_dbg(musb->controller,
+				"wait for TxF-EmptyIntr ep%d\n", ep_num);
+			return;
+		}
+
+		txfifoempty_int_disable(musb, ep_num);
+		tx_ch->txf_complete = 0;
+		tx_ch->txfifo_intr_enable = 0;
+	}
+
+	/* Without the Tx FIFO empty interrupt, txdma_work waits instead */
+	if (!cppi->txfifo_intr_enable && cppi41_txfifo_busy(tx_ch)) {
+		tx_ch->tx_complete = 1;
+		schedule_work(&cppi->txdma_work);
+		return;
+	}
+
+	tx_ch->channel.status = MUSB_DMA_STATUS_FREE;
+	musb_dma_completion(musb, ep_num, 1);
+}
+
 static void usb_process_tx_queue(struct cppi41 *cppi, unsigned index)
 {
 	struct cppi41_queue_obj tx_queue_obj;
@@ -1535,6 +1726,7 @@ static void usb_process_tx_queue(struct cppi41 *cppi, unsigned index)
 
 		tx_ch = &cppi->tx_cppi_ch[ch_num];
 		tx_ch->channel.actual_len += length;
+		tx_ch->nr_bytes += length;
 
 		/*
 		 * Return Tx PD to the software list --
@@ -1546,49 +1738,50 @@ static void usb_process_tx_queue(struct cppi41 *cppi, unsigned index)
 		    (tx_ch->transfer_mode && !tx_ch->zlp_queued))
 			cppi41_next_tx_segment(tx_ch);
 		else if (tx_ch->channel.actual_len >= tx_ch->length) {
-			void __iomem *epio;
-			u16 csr;
-
-			/*
-			 * We get Tx DMA completion interrupt even when
-			 * data is still in FIFO and not moved out to
-			 * USB bus. As we program the next request we
-			 * flush out and old data in FIFO which affects
-			 * USB functionality. So far, we have obsered
-			 * failure with iperf.
-			 */
-			/* wait for tx fifo empty completion interrupt
-			 * if enabled other wise use the workthread
-			 * to poll fifo empty status
-			 */
-			epio = tx_ch->end_pt->regs;
-			csr = musb_readw(epio, MUSB_TXCSR);
+			tx_ch->nr_xfers++;
 
+			/* wait for tx fifo empty completion interrupt */
 			if (tx_ch->txfifo_intr_enable) {
 				tx_ch->txf_complete = 1;
 				dev_dbg(musb->controller,
 				"wait for TxF-EmptyIntr ep%d\n", ep_num);
-			} else {
-				int residue;
-
-				residue = tx_ch->channel.actual_len %
-						tx_ch->pkt_size;
-
-				if (tx_ch->pkt_size > 128 && !residue) {
-					tx_ch->channel.status =
-						MUSB_DMA_STATUS_FREE;
-					musb_dma_completion(cppi->musb,
-						ep_num, 1);
-				} else {
-					tx_ch->tx_complete = 1;
-					tx_ch->count = 1;
-					schedule_work(&cppi->txdma_work);
-				}
-			}
+			} else
+				cppi41_tx_complete(cppi, tx_ch);
 		}
 	}
 }
 
+/*
+ * A short packet may end a transfer while some of its BDs are still sitting in
+ * the free descriptor/buffer queue; take them back before the next transfer is
+ * programmed, or the DMA would fill their stale buffers.
+ *
+ * Context: controller IRQ-locked
+ */
+static void cppi41_rx_reclaim_pds(struct cppi41 *cppi,
+				  struct cppi41_channel *rx_ch)
+{
+	unsigned long pd_addr;
+
+	/* Keep the DMA from fetching one of them meanwhile */
+	if (is_peripheral_active(cppi->musb))
+		cppi41_schedtbl_remove_dma_ch(0, 0, rx_ch->ch_num, 0);
+
+	while ((pd_addr = cppi41_queue_pop(&rx_ch->queue_obj)) != 0) {
+		struct usb_pkt_desc *curr_pd;
+
+		curr_pd = usb_get_pd_ptr(cppi, pd_addr);
+		if (curr_pd == NULL) {
+			ERR("Invalid PD popped from Rx free queue\n");
+			continue;
+		}
+
+		usb_put_free_pd(cppi, curr_pd);
+		if (rx_ch->pd_queued)
+			rx_ch->pd_queued--;
+	}
+}
+
 static void usb_process_rx_queue(struct cppi41 *cppi, unsigned index)
 {
 	struct cppi41_queue_obj rx_queue_obj;
@@ -1640,6 +1833,9 @@ static void usb_process_rx_queue(struct cppi41 *cppi, unsigned index)
 
 		rx_ch = &cppi->rx_cppi_ch[ch_num];
 		rx_ch->channel.actual_len += length;
+		rx_ch->nr_bytes += length;
+		if (rx_ch->pd_queued)
+			rx_ch->pd_queued--;
 
 		if (curr_pd->eop) {
 			curr_pd->eop = 0;
@@ -1673,7 +1869,7 @@ static void usb_process_rx_queue(struct cppi41 *cppi, unsigned index)
 			/* Workaround for early rx completion of
 			 * cppi41 dma in Generic RNDIS mode for ti81xx
 			 */
-			if (is_host_enabled(cppi->musb)) {
+			if (is_host_active(cppi->musb)) {
 				u32 pkt_size = rx_ch->pkt_size;
 				ep = cppi->musb->endpoints + ep_num;
 				isoc = musb_readb(ep->regs, MUSB_RXTYPE);
@@ -1692,6 +1888,10 @@ static void usb_process_rx_queue(struct cppi41 *cppi, unsigned index)
 #endif
 			{
 				rx_ch->channel.status = MUSB_DMA_STATUS_FREE;
+				rx_ch->nr_xfers++;
+
+				if (rx_ch->pd_queued)
+					cppi41_rx_reclaim_pds(cppi, rx_ch);
 
 				if (rx_ch->inf_mode) {
 					cppi41_rx_ch_set_maxbufcnt(
@@ -1740,11 +1940,19 @@ MODULE_LICENSE("GPL v2");
 
 static int __init cppi41_dma_init(void)
 {
+#ifdef CONFIG_DEBUG_FS
+	cppi41_debugfs_root = debugfs_create_dir("cppi41_dma", NULL);
+	if (IS_ERR(cppi41_debugfs_root))
+		cppi41_debugfs_root = NULL;
+#endif
 	return 0;
 }
 module_init(cppi41_dma_init);
 
 static void __exit cppi41_dma__exit(void)
 {
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove(cppi41_debugfs_root);
+#endif
 }
 module_exit(cppi41_dma__exit);
@@ -35,9 +35,14 @@
 #include <linux/delay.h>
 #include <linux/pm_runtime.h>
 #include <linux/lcm.h>
+#include <linux/mutex.h>
+#include <linux/completion.h>
 #include <video/da8xx-fb.h>
 #include <asm/mach-types.h>
 #include <asm/div64.h>
+#ifdef CONFIG_OMAP3_EDMA
+#include <mach/edma.h>
+#endif
 
 #define DRIVER_NAME "da8xx_lcdc"
 
@@ -127,6 +132,11 @@
 #define  LCD_CLK_MAIN_RESET			BIT(3)
 
 #define LCD_NUM_BUFFERS	2
+#define LCD_MAX_BUFFERS	3
+
+/* Below this many bytes a drawing op is cheaper on the CPU than by EDMA */
+#define LCD_DMA_MIN_BYTES	4096
+#define LCD_DMA_TIMEOUT		(HZ / 10)
 
 #define WSI_TIMEOUT	50
 #define PALETTE_SIZE	256
@@ -142,6 +152,11 @@ static struct resource *lcdc_regs;
 static unsigned int lcd_revision;
 static irq_handler_t lcdc_irq_handler;
 
+static unsigned int num_buffers = LCD_NUM_BUFFERS;
+module_param(num_buffers, uint, 0444);
+MODULE_PARM_DESC(num_buffers, "Number of frame buffers for page flipping "
+		"(1-3, default 2)");
+
 static inline unsigned int lcdc_read(unsigned int addr)
 {
 	return (unsigned int)readl(da8xx_fb_reg_base + (addr));
@@ -177,6 +192,21 @@ struct da8xx_fb_par {
 	 * and channel 1.
 	 */
 	unsigned int		which_dma_channel_done;
+	/* frame start each channel scans next, see lcd_end_of_frame() */
+	unsigned int		chan_start[2];
+	int			flip_pending;
+#ifdef CONFIG_OMAP3_EDMA
+	/* EDMA channel for fb_fillrect/fb_copyarea/fb_imageblit */
+	int			edma_ch;
+	struct completion	edma_done;
+	struct mutex		edma_lock;
+	u16			edma_status;
+	/* one line of the current fill colour, source of fb_fillrect */
+	void			*fill_virt;
+	dma_addr_t		fill_phys;
+	u32			fill_color;
+	int			fill_valid;
+#endif
 #ifdef CONFIG_CPU_FREQ
 	struct notifier_block	freq_transition;
 	unsigned int		lcd_fck_rate;
@@ -432,6 +462,8 @@ static void lcd_blit(int load_mode, struct da8xx_fb_par *par)
 		lcdc_write(end, LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG);
 		lcdc_write(start, LCD_DMA_FRM_BUF_BASE_ADDR_1_REG);
 		lcdc_write(end, LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
+		par->chan_start[0] = start;
+		par->chan_start[1] = start;
 	} else if (load_mode == LOAD_PALETTE) {
 		start    = par->p_palette_base;
 		end      = start + par->palette_sz - 1;
@@ -864,6 +896,37 @@ int unregister_vsync_cb(vsync_callback_t handler, void *arg, int idx)
 }
 EXPORT_SYMBOL(unregister_vsync_cb);
 
+/*
+ * DMA channel @chan has finished its frame and the other channel is now
+ * scanning out.  Point @chan at the latest panned buffer; it is picked
+ * up when the other channel's frame ends.  A pan is complete, and the
+ * previous front buffer free for drawing, once the channel now scanning
+ * already shows the new buffer.
+ */
+static void lcd_end_of_frame(struct da8xx_fb_par *par, int chan)
+{
+	static const unsigned int base_reg[2] = {
+		LCD_DMA_FRM_BUF_BASE_ADDR_0_REG,
+		LCD_DMA_FRM_BUF_BASE_ADDR_1_REG,
+	};
+	static const unsigned int ceiling_reg[2] = {
+		LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG,
+		LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG,
+	};
+
+	spin_lock(&par->lock_for_chan_update);
+	par->which_dma_channel_done = chan;
+	lcdc_write(par->dma_start, base_reg[chan]);
+	lcdc_write(par->dma_end, ceiling_reg[chan]);
+	par->chan_start[chan] = par->dma_start;
+	if (par->flip_pending && par->chan_start[!chan] == par->dma_start)
+		par->flip_pending = 0;
+	spin_unlock(&par->lock_for_chan_update);
+
+	par->vsync_flag = 1;
+	wake_up_interruptible(&par->vsync_wait);
+}
+
 /* IRQ handler for version 2 of LCDC */
 static irqreturn_t lcdc_irq_handler_rev02(int irq, void *arg)
 {
@@ -898,25 +961,13 @@ static irqreturn_t lcdc_irq_handler_rev02(int irq, void *arg)
 		lcdc_write(stat, LCD_MASKED_STAT_REG);
 
 		if (stat & LCD_END_OF_FRAME0) {
-			par->which_dma_channel_done = 0;
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_0_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
+			lcd_end_of_frame(par, 0);
 			if (vsync_cb_handler)
 				vsync_cb_handler(vsync_cb_arg);
 		}
 
 		if (stat & LCD_END_OF_FRAME1) {
-			par->which_dma_channel_done = 1;
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_1_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
+			lcd_end_of_frame(par, 1);
 			if (vsync_cb_handler)
 				vsync_cb_handler(vsync_cb_arg);
 		}
@@ -961,23 +1012,11 @@ static irqreturn_t lcdc_irq_handler_rev01(int irq, void *arg)
 	} else {
 		lcdc_write(stat, LCD_STAT_REG);
 
-		if (stat & LCD_END_OF_FRAME0) {
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_0_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
-		}
+		if (stat & LCD_END_OF_FRAME0)
+			lcd_end_of_frame(par, 0);
 
-		if (stat & LCD_END_OF_FRAME1) {
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_1_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
-		}
+		if (stat & LCD_END_OF_FRAME1)
+			lcd_end_of_frame(par, 1);
 	}
 
 	return IRQ_HANDLED;
@@ -1082,6 +1121,262 @@ static inline void lcd_da8xx_cpufreq_deregister(struct da8xx_fb_par *par)
 }
 #endif
 
+#ifdef CONFIG_OMAP3_EDMA
+static void lcd_edma_callback(unsigned lch, u16 ch_status, void *data)
+{
+	struct da8xx_fb_par *par = data;
+
+	par->edma_status = ch_status;
+	complete(&par->edma_done);
+}
+
+/*
+ * Move @bcnt lines of @acnt bytes in a single AB-synchronized EDMA
+ * transfer and sleep until it is done.  Returns 0 on success, in which
+ * case the caller must not fall back to the CPU.
+ */
+static int lcd_edma_2d(struct da8xx_fb_par *par, dma_addr_t src, s16 src_bidx,
+		dma_addr_t dst, s16 dst_bidx, u16 acnt, u16 bcnt)
+{
+	struct edmacc_param param;
+
+	param.opt          = EDMA_TCC(EDMA_CHAN_SLOT(par->edma_ch)) |
+			     TCINTEN | SYNCDIM;
+	param.src          = src;
+	param.a_b_cnt      = acnt | bcnt << 16;
+	param.dst          = dst;
+	param.src_dst_bidx = (u16)src_bidx | (u16)dst_bidx << 16;
+	param.link_bcntrld = 0xffff;
+	param.src_dst_cidx = 0;
+	param.ccnt         = 1;
+	edma_write_slot(par->edma_ch, &param);
+
+	INIT_COMPLETION(par->edma_done);
+	/* CPU writes to the write-combined frame buffer must land first */
+	wmb();
+	edma_start(par->edma_ch);
+
+	if (!wait_for_completion_timeout(&par->edma_done, LCD_DMA_TIMEOUT) ||
+	    par->edma_status != DMA_COMPLETE) {
+		edma_stop(par->edma_ch);
+		edma_clean_channel(par->edma_ch);
+		if (printk_ratelimit())
+			dev_warn(par->dev, "EDMA blit failed\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * EDMA is used for large operations from process context only.  fbcon
+ * also draws from printk() with interrupts off, and small glyph-sized
+ * operations finish on the CPU before a transfer could be set up.
+ */
+static bool lcd_edma_usable(struct fb_info *info, u32 bytes)
+{
+	struct da8xx_fb_par *par = info->par;
+
+	return par->edma_ch >= 0 && bytes >= LCD_DMA_MIN_BYTES &&
+		info->var.bits_per_pixel >= 8 &&
+		info->fix.line_length <= SHRT_MAX &&
+		!irqs_disabled() && !in_atomic() &&
+		info->state == FBINFO_STATE_RUNNING;
+}
+
+static dma_addr_t lcd_fb_dma_addr(struct fb_info *info, u32 x, u32 y)
+{
+	return info->fix.smem_start + y * info->fix.line_length +
+		x * (info->var.bits_per_pixel / 8);
+}
+
+/* Replicate @color over one line of the fill source buffer */
+static void lcd_fill_line(struct da8xx_fb_par *par, struct fb_info *info,
+		u32 color)
+{
+	unsigned int bpp = info->var.bits_per_pixel / 8;
+	u8 *line = par->fill_virt;
+	unsigned int i;
+
+	if (par->fill_valid && par->fill_color == color)
+		return;
+
+	for (i = 0; i + bpp <= info->fix.line_length; i += bpp) {
+		switch (bpp) {
+		case 4:
+			*(u32 *)(line + i) = color;
+			break;
+		case 3:
+			line[i] = color;
+			line[i + 1] = color >> 8;
+			line[i + 2] = color >> 16;
+			break;
+		case 2:
+			*(u16 *)(line + i) = color;
+			break;
+		default:
+			line[i] = color;
+		}
+	}
+
+	par->fill_color = color;
+	par->fill_valid = 1;
+}
+
+static void da8xx_fb_fillrect(struct fb_info *info,
+		const struct fb_fillrect *rect)
+{
+	struct da8xx_fb_par *par = info->par;
+	u32 acnt = rect->width * (info->var.bits_per_pixel / 8);
+	u32 color = rect->color;
+
+	if (rect->rop != ROP_COPY || !rect->width || !rect->height ||
+	    !lcd_edma_usable(info, acnt * rect->height) ||
+	    rect->dx + rect->width > info->var.xres_virtual ||
+	    rect->dy + rect->height > info->var.yres_virtual)
+		goto cpu;
+
+	if (info->fix.visual == FB_VISUAL_TRUECOLOR ||
+	    info->fix.visual == FB_VISUAL_DIRECTCOLOR)
+		color = ((u32 *)info->pseudo_palette)[rect->color];
+
+	mutex_lock(&par->edma_lock);
+	lcd_fill_line(par, info, color);
+	/* source index 0 repeats the same colour line for every row */
+	if (!lcd_edma_2d(par, par->fill_phys, 0,
+			lcd_fb_dma_addr(info, rect->dx, rect->dy),
+			info->fix.line_length, acnt, rect->height)) {
+		mutex_unlock(&par->edma_lock);
+		return;
+	}
+	mutex_unlock(&par->edma_lock);
+cpu:
+	cfb_fillrect(info, rect);
+}
+
+static void da8xx_fb_copyarea(struct fb_info *info,
+		const struct fb_copyarea *area)
+{
+	struct da8xx_fb_par *par = info->par;
+	u32 acnt = area->width * (info->var.bits_per_pixel / 8);
+	s16 bidx = info->fix.line_length;
+	u32 sy = area->sy, dy = area->dy;
+	int ret;
+
+	/*
+	 * Each line is copied front to back, so lines that overlap
+	 * horizontally on the same row are left to the CPU.  Vertical
+	 * overlap is handled by walking the rows bottom up.
+	 */
+	if (!area->width || !area->height ||
+	    !lcd_edma_usable(info, acnt * area->height) ||
+	    (area->sy == area->dy && area->dx != area->sx &&
+	     abs((int)area->dx - (int)area->sx) < area->width))
+		goto cpu;
+
+	if (area->dy > area->sy) {
+		sy += area->height - 1;
+		dy += area->height - 1;
+		bidx = -bidx;
+	}
+
+	mutex_lock(&par->edma_lock);
+	ret = lcd_edma_2d(par, lcd_fb_dma_addr(info, area->sx, sy), bidx,
+			lcd_fb_dma_addr(info, area->dx, dy), bidx,
+			acnt, area->height);
+	mutex_unlock(&par->edma_lock);
+	if (!ret)
+		return;
+cpu:
+	cfb_copyarea(info, area);
+}
+
+/*
+ * Only images that are already in frame buffer format, i.e. palette
+ * indices on a pseudocolour display, can be copied as is.  Monochrome
+ * glyphs need colour expansion and truecolour images a palette lookup
+ * per pixel, both done by cfb_imageblit.
+ */
+static void da8xx_fb_imageblit(struct fb_info *info,
+		const struct fb_image *image)
+{
+	struct da8xx_fb_par *par = info->par;
+	u32 acnt = image->width * (info->var.bits_per_pixel / 8);
+	u32 len = acnt * image->height;
+	dma_addr_t src;
+	int ret;
+
+	if (image->depth != info->var.bits_per_pixel ||
+	    info->fix.visual != FB_VISUAL_PSEUDOCOLOR ||
+	    !virt_addr_valid(image->data) || !lcd_edma_usable(info, len))
+		goto cpu;
+
+	src = dma_map_single(par->dev, (void *)image->data, len,
+			DMA_TO_DEVICE);
+	if (dma_mapping_error(par->dev, src))
+		goto cpu;
+
+	mutex_lock(&par->edma_lock);
+	ret = lcd_edma_2d(par, src, acnt,
+			lcd_fb_dma_addr(info, image->dx, image->dy),
+			info->fix.line_length, acnt, image->height);
+	mutex_unlock(&par->edma_lock);
+	dma_unmap_single(par->dev, src, len, DMA_TO_DEVICE);
+	if (!ret)
+		return;
+cpu:
+	cfb_imageblit(info, image);
+}
+
+static void lcd_edma_init(struct da8xx_fb_par *par, unsigned int line_length)
+{
+	par->edma_ch = -1;
+	init_completion(&par->edma_done);
+	mutex_init(&par->edma_lock);
+
+	par->fill_virt = dma_alloc_coherent(NULL, line_length,
+			&par->fill_phys, GFP_KERNEL);
+	if (!par->fill_virt)
+		goto err;
+
+	par->edma_ch = edma_alloc_channel(EDMA_CHANNEL_ANY, lcd_edma_callback,
+			par, EVENTQ_2);
+	if (par->edma_ch < 0) {
+		dma_free_coherent(NULL, line_length, par->fill_virt,
+				par->fill_phys);
+		goto err;
+	}
+
+	return;
+err:
+	par->edma_ch = -1;
+	dev_warn(par->dev, "no EDMA channel, drawing with the CPU\n");
+}
+
+static void lcd_edma_exit(struct da8xx_fb_par *par, unsigned int line_length)
+{
+	if (par->edma_ch < 0)
+		return;
+
+	edma_free_channel(par->edma_ch);
+	dma_free_coherent(NULL, line_length, par->fill_virt, par->fill_phys);
+}
+#else
+#define da8xx_fb_fillrect	cfb_fillrect
+#define da8xx_fb_copyarea	cfb_copyarea
+#define da8xx_fb_imageblit	cfb_imageblit
+
+static inline void lcd_edma_init(struct da8xx_fb_par *par,
+		unsigned int line_length)
+{
+}
+
+static inline void lcd_edma_exit(struct da8xx_fb_par *par,
+		unsigned int line_length)
+{
+}
+#endif /* CONFIG_OMAP3_EDMA */
+
 static int __devexit fb_remove(struct platform_device *dev)
 {
 	struct fb_info *info = dev_get_drvdata(&dev->dev);
@@ -1102,6 +1397,7 @@ static int __devexit fb_remove(struct platform_device *dev)
 		lcdc_write(0, LCD_DMA_CTRL_REG);
 
 		unregister_framebuffer(info);
+		lcd_edma_exit(par, info->fix.line_length);
 		fb_dealloc_cmap(&info->cmap);
 		dma_free_coherent(NULL, PALETTE_SIZE, par->v_palette_base,
 				  par->p_palette_base);
@@ -1138,11 +1434,20 @@ static int fb_wait_for_vsync(struct fb_info *info)
 	 * to wait long at all. Either way we are guaranteed to return to the
 	 * user immediately after a frame completion which is all that is
 	 * required.
+	 *
+	 * After a pan, wait for the flip instead: when it completes the new
+	 * buffer is on screen and the previous one may be drawn into.
 	 */
-	par->vsync_flag = 0;
-	ret = wait_event_interruptible_timeout(par->vsync_wait,
-					       par->vsync_flag != 0,
-					       par->vsync_timeout);
+	if (par->flip_pending) {
+		ret = wait_event_interruptible_timeout(par->vsync_wait,
+						       !par->flip_pending,
+						       par->vsync_timeout);
+	} else {
+		par->vsync_flag = 0;
+		ret = wait_event_interruptible_timeout(par->vsync_wait,
+						       par->vsync_flag != 0,
+						       par->vsync_timeout);
+	}
 	if (ret < 0)
 		return ret;
 	if (ret == 0)
@@ -1217,6 +1522,8 @@ static int cfb_blank(int blank, struct fb_info *info)
 			par->panel_power_ctrl(0);
 
 		lcd_disable_raster(WAIT_FOR_FRAME_DONE);
+		par->flip_pending = 0;
+		wake_up_interruptible(&par->vsync_wait);
 		break;
 	default:
 		ret = -EINVAL;
@@ -1254,23 +1561,34 @@ static int da8xx_pan_display(struct fb_var_screeninfo *var,
 				new_var.yoffset * fix->line_length +
 				new_var.xoffset * fbi->var.bits_per_pixel / 8;
 			end	= start + fbi->var.yres * fix->line_length - 1;
-			par->dma_start	= start;
-			par->dma_end	= end;
 			spin_lock_irqsave(&par->lock_for_chan_update,
 					irq_flags);
+			par->dma_start	= start;
+			par->dma_end	= end;
+			/* the raster is off, no end of frame will latch it */
+			par->flip_pending = par->blank == FB_BLANK_UNBLANK;
 			if (par->which_dma_channel_done == 0) {
 				lcdc_write(par->dma_start,
 					   LCD_DMA_FRM_BUF_BASE_ADDR_0_REG);
 				lcdc_write(par->dma_end,
 					   LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG);
+				par->chan_start[0] = start;
 			} else if (par->which_dma_channel_done == 1) {
 				lcdc_write(par->dma_start,
 					   LCD_DMA_FRM_BUF_BASE_ADDR_1_REG);
 				lcdc_write(par->dma_end,
 					   LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
+				par->chan_start[1] = start;
 			}
 			spin_unlock_irqrestore(&par->lock_for_chan_update,
 					irq_flags);
+
+			/* FB_ACTIVATE_VBL: return once the flip is visible */
+			if (var->activate & FB_ACTIVATE_VBL &&
+			    !wait_event_interruptible_timeout(par->vsync_wait,
+						!par->flip_pending,
+						par->vsync_timeout))
+				ret = -ETIMEDOUT;
 		}
 	}
 
@@ -1283,9 +1601,9 @@ static struct fb_ops da8xx_fb_ops = {
 	.fb_setcolreg = fb_setcolreg,
 	.fb_pan_display = da8xx_pan_display,
 	.fb_ioctl = fb_ioctl,
-	.fb_fillrect = cfb_fillrect,
-	.fb_copyarea = cfb_copyarea,
-	.fb_imageblit = cfb_imageblit,
+	.fb_fillrect = da8xx_fb_fillrect,
+	.fb_copyarea = da8xx_fb_copyarea,
+	.fb_imageblit = da8xx_fb_imageblit,
 	.fb_blank = cfb_blank,
 };
 
@@ -1418,7 +1736,8 @@ static int __devinit fb_probe(struct platform_device *device)
 	par->vram_size = lcdc_info->width * lcdc_info->height * lcd_cfg->bpp;
 	ulcm = lcm((lcdc_info->width * lcd_cfg->bpp)/8, PAGE_SIZE);
 	par->vram_size = roundup(par->vram_size/8, ulcm);
-	par->vram_size = par->vram_size * LCD_NUM_BUFFERS;
+	num_buffers = clamp_t(unsigned int, num_buffers, 1, LCD_MAX_BUFFERS);
+	par->vram_size = par->vram_size * num_buffers;
 
 	par->vram_virt = dma_alloc_coherent(NULL,
 					    par->vram_size,
@@ -1467,7 +1786,7 @@ static int __devinit fb_probe(struct platform_device *device)
 	da8xx_fb_var.xres_virtual = lcdc_info->width;
 
 	da8xx_fb_var.yres         = lcdc_info->height;
-	da8xx_fb_var.yres_virtual = lcdc_info->height * LCD_NUM_BUFFERS;
+	da8xx_fb_var.yres_virtual = lcdc_info->height * num_buffers;
 
 	da8xx_fb_var.grayscale =
 	    lcd_cfg->p_disp_panel->panel_shade == MONOCHROME ? 1 : 0;
@@ -1508,6 +1827,8 @@ static int __devinit fb_probe(struct platform_device *device)
 	par->which_dma_channel_done = -1;
 	spin_lock_init(&par->lock_for_chan_update);
 
+	lcd_edma_init(par, da8xx_fb_fix.line_length);
+
 	/* Register the Frame Buffer  */
 	if (register_framebuffer(da8xx_fb_info) < 0) {
 		dev_err(&device->dev,
@@ -1543,6 +1864,7 @@ err_cpu_freq:
 	unregister_framebuffer(da8xx_fb_info);
 
 err_dealloc_cmap:
+	lcd_edma_exit(par, da8xx_fb_fix.line_length);
 	fb_dealloc_cmap(&da8xx_fb_info->cmap);
 
 err_release_pl_mem:
@@ -23,6 +23,9 @@
 
 #include <linux/types.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/sched.h>
+#include <linux/err.h>
 #include <linux/slab.h>
 #include <linux/buffer_head.h>
 
@@ -83,34 +86,213 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
-void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
+/*
+ * Each mounted filesystem owns a pool of decompressor streams.  A block is
+ * decompressed using whichever stream is free, so readers no longer queue
+ * behind a single stream while another reader (possibly preempted) is in
+ * the middle of a long block.  Streams are created on demand, up to
+ * msblk->max_streams, and extra streams are freed as they are returned if
+ * the limit is lowered on remount.
+ */
+struct squashfs_stream {
+	void			*comp_opts;
+	int			comp_opts_len;
+	int			streams;
+	struct mutex		mutex;
+	struct list_head	free_list;
+	wait_queue_head_t	wait;
+};
+
+struct decomp_stream {
+	void			*stream;
+	struct list_head	list;
+};
+
+
+static struct decomp_stream *alloc_decomp_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *pool)
+{
+	struct decomp_stream *decomp;
+
+	decomp = kmalloc(sizeof(*decomp), GFP_KERNEL);
+	if (decomp == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	decomp->stream = msblk->decompressor->init(msblk, pool->comp_opts,
+		pool->comp_opts_len);
+	if (IS_ERR(decomp->stream)) {
+		int err = PTR_ERR(decomp->stream);
+
+		kfree(decomp);
+		return ERR_PTR(err);
+	}
+
+	return decomp;
+}
+
+
+static void free_decomp_stream(struct squashfs_sb_info *msblk,
+	struct decomp_stream *decomp)
+{
+	msblk->decompressor->free(decomp->stream);
+	kfree(decomp);
+}
+
+
+static struct decomp_stream *get_decomp_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *pool)
+{
+	struct decomp_stream *decomp;
+
+	while (1) {
+		mutex_lock(&pool->mutex);
+
+		if (!list_empty(&pool->free_list)) {
+			decomp = list_entry(pool->free_list.next,
+				struct decomp_stream, list);
+			list_del(&decomp->list);
+			mutex_unlock(&pool->mutex);
+			return decomp;
+		}
+
+		if (pool->streams < msblk->max_streams) {
+			/*
+			 * Reserve the slot and allocate outside the mutex,
+			 * the other streams may be returned meanwhile.
+			 */
+			pool->streams++;
+			mutex_unlock(&pool->mutex);
+
+			decomp = alloc_decomp_stream(msblk, pool);
+			if (!IS_ERR(decomp))
+				return decomp;
+
+			/* Out of memory, wait for an existing stream */
+			mutex_lock(&pool->mutex);
+			pool->streams--;
+		}
+
+		mutex_unlock(&pool->mutex);
+
+		wait_event(pool->wait, !list_empty(&pool->free_list));
+	}
+}
+
+
+static void put_decomp_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *pool, struct decomp_stream *decomp)
+{
+	mutex_lock(&pool->mutex);
+
+	if (pool->streams > msblk->max_streams) {
+		pool->streams--;
+		mutex_unlock(&pool->mutex);
+		free_decomp_stream(msblk, decomp);
+		return;
+	}
+
+	list_add(&decomp->list, &pool->free_list);
+	mutex_unlock(&pool->mutex);
+	wake_up(&pool->wait);
+}
+
+
+int squashfs_decompressor_create(struct super_block *sb, unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
-	void *strm, *buffer = NULL;
-	int length = 0;
+	struct squashfs_stream *pool;
+	struct decomp_stream *decomp;
+	int err;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (pool == NULL)
+		return -ENOMEM;
+
+	mutex_init(&pool->mutex);
+	INIT_LIST_HEAD(&pool->free_list);
+	init_waitqueue_head(&pool->wait);
 
 	/*
-	 * Read decompressor specific options from file system if present
+	 * Read decompressor specific options from file system if present.
+	 * They are kept for the lifetime of the mount, as streams are
+	 * created on demand.
 	 */
 	if (SQUASHFS_COMP_OPTS(flags)) {
-		buffer = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
-		if (buffer == NULL)
-			return ERR_PTR(-ENOMEM);
+		pool->comp_opts = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
+		if (pool->comp_opts == NULL) {
+			err = -ENOMEM;
+			goto failed;
+		}
 
-		length = squashfs_read_data(sb, &buffer,
+		pool->comp_opts_len = squashfs_read_data(sb, &pool->comp_opts,
 			sizeof(struct squashfs_super_block), 0, NULL,
 			PAGE_CACHE_SIZE, 1);
 
-		if (length < 0) {
-			strm = ERR_PTR(length);
-			goto finished;
+		if (pool->comp_opts_len < 0) {
+			err = pool->comp_opts_len;
+			goto failed;
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	/* The first stream is allocated now, so a mount can always read */
+	decomp = alloc_decomp_stream(msblk, pool);
+	if (IS_ERR(decomp)) {
+		err = PTR_ERR(decomp);
+		goto failed;
+	}
+
+	list_add(&decomp->list, &pool->free_list);
+	pool->streams = 1;
+	msblk->stream = pool;
+
+	return 0;
+
+failed:
+	kfree(pool->comp_opts);
+	kfree(pool);
+	return err;
+}
+
+
+void squashfs_decompressor_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *pool = msblk->stream;
+	struct decomp_stream *decomp, *next;
+
+	if (pool == NULL)
+		return;
+
+	list_for_each_entry_safe(decomp, next, &pool->free_list, list) {
+		list_del(&decomp->list);
+		free_decomp_stream(msblk, decomp);
+	}
+
+	kfree(pool->comp_opts);
+	kfree(pool);
+	msblk->stream = NULL;
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk, void **buffer,
+	struct buffer_head **bh, int b, int offset, int length, int srclength,
+	int pages)
+{
+	struct squashfs_stream *pool = msblk->stream;
+	struct decomp_stream *decomp;
+	int res;
+
+	if (unlikely(pool == NULL)) {
+		/* The compressor options block is always stored uncompressed */
+		ERROR("compressed block read before decompressor set up\n");
+		for (res = 0; res < b; res++)
+			put_bh(bh[res]);
+		return -EIO;
+	}
 
-finished:
-	kfree(buffer);
+	decomp = get_decomp_stream(msblk, pool);
+	res = msblk->decompressor->decompress(msblk, decomp->stream, buffer,
+		bh, b, offset, length, srclength, pages);
+	put_decomp_stream(msblk, pool, decomp);
 
-	return strm;
+	return res;
 }
@@ -371,6 +371,96 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress a datablock straight into the page cache pages it covers,
+ * rather than into the read_page cache and copying out.  This is only
+ * possible if all of the other pages can be grabbed without blocking and
+ * none of them are already up to date, otherwise -EAGAIN is returned and
+ * the caller falls back to the read_page cache.  The page being read is
+ * left locked.
+ */
+static int squashfs_readpage_block(struct page *target_page, u64 block,
+	int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = min_t(int, start_index | mask,
+		(i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT);
+	int pages = end_index - start_index + 1;
+	int i, bytes, res = -EAGAIN;
+	struct page **page;
+	void **pageaddr;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	pageaddr = kcalloc(pages, sizeof(*pageaddr), GFP_KERNEL);
+	if (page == NULL || pageaddr == NULL)
+		goto out;
+
+	for (i = 0; i < pages; i++) {
+		if (start_index + i == target_page->index) {
+			page[i] = target_page;
+			continue;
+		}
+
+		page[i] = grab_cache_page_nowait(target_page->mapping,
+			start_index + i);
+		if (page[i] == NULL)
+			goto release_pages;
+
+		if (PageUptodate(page[i])) {
+			i++;
+			goto release_pages;
+		}
+	}
+
+	for (i = 0; i < pages; i++)
+		pageaddr[i] = kmap(page[i]);
+
+	/*
+	 * The block can't decompress to more than the pages it covers, so
+	 * bound the source length by them.  This also stops a corrupt block
+	 * overrunning the page array.
+	 */
+	res = squashfs_read_data(inode->i_sb, pageaddr, block, bsize, NULL,
+		pages << PAGE_CACHE_SHIFT, pages);
+
+	for (i = 0; i < pages; i++) {
+		if (res >= 0) {
+			bytes = clamp_t(int, res - (i << PAGE_CACHE_SHIFT), 0,
+				PAGE_CACHE_SIZE);
+			memset(pageaddr[i] + bytes, 0, PAGE_CACHE_SIZE - bytes);
+		}
+		kunmap(page[i]);
+		if (res >= 0) {
+			flush_dcache_page(page[i]);
+			SetPageUptodate(page[i]);
+		}
+		if (page[i] != target_page) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+		}
+	}
+
+	if (res >= 0)
+		res = 0;
+	goto out;
+
+release_pages:
+	while (i--) {
+		if (page[i] && page[i] != target_page) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+		}
+	}
+out:
+	kfree(pageaddr);
+	kfree(page);
+	return res;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -410,8 +500,17 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Read and decompress datablock, directly into the
+			 * page cache if possible.
 			 */
+			int res = squashfs_readpage_block(page, block, bsize);
+
+			if (res == 0) {
+				unlock_page(page);
+				return 0;
+			} else if (res != -EAGAIN)
+				goto error_out;
+
 			buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
 			if (buffer->error) {
@@ -24,6 +24,8 @@
  */
 
 #define SQUASHFS_CACHED_FRAGMENTS	CONFIG_SQUASHFS_FRAGMENT_CACHE_SIZE
+#define SQUASHFS_DECOMP_STREAMS		CONFIG_SQUASHFS_DECOMP_STREAMS
+#define SQUASHFS_MAX_DECOMP_STREAMS	16
 #define SQUASHFS_MAJOR			4
 #define SQUASHFS_MINOR			0
 #define SQUASHFS_START			0
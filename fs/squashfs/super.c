@@ -36,6 +36,9 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/mount.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -74,6 +77,55 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 }
 
 
+enum {
+	Opt_streams, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_streams, "streams=%u"},
+	{Opt_err, NULL}
+};
+
+/*
+ * Parse the mount options.  The only option is the number of decompressor
+ * streams, which bounds how many blocks can be decompressed concurrently.
+ */
+static int squashfs_parse_options(char *options, int *streams)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int option;
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		int token;
+
+		if (!*p)
+			continue;
+
+		token = match_token(p, tokens, args);
+		switch (token) {
+		case Opt_streams:
+			if (match_int(&args[0], &option) || option < 1 ||
+					option > SQUASHFS_MAX_DECOMP_STREAMS) {
+				ERROR("streams must be between 1 and %d\n",
+					SQUASHFS_MAX_DECOMP_STREAMS);
+				return -EINVAL;
+			}
+			*streams = option;
+			break;
+		default:
+			ERROR("Unrecognised mount option \"%s\"\n", p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -98,9 +150,13 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, SQUASHFS_DEVBLK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
+	msblk->max_streams = SQUASHFS_DECOMP_STREAMS;
+	err = squashfs_parse_options(data, &msblk->max_streams);
+	if (err)
+		goto failed_mount;
+
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
 	 * are not beyond filesystem end.  But as we're using
@@ -207,12 +263,9 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount;
 	}
 
-	msblk->stream = squashfs_decompressor_init(sb, flags);
-	if (IS_ERR(msblk->stream)) {
-		err = PTR_ERR(msblk->stream);
-		msblk->stream = NULL;
+	err = squashfs_decompressor_create(sb, flags);
+	if (err)
 		goto failed_mount;
-	}
 
 	/* Handle xattrs */
 	sb->s_xattr = squashfs_xattr_handlers;
@@ -332,7 +385,7 @@ failed_mount:
 	squashfs_cache_delete(msblk->block_cache);
 	squashfs_cache_delete(msblk->fragment_cache);
 	squashfs_cache_delete(msblk->read_page);
-	squashfs_decompressor_free(msblk, msblk->stream);
+	squashfs_decompressor_destroy(msblk);
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
@@ -367,7 +420,28 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int streams = msblk->max_streams, err;
+
 	*flags |= MS_RDONLY;
+
+	err = squashfs_parse_options(data, &streams);
+	if (err)
+		return err;
+
+	/* Surplus streams are released as they are next returned */
+	msblk->max_streams = streams;
+	return 0;
+}
+
+
+static int squashfs_show_options(struct seq_file *seq, struct vfsmount *mnt)
+{
+	struct squashfs_sb_info *msblk = mnt->mnt_sb->s_fs_info;
+
+	if (msblk->max_streams != SQUASHFS_DECOMP_STREAMS)
+		seq_printf(seq, ",streams=%d", msblk->max_streams);
+
 	return 0;
 }
 
@@ -379,7 +453,7 @@ static void squashfs_put_super(struct super_block *sb)
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
-		squashfs_decompressor_free(sbi, sbi->stream);
+		squashfs_decompressor_destroy(sbi);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
@@ -487,7 +561,8 @@ static const struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
-	.remount_fs = squashfs_remount
+	.remount_fs = squashfs_remount,
+	.show_options = squashfs_show_options
 };
 
 module_init(init_squashfs_fs);
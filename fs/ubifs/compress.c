@@ -25,11 +25,30 @@
 /*
  * This file provides a single place to access to compression and
  * decompression.
+ *
+ * Compression (and zlib decompression) needs a per-stream state, so every
+ * compressor has a pool of cryptoapi handles, called workspaces here. Only
+ * one workspace is allocated at start-up; more are allocated on demand when
+ * several tasks compress at the same time, up to one per possible CPU plus a
+ * spare one. When the limit is reached, or a workspace cannot be allocated,
+ * tasks wait for a workspace to be released. LZO decompression has no state
+ * and is done without taking a workspace.
  */
 
 #include <linux/crypto.h>
+#include <linux/slab.h>
 #include "ubifs.h"
 
+/**
+ * struct ubifs_compr_ws - compressor workspace.
+ * @list: link in the list of idle workspaces
+ * @cc: cryptoapi compressor handle
+ */
+struct ubifs_compr_ws {
+	struct list_head list;
+	struct crypto_comp *cc;
+};
+
 /* Fake description object for the "none" compressor */
 static struct ubifs_compressor none_compr = {
 	.compr_type = UBIFS_COMPR_NONE,
@@ -38,11 +57,9 @@ static struct ubifs_compressor none_compr = {
 };
 
 #ifdef CONFIG_UBIFS_FS_LZO
-static DEFINE_MUTEX(lzo_mutex);
-
 static struct ubifs_compressor lzo_compr = {
 	.compr_type = UBIFS_COMPR_LZO,
-	.comp_mutex = &lzo_mutex,
+	.stateless_decomp = 1,
 	.name = "lzo",
 	.capi_name = "lzo",
 };
@@ -54,13 +71,8 @@ static struct ubifs_compressor lzo_compr = {
 #endif
 
 #ifdef CONFIG_UBIFS_FS_ZLIB
-static DEFINE_MUTEX(deflate_mutex);
-static DEFINE_MUTEX(inflate_mutex);
-
 static struct ubifs_compressor zlib_compr = {
 	.compr_type = UBIFS_COMPR_ZLIB,
-	.comp_mutex = &deflate_mutex,
-	.decomp_mutex = &inflate_mutex,
 	.name = "zlib",
 	.capi_name = "deflate",
 };
@@ -74,6 +86,95 @@ static struct ubifs_compressor zlib_compr = {
 /* All UBIFS compressors */
 struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
+/**
+ * alloc_ws - allocate a compressor workspace.
+ * @compr: compressor description object
+ *
+ * Returns the new workspace or an error code in case of failure.
+ */
+static struct ubifs_compr_ws *alloc_ws(struct ubifs_compressor *compr)
+{
+	struct ubifs_compr_ws *ws;
+
+	ws = kmalloc(sizeof(struct ubifs_compr_ws), GFP_NOFS);
+	if (!ws)
+		return ERR_PTR(-ENOMEM);
+
+	ws->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+	if (IS_ERR(ws->cc)) {
+		long err = PTR_ERR(ws->cc);
+
+		kfree(ws);
+		return ERR_PTR(err);
+	}
+
+	return ws;
+}
+
+/**
+ * free_ws - free a compressor workspace.
+ * @ws: the workspace to free
+ */
+static void free_ws(struct ubifs_compr_ws *ws)
+{
+	crypto_free_comp(ws->cc);
+	kfree(ws);
+}
+
+/**
+ * get_ws - get an idle workspace of a compressor.
+ * @compr: compressor description object
+ *
+ * This function takes an idle workspace, allocates a new one if there is none
+ * and the limit is not reached yet, or waits for a workspace to be released.
+ */
+static struct ubifs_compr_ws *get_ws(struct ubifs_compressor *compr)
+{
+	struct ubifs_compr_ws *ws;
+
+	while (1) {
+		spin_lock(&compr->ws_lock);
+		if (!list_empty(&compr->idle_ws)) {
+			ws = list_first_entry(&compr->idle_ws,
+					      struct ubifs_compr_ws, list);
+			list_del(&ws->list);
+			spin_unlock(&compr->ws_lock);
+			return ws;
+		}
+
+		if (compr->ws_cnt < compr->max_ws) {
+			compr->ws_cnt += 1;
+			spin_unlock(&compr->ws_lock);
+
+			ws = alloc_ws(compr);
+			if (!IS_ERR(ws))
+				return ws;
+
+			/* Not fatal - there is at least one workspace */
+			dbg_gen("cannot allocate %s workspace, error %ld",
+				compr->name, PTR_ERR(ws));
+			spin_lock(&compr->ws_lock);
+			compr->ws_cnt -= 1;
+		}
+		spin_unlock(&compr->ws_lock);
+
+		wait_event(compr->ws_wait, !list_empty(&compr->idle_ws));
+	}
+}
+
+/**
+ * put_ws - return a workspace to the pool of idle workspaces.
+ * @compr: compressor description object
+ * @ws: the workspace
+ */
+static void put_ws(struct ubifs_compressor *compr, struct ubifs_compr_ws *ws)
+{
+	spin_lock(&compr->ws_lock);
+	list_add(&ws->list, &compr->idle_ws);
+	spin_unlock(&compr->ws_lock);
+	wake_up(&compr->ws_wait);
+}
+
 /**
  * ubifs_compress - compress data.
  * @in_buf: data to compress
@@ -97,6 +198,7 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 {
 	int err;
 	struct ubifs_compressor *compr = ubifs_compressors[*compr_type];
+	struct ubifs_compr_ws *ws;
 
 	if (*compr_type == UBIFS_COMPR_NONE)
 		goto no_compr;
@@ -105,12 +207,14 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 	if (in_len < UBIFS_MIN_COMPR_LEN)
 		goto no_compr;
 
-	if (compr->comp_mutex)
-		mutex_lock(compr->comp_mutex);
-	err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
+	/* The inode may refer to a compressor which was not compiled in */
+	if (unlikely(!compr->capi_name))
+		goto no_compr;
+
+	ws = get_ws(compr);
+	err = crypto_comp_compress(ws->cc, in_buf, in_len, out_buf,
 				   (unsigned int *)out_len);
-	if (compr->comp_mutex)
-		mutex_unlock(compr->comp_mutex);
+	put_ws(compr, ws);
 	if (unlikely(err)) {
 		ubifs_warn("cannot compress %d bytes, compressor %s, "
 			   "error %d, leave data uncompressed",
@@ -150,6 +254,7 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 {
 	int err;
 	struct ubifs_compressor *compr;
+	struct ubifs_compr_ws *ws;
 
 	if (unlikely(compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT)) {
 		ubifs_err("invalid compression type %d", compr_type);
@@ -169,12 +274,15 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 		return 0;
 	}
 
-	if (compr->decomp_mutex)
-		mutex_lock(compr->decomp_mutex);
-	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
-				     (unsigned int *)out_len);
-	if (compr->decomp_mutex)
-		mutex_unlock(compr->decomp_mutex);
+	if (compr->stateless_decomp)
+		err = crypto_comp_decompress(compr->cc, in_buf, in_len,
+					     out_buf, (unsigned int *)out_len);
+	else {
+		ws = get_ws(compr);
+		err = crypto_comp_decompress(ws->cc, in_buf, in_len, out_buf,
+					     (unsigned int *)out_len);
+		put_ws(compr, ws);
+	}
 	if (err)
 		ubifs_err("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
@@ -186,18 +294,30 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
  * compr_init - initialize a compressor.
  * @compr: compressor description object
  *
- * This function initializes the requested compressor and returns zero in case
- * of success or a negative error code in case of failure.
+ * This function initializes the requested compressor and allocates its first
+ * workspace. Returns zero in case of success or a negative error code in case
+ * of failure.
  */
 static int __init compr_init(struct ubifs_compressor *compr)
 {
+	struct ubifs_compr_ws *ws;
+
+	spin_lock_init(&compr->ws_lock);
+	INIT_LIST_HEAD(&compr->idle_ws);
+	init_waitqueue_head(&compr->ws_wait);
+
 	if (compr->capi_name) {
-		compr->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
-		if (IS_ERR(compr->cc)) {
+		ws = alloc_ws(compr);
+		if (IS_ERR(ws)) {
 			ubifs_err("cannot initialize compressor %s, error %ld",
-				  compr->name, PTR_ERR(compr->cc));
-			return PTR_ERR(compr->cc);
+				  compr->name, PTR_ERR(ws));
+			return PTR_ERR(ws);
 		}
+		list_add(&ws->list, &compr->idle_ws);
+		compr->cc = ws->cc;
+		compr->ws_cnt = 1;
+		/* Plus one, so that a preempted writer does not block reads */
+		compr->max_ws = num_possible_cpus() + 1;
 	}
 
 	ubifs_compressors[compr->compr_type] = compr;
@@ -207,12 +327,25 @@ static int __init compr_init(struct ubifs_compressor *compr)
 /**
  * compr_exit - de-initialize a compressor.
  * @compr: compressor description object
+ *
+ * All workspaces are idle at this point, because no UBIFS file-system is
+ * mounted.
  */
 static void compr_exit(struct ubifs_compressor *compr)
 {
-	if (compr->capi_name)
-		crypto_free_comp(compr->cc);
-	return;
+	struct ubifs_compr_ws *ws, *tmp;
+
+	if (!compr->capi_name)
+		return;
+
+	ubifs_assert(compr->ws_cnt > 0);
+	list_for_each_entry_safe(ws, tmp, &compr->idle_ws, list) {
+		list_del(&ws->list);
+		free_ws(ws);
+		compr->ws_cnt -= 1;
+	}
+	ubifs_assert(compr->ws_cnt == 0);
+	compr->cc = NULL;
 }
 
 /**
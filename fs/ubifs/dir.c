@@ -75,6 +75,33 @@ static int inherit_flags(const struct inode *dir, int mode)
 	return flags;
 }
 
+/**
+ * inherit_compr - inherit compression type of the parent inode.
+ * @c: UBIFS file-system description object
+ * @dir: parent inode
+ * @mode: new inode mode flags
+ *
+ * This is a helper function for 'ubifs_new_inode()'. Regular files and
+ * directories inherit the compression type of the parent directory, which is
+ * set with the %UBIFS_IOC_SETCOMPR ioctl. %UBIFS_COMPR_NONE in a directory
+ * means that the default compressor of the file-system is used (switching
+ * compression off is done with %UBIFS_COMPR_FL). Returns the compression
+ * type for the new inode.
+ */
+static int inherit_compr(const struct ubifs_info *c, const struct inode *dir,
+			 int mode)
+{
+	const struct ubifs_inode *ui = ubifs_inode(dir);
+
+	if (S_ISDIR(dir->i_mode) && (S_ISREG(mode) || S_ISDIR(mode)) &&
+	    ui->compr_type != UBIFS_COMPR_NONE)
+		return ui->compr_type;
+
+	if (S_ISREG(mode))
+		return c->default_compr;
+	return UBIFS_COMPR_NONE;
+}
+
 /**
  * ubifs_new_inode - allocate new UBIFS inode object.
  * @c: UBIFS file-system description object
@@ -137,10 +164,7 @@ struct inode *ubifs_new_inode(struct ubifs_info *c, const struct inode *dir,
 
 	ui->flags = inherit_flags(dir, mode);
 	ubifs_set_inode_flags(inode);
-	if (S_ISREG(mode))
-		ui->compr_type = c->default_compr;
-	else
-		ui->compr_type = UBIFS_COMPR_NONE;
+	ui->compr_type = inherit_compr(c, dir, mode);
 	ui->synced_i_size = 0;
 
 	spin_lock(&c->cnt_lock);
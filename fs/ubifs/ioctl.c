@@ -22,7 +22,10 @@
  *          Adrian Hunter
  */
 
-/* This file implements EXT2-compatible extended attribute ioctl() calls */
+/*
+ * This file implements EXT2-compatible extended attribute ioctl() calls and
+ * the UBIFS-specific compression type ioctls.
+ */
 
 #include <linux/compat.h>
 #include <linux/mount.h>
@@ -144,6 +147,52 @@ out_unlock:
 	return err;
 }
 
+/**
+ * setcompr - set compression type of an inode.
+ * @inode: the inode to change
+ * @compr_type: new compression type (%UBIFS_COMPR_NONE, etc)
+ *
+ * This function changes the compressor used for future writes to @inode and
+ * switches the %UBIFS_COMPR_FL flag accordingly. Returns zero in case of
+ * success and a negative error code in case of failure.
+ */
+static int setcompr(struct inode *inode, int compr_type)
+{
+	int err, release;
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct ubifs_budget_req req = { .dirtied_ino = 1,
+					.dirtied_ino_d = ui->data_len };
+
+	if (compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT)
+		return -EINVAL;
+	if (!ubifs_compr_present(compr_type))
+		return -EOPNOTSUPP;
+	if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode))
+		return -EINVAL;
+
+	err = ubifs_budget_space(c, &req);
+	if (err)
+		return err;
+
+	mutex_lock(&ui->ui_mutex);
+	ui->compr_type = compr_type;
+	if (compr_type == UBIFS_COMPR_NONE)
+		ui->flags &= ~UBIFS_COMPR_FL;
+	else
+		ui->flags |= UBIFS_COMPR_FL;
+	inode->i_ctime = ubifs_current_time(inode);
+	release = ui->dirty;
+	mark_inode_dirty_sync(inode);
+	mutex_unlock(&ui->ui_mutex);
+
+	if (release)
+		ubifs_release_budget(c, &req);
+	if (IS_SYNC(inode))
+		err = write_inode_now(inode, 1);
+	return err;
+}
+
 long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	int flags, err;
@@ -182,6 +231,32 @@ long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return err;
 	}
 
+	case UBIFS_IOC_GETCOMPR:
+		return put_user(ubifs_inode(inode)->compr_type,
+				(int __user *) arg);
+
+	case UBIFS_IOC_SETCOMPR: {
+		int compr_type;
+
+		if (IS_RDONLY(inode))
+			return -EROFS;
+
+		if (!inode_owner_or_capable(inode))
+			return -EACCES;
+
+		if (get_user(compr_type, (int __user *) arg))
+			return -EFAULT;
+
+		err = mnt_want_write(file->f_path.mnt);
+		if (err)
+			return err;
+		dbg_gen("set compression type: %d, old %d", compr_type,
+			ubifs_inode(inode)->compr_type);
+		err = setcompr(inode, compr_type);
+		mnt_drop_write(file->f_path.mnt);
+		return err;
+	}
+
 	default:
 		return -ENOTTY;
 	}
@@ -197,6 +272,9 @@ long ubifs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case FS_IOC32_SETFLAGS:
 		cmd = FS_IOC_SETFLAGS;
 		break;
+	case UBIFS_IOC_GETCOMPR:
+	case UBIFS_IOC_SETCOMPR:
+		break;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -341,6 +341,23 @@ enum {
 	UBIFS_COMPR_TYPES_CNT,
 };
 
+/*
+ * UBIFS ioctl commands.
+ *
+ * UBIFS_IOC_GETCOMPR: get the compression type of an inode
+ * UBIFS_IOC_SETCOMPR: set the compression type of an inode
+ *
+ * The argument is a compression type (%UBIFS_COMPR_NONE, etc). The type is
+ * used for data written to the inode afterwards, existing data nodes are not
+ * re-compressed. Setting %UBIFS_COMPR_NONE also clears the compression inode
+ * flag, setting another type sets it. New inodes inherit the compression type
+ * of their parent directory, unless the directory uses the default type of
+ * the file-system.
+ */
+#define UBIFS_IOC_MAGIC 'O'
+#define UBIFS_IOC_GETCOMPR _IOR(UBIFS_IOC_MAGIC, 16, __s32)
+#define UBIFS_IOC_SETCOMPR _IOW(UBIFS_IOC_MAGIC, 17, __s32)
+
 /*
  * UBIFS node types.
  *
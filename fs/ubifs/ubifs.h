@@ -822,17 +822,26 @@ struct ubifs_node_range {
 /**
  * struct ubifs_compressor - UBIFS compressor description structure.
  * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
- * @cc: cryptoapi compressor handle
- * @comp_mutex: mutex used during compression
- * @decomp_mutex: mutex used during decompression
+ * @cc: cryptoapi handle of the first workspace, used for stateless
+ *      decompression
+ * @ws_lock: protects @idle_ws and @ws_cnt
+ * @idle_ws: list of idle workspaces
+ * @ws_cnt: count of allocated workspaces
+ * @max_ws: maximum count of workspaces
+ * @ws_wait: tasks waiting for an idle workspace wait here
+ * @stateless_decomp: decompression does not need a workspace of its own
  * @name: compressor name
  * @capi_name: cryptoapi compressor name
  */
 struct ubifs_compressor {
 	int compr_type;
 	struct crypto_comp *cc;
-	struct mutex *comp_mutex;
-	struct mutex *decomp_mutex;
+	spinlock_t ws_lock;
+	struct list_head idle_ws;
+	int ws_cnt;
+	int max_ws;
+	wait_queue_head_t ws_wait;
+	unsigned int stateless_decomp:1;
 	const char *name;
 	const char *capi_name;
 };
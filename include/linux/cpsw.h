@@ -32,6 +32,7 @@ struct cpsw_platform_data {
 	u32	host_port_reg_ofs; /* cpsw cpdma host port registers */
 
 	u32	hw_stats_reg_ofs;  /* cpsw hardware statistics counters */
+	u32	cpts_reg_ofs;      /* cpts registers, 0 if not present */
 
 	u32	bd_ram_ofs;   /* embedded buffer descriptor RAM offset*/
 	u32	bd_ram_size;  /*buffer descriptor ram size */
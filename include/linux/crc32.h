@@ -11,6 +11,12 @@
 extern u32  crc32_le(u32 crc, unsigned char const *p, size_t len);
 extern u32  crc32_be(u32 crc, unsigned char const *p, size_t len);
 
+/*
+ * CRC32c (Castagnoli) with the same table driven code as crc32_le.  Like
+ * crc32_le() no inversion is done, the caller seeds it (usually with ~0).
+ */
+extern u32  __crc32c_le(u32 crc, unsigned char const *p, size_t len);
+
 #define crc32(seed, data, length)  crc32_le(seed, (unsigned char const *)(data), length)
 
 /*
@@ -1,3 +1,6 @@
+#ifndef __LINUX_TI_TSC_H
+#define __LINUX_TI_TSC_H
+
 /**
  * struct tsc_data	Touchscreen wire configuration
  * @wires:		Wires refer to application modes
@@ -16,3 +19,5 @@ struct tsc_data {
 	int x_plate_resistance;
 	int steps_to_configure;
 };
+
+#endif
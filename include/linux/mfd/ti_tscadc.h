@@ -0,0 +1,164 @@
+/*
+ * TI Touch Screen / ADC MFD driver
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __LINUX_TI_TSCADC_MFD_H
+#define __LINUX_TI_TSCADC_MFD_H
+
+#include <linux/spinlock.h>
+#include <linux/platform_device.h>
+#include <linux/mfd/core.h>
+#include <linux/input/ti_tsc.h>
+#include <linux/platform_data/ti_adc.h>
+
+#define TSCADC_REG_IRQEOI		0x020
+#define TSCADC_REG_RAWIRQSTATUS		0x024
+#define TSCADC_REG_IRQSTATUS		0x028
+#define TSCADC_REG_IRQENABLE		0x02C
+#define TSCADC_REG_IRQCLR		0x030
+#define TSCADC_REG_IRQWAKEUP		0x034
+#define TSCADC_REG_CTRL			0x040
+#define TSCADC_REG_ADCFSM		0x044
+#define TSCADC_REG_CLKDIV		0x04C
+#define TSCADC_REG_SE			0x054
+#define TSCADC_REG_IDLECONFIG		0x058
+#define TSCADC_REG_CHARGECONFIG		0x05C
+#define TSCADC_REG_CHARGEDELAY		0x060
+#define TSCADC_REG_STEPCONFIG(n)	(0x64 + ((n-1) * 8))
+#define TSCADC_REG_STEPDELAY(n)		(0x68 + ((n-1) * 8))
+#define TSCADC_REG_FIFO0CNT		0xE4
+#define TSCADC_REG_FIFO0THR		0xE8
+#define TSCADC_REG_FIFO1CNT		0xF0
+#define TSCADC_REG_FIFO1THR		0xF4
+#define TSCADC_REG_FIFO0		0x100
+#define TSCADC_REG_FIFO1		0x200
+
+/*	Register Bitfields	*/
+#define TSCADC_IRQWKUP_ENB		BIT(0)
+#define TSCADC_IRQWKUP_DISABLE		0x00
+#define TSCADC_IRQENB_HW_PEN		BIT(0)
+#define TSCADC_IRQENB_FIFO0THRES	BIT(2)
+#define TSCADC_IRQENB_FIFO0OVRRUN	BIT(3)
+#define TSCADC_IRQENB_FIFO1THRES	BIT(5)
+#define TSCADC_IRQENB_FIFO1OVRRUN	BIT(6)
+#define TSCADC_IRQENB_FIFO1UNDRFLW	BIT(7)
+#define TSCADC_IRQENB_PENUP		BIT(9)
+#define TSCADC_STEPCONFIG_MODE_SWCNT	0x1
+#define TSCADC_STEPCONFIG_MODE_HWSYNC	0x2
+#define TSCADC_STEPCONFIG_2SAMPLES_AVG	(1 << 4)
+#define TSCADC_STEPCONFIG_AVG_16	(4 << 2)
+#define TSCADC_STEPCONFIG_XPP		BIT(5)
+#define TSCADC_STEPCONFIG_XNN		BIT(6)
+#define TSCADC_STEPCONFIG_YPP		BIT(7)
+#define TSCADC_STEPCONFIG_YNN		BIT(8)
+#define TSCADC_STEPCONFIG_XNP		BIT(9)
+#define TSCADC_STEPCONFIG_YPN		BIT(10)
+#define TSCADC_STEPCONFIG_RFP		(1 << 12)
+#define TSCADC_STEPCONFIG_INM		(1 << 18)
+#define TSCADC_STEPCONFIG_INP_4		(1 << 19)
+#define TSCADC_STEPCONFIG_INP		(1 << 20)
+#define TSCADC_STEPCONFIG_INP_5		(1 << 21)
+#define TSCADC_STEPCONFIG_INP_AN(n)	((n) << 19)
+#define TSCADC_STEPCONFIG_IDLE_INP	(1 << 22)
+#define TSCADC_STEPCONFIG_FIFO1		(1 << 26)
+#define TSCADC_STEPCONFIG_OPENDLY	0x018
+#define TSCADC_STEPCONFIG_SAMPLEDLY	0x88
+#define TSCADC_STEPCONFIG_Z1		(3 << 19)
+#define TSCADC_STEPCHARGE_INM_SWAP	BIT(16)
+#define TSCADC_STEPCHARGE_INM		BIT(15)
+#define TSCADC_STEPCHARGE_INP_SWAP	BIT(20)
+#define TSCADC_STEPCHARGE_INP		BIT(19)
+#define TSCADC_STEPCHARGE_RFM		(1 << 23)
+#define TSCADC_STEPCHARGE_DELAY		0x1
+#define TSCADC_CNTRLREG_TSCSSENB	BIT(0)
+#define TSCADC_CNTRLREG_STEPID		BIT(1)
+#define TSCADC_CNTRLREG_STEPCONFIGWRT	BIT(2)
+#define TSCADC_CNTRLREG_POWERDOWN	BIT(4)
+#define TSCADC_CNTRLREG_TSCENB		BIT(7)
+#define TSCADC_CNTRLREG_4WIRE		(0x1 << 5)
+#define TSCADC_CNTRLREG_5WIRE		(0x1 << 6)
+#define TSCADC_CNTRLREG_8WIRE		(0x3 << 5)
+#define TSCADC_ADCFSM_STEPID		0x10
+#define TSCADC_ADCFSM_FSM		BIT(5)
+#define TSCADC_FIFO_DATA		0xfff
+#define TSCADC_FIFO_STEPID(val)		(((val) >> 16) & 0xf)
+
+/* Step enable: bit 0 is the touchscreen charge step, bit n is step n */
+#define TSCADC_STPENB_CHARGE		BIT(0)
+#define TSCADC_STPENB_STEP(n)		BIT(n)
+
+#define TSCADC_FIFO_DEPTH		64
+#define TOTAL_STEPS			16
+#define TOTAL_CHANNELS			8
+
+#define ADC_CLK				3000000
+
+#define TSCADC_CELLS			2
+
+/**
+ * struct mfd_tscadc_board	TSCADC board configuration
+ * @tsc_init:	touchscreen configuration, NULL if no panel is fitted
+ * @adc_init:	general purpose ADC configuration, NULL if unused
+ *
+ * The eight analog inputs are shared: the touchscreen claims AIN0
+ * upwards for its wires and sequencer steps 1 upwards, the ADC claims
+ * the remaining inputs from AIN7 downwards and steps from 16 downwards.
+ */
+struct mfd_tscadc_board {
+	struct tsc_data *tsc_init;
+	struct adc_data *adc_init;
+};
+
+struct tscadc;
+struct adc_device;
+
+struct ti_tscadc_dev {
+	struct device *dev;
+	void __iomem *tscadc_base;
+	int irq;
+	int used_cells;
+	struct mfd_cell cells[TSCADC_CELLS];
+	unsigned int ctrl;
+	unsigned int clk_div;
+
+	/* Step enable bits currently wanted by the cells */
+	spinlock_t reg_lock;
+	u32 reg_se_cache;
+	u32 reg_se_once;	/* one-shot steps not read back yet */
+
+	/* tsc device */
+	struct tscadc *tsc;
+
+	/* adc device */
+	struct adc_device *adc;
+};
+
+/*
+ * Cells get a pointer to the shared ti_tscadc_dev as their platform
+ * data, so both see the same copy.
+ */
+static inline struct ti_tscadc_dev *ti_tscadc_dev_get(struct platform_device *p)
+{
+	struct ti_tscadc_dev **tscadc_dev = p->dev.platform_data;
+
+	return *tscadc_dev;
+}
+
+void ti_tscadc_se_set(struct ti_tscadc_dev *tsadc, u32 val);
+void ti_tscadc_se_clr(struct ti_tscadc_dev *tsadc, u32 val);
+void ti_tscadc_se_set_once(struct ti_tscadc_dev *tsadc, u32 val);
+void ti_tscadc_se_done(struct ti_tscadc_dev *tsadc, u32 val);
+void ti_tscadc_se_update(struct ti_tscadc_dev *tsadc);
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef __LINUX_TI_ADC_H
+#define __LINUX_TI_ADC_H
+
 /**
  * struct adc_data	ADC Input information
  * @adc_channels:	Number of analog inputs
@@ -7,3 +10,5 @@
 struct adc_data {
 	int adc_channels;
 };
+
+#endif
@@ -27,14 +27,19 @@
 #include <linux/types.h>
 #include <linux/init.h>
 #include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/random.h>
+#include <linux/irqflags.h>
 #include "crc32defs.h"
-#if CRC_LE_BITS == 8
+#if CRC_LE_BITS > 8
 # define tole(x) __constant_cpu_to_le32(x)
 #else
 # define tole(x) (x)
 #endif
 
-#if CRC_BE_BITS == 8
+#if CRC_BE_BITS > 8
 # define tobe(x) __constant_cpu_to_be32(x)
 #else
 # define tobe(x) (x)
@@ -42,29 +47,50 @@
 #include "crc32table.h"
 
 MODULE_AUTHOR("Matt Domsch <Matt_Domsch@dell.com>");
-MODULE_DESCRIPTION("Ethernet CRC32 calculations");
+MODULE_DESCRIPTION("Various CRC32 calculations");
 MODULE_LICENSE("GPL");
 
-#if CRC_LE_BITS == 8 || CRC_BE_BITS == 8
+#if CRC_LE_BITS > 8 || CRC_BE_BITS > 8
 
-static inline u32
-crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
+#if CRC_LE_BITS == 64
+/*
+ * Slicing by 8 halves the number of loop iterations of slicing by 4, but
+ * touches twice as much table (8 KiB per polynomial), which does not
+ * always pay off with a small L1 data cache.  Start out slicing by 8 and
+ * let crc32_init() keep whichever variant measured faster.
+ */
+static int crc32_slices __read_mostly = 8;
+#endif
+
+/*
+ * Fold the buffer into crc @slices (4 or 8) bytes per step, using the
+ * first @slices rows of @tab.  @slices is always a constant, so each
+ * variant gets its own loop.
+ */
+static __always_inline u32
+crc32_body(u32 crc, unsigned char const *buf, size_t len,
+	   const u32 (*tab)[256], const int slices)
 {
 # ifdef __LITTLE_ENDIAN
-#  define DO_CRC(x) crc = tab[0][(crc ^ (x)) & 255] ^ (crc >> 8)
-#  define DO_CRC4 crc = tab[3][(crc) & 255] ^ \
-		tab[2][(crc >> 8) & 255] ^ \
-		tab[1][(crc >> 16) & 255] ^ \
-		tab[0][(crc >> 24) & 255]
+#  define DO_CRC(x) crc = t0[(crc ^ (x)) & 255] ^ (crc >> 8)
+#  define DO_CRC4 (t3[(q) & 255] ^ t2[(q >> 8) & 255] ^ \
+		   t1[(q >> 16) & 255] ^ t0[(q >> 24) & 255])
+#  define DO_CRC8 (t7[(q) & 255] ^ t6[(q >> 8) & 255] ^ \
+		   t5[(q >> 16) & 255] ^ t4[(q >> 24) & 255])
 # else
-#  define DO_CRC(x) crc = tab[0][((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
-#  define DO_CRC4 crc = tab[0][(crc) & 255] ^ \
-		tab[1][(crc >> 8) & 255] ^ \
-		tab[2][(crc >> 16) & 255] ^ \
-		tab[3][(crc >> 24) & 255]
+#  define DO_CRC(x) crc = t0[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
+#  define DO_CRC4 (t0[(q) & 255] ^ t1[(q >> 8) & 255] ^ \
+		   t2[(q >> 16) & 255] ^ t3[(q >> 24) & 255])
+#  define DO_CRC8 (t4[(q) & 255] ^ t5[(q >> 8) & 255] ^ \
+		   t6[(q >> 16) & 255] ^ t7[(q >> 24) & 255])
 # endif
 	const u32 *b;
 	size_t    rem_len;
+	const u32 *t0 = tab[0], *t1 = tab[1], *t2 = tab[2], *t3 = tab[3];
+# if CRC_LE_BITS == 64
+	const u32 *t4 = tab[4], *t5 = tab[5], *t6 = tab[6], *t7 = tab[7];
+# endif
+	u32 q;
 
 	/* Align it */
 	if (unlikely((long)buf & 3 && len)) {
@@ -72,13 +98,22 @@ crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
 			DO_CRC(*buf++);
 		} while ((--len) && ((long)buf)&3);
 	}
-	rem_len = len & 3;
+
+	rem_len = len & (slices - 1);
 	/* load data 32 bits wide, xor data 32 bits wide. */
-	len = len >> 2;
+	len = len / slices;
 	b = (const u32 *)buf;
 	for (--b; len; --len) {
-		crc ^= *++b; /* use pre increment for speed */
-		DO_CRC4;
+		q = crc ^ *++b; /* use pre increment for speed */
+# if CRC_LE_BITS == 64
+		if (slices == 8) {
+			crc = DO_CRC8;
+			q = *++b;
+			crc ^= DO_CRC4;
+			continue;
+		}
+# endif
+		crc = DO_CRC4;
 	}
 	len = rem_len;
 	/* And the last few bytes */
@@ -91,121 +126,175 @@ crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
 	return crc;
 #undef DO_CRC
 #undef DO_CRC4
+#undef DO_CRC8
+}
+
+static inline u32
+crc32_slice(u32 crc, unsigned char const *buf, size_t len,
+	    const u32 (*tab)[256])
+{
+#if CRC_LE_BITS == 64
+	if (crc32_slices == 8)
+		return crc32_body(crc, buf, len, tab, 8);
+#endif
+	return crc32_body(crc, buf, len, tab, 4);
 }
 #endif
+
 /**
- * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
- * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
- *	other uses, or the previous crc32 value if computing incrementally.
+ * crc32_le_generic() - Calculate bitwise little-endian CRC32
+ * @crc: seed value for computation.
  * @p: pointer to buffer over which CRC is run
  * @len: length of buffer @p
+ * @tab: little-endian CRC32 lookup table for @polynomial
+ * @polynomial: CRC32 LE polynomial
  */
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len);
-
-#if CRC_LE_BITS == 1
-/*
- * In fact, the table-based code will work in this case, but it can be
- * simplified by inlining the table in ?: form.
- */
-
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+static inline u32 __pure
+crc32_le_generic(u32 crc, unsigned char const *p, size_t len,
+		 const u32 (*tab)[256], u32 polynomial)
 {
+#if CRC_LE_BITS == 1
 	int i;
 	while (len--) {
 		crc ^= *p++;
 		for (i = 0; i < 8; i++)
-			crc = (crc >> 1) ^ ((crc & 1) ? CRCPOLY_LE : 0);
+			crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
 	}
-	return crc;
-}
-#else				/* Table-based approach */
-
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
-{
-# if CRC_LE_BITS == 8
-	const u32      (*tab)[] = crc32table_le;
-
-	crc = __cpu_to_le32(crc);
-	crc = crc32_body(crc, p, len, tab);
-	return __le32_to_cpu(crc);
-# elif CRC_LE_BITS == 4
+#elif CRC_LE_BITS == 2
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 4) ^ crc32table_le[crc & 15];
-		crc = (crc >> 4) ^ crc32table_le[crc & 15];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
 	}
-	return crc;
-# elif CRC_LE_BITS == 2
+#elif CRC_LE_BITS == 4
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
+		crc = (crc >> 4) ^ tab[0][crc & 15];
+		crc = (crc >> 4) ^ tab[0][crc & 15];
 	}
+#elif CRC_LE_BITS == 8
+	/* aka Sarwate algorithm */
+	while (len--) {
+		crc ^= *p++;
+		crc = (crc >> 8) ^ tab[0][crc & 255];
+	}
+#else
+	crc = __cpu_to_le32(crc);
+	crc = crc32_slice(crc, p, len, tab);
+	crc = __le32_to_cpu(crc);
+#endif
 	return crc;
-# endif
 }
-#endif
 
 /**
- * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
+ * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
  * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
  *	other uses, or the previous crc32 value if computing incrementally.
  * @p: pointer to buffer over which CRC is run
  * @len: length of buffer @p
  */
-u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len);
+#if CRC_LE_BITS == 1
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, NULL, CRCPOLY_LE);
+}
 
-#if CRC_BE_BITS == 1
-/*
- * In fact, the table-based code will work in this case, but it can be
- * simplified by inlining the table in ?: form.
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, NULL, CRC32C_POLY_LE);
+}
+#else
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len,
+			(const u32 (*)[256])crc32table_le, CRCPOLY_LE);
+}
+
+/**
+ * __crc32c_le() - Calculate little-endian CRC32c (Castagnoli)
+ * @crc: seed value for computation, or the previous value if computing
+ *	incrementally.  No inversion is done on input or output.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
  */
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len,
+			(const u32 (*)[256])crc32ctable_le, CRC32C_POLY_LE);
+}
+#endif
+EXPORT_SYMBOL(crc32_le);
+EXPORT_SYMBOL(__crc32c_le);
 
-u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
+/**
+ * crc32_be_generic() - Calculate bitwise big-endian CRC32
+ * @crc: seed value for computation.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ * @tab: big-endian CRC32 lookup table for @polynomial
+ * @polynomial: CRC32 BE polynomial
+ */
+static inline u32 __pure
+crc32_be_generic(u32 crc, unsigned char const *p, size_t len,
+		 const u32 (*tab)[256], u32 polynomial)
 {
+#if CRC_BE_BITS == 1
 	int i;
 	while (len--) {
 		crc ^= *p++ << 24;
 		for (i = 0; i < 8; i++)
 			crc =
-			    (crc << 1) ^ ((crc & 0x80000000) ? CRCPOLY_BE :
+			    (crc << 1) ^ ((crc & 0x80000000) ? polynomial :
 					  0);
 	}
-	return crc;
-}
-
-#else				/* Table-based approach */
-u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
-{
-# if CRC_BE_BITS == 8
-	const u32      (*tab)[] = crc32table_be;
-
-	crc = __cpu_to_be32(crc);
-	crc = crc32_body(crc, p, len, tab);
-	return __be32_to_cpu(crc);
-# elif CRC_BE_BITS == 4
+#elif CRC_BE_BITS == 2
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 4) ^ crc32table_be[crc >> 28];
-		crc = (crc << 4) ^ crc32table_be[crc >> 28];
+		crc = (crc << 2) ^ tab[0][crc >> 30];
+		crc = (crc << 2) ^ tab[0][crc >> 30];
+		crc = (crc << 2) ^ tab[0][crc >> 30];
+		crc = (crc << 2) ^ tab[0][crc >> 30];
 	}
-	return crc;
-# elif CRC_BE_BITS == 2
+#elif CRC_BE_BITS == 4
+	while (len--) {
+		crc ^= *p++ << 24;
+		crc = (crc << 4) ^ tab[0][crc >> 28];
+		crc = (crc << 4) ^ tab[0][crc >> 28];
+	}
+#elif CRC_BE_BITS == 8
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
+		crc = (crc << 8) ^ tab[0][crc >> 24];
 	}
+#else
+	crc = __cpu_to_be32(crc);
+	crc = crc32_slice(crc, p, len, tab);
+	crc = __be32_to_cpu(crc);
+#endif
 	return crc;
-# endif
 }
-#endif
 
-EXPORT_SYMBOL(crc32_le);
+/**
+ * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
+ * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
+ *	other uses, or the previous crc32 value if computing incrementally.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ */
+#if CRC_BE_BITS == 1
+u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_be_generic(crc, p, len, NULL, CRCPOLY_BE);
+}
+#else
+u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_be_generic(crc, p, len,
+			(const u32 (*)[256])crc32table_be, CRCPOLY_BE);
+}
+#endif
 EXPORT_SYMBOL(crc32_be);
 
 /*
@@ -335,137 +424,163 @@ EXPORT_SYMBOL(crc32_be);
  * the same way on decoding, it doesn't make a difference.
  */
 
-#ifdef UNITTEST
+#if CRC_LE_BITS == 64 || defined(CONFIG_CRC32_SELFTEST)
+
+#define CRC32_TEST_LEN		4096
+#define CRC32_BENCH_LOOPS	8
 
-#include <stdlib.h>
-#include <stdio.h>
+/* Keeps the benchmarked calls from being optimised away */
+static u32 crc32_bench_sink __initdata;
 
-#if 0				/*Not used at present */
-static void
-buf_dump(char const *prefix, unsigned char const *buf, size_t len)
+/*
+ * Return the throughput in MB/s of @fn over @buf.  Interrupts are off so
+ * the figures of the different variants can be compared.
+ */
+static unsigned int __init
+crc32_bench(u32 (*fn)(u32, unsigned char const *, size_t), const u8 *buf)
 {
-	fputs(prefix, stdout);
-	while (len--)
-		printf(" %02x", *buf++);
-	putchar('\n');
+	unsigned long flags;
+	ktime_t start;
+	u64 bytes = (u64)CRC32_TEST_LEN * CRC32_BENCH_LOOPS * 1000;
+	s64 nsec;
+	u32 crc = 0;
+	int i;
+
+	/* warm the caches */
+	crc = fn(crc, buf, CRC32_TEST_LEN);
+
+	local_irq_save(flags);
+	start = ktime_get();
+	for (i = 0; i < CRC32_BENCH_LOOPS; i++)
+		crc = fn(crc, buf, CRC32_TEST_LEN);
+	nsec = ktime_to_ns(ktime_sub(ktime_get(), start));
+	local_irq_restore(flags);
 
+	crc32_bench_sink ^= crc;
+
+	if (nsec <= 0)
+		nsec = 1;
+	do_div(bytes, (u32)nsec);
+	return (unsigned int)bytes;
 }
-#endif
 
-static void bytereverse(unsigned char *buf, size_t len)
+#ifdef CONFIG_CRC32_SELFTEST
+static u32 __init crc32_le_bitwise(u32 crc, unsigned char const *p,
+				   size_t len, u32 polynomial)
 {
+	int i;
+
 	while (len--) {
-		unsigned char x = bitrev8(*buf);
-		*buf++ = x;
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
 	}
+	return crc;
 }
 
-static void random_garbage(unsigned char *buf, size_t len)
+static u32 __init crc32_be_bitwise(u32 crc, unsigned char const *p,
+				   size_t len)
 {
-	while (len--)
-		*buf++ = (unsigned char) random();
+	int i;
+
+	while (len--) {
+		crc ^= *p++ << 24;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^
+				((crc & 0x80000000) ? CRCPOLY_BE : 0);
+	}
+	return crc;
 }
 
-#if 0				/* Not used at present */
-static void store_le(u32 x, unsigned char *buf)
+/*
+ * Check the configured implementation against the bitwise definition of
+ * each CRC, for random seeds, lengths and alignments.
+ */
+static int __init crc32_verify(const u8 *buf)
 {
-	buf[0] = (unsigned char) x;
-	buf[1] = (unsigned char) (x >> 8);
-	buf[2] = (unsigned char) (x >> 16);
-	buf[3] = (unsigned char) (x >> 24);
+	int i, errors = 0;
+
+	for (i = 0; i < 100; i++) {
+		const u8 *p = buf + (random32() & 63);
+		size_t len = random32() % (CRC32_TEST_LEN / 4);
+		u32 seed = random32();
+
+		if (crc32_le(seed, p, len) !=
+		    crc32_le_bitwise(seed, p, len, CRCPOLY_LE))
+			errors++;
+		if (__crc32c_le(seed, p, len) !=
+		    crc32_le_bitwise(seed, p, len, CRC32C_POLY_LE))
+			errors++;
+		if (crc32_be(seed, p, len) != crc32_be_bitwise(seed, p, len))
+			errors++;
+	}
+
+	return errors;
 }
-#endif
 
-static void store_be(u32 x, unsigned char *buf)
+/* Test and report one variant, returning its crc32_le throughput */
+static unsigned int __init crc32_test_variant(const u8 *buf, const char *name)
 {
-	buf[0] = (unsigned char) (x >> 24);
-	buf[1] = (unsigned char) (x >> 16);
-	buf[2] = (unsigned char) (x >> 8);
-	buf[3] = (unsigned char) x;
+	unsigned int le, be, c;
+	int errors;
+
+	errors = crc32_verify(buf);
+	le = crc32_bench(crc32_le, buf);
+	be = crc32_bench(crc32_be, buf);
+	c = crc32_bench(__crc32c_le, buf);
+
+	if (errors)
+		pr_warn("crc32: %s: %d self tests failed\n", name, errors);
+	pr_info("crc32: %s: crc32_le %u MB/s, crc32_be %u MB/s, "
+		"crc32c %u MB/s\n", name, le, be, c);
+
+	return le;
 }
+#else
+/* Without the self test, only time crc32_le to pick the variant */
+static unsigned int __init crc32_test_variant(const u8 *buf, const char *name)
+{
+	return crc32_bench(crc32_le, buf);
+}
+#endif
 
-/*
- * This checks that CRC(buf + CRC(buf)) = 0, and that
- * CRC commutes with bit-reversal.  This has the side effect
- * of bytewise bit-reversing the input buffer, and returns
- * the CRC of the reversed buffer.
- */
-static u32 test_step(u32 init, unsigned char *buf, size_t len)
+static int __init crc32_init(void)
 {
-	u32 crc1, crc2;
-	size_t i;
-
-	crc1 = crc32_be(init, buf, len);
-	store_be(crc1, buf + len);
-	crc2 = crc32_be(init, buf, len + 4);
-	if (crc2)
-		printf("\nCRC cancellation fail: 0x%08x should be 0\n",
-		       crc2);
-
-	for (i = 0; i <= len + 4; i++) {
-		crc2 = crc32_be(init, buf, i);
-		crc2 = crc32_be(crc2, buf + i, len + 4 - i);
-		if (crc2)
-			printf("\nCRC split fail: 0x%08x\n", crc2);
-	}
+	u8 *buf;
+	int i;
 
-	/* Now swap it around for the other test */
-
-	bytereverse(buf, len + 4);
-	init = bitrev32(init);
-	crc2 = bitrev32(crc1);
-	if (crc1 != bitrev32(crc2))
-		printf("\nBit reversal fail: 0x%08x -> 0x%08x -> 0x%08x\n",
-		       crc1, crc2, bitrev32(crc2));
-	crc1 = crc32_le(init, buf, len);
-	if (crc1 != crc2)
-		printf("\nCRC endianness fail: 0x%08x != 0x%08x\n", crc1,
-		       crc2);
-	crc2 = crc32_le(init, buf, len + 4);
-	if (crc2)
-		printf("\nCRC cancellation fail: 0x%08x should be 0\n",
-		       crc2);
-
-	for (i = 0; i <= len + 4; i++) {
-		crc2 = crc32_le(init, buf, i);
-		crc2 = crc32_le(crc2, buf + i, len + 4 - i);
-		if (crc2)
-			printf("\nCRC split fail: 0x%08x\n", crc2);
-	}
+	buf = kmalloc(CRC32_TEST_LEN, GFP_KERNEL);
+	if (!buf)
+		return 0;
 
-	return crc1;
-}
+	for (i = 0; i < CRC32_TEST_LEN; i++)
+		buf[i] = random32();
 
-#define SIZE 64
-#define INIT1 0
-#define INIT2 0
+#if CRC_LE_BITS == 64
+	{
+		unsigned int slice4, slice8;
 
-int main(void)
-{
-	unsigned char buf1[SIZE + 4];
-	unsigned char buf2[SIZE + 4];
-	unsigned char buf3[SIZE + 4];
-	int i, j;
-	u32 crc1, crc2, crc3;
-
-	for (i = 0; i <= SIZE; i++) {
-		printf("\rTesting length %d...", i);
-		fflush(stdout);
-		random_garbage(buf1, i);
-		random_garbage(buf2, i);
-		for (j = 0; j < i; j++)
-			buf3[j] = buf1[j] ^ buf2[j];
-
-		crc1 = test_step(INIT1, buf1, i);
-		crc2 = test_step(INIT2, buf2, i);
-		/* Now check that CRC(buf1 ^ buf2) = CRC(buf1) ^ CRC(buf2) */
-		crc3 = test_step(INIT1 ^ INIT2, buf3, i);
-		if (crc3 != (crc1 ^ crc2))
-			printf("CRC XOR fail: 0x%08x != 0x%08x ^ 0x%08x\n",
-			       crc3, crc1, crc2);
+		crc32_slices = 4;
+		slice4 = crc32_test_variant(buf, "slice by 4");
+		crc32_slices = 8;
+		slice8 = crc32_test_variant(buf, "slice by 8");
+
+		if (slice4 > slice8)
+			crc32_slices = 4;
+		pr_info("crc32: using slice by %d\n", crc32_slices);
 	}
-	printf("\nAll test complete.  No failures expected.\n");
+#else
+	crc32_test_variant(buf, "CRC_LE_BITS " __stringify(CRC_LE_BITS));
+#endif
+
+	kfree(buf);
 	return 0;
 }
 
-#endif				/* UNITTEST */
+static void __exit crc32_exit(void)
+{
+}
+
+module_init(crc32_init);
+module_exit(crc32_exit);
+#endif
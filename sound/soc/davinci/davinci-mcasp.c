@@ -607,11 +607,37 @@ static int davinci_config_channel_size(struct davinci_audio_dev *dev,
 	return 0;
 }
 
-static void davinci_hw_common_param(struct davinci_audio_dev *dev, int stream)
+/*
+ * Largest FIFO threshold up to the configured one that splits a period
+ * evenly.  The PCM DMA moves one threshold worth of words per McASP
+ * event, so an uneven split truncates every period and skews the live
+ * DMA position used for low latency streaming.  Small periods therefore
+ * get a small threshold, large ones keep the configured DMA burst.
+ */
+static u8 davinci_mcasp_fifo_level(u8 numevt, u8 ser,
+		unsigned int period_words)
+{
+	if (!numevt || !ser)
+		return numevt;
+
+	/* the FIFO holds 64 words */
+	if (numevt * ser > 64)
+		numevt = 64 / ser;
+
+	while (numevt > 1 && period_words % numevt)
+		numevt--;
+
+	return numevt;
+}
+
+/* Returns the FIFO threshold in words per serializer, 0 without FIFO */
+static u8 davinci_hw_common_param(struct davinci_audio_dev *dev, int stream,
+		unsigned int period_words)
 {
 	int i;
 	u8 tx_ser = 0;
 	u8 rx_ser = 0;
+	u8 numevt = 0;
 
 	/* Default configuration */
 	mcasp_set_bits(dev->base + DAVINCI_MCASP_PWREMUMGT_REG, MCASP_SOFT);
@@ -644,40 +670,42 @@ static void davinci_hw_common_param(struct davinci_audio_dev *dev, int stream)
 	}
 
 	if (dev->txnumevt && stream == SNDRV_PCM_STREAM_PLAYBACK) {
-		if (dev->txnumevt * tx_ser > 64)
-			dev->txnumevt = 1;
+		numevt = davinci_mcasp_fifo_level(dev->txnumevt, tx_ser,
+				period_words);
 
 		if (dev->version == MCASP_VERSION_3) {
 			mcasp_mod_bits(dev->base + MCASP_VER3_WFIFOCTL, tx_ser,
 								NUMDMA_MASK);
 			mcasp_mod_bits(dev->base + MCASP_VER3_WFIFOCTL,
-				((dev->txnumevt * tx_ser) << 8), NUMEVT_MASK);
+				((numevt * tx_ser) << 8), NUMEVT_MASK);
 		} else {
 			mcasp_mod_bits(dev->base + DAVINCI_MCASP_WFIFOCTL,
 							tx_ser, NUMDMA_MASK);
 			mcasp_mod_bits(dev->base + DAVINCI_MCASP_WFIFOCTL,
-				((dev->txnumevt * tx_ser) << 8), NUMEVT_MASK);
+				((numevt * tx_ser) << 8), NUMEVT_MASK);
 		}
 	}
 
 	if (dev->rxnumevt && stream == SNDRV_PCM_STREAM_CAPTURE) {
-		if (dev->rxnumevt * rx_ser > 64)
-			dev->rxnumevt = 1;
+		numevt = davinci_mcasp_fifo_level(dev->rxnumevt, rx_ser,
+				period_words);
 
 		if (dev->version == MCASP_VERSION_3) {
 			mcasp_mod_bits(dev->base + MCASP_VER3_RFIFOCTL, rx_ser,
 								NUMDMA_MASK);
 			mcasp_mod_bits(dev->base + MCASP_VER3_RFIFOCTL,
-					((dev->rxnumevt * rx_ser) << 8),
+					((numevt * rx_ser) << 8),
 					NUMEVT_MASK);
 		} else {
 			mcasp_mod_bits(dev->base + DAVINCI_MCASP_RFIFOCTL,
 							rx_ser,	NUMDMA_MASK);
 			mcasp_mod_bits(dev->base + DAVINCI_MCASP_RFIFOCTL,
-					((dev->rxnumevt * rx_ser) << 8),
+					((numevt * rx_ser) << 8),
 					NUMEVT_MASK);
 		}
 	}
+
+	return numevt;
 }
 
 static void davinci_hw_param(struct davinci_audio_dev *dev, int stream)
@@ -760,6 +788,25 @@ static void davinci_hw_dit_param(struct davinci_audio_dev *dev)
 	mcasp_set_bits(dev->base + DAVINCI_MCASP_TXDITCTL_REG, DITEN);
 }
 
+/*
+ * While DDR wakes up, the serializers drain what the last DMA event left
+ * in the FIFO, or the single word of the serializer buffer without FIFO.
+ * Keep cpuidle from taking DDR low power states that wake up slower.
+ */
+static void davinci_mcasp_update_qos(struct davinci_audio_dev *dev,
+		int stream, u8 fifo_level, unsigned int words_per_sec)
+{
+	struct pm_qos_request *req = &dev->pm_qos_req[stream];
+	s32 latency;
+
+	latency = max_t(u32, fifo_level, 1) * USEC_PER_SEC / words_per_sec;
+
+	if (pm_qos_request_active(req))
+		pm_qos_update_request(req, latency);
+	else
+		pm_qos_add_request(req, PM_QOS_CPU_DMA_LATENCY, latency);
+}
+
 static int davinci_mcasp_hw_params(struct snd_pcm_substream *substream,
 					struct snd_pcm_hw_params *params,
 					struct snd_soc_dai *cpu_dai)
@@ -770,11 +817,8 @@ static int davinci_mcasp_hw_params(struct snd_pcm_substream *substream,
 	int word_length;
 	u8 fifo_level;
 
-	davinci_hw_common_param(dev, substream->stream);
-	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
-		fifo_level = dev->txnumevt;
-	else
-		fifo_level = dev->rxnumevt;
+	fifo_level = davinci_hw_common_param(dev, substream->stream,
+			params_period_size(params) * params_channels(params));
 
 	if (dev->op_mode == DAVINCI_MCASP_DIT_MODE)
 		davinci_hw_dit_param(dev);
@@ -813,6 +857,21 @@ static int davinci_mcasp_hw_params(struct snd_pcm_substream *substream,
 	dma_params->fifo_level = fifo_level;
 	davinci_config_channel_size(dev, word_length);
 
+	davinci_mcasp_update_qos(dev, substream->stream, fifo_level,
+			params_rate(params) * params_channels(params));
+
+	return 0;
+}
+
+static int davinci_mcasp_hw_free(struct snd_pcm_substream *substream,
+				 struct snd_soc_dai *cpu_dai)
+{
+	struct davinci_audio_dev *dev = snd_soc_dai_get_drvdata(cpu_dai);
+	struct pm_qos_request *req = &dev->pm_qos_req[substream->stream];
+
+	if (pm_qos_request_active(req))
+		pm_qos_remove_request(req);
+
 	return 0;
 }
 
@@ -865,6 +924,7 @@ static struct snd_soc_dai_ops davinci_mcasp_dai_ops = {
 	.startup	= davinci_mcasp_startup,
 	.trigger	= davinci_mcasp_trigger,
 	.hw_params	= davinci_mcasp_hw_params,
+	.hw_free	= davinci_mcasp_hw_free,
 	.set_fmt	= davinci_mcasp_set_dai_fmt,
 
 };
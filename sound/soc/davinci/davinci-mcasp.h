@@ -19,6 +19,7 @@
 #define DAVINCI_MCASP_H
 
 #include <linux/io.h>
+#include <linux/pm_qos.h>
 #include <asm/hardware/asp.h>
 #include "davinci-pcm.h"
 
@@ -56,6 +57,9 @@ struct davinci_audio_dev {
 	u8	txnumevt;
 	u8	rxnumevt;
 
+	/* DDR wake up latency each running stream tolerates */
+	struct pm_qos_request pm_qos_req[2];
+
 	/* backup related */
 	unsigned int *xrsrctl;
 	unsigned int pfunc;
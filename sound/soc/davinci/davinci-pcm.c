@@ -28,6 +28,20 @@
 
 #include "davinci-pcm.h"
 
+/*
+ * Without SRAM ping/pong, run the EDMA as a ring of linked PaRAM sets,
+ * one per period, and report the live DMA position.  Periods no longer
+ * depend on the completion IRQ reloading the next one in time, so they
+ * can be as short as a few milliseconds.
+ */
+static bool ring_mode = true;
+module_param(ring_mode, bool, 0644);
+MODULE_PARM_DESC(ring_mode, "Linked PaRAM ring with live DMA position "
+		"for low latency streams (default: on)");
+
+/* PaRAM sets per stream in ring mode, i.e. the maximum period count */
+#define DAVINCI_PCM_RING_MAX	32
+
 #ifdef DEBUG
 static void print_buf_info(int slot, char *name)
 {
@@ -149,6 +163,9 @@ struct davinci_runtime_data {
 	int period;		/* current DMA period */
 	int asp_channel;	/* Master DMA channel */
 	int asp_link[2];	/* asp parameter link channel, ping/pong */
+	/* ring mode: one slot per period, ring[0] is asp_link[0] */
+	int ring[DAVINCI_PCM_RING_MAX];
+	int ring_periods;	/* 0 when not in ring mode */
 	struct davinci_pcm_dma_params *params;	/* DMA params */
 	int ram_channel;
 	int ram_link;
@@ -174,9 +191,11 @@ static void davinci_pcm_period_reset(struct snd_pcm_substream *substream)
 	prtd->period = 0;
 }
 /*
- * Not used with ping/pong
+ * Program @slot to move period @period between memory and the ASP.
+ * Not used with ping/pong.
  */
-static void davinci_pcm_enqueue_dma(struct snd_pcm_substream *substream)
+static void davinci_pcm_setup_period(struct snd_pcm_substream *substream,
+		int slot, int period)
 {
 	struct davinci_runtime_data *prtd = substream->runtime->private_data;
 	struct snd_pcm_runtime *runtime = substream->runtime;
@@ -192,12 +211,12 @@ static void davinci_pcm_enqueue_dma(struct snd_pcm_substream *substream)
 	unsigned int fifo_level;
 
 	period_size = snd_pcm_lib_period_bytes(substream);
-	dma_offset = prtd->period * period_size;
+	dma_offset = period * period_size;
 	dma_pos = runtime->dma_addr + dma_offset;
 	fifo_level = prtd->params->fifo_level;
 
 	pr_debug("davinci_pcm: audio_set_dma_params_play channel = %d "
-		"dma_ptr = %x period_size=%x\n", prtd->asp_link[0], dma_pos,
+		"dma_ptr = %x period_size=%x\n", slot, dma_pos,
 		period_size);
 
 	data_type = prtd->params->data_type;
@@ -222,19 +241,27 @@ static void davinci_pcm_enqueue_dma(struct snd_pcm_substream *substream)
 	}
 
 	acnt = prtd->params->acnt;
-	edma_set_src(prtd->asp_link[0], src, INCR, W8BIT);
-	edma_set_dest(prtd->asp_link[0], dst, INCR, W8BIT);
+	edma_set_src(slot, src, INCR, W8BIT);
+	edma_set_dest(slot, dst, INCR, W8BIT);
 
-	edma_set_src_index(prtd->asp_link[0], src_bidx, src_cidx);
-	edma_set_dest_index(prtd->asp_link[0], dst_bidx, dst_cidx);
+	edma_set_src_index(slot, src_bidx, src_cidx);
+	edma_set_dest_index(slot, dst_bidx, dst_cidx);
 
 	if (!fifo_level)
-		edma_set_transfer_params(prtd->asp_link[0], acnt, count, 1, 0,
-							ASYNC);
+		edma_set_transfer_params(slot, acnt, count, 1, 0, ASYNC);
 	else
-		edma_set_transfer_params(prtd->asp_link[0], acnt, fifo_level,
-							count, fifo_level,
-							ABSYNC);
+		edma_set_transfer_params(slot, acnt, fifo_level, count,
+							fifo_level, ABSYNC);
+}
+
+/*
+ * Not used with ping/pong
+ */
+static void davinci_pcm_enqueue_dma(struct snd_pcm_substream *substream)
+{
+	struct davinci_runtime_data *prtd = substream->runtime->private_data;
+
+	davinci_pcm_setup_period(substream, prtd->asp_link[0], prtd->period);
 }
 
 static void davinci_pcm_dma_irq(unsigned link, u16 ch_status, void *data)
@@ -250,7 +277,7 @@ static void davinci_pcm_dma_irq(unsigned link, u16 ch_status, void *data)
 
 	if (snd_pcm_running(substream)) {
 		spin_lock(&prtd->lock);
-		if (prtd->ram_channel < 0) {
+		if (prtd->ram_channel < 0 && !prtd->ring_periods) {
 			/* No ping/pong must fix up link dma data*/
 			davinci_pcm_enqueue_dma(substream);
 		}
@@ -619,6 +646,20 @@ static int davinci_pcm_prepare(struct snd_pcm_substream *substream)
 
 		return 0;
 	}
+	if (prtd->ring_periods) {
+		int i, n = prtd->ring_periods;
+
+		/* the whole buffer is queued up front, linked in a circle */
+		for (i = 0; i < n; i++) {
+			davinci_pcm_setup_period(substream, prtd->ring[i], i);
+			edma_link(prtd->ring[i], prtd->ring[(i + 1) % n]);
+		}
+		edma_read_slot(prtd->ring[0], &prtd->asp_params);
+		edma_write_slot(prtd->asp_channel, &prtd->asp_params);
+
+		return 0;
+	}
+
 	davinci_pcm_enqueue_dma(substream);
 	davinci_pcm_period_elapsed(substream);
 
@@ -640,6 +681,26 @@ davinci_pcm_pointer(struct snd_pcm_substream *substream)
 	int asp_count;
 	unsigned int period_size = snd_pcm_lib_period_bytes(substream);
 
+	if (prtd->ring_periods) {
+		dma_addr_t src, dst;
+
+		/*
+		 * The master PaRAM set advances with every McASP event, so
+		 * this is exact to one FIFO threshold.
+		 */
+		edma_get_position(prtd->asp_channel, &src, &dst);
+		if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+			asp_count = src - runtime->dma_addr;
+		else
+			asp_count = dst - runtime->dma_addr;
+
+		offset = bytes_to_frames(runtime, asp_count);
+		if (offset >= runtime->buffer_size)
+			offset = 0;
+
+		return offset;
+	}
+
 	/*
 	 * There is a phase offset of 2 periods between the position used by dma
 	 * setup and the position reported in the pointer function. Either +2 in
@@ -662,6 +723,55 @@ davinci_pcm_pointer(struct snd_pcm_substream *substream)
 	return offset;
 }
 
+static void davinci_pcm_ring_free(struct davinci_runtime_data *prtd)
+{
+	int i;
+
+	if (!prtd->ring_periods)
+		return;
+
+	/* back to the self-linked reload slot before the ring goes away */
+	edma_link(prtd->asp_link[0], prtd->asp_link[0]);
+	for (i = 1; i < prtd->ring_periods; i++) {
+		edma_unlink(prtd->ring[i]);
+		edma_free_slot(prtd->ring[i]);
+	}
+	prtd->ring_periods = 0;
+}
+
+/*
+ * Allocate a PaRAM set per period.  asp_link[0] serves as the first
+ * one.  Without enough free sets the stream falls back to reloading
+ * a single set from the completion IRQ.
+ */
+static void davinci_pcm_ring_alloc(struct snd_pcm_substream *substream,
+		unsigned int periods)
+{
+	struct davinci_runtime_data *prtd = substream->runtime->private_data;
+	int i, slot;
+
+	davinci_pcm_ring_free(prtd);
+
+	if (!ring_mode || prtd->ram_channel >= 0 ||
+	    periods > DAVINCI_PCM_RING_MAX)
+		return;
+
+	prtd->ring[0] = prtd->asp_link[0];
+	for (i = 1; i < periods; i++) {
+		slot = edma_alloc_slot(EDMA_CTLR(prtd->asp_channel),
+				EDMA_SLOT_ANY);
+		if (slot < 0) {
+			prtd->ring_periods = i;
+			davinci_pcm_ring_free(prtd);
+			return;
+		}
+		/* same options: TCINTEN and the master channel's TCC */
+		edma_write_slot(slot, &prtd->asp_params);
+		prtd->ring[i] = slot;
+	}
+	prtd->ring_periods = periods;
+}
+
 static int davinci_pcm_open(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
@@ -681,6 +791,16 @@ static int davinci_pcm_open(struct snd_pcm_substream *substream)
 			&pcm_hardware_playback : &pcm_hardware_capture;
 	allocate_sram(substream, params->sram_size, ppcm);
 	snd_soc_set_runtime_hwparams(substream, ppcm);
+
+	/*
+	 * Ring mode needs no spare periods to hide the reload IRQ, and
+	 * its position is exact rather than per period.
+	 */
+	if (ring_mode && !substream->dma_buffer.private_data) {
+		runtime->hw.periods_min = 2;
+		runtime->hw.periods_max = DAVINCI_PCM_RING_MAX;
+		runtime->hw.info &= ~SNDRV_PCM_INFO_BATCH;
+	}
 	/* ensure that buffer size is a multiple of period size */
 	ret = snd_pcm_hw_constraint_integer(runtime,
 						SNDRV_PCM_HW_PARAM_PERIODS);
@@ -719,6 +839,7 @@ static int davinci_pcm_close(struct snd_pcm_substream *substream)
 		edma_stop(prtd->ram_channel);
 	if (prtd->asp_channel >= 0)
 		edma_stop(prtd->asp_channel);
+	davinci_pcm_ring_free(prtd);
 	if (prtd->asp_link[0] >= 0)
 		edma_unlink(prtd->asp_link[0]);
 	if (prtd->asp_link[1] >= 0)
@@ -747,12 +868,18 @@ static int davinci_pcm_close(struct snd_pcm_substream *substream)
 static int davinci_pcm_hw_params(struct snd_pcm_substream *substream,
 				 struct snd_pcm_hw_params *hw_params)
 {
+	davinci_pcm_ring_alloc(substream, params_periods(hw_params));
+
 	return snd_pcm_lib_malloc_pages(substream,
 					params_buffer_bytes(hw_params));
 }
 
 static int davinci_pcm_hw_free(struct snd_pcm_substream *substream)
 {
+	struct davinci_runtime_data *prtd = substream->runtime->private_data;
+
+	davinci_pcm_ring_free(prtd);
+
 	return snd_pcm_lib_free_pages(substream);
 }
 